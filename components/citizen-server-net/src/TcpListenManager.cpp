@@ -26,8 +26,8 @@ namespace fx
 
 	TcpListenManager::TcpListenManager(const boost::property_tree::ptree& pt)
 	{
-		// initialize a TCP stack
-		m_tcpStack = new net::TcpServerManager();
+		// initialize a TCP stack, optionally sharded across multiple event loops
+		m_tcpStack = new net::TcpServerManager(pt.get<int>("server.tcpLoops", 1));
 
 		// for each defined endpoint
 		for (auto& child : pt.get_child("server.endpoints"))
@@ -42,6 +42,16 @@ namespace fx
 				fwRefContainer<net::MultiplexTcpServer> server = new net::MultiplexTcpServer(m_tcpStack);
 				server->Bind(peerAddress.get());
 
+				// apply connection limits, if configured
+				fwRefContainer<net::TcpServer> rootServer = server->GetRootServer();
+
+				if (rootServer.GetRef())
+				{
+					rootServer->SetMaxConnections(pt.get<size_t>("server.maxConnections", 0));
+					rootServer->SetMaxConnectionsPerAddress(pt.get<size_t>("server.maxConnectionsPerAddress", 0));
+					rootServer->SetIdleTimeout(std::chrono::seconds(pt.get<int>("server.idleTimeout", 0)));
+				}
+
 				// add the server to the list
 				m_multiplexServers.push_back(server);
 			}
@@ -41,15 +41,7 @@ void ShellService::Initialize(fwRefContainer<net::MultiplexTcpServer> serverHost
 
 	m_serverHost = serverHost;
 
-	m_server = serverHost->CreateServer([] (const std::vector<uint8_t>& data)
-	{
-		if (data.size() < 5)
-		{
-			return net::MultiplexPatternMatchResult::InsufficientData;
-		}
-
-		return ((memcmp(&data[0], "SSH-2", 5) == 0) ? net::MultiplexPatternMatchResult::Match : net::MultiplexPatternMatchResult::NoMatch);
-	});
+	m_server = serverHost->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern::FromPrefix("SSH-2") });
 
 	m_server->SetConnectionCallback(std::bind(&ShellService::OnConnected, this, std::placeholders::_1));
 }
@@ -110,11 +102,8 @@ void ShellService::OnConnected(fwRefContainer<net::TcpServerStream> stream)
 		// get the stream
 		net::TcpServerStream* stream = reinterpret_cast<net::TcpServerStream*>(socket->fd_out);
 
-		// create a buffer
-		std::vector<uint8_t> dataBuf(size);
-		memcpy(&dataBuf[0], data, dataBuf.size());
-
-		stream->Write(dataBuf);
+		// copy the data into a pooled buffer
+		stream->Write(net::Slice::Copy(data, size));
 
 		return static_cast<int>(size);
 	};
@@ -136,13 +125,13 @@ void ShellService::OnConnected(fwRefContainer<net::TcpServerStream> stream)
 
 	ssh_handle_key_exchange(session);
 
-	stream->SetReadCallback([=] (const std::vector<uint8_t>& data)
+	stream->SetReadCallback([=] (const net::Slice& data)
 	{
 		// flag to prevent instant closing
 		*inInputCallback = true;
 
 		// call input callback
-		outSocket->input_callback(outSocket, &data[0], data.size());
+		outSocket->input_callback(outSocket, data.GetData(), data.GetLength());
 
 		// unset if set, kill if not set
 		if (*inInputCallback)
@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include "NetSlice.h"
+
 namespace net
 {
 class
@@ -19,5 +21,14 @@ public:
 	virtual ~DatagramSink() {}
 
 	virtual void WritePacket(const std::vector<uint8_t>& packet) = 0;
+
+	//
+	// Writes a packet without requiring it to be in a vector. The slice is only valid for the duration of the call.
+	// Sinks that can consume slices should override this - the default copies the packet into a vector.
+	//
+	virtual void WritePacket(const Slice& packet)
+	{
+		WritePacket(packet.ToVector());
+	}
 };
 }
\ No newline at end of file
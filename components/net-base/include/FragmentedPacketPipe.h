@@ -9,14 +9,133 @@
 
 #include "InOutPipe.h"
 
+#include <chrono>
+#include <map>
+
 namespace net
 {
+//
+// Splits outgoing packets that don't fit the MTU into fragments, and reassembles incoming fragments.
+//
+// Packets that fit are passed on with a single byte of overhead. Fragments of a packet can arrive in any order, and
+// fragments of multiple packets may be interleaved - each packet being reassembled gets a pooled block the fragments
+// are copied into directly. The block grows with the fragments received, rather than trusting the fragment count
+// up front, and the blocks of all packets being reassembled share a memory limit. Packets that don't complete in
+// time, or get pushed out by newer ones, are dropped.
+//
 class
 #ifdef COMPILING_NET_BASE
 		DLL_EXPORT
 #endif
 	FragmentedPacketPipe : public InOutPipe
 {
+public:
+	typedef std::chrono::steady_clock::time_point TTimePoint;
+
+	// the size of the header on fragmented packets
+	static const size_t FragmentHeaderSize = 9;
+
+private:
+	struct Reassembly
+	{
+		// the fragmented packet, sized for the furthest fragment received so far
+		fwRefContainer<BufferBlock> block;
+
+		// one bit per received fragment
+		std::vector<uint64_t> receivedBits;
+
+		uint16_t fragmentCount;
+
+		uint16_t receivedCount;
+
+		uint16_t fragmentSize;
+
+		size_t length;
+
+		TTimePoint startTime;
+	};
+
+private:
+	size_t m_mtu;
+
+	uint16_t m_nextMessageId;
+
+	std::map<uint16_t, Reassembly> m_reassemblies;
+
+	size_t m_maxReassemblies;
+
+	size_t m_maxPacketSize;
+
+	size_t m_maxReassemblyMemory;
+
+	// the capacity of all reassembly blocks
+	size_t m_reassemblyMemory;
+
+	std::chrono::milliseconds m_reassemblyTimeout;
+
+	uint64_t m_evictedPackets;
+
+private:
+	void ProcessFragment(Buffer& data, TTimePoint now);
+
+	// grows a reassembly block to fit the length, evicting other packets if that'd exceed the memory limit
+	bool ReserveReassembly(std::map<uint16_t, Reassembly>::iterator it, size_t length);
+
+	void EvictOldestReassembly(std::map<uint16_t, Reassembly>::iterator except);
+
+	std::map<uint16_t, Reassembly>::iterator EraseReassembly(std::map<uint16_t, Reassembly>::iterator it);
+
+public:
+	FragmentedPacketPipe(const fwRefContainer<NetPipe>& outgoingPipe, const fwRefContainer<NetPipe>& incomingPipe, size_t mtu = 1300);
+
+	virtual void Reset() override;
+
+	virtual void PassPacket(Buffer data) override;
+
+	virtual void PassIncomingPacket(Buffer data) override;
+
+	void PassIncomingPacket(Buffer data, TTimePoint now);
+
+	//
+	// Drops packets that didn't complete within the reassembly timeout - to be called periodically if fragments may
+	// stop arriving.
+	//
+	void Update();
+
+	void Update(TTimePoint now);
+
+	// sets how many packets can be reassembled at once, and how long each may take
+	inline void SetReassemblyLimits(size_t maxPackets, std::chrono::milliseconds timeout)
+	{
+		m_maxReassemblies = maxPackets;
+		m_reassemblyTimeout = timeout;
+	}
+
+	// sets the largest incoming packet that will be reassembled
+	inline void SetMaxPacketSize(size_t maxPacketSize)
+	{
+		m_maxPacketSize = maxPacketSize;
+	}
+
+	// sets how much memory all packets being reassembled may take up together
+	inline void SetMaxReassemblyMemory(size_t maxMemory)
+	{
+		m_maxReassemblyMemory = maxMemory;
+	}
+
+	inline size_t GetReassemblyMemory() const
+	{
+		return m_reassemblyMemory;
+	}
+
+	inline size_t GetPendingPacketCount() const
+	{
+		return m_reassemblies.size();
+	}
 
+	inline uint64_t GetEvictedPacketCount() const
+	{
+		return m_evictedPackets;
+	}
 };
-}
\ No newline at end of file
+}
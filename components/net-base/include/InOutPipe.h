@@ -0,0 +1,51 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "NetPipe.h"
+
+namespace net
+{
+//
+// A pipe stage handling both directions of a connection. Packets passed to PassPacket are outgoing, and get passed on to
+// the outgoing pipe once processed - received packets are passed to PassIncomingPacket, and end up at the incoming pipe.
+//
+class InOutPipe : public NetPipe
+{
+private:
+	fwRefContainer<NetPipe> m_outgoingPipe;
+
+	fwRefContainer<NetPipe> m_incomingPipe;
+
+protected:
+	inline const fwRefContainer<NetPipe>& GetOutgoingPipe()
+	{
+		return m_outgoingPipe;
+	}
+
+	inline const fwRefContainer<NetPipe>& GetIncomingPipe()
+	{
+		return m_incomingPipe;
+	}
+
+public:
+	inline InOutPipe(const fwRefContainer<NetPipe>& outgoingPipe, const fwRefContainer<NetPipe>& incomingPipe)
+		: m_outgoingPipe(outgoingPipe), m_incomingPipe(incomingPipe)
+	{
+
+	}
+
+	virtual void Reset() override
+	{
+		m_outgoingPipe->Reset();
+		m_incomingPipe->Reset();
+	}
+
+	virtual void PassIncomingPacket(Buffer data) = 0;
+};
+}
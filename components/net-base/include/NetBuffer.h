@@ -9,12 +9,38 @@
 
 #include <memory>
 
+#include "NetSlice.h"
+
 namespace net
 {
-class Buffer
+//
+// A packet buffer with a read/write cursor.
+//
+// Small packets are stored inline, without any allocation. Larger ones live in a pooled block, which copies of the
+// buffer (and sub-buffers of it) share rather than copying the data - writes to a shared block are visible to all
+// buffers using it, unless the write has to grow the buffer, which gives the writing buffer its own copy.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	Buffer
 {
+public:
+	// packets up to this size don't need a block
+	static const size_t InlineCapacity = 48;
+
 private:
-	std::shared_ptr<std::vector<uint8_t>> m_bytes;
+	// the backing block, or null if the data is stored inline
+	fwRefContainer<BufferBlock> m_block;
+
+	// where our view starts in the block
+	size_t m_offset;
+
+	size_t m_length;
+
+	uint8_t m_inlineBytes[InlineCapacity];
+
 	size_t m_curOff;
 
 	bool m_end;
@@ -22,27 +48,41 @@ private:
 private:
 	void Initialize();
 
-protected:
-	void EnsureWritableSize(size_t length);
+	void Assign(const uint8_t* bytes, size_t length);
 
-	inline std::shared_ptr<std::vector<uint8_t>> GetBytes()
-	{
-		return m_bytes;
-	}
+	// makes room for at least the specified length, keeping the current data
+	void Reserve(size_t length);
 
-	inline const std::shared_ptr<std::vector<uint8_t>> GetBytes() const
+	inline uint8_t* GetWritableBuffer()
 	{
-		return m_bytes;
+		return (m_block.GetRef()) ? m_block->GetData() + m_offset : m_inlineBytes;
 	}
 
+protected:
+	void EnsureWritableSize(size_t length);
+
 public:
 	Buffer();
 	Buffer(const uint8_t* bytes, size_t length);
 	Buffer(const std::vector<uint8_t>& origBytes);
+
+	// takes ownership of the vector's storage (unless small enough to be stored inline)
+	Buffer(std::vector<uint8_t>&& origBytes);
+
+	// shares the slice's block if it has one, and copies it otherwise
+	explicit Buffer(const Slice& slice);
+
 	Buffer(size_t length);
 
+	// copies share the data, but get their own cursor, starting at the beginning
 	Buffer(const Buffer& other);
 
+	Buffer(Buffer&& other);
+
+	Buffer& operator=(const Buffer& other);
+
+	Buffer& operator=(Buffer&& other);
+
 	bool IsAtEnd() const;
 
 	bool Read(void* buffer, size_t length);
@@ -63,18 +103,39 @@ public:
 		Write(&value, sizeof(T));
 	}
 
+	//
+	// Reads data into another buffer. If the other buffer is empty, it becomes a view of the data rather than a copy.
+	//
 	bool ReadTo(Buffer& other, size_t length);
 
+	//
+	// Gets a buffer viewing a range of this buffer, sharing the block backing it.
+	//
+	Buffer GetSubBuffer(size_t offset, size_t length) const;
+
 	inline void Reset()
 	{
 		m_curOff = 0;
 	}
 
-	inline const uint8_t* GetBuffer() const { return &(*m_bytes)[0]; }
-	inline size_t GetLength() const { return m_bytes->size(); }
+	inline const uint8_t* GetBuffer() const
+	{
+		return (m_block.GetRef()) ? m_block->GetData() + m_offset : m_inlineBytes;
+	}
+
+	inline size_t GetLength() const { return m_length; }
 	inline size_t GetCurOffset() const { return m_curOff; }
 	inline size_t GetRemainingBytes() const { return GetLength() - GetCurOffset(); }
 
-	inline const std::vector<uint8_t>& GetData() const { return *m_bytes; }
+	// whether the data lives in a (possibly shared) block rather than inline
+	inline bool IsShared() const
+	{
+		return (m_block.GetRef() != nullptr);
+	}
+
+	// gets a slice of the data - sharing the block if there is one, and borrowed from this buffer otherwise
+	Slice ToSlice() const;
+
+	std::vector<uint8_t> ToVector() const;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,153 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace net
+{
+//
+// A reference-counted block of memory that slices can point into. Once the last reference is released, the block is
+// handed back to whatever owns its storage (a pool, or the heap).
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	BufferBlock
+{
+private:
+	std::atomic<uint32_t> m_refCount;
+
+protected:
+	uint8_t* m_data;
+
+	size_t m_capacity;
+
+protected:
+	// called once the last reference has been released
+	virtual void Free() = 0;
+
+public:
+	BufferBlock();
+
+	virtual ~BufferBlock();
+
+	inline uint8_t* GetData()
+	{
+		return m_data;
+	}
+
+	inline const uint8_t* GetData() const
+	{
+		return m_data;
+	}
+
+	inline size_t GetCapacity() const
+	{
+		return m_capacity;
+	}
+
+	inline uint32_t GetRefCount() const
+	{
+		return m_refCount.load(std::memory_order_acquire);
+	}
+
+	void AddRef();
+
+	bool Release();
+};
+
+class BufferPool;
+
+//
+// A block that lives in a buffer pool, and gets returned to it once released.
+//
+class PooledBufferBlock : public BufferBlock
+{
+private:
+	BufferPool* m_pool;
+
+	std::unique_ptr<uint8_t[]> m_storage;
+
+protected:
+	virtual void Free() override;
+
+public:
+	PooledBufferBlock(BufferPool* pool, size_t capacity);
+};
+
+//
+// A block taking ownership of an existing vector, so callers handing over their data don't need a copy.
+//
+class VectorBufferBlock : public BufferBlock
+{
+private:
+	std::vector<uint8_t> m_storage;
+
+protected:
+	virtual void Free() override;
+
+public:
+	VectorBufferBlock(std::vector<uint8_t>&& storage);
+};
+
+//
+// A thread-safe free list of fixed-size buffer blocks.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	BufferPool
+{
+private:
+	size_t m_blockSize;
+
+	size_t m_maxFreeBlocks;
+
+	std::mutex m_mutex;
+
+	std::vector<PooledBufferBlock*> m_freeBlocks;
+
+	// the amount of blocks the pool had to allocate from the heap - at steady state, this should stop increasing
+	std::atomic<uint64_t> m_heapAllocations;
+
+public:
+	BufferPool(size_t blockSize, size_t maxFreeBlocks);
+
+	~BufferPool();
+
+	fwRefContainer<BufferBlock> Allocate();
+
+	void Return(PooledBufferBlock* block);
+
+	inline size_t GetBlockSize() const
+	{
+		return m_blockSize;
+	}
+
+	inline uint64_t GetHeapAllocationCount() const
+	{
+		return m_heapAllocations.load(std::memory_order_relaxed);
+	}
+
+public:
+	// the largest block size served by the shared pools
+	static const size_t MaxPooledSize = 65536;
+
+	//
+	// Gets the shared pool with the smallest block size fitting the specified length, or nullptr if the length exceeds
+	// MaxPooledSize.
+	//
+	static BufferPool* GetForSize(size_t length);
+};
+}
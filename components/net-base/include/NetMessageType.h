@@ -0,0 +1,64 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+namespace net
+{
+namespace detail
+{
+// steps of the one-at-a-time hash, split up to fit single-expression constexpr functions
+constexpr uint32_t JoaatMix(uint32_t hash)
+{
+	return hash ^ (hash >> 6);
+}
+
+constexpr uint32_t JoaatAccumulate(const char* string, uint32_t hash)
+{
+	return (*string) ? JoaatAccumulate(string + 1, JoaatMix((hash + static_cast<uint32_t>(*string)) + ((hash + static_cast<uint32_t>(*string)) << 10))) : hash;
+}
+
+constexpr uint32_t JoaatFinalizeShift(uint32_t hash)
+{
+	return hash + (hash << 15);
+}
+
+constexpr uint32_t JoaatFinalizeXor(uint32_t hash)
+{
+	return JoaatFinalizeShift(hash ^ (hash >> 11));
+}
+
+constexpr uint32_t JoaatFinalize(uint32_t hash)
+{
+	return JoaatFinalizeXor(hash + (hash << 3));
+}
+}
+
+//
+// Hashes a message type name - usable at compile time, and equal to HashRageString.
+//
+constexpr uint32_t HashMessageName(const char* name)
+{
+	return detail::JoaatFinalize(detail::JoaatAccumulate(name, 0));
+}
+
+//
+// A message type, identified by the hash of its name.
+//
+struct MessageType
+{
+	const char* name;
+
+	uint32_t hash;
+
+	constexpr MessageType(const char* name)
+		: name(name), hash(HashMessageName(name))
+	{
+
+	}
+};
+}
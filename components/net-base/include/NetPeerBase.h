@@ -9,6 +9,7 @@
 
 #include <DatagramSink.h>
 #include <NetBuffer.h>
+#include <NetMessageType.h>
 
 #include <SequencedInputDatagramChannel.h>
 #include <SequencedOutputDatagramChannel.h>
@@ -21,16 +22,21 @@ class PeerBase;
 typedef std::function<void(PeerBase*, Buffer&)> NetProcessor;
 typedef std::function<void(PeerBase*, Buffer&)> NetGenerator;
 
+//
+// A set of message types a peer can process and generate. Types are registered by name hash - pass a constexpr
+// MessageType to have it hashed at compile time.
+//
 class PeerHandler
 {
 private:
-	std::map<uint32_t, NetProcessor> m_processors;
-	std::map<uint32_t, NetGenerator> m_generators;
+	// in registration order, which is the order generated types get their wire ids in
+	std::vector<std::pair<uint32_t, NetProcessor>> m_processors;
+	std::vector<std::pair<uint32_t, NetGenerator>> m_generators;
 	std::vector<std::pair<const char*, fwRefContainer<fwRefCountable>>> m_components;
 
 private:
 	template<typename TContainer, typename TReceiver>
-	void AddTo(const TContainer& container, const TReceiver& receiver)
+	void AddTo(const TContainer& container, const TReceiver& receiver) const
 	{
 		for (auto&& entry : container)
 		{
@@ -40,45 +46,45 @@ private:
 
 public:
 	template<typename TReceiver>
-	void AddProcessors(const TReceiver& receiver)
+	void AddProcessors(const TReceiver& receiver) const
 	{
 		AddTo(m_processors, receiver);
 	}
 
 	template<typename TReceiver>
-	void AddHandlers(const TReceiver& receiver)
+	void AddGenerators(const TReceiver& receiver) const
 	{
-		AddTo(m_handlers, receiver);
+		AddTo(m_generators, receiver);
 	}
 
 	template<typename TReceiver>
-	void AddComponents(const TReceiver& receiver)
+	void AddComponents(const TReceiver& receiver) const
 	{
 		AddTo(m_components, receiver);
 	}
 
 	template<typename TProcess>
-	uint32_t RegisterType(const char* name, const TProcess& processor)
+	uint32_t RegisterType(const MessageType& type, const TProcess& processor)
 	{
-		uint32_t nameHash = HashRageString(name);
+		m_processors.push_back(std::make_pair(type.hash, NetProcessor(processor)));
 
-		m_processors.insert(std::make_pair(nameHash, std::function<void(PeerBase*, Buffer&)>(processor)));
-
-		return nameHash;
+		return type.hash;
 	}
 
 	template<typename TProcess, typename TGenerate>
-	uint32_t RegisterType(const char* name, const TProcess& processor, const TGenerate& generator)
+	uint32_t RegisterType(const MessageType& type, const TProcess& processor, const TGenerate& generator)
 	{
-		uint32_t nameHash = RegisterType<TProcess>(name, processor);
+		RegisterType<TProcess>(type, processor);
+
+		m_generators.push_back(std::make_pair(type.hash, NetGenerator(generator)));
 
-		m_generators.insert(std::make_pair(nameHash, std::function<void(PeerBase*, Buffer&)>(generator)));
+		return type.hash;
 	}
 
 	template<typename TComponent, typename... TArgs>
 	void RegisterComponent(TArgs... args)
 	{
-		m_components.push_back(std::make_pair(Instance<TComponent>::GetName(), new TComponent(Args...)));
+		m_components.push_back(std::make_pair(Instance<TComponent>::GetName(), new TComponent(args...)));
 	}
 };
 
@@ -96,15 +102,21 @@ public:
 	}
 
 	virtual void WritePacket(const std::vector<uint8_t>& packet) override
+	{
+		m_function(Slice::Borrow(packet.data(), packet.size()));
+	}
+
+	virtual void WritePacket(const Slice& packet) override
 	{
 		m_function(packet);
 	}
 };
 
-class FunctionDatagramSink : public FuncDatagramSinkBase<std::function<void(const std::vector<uint8_t>&)>>
+// the slice passed to the function is only valid for the duration of the call
+class FunctionDatagramSink : public FuncDatagramSinkBase<std::function<void(const Slice&)>>
 {
 public:
-	FunctionDatagramSink(const std::function<void(const std::vector<uint8_t>&)>& function)
+	FunctionDatagramSink(const std::function<void(const Slice&)>& function)
 		: FuncDatagramSinkBase::FuncDatagramSinkBase(function)
 	{
 		
@@ -122,15 +134,17 @@ private:
 
 	fwRefContainer<SequencedOutputDatagramChannel> m_outputChannel;
 
-	std::map<uint32_t, NetProcessor> m_processors;
+	std::unordered_map<uint32_t, NetProcessor> m_processors;
 
-	std::map<uint32_t, NetGenerator> m_generators;
+	std::unordered_map<uint32_t, NetGenerator> m_generators;
 
-	// mapping of shorthand to full packet types (local to remote)
-	std::map<uint32_t, int> m_localToRemoteMapping;
+	// mapping of full packet types we generate to the shorthand we send them as
+	std::unordered_map<uint32_t, int> m_localToRemoteMapping;
 
-	// mapping of shorthand to full packet types (remote to local)
-	std::map<int, uint32_t> m_remoteToLocalMapping;
+	// processors by the shorthand the remote sends each type as, built once the remote sent its mapping
+	std::vector<const NetProcessor*> m_dispatchTable;
+
+	bool m_receivedMapping;
 
 	fwRefContainer<RefInstanceRegistry> m_components;
 
@@ -139,17 +153,58 @@ private:
 private:
 	void RegisterHandlerInternal(const PeerHandler& trait);
 
-	void ProcessEncapsulatedPacket(const std::vector<uint8_t>& buffer);
+	void ProcessEncapsulatedPacket(const Slice& packet);
 
 	void ProcessMappingPacket(Buffer& buffer);
 
+	void ProcessAcknowledgementPacket(Buffer& buffer);
+
 	int ReadCompressedType(Buffer& buffer);
 
+	void WriteCompressedType(Buffer& buffer, int type);
+
 public:
 	PeerBase(const fwRefContainer<DatagramSink>& outSink);
 
 	void ProcessPacket(const std::vector<uint8_t>& buffer);
 
+	void ProcessPacket(const Slice& packet);
+
+	//
+	// Sends an encapsulated packet through the sequenced output channel.
+	//
+	void SendPacket(const Buffer& buffer);
+
+	//
+	// Releases received packets that were held back for reordering too long - to be called periodically.
+	//
+	void Update();
+
+	//
+	// Writes a packet acknowledging what we received so far, including packets received past a gap. Remote peers
+	// use this to detect lost packets without waiting for a timeout.
+	//
+	void WriteAcknowledgementPacket(Buffer& buffer);
+
+	//
+	// Sets the callback for sent packets the remote acknowledgements show as lost.
+	//
+	inline void SetLossCallback(const SequencedOutputDatagramChannel::TLossCallback& callback)
+	{
+		m_outputChannel->SetLossCallback(callback);
+	}
+
+	//
+	// Writes the packet telling the remote which shorthand each type we generate will be sent as - this has to be
+	// sent before any other packet.
+	//
+	void WriteMappingPacket(Buffer& buffer);
+
+	//
+	// Gets the shorthand a generated type is sent as, or -1 if no handler generates it.
+	//
+	int GetWireType(uint32_t type);
+
 	template<typename HandlerType>
 	void RegisterHandler()
 	{
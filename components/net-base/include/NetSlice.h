@@ -0,0 +1,106 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "NetBufferPool.h"
+
+namespace net
+{
+//
+// A view of a range of bytes, optionally keeping the block backing it alive.
+//
+// Slices without a block are borrowed: they point into memory owned by someone else, and are only valid for as long as
+// the owner says so (usually the duration of a callback). Call Retain() to get a slice that is safe to keep around.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	Slice
+{
+private:
+	fwRefContainer<BufferBlock> m_block;
+
+	const uint8_t* m_data;
+
+	size_t m_length;
+
+public:
+	Slice();
+
+	Slice(const fwRefContainer<BufferBlock>& block, size_t offset, size_t length);
+
+	//
+	// Takes ownership of a vector's storage without copying it.
+	//
+	explicit Slice(std::vector<uint8_t>&& data);
+
+	//
+	// Copies data into a new slice, backed by a pooled block if the length allows.
+	//
+	static Slice Copy(const void* data, size_t length);
+
+	//
+	// Creates a non-owning slice over existing memory.
+	//
+	static Slice Borrow(const void* data, size_t length);
+
+	inline const uint8_t* GetData() const
+	{
+		return m_data;
+	}
+
+	inline size_t GetLength() const
+	{
+		return m_length;
+	}
+
+	inline bool IsEmpty() const
+	{
+		return (m_length == 0);
+	}
+
+	inline bool IsOwned() const
+	{
+		return (m_block.GetRef() != nullptr);
+	}
+
+	inline const fwRefContainer<BufferBlock>& GetBlock() const
+	{
+		return m_block;
+	}
+
+	inline const uint8_t& operator[](size_t index) const
+	{
+		return m_data[index];
+	}
+
+	inline const uint8_t* begin() const
+	{
+		return m_data;
+	}
+
+	inline const uint8_t* end() const
+	{
+		return m_data + m_length;
+	}
+
+	//
+	// Gets a slice of a sub-range of this slice, sharing the same backing block.
+	//
+	Slice SubSlice(size_t offset, size_t length) const;
+
+	//
+	// Gets a slice that stays valid after the current callback returns - this is the slice itself if it's owned,
+	// or a copy otherwise.
+	//
+	Slice Retain() const;
+
+	std::vector<uint8_t> ToVector() const;
+};
+}
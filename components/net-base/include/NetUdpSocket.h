@@ -9,9 +9,20 @@
 
 #include <NetBase.h>
 #include <NetAddress.h>
+#include <NetSlice.h>
 
 namespace net
 {
+//
+// A datagram in a batch of datagrams being sent or received.
+//
+struct UdpDatagram
+{
+	Slice data;
+
+	PeerAddress address;
+};
+
 class
 #ifdef COMPILING_NET_BASE
 	DLL_EXPORT
@@ -44,5 +55,22 @@ public:
 	boost::optional<std::vector<uint8_t>> ReceiveFrom(size_t size, PeerAddress* outAddress);
 
 	bool SendTo(const std::vector<uint8_t>& data, const PeerAddress& outAddress);
+
+	//
+	// Receives up to count datagrams using as few system calls as possible, waiting for the first one if the socket is
+	// blocking. Returns the amount of datagrams received. Datagrams larger than maxSize get dropped, rather than received
+	// cut off.
+	//
+	// Each datagram gets received into the block its data slice points into, as long as nothing else holds on to that
+	// block and it can fit maxSize bytes - otherwise, it gets replaced by a pooled block. Reusing the same datagram array
+	// across calls thereby recycles blocks, unless a slice of one got retained.
+	//
+	size_t ReceiveBatch(UdpDatagram* datagrams, size_t count, size_t maxSize = 2048);
+
+	//
+	// Sends a list of datagrams using as few system calls as possible. Returns the amount of datagrams sent, which is
+	// less than count if the socket's send buffer filled up, or sending failed.
+	//
+	size_t SendBatch(const UdpDatagram* datagrams, size_t count);
 };
 }
\ No newline at end of file
@@ -0,0 +1,97 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace net
+{
+//
+// A fixed set of threads running queued callbacks, for work that shouldn't block a network loop.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	WorkerPool
+{
+public:
+	typedef std::function<void()> TCallback;
+
+private:
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_wakeCondition;
+
+	std::deque<TCallback> m_queue;
+
+	bool m_shouldExit;
+
+private:
+	void RunThread();
+
+public:
+	WorkerPool(size_t threadCount);
+
+	// runs any callbacks that are still queued before returning
+	~WorkerPool();
+
+	void Enqueue(const TCallback& callback);
+
+	inline size_t GetThreadCount() const
+	{
+		return m_threads.size();
+	}
+
+public:
+	//
+	// Gets a pool shared by the whole process, sized to the amount of hardware threads.
+	//
+	static WorkerPool* GetDefault();
+};
+
+//
+// Runs callbacks on a worker pool one at a time, in the order they were posted - for work belonging to a single
+// connection, which has to stay ordered without tying up a thread.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	WorkerStrand : public std::enable_shared_from_this<WorkerStrand>
+{
+public:
+	typedef WorkerPool::TCallback TCallback;
+
+private:
+	WorkerPool* m_pool;
+
+	std::mutex m_mutex;
+
+	std::deque<TCallback> m_queue;
+
+	// set while the strand is queued on, or running on the pool
+	bool m_running;
+
+private:
+	void Run();
+
+public:
+	WorkerStrand(WorkerPool* pool);
+
+	void Post(const TCallback& callback);
+};
+}
@@ -0,0 +1,101 @@
+/*
+ * DO NOT EDIT. THIS FILE IS GENERATED FROM PeerMessages.netidl using tools/idl/netmsg.py.
+ */
+
+#pragma once
+
+#include <NetBuffer.h>
+#include <NetMessageType.h>
+
+namespace net
+{
+namespace msg
+{
+struct msgPeerAck
+{
+	static const uint32_t TypeHash = HashMessageName("msgPeerAck");
+
+	static constexpr MessageType GetType()
+	{
+		return MessageType("msgPeerAck");
+	}
+
+	// a received message - slices point into the buffer it was read from
+	class Reader
+	{
+	private:
+		uint32_t m_sequence;
+
+		uint32_t m_selectiveAcks;
+
+		bool m_valid;
+
+	public:
+		inline explicit Reader(const Buffer& buffer)
+		{
+			m_valid = Parse(buffer.GetBuffer() + buffer.GetCurOffset(), buffer.GetRemainingBytes());
+		}
+
+		inline bool Parse(const uint8_t* data, size_t length)
+		{
+			size_t offset = 0;
+
+			if ((length - offset) < sizeof(m_sequence))
+			{
+				return false;
+			}
+
+			memcpy(&m_sequence, data + offset, sizeof(m_sequence));
+			offset += sizeof(m_sequence);
+
+			if ((length - offset) < sizeof(m_selectiveAcks))
+			{
+				return false;
+			}
+
+			memcpy(&m_selectiveAcks, data + offset, sizeof(m_selectiveAcks));
+			offset += sizeof(m_selectiveAcks);
+
+			return true;
+		}
+
+		inline bool IsValid() const
+		{
+			return m_valid;
+		}
+
+		inline uint32_t GetSequence() const
+		{
+			return m_sequence;
+		}
+
+		inline uint32_t GetSelectiveAcks() const
+		{
+			return m_selectiveAcks;
+		}
+	};
+
+	// a message to send - slices are only read from while writing
+	struct Writer
+	{
+		uint32_t sequence;
+
+		uint32_t selectiveAcks;
+
+		inline size_t GetSize() const
+		{
+			return 0
+				+ sizeof(sequence)
+				+ sizeof(selectiveAcks);
+		}
+
+		inline void Write(Buffer& buffer) const
+		{
+			buffer.Write<uint32_t>(sequence);
+			buffer.Write<uint32_t>(selectiveAcks);
+		}
+	};
+};
+
+}
+}
@@ -17,6 +17,10 @@ class
 #endif
 	SequencedDatagramChannel : public fwRefCountable
 {
+public:
+	// marks out-of-band packets - never used as a sequence, so channels skip over it when wrapping around
+	static const uint32_t OutOfBandSequence = 0xFFFFFFFF;
+
 private:
 	fwRefContainer<DatagramSink> m_sink;
 
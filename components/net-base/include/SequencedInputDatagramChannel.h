@@ -9,17 +9,120 @@
 
 #include "SequencedDatagramChannel.h"
 
+#include <chrono>
+
 namespace net
 {
+//
+// Strips the sequence from incoming packets, forwarding them to the sink in order.
+//
+// By default, packets arriving after a later packet are dropped. With a reorder window, packets arriving early get held
+// back until the gap before them fills, up to the window size and a maximum delay - once either is exceeded, the
+// missing packets are considered lost and the held packets are released.
+//
 class
 #ifdef COMPILING_NET_BASE
 	DLL_EXPORT
 #endif
 	SequencedInputDatagramChannel : public SequencedDatagramChannel
 {
+public:
+	typedef std::chrono::steady_clock::time_point TTimePoint;
+
+private:
+	struct PendingPacket
+	{
+		Slice data;
+
+		uint32_t sequence;
+
+		bool present;
+
+		TTimePoint arrivalTime;
+	};
+
+private:
+	// slots for early packets, indexed by sequence modulo the window size
+	std::vector<PendingPacket> m_pendingPackets;
+
+	size_t m_pendingCount;
+
+	std::chrono::milliseconds m_maxReorderDelay;
+
+	uint64_t m_lostPackets;
+
+	uint64_t m_duplicatePackets;
+
+	uint64_t m_reorderedPackets;
+
+	uint64_t m_latePackets;
+
+	// bit N is set if sequence (GetSequence() - N) was delivered, to tell duplicates from packets we gave up on
+	uint64_t m_deliveredHistory;
+
+private:
+	PendingPacket& GetPendingSlot(uint32_t sequence);
+
+	void Deliver(uint32_t sequence, const Slice& payload);
+
+	// moves the current sequence forward, recording whether the packet at the new sequence got delivered
+	void Advance(uint32_t sequence, bool delivered);
+
+	// delivers held packets following the current sequence
+	void ReleaseInOrder();
+
+	// gives up on any packets missing up to (and including) the sequence
+	void SkipTo(uint32_t sequence);
+
 public:
 	SequencedInputDatagramChannel();
 
+	//
+	// Sets the amount of packets (past the next expected one) that can be held back, and how long a packet may be held.
+	// A window of 0 disables reordering.
+	//
+	void SetReorderWindow(size_t packetCount, std::chrono::milliseconds maxDelay);
+
 	void ProcessPacket(const std::vector<uint8_t>& packet);
+
+	void ProcessPacket(const Slice& packet);
+
+	void ProcessPacket(const Slice& packet, TTimePoint now);
+
+	//
+	// Releases held packets that exceeded the maximum delay - to be called periodically if packets may stop arriving.
+	//
+	void Update();
+
+	void Update(TTimePoint now);
+
+	//
+	// Gets a bitfield of packets received out of order, relative to the current sequence: bit N is set if sequence
+	// (GetSequence() + 2 + N) was received - sequence (GetSequence() + 1) is always missing if any bit is set.
+	//
+	uint32_t GetSelectiveAcks();
+
+	inline uint64_t GetLostPacketCount() const
+	{
+		return m_lostPackets;
+	}
+
+	inline uint64_t GetDuplicatePacketCount() const
+	{
+		return m_duplicatePackets;
+	}
+
+	inline uint64_t GetReorderedPacketCount() const
+	{
+		return m_reorderedPackets;
+	}
+
+	//
+	// Gets the amount of packets that arrived after they were already counted as lost.
+	//
+	inline uint64_t GetLatePacketCount() const
+	{
+		return m_latePackets;
+	}
 };
-}
\ No newline at end of file
+}
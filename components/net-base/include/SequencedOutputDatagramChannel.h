@@ -9,6 +9,8 @@
 
 #include "SequencedDatagramChannel.h"
 
+#include <functional>
+
 namespace net
 {
 class
@@ -17,9 +19,37 @@ class
 #endif
 	SequencedOutputDatagramChannel : public SequencedDatagramChannel
 {
+public:
+	// called with the sequence of a packet the remote end likely didn't receive
+	typedef std::function<void(uint32_t sequence)> TLossCallback;
+
+	// the amount of later packets that have to be acknowledged before a missing packet is considered lost
+	static const int FastRetransmitThreshold = 3;
+
+private:
+	TLossCallback m_lossCallback;
+
+	// the last sequence that was acknowledged or reported lost
+	uint32_t m_lossCheckedSequence;
+
+	bool m_receivedAcknowledgement;
+
 public:
 	SequencedOutputDatagramChannel();
 
 	void WritePacket(const std::vector<uint8_t>& packet);
+
+	void WritePacket(const Slice& packet);
+
+	inline void SetLossCallback(const TLossCallback& callback)
+	{
+		m_lossCallback = callback;
+	}
+
+	//
+	// Processes an acknowledgement from the remote input channel - its current sequence, and its selective acks.
+	// Packets missing while enough later packets arrived get reported to the loss callback, once each.
+	//
+	void ProcessAcknowledgement(uint32_t ackSequence, uint32_t selectiveAcks);
 };
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include <uv.h>
+
+#include "UvTimerWheel.h"
+
+// wrapper to make sure the libuv handle only gets freed after the close completes
+template<typename Handle>
+void UvClose(std::unique_ptr<Handle> handle)
+{
+	struct TempCloseData
+	{
+		std::unique_ptr<Handle> item;
+	};
+
+	// create temporary object and give it our reference
+	TempCloseData* tempCloseData = new TempCloseData;
+	tempCloseData->item = std::move(handle);
+	tempCloseData->item->data = tempCloseData;
+
+	// close the libuv handle
+	uv_close(reinterpret_cast<uv_handle_t*>(tempCloseData->item.get()), [] (uv_handle_t* handle)
+	{
+		// delete the close holder
+		delete reinterpret_cast<TempCloseData*>(handle->data);
+	});
+}
+
+namespace net
+{
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UvLoopHolder : public fwRefCountable
+{
+public:
+	typedef std::function<void()> TCallback;
+
+	// buckets of the enqueue-to-run latency histogram - bucket N counts callbacks that waited less than 2^N microseconds
+	// (the last bucket also counts anything slower)
+	static const size_t LatencyBucketCount = 24;
+
+	typedef std::array<uint64_t, LatencyBucketCount> TLatencyHistogram;
+
+private:
+	// a queued callback, and the node type of the MPSC queue
+	struct CallbackNode
+	{
+		std::atomic<CallbackNode*> next;
+
+		TCallback callback;
+
+		std::chrono::high_resolution_clock::time_point enqueueTime;
+	};
+
+private:
+	uv_loop_t m_loop;
+
+	uv_async_t m_wakeAsync;
+
+	std::thread m_thread;
+
+	std::atomic<bool> m_shouldExit;
+
+	// threads in the middle of enqueueing - the loop thread waits for them before its last run of the queue
+	std::atomic<int> m_activeProducers;
+
+	std::string m_loopTag;
+
+	// intrusive MPSC queue (Vyukov) - producers exchange the head, the loop thread consumes from the tail
+	std::atomic<CallbackNode*> m_queueHead;
+
+	CallbackNode* m_queueTail;
+
+	CallbackNode m_queueStub;
+
+	std::array<std::atomic<uint64_t>, LatencyBucketCount> m_latencyHistogram;
+
+	std::unique_ptr<UvTimerWheel> m_timerWheel;
+
+private:
+	void PushCallbackNode(CallbackNode* node);
+
+	CallbackNode* PopCallbackNode();
+
+	void RunCallbacks();
+
+public:
+	UvLoopHolder(const std::string& loopTag);
+
+	virtual ~UvLoopHolder();
+
+	// the last reference may get dropped from a callback on our own loop, which can't wait for itself to exit - the
+	// holder gets destroyed on a teardown thread shared by all holders instead
+	virtual bool Release() override;
+
+	inline uv_loop_t* GetLoop()
+	{
+		return &m_loop;
+	}
+
+	inline const std::string& GetLoopTag() const
+	{
+		return m_loopTag;
+	}
+
+	// a wheel with a 100ms tick for coarse timers, such as timeouts - only to be used from the loop thread
+	inline UvTimerWheel* GetTimerWheel()
+	{
+		return m_timerWheel.get();
+	}
+
+	inline bool IsInLoopThread() const
+	{
+		return (std::this_thread::get_id() == m_thread.get_id());
+	}
+
+	//
+	// Queues a callback to be executed on the loop thread. This is safe to call from any thread. Returns false without
+	// queueing the callback if the loop is shutting down.
+	//
+	bool EnqueueCallback(const TCallback& callback);
+
+	//
+	// Runs a callback on the loop thread, waiting for it to complete. If called from the loop thread, the callback is
+	// executed immediately. Returns false without running the callback if the loop is shutting down.
+	//
+	bool InvokeCallback(const TCallback& callback);
+
+	//
+	// Gets a snapshot of the enqueue-to-run latency histogram for queued callbacks.
+	//
+	TLatencyHistogram GetCallbackLatencyHistogram() const;
+
+	void ResetCallbackLatencyHistogram();
+};
+}
@@ -13,7 +13,11 @@
 
 namespace net
 {
-class UvLoopManager
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UvLoopManager
 {
 private:
 	std::unordered_map<std::string, fwRefContainer<UvLoopHolder>> m_uvLoops;
@@ -0,0 +1,127 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <uv.h>
+
+namespace net
+{
+class UvTimerWheel;
+
+//
+// A timer on a timer wheel. These are meant to be embedded into whatever owns them - destroying a timer stops it, so
+// unless it's known to be inactive, that has to happen on the loop thread as well.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UvWheelTimer
+{
+	friend class UvTimerWheel;
+
+public:
+	typedef std::function<void()> TCallback;
+
+private:
+	UvWheelTimer* m_prev;
+
+	UvWheelTimer* m_next;
+
+	UvTimerWheel* m_wheel;
+
+	// the tick the timer expires at
+	uint64_t m_expiryTick;
+
+	TCallback m_callback;
+
+private:
+	void Unlink();
+
+public:
+	UvWheelTimer();
+
+	~UvWheelTimer();
+
+	UvWheelTimer(const UvWheelTimer&) = delete;
+
+	UvWheelTimer& operator=(const UvWheelTimer&) = delete;
+
+	inline bool IsActive() const
+	{
+		return (m_wheel != nullptr);
+	}
+
+	void Stop();
+};
+
+//
+// A hashed timer wheel, driving any amount of coarse timers (such as connection timeouts) using a single libuv timer.
+//
+// Timers get hashed into a slot by the tick they expire at, so starting and stopping them is constant time - every tick
+// only looks at the timers in a single slot. The libuv timer only runs while there are active timers. Only to be used
+// from the thread of the loop the wheel belongs to.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UvTimerWheel
+{
+	friend class UvWheelTimer;
+
+private:
+	uv_loop_t* m_loop;
+
+	uv_timer_t m_tickTimer;
+
+	uint64_t m_tickLength;
+
+	uint64_t m_currentTick;
+
+	// sentinel nodes of each slot's circular list
+	std::vector<UvWheelTimer> m_slots;
+
+	size_t m_activeTimers;
+
+private:
+	void Link(UvWheelTimer* timer);
+
+	void OnTick();
+
+	void AdvanceTo(uint64_t tick);
+
+public:
+	UvTimerWheel(uv_loop_t* loop, std::chrono::milliseconds tickLength, size_t slotCount);
+
+	~UvTimerWheel();
+
+	UvTimerWheel(const UvTimerWheel&) = delete;
+
+	UvTimerWheel& operator=(const UvTimerWheel&) = delete;
+
+	//
+	// Starts (or restarts) a timer, calling the callback once the timeout passed - rounded up to the next tick.
+	//
+	void Start(UvWheelTimer* timer, std::chrono::milliseconds timeout, const UvWheelTimer::TCallback& callback);
+
+	//
+	// Closes the libuv timer - has to be called on the loop thread before the loop goes away.
+	//
+	void Close();
+
+	inline size_t GetActiveTimerCount() const
+	{
+		return m_activeTimers;
+	}
+};
+}
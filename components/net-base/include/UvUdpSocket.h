@@ -0,0 +1,145 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <uv.h>
+
+#include "NetAddress.h"
+#include "NetSlice.h"
+#include "UvLoopHolder.h"
+
+namespace net
+{
+//
+// A UDP socket running on a libuv loop, delivering datagrams as they arrive rather than having to be polled.
+//
+// The slice passed to the receive callback is owned, so it can be retained without copying. Most datagrams get copied
+// into a pooled block of their size for this, which is cheaper than a receive buffer pinned by a retained datagram.
+// Where libuv supports it, datagrams are read in batches using recvmmsg.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UvUdpSocket : public fwRefCountable
+{
+public:
+	// called on the loop thread for each received datagram
+	typedef std::function<void(const Slice& data, const PeerAddress& address)> TReceiveCallback;
+
+	// the amount of datagrams to read using a single recvmmsg call - libuv reserves 64 kB for each
+	static const size_t MultipleMessageCount = 8;
+
+private:
+	fwRefContainer<UvLoopHolder> m_loop;
+
+	std::unique_ptr<uv_udp_t> m_handle;
+
+	TReceiveCallback m_receiveCallback;
+
+	// the block datagrams are currently being received into
+	fwRefContainer<BufferBlock> m_receiveBlock;
+
+	bool m_usingMultipleMessages;
+
+private:
+	void OnAllocate(size_t suggestedSize, uv_buf_t* buffer);
+
+	void OnReceive(ssize_t length, const uv_buf_t* buffer, const sockaddr* address, unsigned int flags);
+
+	void SendOnLoop(const Slice& data, const PeerAddress& address);
+
+	void CloseOnLoop();
+
+public:
+	UvUdpSocket(const fwRefContainer<UvLoopHolder>& loop);
+
+	virtual ~UvUdpSocket();
+
+	//
+	// Binds the socket and starts receiving datagrams. If reusePort is set, other sockets can bind to the same address,
+	// and the kernel will distribute datagrams between them by their source. This is safe to call from any thread.
+	//
+	bool Bind(const PeerAddress& bindAddress, const TReceiveCallback& callback, bool reusePort = false);
+
+	//
+	// Gets the address the socket is bound to, such as to find the port picked when binding to port 0.
+	//
+	PeerAddress GetLocalAddress();
+
+	//
+	// Sends a datagram. This is safe to call from any thread - when not called on the loop thread, the data gets retained
+	// and sent from the loop.
+	//
+	void SendTo(const Slice& data, const PeerAddress& address);
+
+	//
+	// Stops receiving and closes the socket, waiting for the loop to do so if called from another thread.
+	//
+	void Close();
+
+	inline const fwRefContainer<UvLoopHolder>& GetLoop() const
+	{
+		return m_loop;
+	}
+
+	inline bool IsUsingMultipleMessages() const
+	{
+		return m_usingMultipleMessages;
+	}
+};
+
+//
+// A set of UDP sockets bound to the same address, each running on its own loop.
+//
+class
+#ifdef COMPILING_NET_BASE
+	DLL_EXPORT
+#endif
+	UvUdpSocketGroup : public fwRefCountable
+{
+private:
+	std::vector<fwRefContainer<UvUdpSocket>> m_sockets;
+
+public:
+	//
+	// Creates a socket on each of `loopCount` loops, named like the loops of a TcpServerManager. Without SO_REUSEPORT,
+	// only the first loop gets a socket.
+	//
+	UvUdpSocketGroup(const std::string& loopTag, int loopCount);
+
+	virtual ~UvUdpSocketGroup();
+
+	//
+	// Binds all sockets to the same address. The callback gets invoked on the loop of the socket that received the
+	// datagram, so it has to be safe to call from multiple threads at once.
+	//
+	bool Bind(const PeerAddress& bindAddress, const UvUdpSocket::TReceiveCallback& callback);
+
+	//
+	// Sends a datagram from the socket a hash of the target address maps to, so datagrams to the same peer stay in order.
+	//
+	void SendTo(const Slice& data, const PeerAddress& address);
+
+	void Close();
+
+	inline size_t GetSocketCount() const
+	{
+		return m_sockets.size();
+	}
+
+	inline const fwRefContainer<UvUdpSocket>& GetSocket(size_t index) const
+	{
+		return m_sockets[index];
+	}
+};
+}
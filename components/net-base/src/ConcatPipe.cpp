@@ -30,13 +30,12 @@ void ConcatInputPipe::PassPacket(Buffer data)
 	// verify length
 	if (data.GetRemainingBytes() >= firstLength)
 	{
-		// create arrays for both first and second
-		Buffer firstData(firstLength);
-		Buffer secondData(data.GetRemainingBytes() - firstLength);
+		// get views of both first and second - as these start out empty, this doesn't copy
+		Buffer firstData;
+		Buffer secondData;
 
-		// write data to both arrays
-		data.ReadTo(firstData, firstData.GetLength());
-		data.ReadTo(secondData, secondData.GetLength());
+		data.ReadTo(firstData, firstLength);
+		data.ReadTo(secondData, data.GetRemainingBytes());
 
 		// pass to both pipes
 		m_pipe1->PassPacket(firstData);
@@ -72,7 +71,7 @@ void ConcatOutputPipe::PassPacket(Buffer data)
 		m_savedFirst.ReadTo(outPacket, m_savedFirst.GetLength());
 		data.ReadTo(outPacket, data.GetLength());
 		
-		m_pipe->PassPacket(outPacket);
+		m_pipe->PassPacket(std::move(outPacket));
 	}
 
 	m_tickTock = !m_tickTock;
@@ -131,7 +130,7 @@ static InitFunction initFunction([] ()
 	outPipe->PassPacket(data1);
 	outPipe->PassPacket(data2);
 
-	udpSocket1->SendTo(toSendPipe->GetPacket().GetData(), udpSocket2->GetLocalAddress());
+	udpSocket1->SendTo(toSendPipe->GetPacket().ToVector(), udpSocket2->GetLocalAddress());
 
 	PeerAddress inAddress;
 	Buffer recvBit = udpSocket2->ReceiveFrom(2048, &inAddress).get();
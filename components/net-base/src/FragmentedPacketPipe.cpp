@@ -0,0 +1,293 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "FragmentedPacketPipe.h"
+
+namespace net
+{
+// the first byte of each packet
+enum class FragmentType : uint8_t
+{
+	Whole = 0,
+	Fragment = 1
+};
+
+// the largest message sent over the network
+static const size_t DefaultMaxPacketSize = 65536;
+
+// smaller blocks aren't worth growing in steps
+static const size_t MinReassemblyCapacity = 4096;
+
+FragmentedPacketPipe::FragmentedPacketPipe(const fwRefContainer<NetPipe>& outgoingPipe, const fwRefContainer<NetPipe>& incomingPipe, size_t mtu)
+	: InOutPipe(outgoingPipe, incomingPipe), m_mtu(mtu), m_nextMessageId(0), m_maxReassemblies(8), m_maxPacketSize(DefaultMaxPacketSize),
+	  m_maxReassemblyMemory(DefaultMaxPacketSize * 4), m_reassemblyMemory(0), m_reassemblyTimeout(5000), m_evictedPackets(0)
+{
+	assert(mtu > FragmentHeaderSize);
+}
+
+void FragmentedPacketPipe::Reset()
+{
+	m_nextMessageId = 0;
+	m_reassemblies.clear();
+	m_reassemblyMemory = 0;
+
+	InOutPipe::Reset();
+}
+
+void FragmentedPacketPipe::PassPacket(Buffer data)
+{
+	size_t length = data.GetLength();
+
+	if ((length + 1) <= m_mtu)
+	{
+		Buffer outPacket(length + 1);
+		outPacket.Write<uint8_t>(static_cast<uint8_t>(FragmentType::Whole));
+		outPacket.Write(data.GetBuffer(), length);
+
+		GetOutgoingPipe()->PassPacket(std::move(outPacket));
+		return;
+	}
+
+	size_t fragmentSize = m_mtu - FragmentHeaderSize;
+	size_t fragmentCount = (length + fragmentSize - 1) / fragmentSize;
+
+	if (fragmentCount > UINT16_MAX || fragmentSize > UINT16_MAX)
+	{
+		trace("Packet of %d bytes is too large to be fragmented.\n", static_cast<int>(length));
+		return;
+	}
+
+	uint16_t messageId = m_nextMessageId++;
+
+	for (size_t i = 0; i < fragmentCount; i++)
+	{
+		size_t offset = i * fragmentSize;
+		size_t thisSize = std::min(fragmentSize, length - offset);
+
+		Buffer outPacket(thisSize + FragmentHeaderSize);
+		outPacket.Write<uint8_t>(static_cast<uint8_t>(FragmentType::Fragment));
+		outPacket.Write<uint16_t>(messageId);
+		outPacket.Write<uint16_t>(static_cast<uint16_t>(i));
+		outPacket.Write<uint16_t>(static_cast<uint16_t>(fragmentCount));
+		outPacket.Write<uint16_t>(static_cast<uint16_t>(fragmentSize));
+		outPacket.Write(data.GetBuffer() + offset, thisSize);
+
+		GetOutgoingPipe()->PassPacket(std::move(outPacket));
+	}
+}
+
+void FragmentedPacketPipe::PassIncomingPacket(Buffer data)
+{
+	PassIncomingPacket(std::move(data), std::chrono::steady_clock::now());
+}
+
+void FragmentedPacketPipe::PassIncomingPacket(Buffer data, TTimePoint now)
+{
+	if (data.GetLength() < 1)
+	{
+		return;
+	}
+
+	FragmentType type = static_cast<FragmentType>(data.Read<uint8_t>());
+
+	if (type == FragmentType::Whole)
+	{
+		GetIncomingPipe()->PassPacket(data.GetSubBuffer(1, data.GetLength() - 1));
+	}
+	else if (type == FragmentType::Fragment && data.GetLength() > FragmentHeaderSize)
+	{
+		ProcessFragment(data, now);
+	}
+
+	Update(now);
+}
+
+void FragmentedPacketPipe::ProcessFragment(Buffer& data, TTimePoint now)
+{
+	uint16_t messageId = data.Read<uint16_t>();
+	uint16_t fragmentIndex = data.Read<uint16_t>();
+	uint16_t fragmentCount = data.Read<uint16_t>();
+	uint16_t fragmentSize = data.Read<uint16_t>();
+
+	size_t thisSize = data.GetRemainingBytes();
+
+	// all fragments but the last are exactly the fragment size
+	bool isLast = (fragmentIndex == fragmentCount - 1);
+
+	if (fragmentIndex >= fragmentCount || fragmentSize == 0 || thisSize > fragmentSize || (!isLast && thisSize != fragmentSize))
+	{
+		return;
+	}
+
+	size_t capacity = size_t(fragmentCount) * fragmentSize;
+
+	if (capacity > m_maxPacketSize)
+	{
+		return;
+	}
+
+	auto it = m_reassemblies.find(messageId);
+
+	if (it == m_reassemblies.end())
+	{
+		// make room by dropping the packet that has been waiting the longest
+		while (!m_reassemblies.empty() && m_reassemblies.size() >= m_maxReassemblies)
+		{
+			EvictOldestReassembly(m_reassemblies.end());
+		}
+
+		Reassembly reassembly;
+		reassembly.receivedBits.resize((fragmentCount + 63) / 64);
+		reassembly.fragmentCount = fragmentCount;
+		reassembly.receivedCount = 0;
+		reassembly.fragmentSize = fragmentSize;
+		reassembly.length = 0;
+		reassembly.startTime = now;
+
+		it = m_reassemblies.insert({ messageId, std::move(reassembly) }).first;
+	}
+
+	Reassembly& reassembly = it->second;
+
+	// fragments of an old packet with a reused id, most likely
+	if (reassembly.fragmentCount != fragmentCount || reassembly.fragmentSize != fragmentSize)
+	{
+		return;
+	}
+
+	uint64_t& bitWord = reassembly.receivedBits[fragmentIndex / 64];
+	uint64_t bit = (uint64_t(1) << (fragmentIndex % 64));
+
+	if (bitWord & bit)
+	{
+		return;
+	}
+
+	size_t fragmentEnd = (size_t(fragmentIndex) * fragmentSize) + thisSize;
+
+	if (!ReserveReassembly(it, fragmentEnd))
+	{
+		return;
+	}
+
+	bitWord |= bit;
+	reassembly.receivedCount++;
+
+	memcpy(reassembly.block->GetData() + (size_t(fragmentIndex) * fragmentSize), data.GetBuffer() + data.GetCurOffset(), thisSize);
+
+	if (isLast)
+	{
+		reassembly.length = (size_t(fragmentCount - 1) * fragmentSize) + thisSize;
+	}
+
+	if (reassembly.receivedCount == reassembly.fragmentCount)
+	{
+		Buffer packet(Slice(reassembly.block, 0, reassembly.length));
+
+		EraseReassembly(it);
+
+		GetIncomingPipe()->PassPacket(std::move(packet));
+	}
+}
+
+bool FragmentedPacketPipe::ReserveReassembly(std::map<uint16_t, Reassembly>::iterator it, size_t length)
+{
+	Reassembly& reassembly = it->second;
+
+	size_t oldCapacity = (reassembly.block.GetRef()) ? reassembly.block->GetCapacity() : 0;
+
+	if (length <= oldCapacity)
+	{
+		return true;
+	}
+
+	// double the block, so receiving the fragments in order doesn't keep copying them
+	size_t fullCapacity = size_t(reassembly.fragmentCount) * reassembly.fragmentSize;
+	size_t capacity = std::min(std::max(std::max(length, oldCapacity * 2), MinReassemblyCapacity), fullCapacity);
+
+	BufferPool* pool = BufferPool::GetForSize(capacity);
+	size_t newCapacity = (pool) ? pool->GetBlockSize() : capacity;
+
+	while ((m_reassemblyMemory - oldCapacity + newCapacity) > m_maxReassemblyMemory)
+	{
+		if (m_reassemblies.size() <= 1)
+		{
+			trace("Dropping a fragmented packet, as it doesn't fit the reassembly memory limit.\n");
+
+			EraseReassembly(it);
+			m_evictedPackets++;
+
+			return false;
+		}
+
+		EvictOldestReassembly(it);
+	}
+
+	fwRefContainer<BufferBlock> block = (pool) ? pool->Allocate() : new VectorBufferBlock(std::vector<uint8_t>(capacity));
+
+	if (oldCapacity > 0)
+	{
+		memcpy(block->GetData(), reassembly.block->GetData(), oldCapacity);
+	}
+
+	reassembly.block = block;
+	m_reassemblyMemory += block->GetCapacity() - oldCapacity;
+
+	return true;
+}
+
+void FragmentedPacketPipe::EvictOldestReassembly(std::map<uint16_t, Reassembly>::iterator except)
+{
+	auto oldest = m_reassemblies.end();
+
+	for (auto it = m_reassemblies.begin(); it != m_reassemblies.end(); it++)
+	{
+		if (it != except && (oldest == m_reassemblies.end() || it->second.startTime < oldest->second.startTime))
+		{
+			oldest = it;
+		}
+	}
+
+	if (oldest != m_reassemblies.end())
+	{
+		EraseReassembly(oldest);
+		m_evictedPackets++;
+	}
+}
+
+std::map<uint16_t, FragmentedPacketPipe::Reassembly>::iterator FragmentedPacketPipe::EraseReassembly(std::map<uint16_t, Reassembly>::iterator it)
+{
+	if (it->second.block.GetRef())
+	{
+		m_reassemblyMemory -= it->second.block->GetCapacity();
+	}
+
+	return m_reassemblies.erase(it);
+}
+
+void FragmentedPacketPipe::Update()
+{
+	Update(std::chrono::steady_clock::now());
+}
+
+void FragmentedPacketPipe::Update(TTimePoint now)
+{
+	for (auto it = m_reassemblies.begin(); it != m_reassemblies.end();)
+	{
+		if ((now - it->second.startTime) >= m_reassemblyTimeout)
+		{
+			it = EraseReassembly(it);
+			m_evictedPackets++;
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+}
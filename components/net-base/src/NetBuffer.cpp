@@ -10,65 +10,207 @@
 
 namespace net
 {
+static fwRefContainer<BufferBlock> AllocateBlock(size_t capacity)
+{
+	BufferPool* pool = BufferPool::GetForSize(capacity);
+
+	if (!pool)
+	{
+		return new VectorBufferBlock(std::vector<uint8_t>(capacity));
+	}
+
+	return pool->Allocate();
+}
+
 Buffer::Buffer()
 {
 	Initialize();
-
-	m_bytes = std::make_shared<std::vector<uint8_t>>();
 }
 
 Buffer::Buffer(const uint8_t* bytes, size_t length)
 {
 	Initialize();
 
-	m_bytes = std::make_shared<std::vector<uint8_t>>(length);
-
-	memcpy(&(*m_bytes)[0], bytes, m_bytes->size());
+	Assign(bytes, length);
 }
 
 Buffer::Buffer(const std::vector<uint8_t>& origBytes)
 {
 	Initialize();
 
-	m_bytes = std::make_shared<std::vector<uint8_t>>(origBytes);
+	if (!origBytes.empty())
+	{
+		Assign(&origBytes[0], origBytes.size());
+	}
+}
+
+Buffer::Buffer(std::vector<uint8_t>&& origBytes)
+{
+	Initialize();
+
+	if (origBytes.size() <= InlineCapacity)
+	{
+		if (!origBytes.empty())
+		{
+			Assign(&origBytes[0], origBytes.size());
+		}
+
+		return;
+	}
+
+	m_length = origBytes.size();
+	m_block = new VectorBufferBlock(std::move(origBytes));
+}
+
+Buffer::Buffer(const Slice& slice)
+{
+	Initialize();
+
+	if (slice.IsOwned() && slice.GetLength() > InlineCapacity)
+	{
+		m_block = slice.GetBlock();
+		m_offset = slice.GetData() - m_block->GetData();
+		m_length = slice.GetLength();
+	}
+	else
+	{
+		Assign(slice.GetData(), slice.GetLength());
+	}
 }
 
 Buffer::Buffer(size_t length)
 {
 	Initialize();
 
-	m_bytes = std::make_shared<std::vector<uint8_t>>(length);
+	Reserve(length);
+	memset(GetWritableBuffer(), 0, length);
+
+	m_length = length;
 }
 
 Buffer::Buffer(const Buffer& other)
 {
+	Initialize();
+
+	*this = other;
+
+	m_curOff = 0;
+	m_end = false;
+}
+
+Buffer::Buffer(Buffer&& other)
+{
+	Initialize();
+
+	*this = std::move(other);
+
 	m_curOff = 0;
 	m_end = false;
+}
+
+Buffer& Buffer::operator=(const Buffer& other)
+{
+	if (this != &other)
+	{
+		m_block = other.m_block;
+		m_offset = other.m_offset;
+		m_length = other.m_length;
+
+		if (!m_block.GetRef())
+		{
+			memcpy(m_inlineBytes, other.m_inlineBytes, m_length);
+		}
+
+		m_curOff = other.m_curOff;
+		m_end = other.m_end;
+	}
+
+	return *this;
+}
+
+Buffer& Buffer::operator=(Buffer&& other)
+{
+	if (this != &other)
+	{
+		m_block = std::move(other.m_block);
+		m_offset = other.m_offset;
+		m_length = other.m_length;
+
+		if (!m_block.GetRef())
+		{
+			memcpy(m_inlineBytes, other.m_inlineBytes, m_length);
+		}
+
+		m_curOff = other.m_curOff;
+		m_end = other.m_end;
+
+		other.m_block = nullptr;
+		other.Initialize();
+	}
 
-	m_bytes = other.GetBytes();
+	return *this;
 }
 
 void Buffer::Initialize()
 {
+	m_offset = 0;
+	m_length = 0;
 	m_curOff = 0;
 	m_end = false;
 }
 
+void Buffer::Assign(const uint8_t* bytes, size_t length)
+{
+	Reserve(length);
+
+	if (length > 0)
+	{
+		memcpy(GetWritableBuffer(), bytes, length);
+	}
+
+	m_length = length;
+}
+
+void Buffer::Reserve(size_t length)
+{
+	size_t capacity = (m_block.GetRef()) ? (m_block->GetCapacity() - m_offset) : InlineCapacity;
+
+	// a block shared with another buffer can be written to, but not grown - the growth would be visible to the others
+	bool canGrowInPlace = (!m_block.GetRef() || m_block->GetRefCount() == 1);
+
+	if (length <= capacity && (length <= m_length || canGrowInPlace))
+	{
+		return;
+	}
+
+	// grow geometrically, so repeated small writes don't each end up copying
+	size_t newCapacity = std::max(length, m_length * 2);
+	fwRefContainer<BufferBlock> newBlock = AllocateBlock(newCapacity);
+
+	if (m_length > 0)
+	{
+		memcpy(newBlock->GetData(), GetBuffer(), m_length);
+	}
+
+	m_block = newBlock;
+	m_offset = 0;
+}
+
 bool Buffer::Read(void* buffer, size_t length)
 {
-	if ((m_curOff + length) >= m_bytes->size())
+	if ((m_curOff + length) >= m_length)
 	{
 		m_end = true;
 
 		// and if it really doesn't fit out of our buffer
-		if ((m_curOff + length) > m_bytes->size())
+		if ((m_curOff + length) > m_length)
 		{
-			memset(buffer, 0xCE, sizeof(length));
+			memset(buffer, 0xCE, length);
 			return false;
 		}
 	}
 
-	memcpy(buffer, &(*m_bytes)[m_curOff], length);
+	memcpy(buffer, GetBuffer() + m_curOff, length);
 	m_curOff += length;
 
 	return true;
@@ -76,9 +218,14 @@ bool Buffer::Read(void* buffer, size_t length)
 
 void Buffer::EnsureWritableSize(size_t length)
 {
-	if ((m_curOff + length) >= m_bytes->size())
+	if ((m_curOff + length) > m_length)
 	{
-		m_bytes->resize(m_curOff + length);
+		Reserve(m_curOff + length);
+
+		// the gap between the old and the new length was zero-filled by the vector we used to be backed by
+		memset(GetWritableBuffer() + m_length, 0, (m_curOff + length) - m_length);
+
+		m_length = m_curOff + length;
 	}
 }
 
@@ -86,23 +233,31 @@ void Buffer::Write(const void* buffer, size_t length)
 {
 	EnsureWritableSize(length);
 
-	memcpy(&(*m_bytes)[m_curOff], buffer, length);
+	memcpy(GetWritableBuffer() + m_curOff, buffer, length);
 	m_curOff += length;
 }
 
 bool Buffer::ReadTo(Buffer& other, size_t length)
 {
-	other.EnsureWritableSize(length);
-
-	if ((m_curOff + length) > m_bytes->size())
+	if ((m_curOff + length) > m_length)
 	{
 		return false;
 	}
 
-	auto bytes = GetBytes();
-	auto otherBytes = other.GetBytes();
+	// an empty buffer can just become a view of the data
+	if (other.GetLength() == 0)
+	{
+		other = GetSubBuffer(m_curOff, length);
+		other.m_curOff = length;
+
+		m_curOff += length;
+
+		return true;
+	}
+
+	other.EnsureWritableSize(length);
 
-	memcpy(&(*otherBytes)[other.GetCurOffset()], &(*bytes)[GetCurOffset()], length);
+	memcpy(other.GetWritableBuffer() + other.GetCurOffset(), GetBuffer() + GetCurOffset(), length);
 
 	m_curOff += length;
 	other.m_curOff += length; // ugly :(
@@ -110,8 +265,44 @@ bool Buffer::ReadTo(Buffer& other, size_t length)
 	return true;
 }
 
+Buffer Buffer::GetSubBuffer(size_t offset, size_t length) const
+{
+	assert(offset + length <= m_length);
+
+	Buffer subBuffer;
+
+	// small views are cheaper to copy than to keep a block alive for
+	if (!m_block.GetRef() || length <= InlineCapacity)
+	{
+		subBuffer.Assign(GetBuffer() + offset, length);
+	}
+	else
+	{
+		subBuffer.m_block = m_block;
+		subBuffer.m_offset = m_offset + offset;
+		subBuffer.m_length = length;
+	}
+
+	return subBuffer;
+}
+
+Slice Buffer::ToSlice() const
+{
+	if (m_block.GetRef())
+	{
+		return Slice(m_block, m_offset, m_length);
+	}
+
+	return Slice::Borrow(m_inlineBytes, m_length);
+}
+
+std::vector<uint8_t> Buffer::ToVector() const
+{
+	return std::vector<uint8_t>(GetBuffer(), GetBuffer() + m_length);
+}
+
 bool Buffer::IsAtEnd() const
 {
-	return (m_end || m_curOff == m_bytes->size());
+	return (m_end || m_curOff == m_length);
+}
 }
-}
\ No newline at end of file
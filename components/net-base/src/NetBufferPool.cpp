@@ -0,0 +1,140 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetBufferPool.h"
+
+namespace net
+{
+BufferBlock::BufferBlock()
+	: m_refCount(0), m_data(nullptr), m_capacity(0)
+{
+
+}
+
+BufferBlock::~BufferBlock()
+{
+
+}
+
+void BufferBlock::AddRef()
+{
+	m_refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool BufferBlock::Release()
+{
+	if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		Free();
+
+		return true;
+	}
+
+	return false;
+}
+
+PooledBufferBlock::PooledBufferBlock(BufferPool* pool, size_t capacity)
+	: m_pool(pool), m_storage(new uint8_t[capacity])
+{
+	m_data = m_storage.get();
+	m_capacity = capacity;
+}
+
+void PooledBufferBlock::Free()
+{
+	m_pool->Return(this);
+}
+
+VectorBufferBlock::VectorBufferBlock(std::vector<uint8_t>&& storage)
+	: m_storage(std::move(storage))
+{
+	m_data = m_storage.data();
+	m_capacity = m_storage.size();
+}
+
+void VectorBufferBlock::Free()
+{
+	delete this;
+}
+
+BufferPool::BufferPool(size_t blockSize, size_t maxFreeBlocks)
+	: m_blockSize(blockSize), m_maxFreeBlocks(maxFreeBlocks), m_heapAllocations(0)
+{
+
+}
+
+BufferPool::~BufferPool()
+{
+	for (auto& block : m_freeBlocks)
+	{
+		delete block;
+	}
+}
+
+fwRefContainer<BufferBlock> BufferPool::Allocate()
+{
+	PooledBufferBlock* block = nullptr;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (!m_freeBlocks.empty())
+		{
+			block = m_freeBlocks.back();
+			m_freeBlocks.pop_back();
+		}
+	}
+
+	if (!block)
+	{
+		block = new PooledBufferBlock(this, m_blockSize);
+
+		m_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	return fwRefContainer<BufferBlock>(block);
+}
+
+void BufferPool::Return(PooledBufferBlock* block)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if (m_freeBlocks.size() < m_maxFreeBlocks)
+		{
+			m_freeBlocks.push_back(block);
+			return;
+		}
+	}
+
+	// the pool is full, so give the memory back
+	delete block;
+}
+
+BufferPool* BufferPool::GetForSize(size_t length)
+{
+	// these are intentionally leaked, as blocks may still be released during shutdown
+	static BufferPool* pools[] =
+	{
+		new BufferPool(256, 4096),
+		new BufferPool(2048, 2048),
+		new BufferPool(16384, 512),
+		new BufferPool(MaxPooledSize, 256)
+	};
+
+	for (auto& pool : pools)
+	{
+		if (length <= pool->GetBlockSize())
+		{
+			return pool;
+		}
+	}
+
+	return nullptr;
+}
+}
@@ -8,24 +8,87 @@
 #include "StdInc.h"
 #include "NetPeerBase.h"
 
+#include "PeerMessages.h"
+
 namespace net
 {
+// shorthand types with a fixed meaning - generated types get shorthands after these
+enum : int
+{
+	MappingPacketType = 1,
+	AcknowledgementPacketType = 2,
+	FirstGeneratedType = 3,
+
+	// the largest type that fits the two-byte encoding
+	MaxCompressedType = 0x7FFF
+};
+
+// the next expected packet, plus the 32 packets selective acks cover
+static const size_t ReorderWindowSize = 33;
+
+static const std::chrono::milliseconds MaxReorderDelay(100);
+
 PeerBase::PeerBase(const fwRefContainer<DatagramSink>& outSink)
-	: m_outSink(outSink), m_inputChannel(new SequencedInputDatagramChannel()), m_outputChannel(new SequencedOutputDatagramChannel()), m_components(new RefInstanceRegistry())
+	: m_outSink(outSink), m_inputChannel(new SequencedInputDatagramChannel()), m_outputChannel(new SequencedOutputDatagramChannel()), m_receivedMapping(false), m_components(new RefInstanceRegistry())
 {
-	m_inSink = new FunctionDatagramSink([=] (const std::vector<uint8_t>& packet)
+	m_inSink = new FunctionDatagramSink([=] (const Slice& packet)
 	{
 		return ProcessEncapsulatedPacket(packet);
 	});
 
+	m_inputChannel->SetSink(m_inSink);
+	m_inputChannel->SetReorderWindow(ReorderWindowSize, MaxReorderDelay);
+
 	m_outputChannel->SetSink(outSink);
 }
 
+void PeerBase::RegisterHandlerInternal(const PeerHandler& handler)
+{
+	handler.AddProcessors([&] (uint32_t type, const NetProcessor& processor)
+	{
+		m_processors[type] = processor;
+	});
+
+	handler.AddGenerators([&] (uint32_t type, const NetGenerator& generator)
+	{
+		m_generators[type] = generator;
+
+		if (m_localToRemoteMapping.find(type) == m_localToRemoteMapping.end())
+		{
+			int shorthand = FirstGeneratedType + static_cast<int>(m_localToRemoteMapping.size());
+
+			assert(shorthand <= MaxCompressedType);
+
+			m_localToRemoteMapping[type] = shorthand;
+		}
+	});
+
+	handler.AddComponents([&] (const char* name, const fwRefContainer<fwRefCountable>& component)
+	{
+		m_components->SetInstance(name, component);
+	});
+}
+
 void PeerBase::ProcessPacket(const std::vector<uint8_t>& buffer)
 {
 	m_inputChannel->ProcessPacket(buffer);
 }
 
+void PeerBase::ProcessPacket(const Slice& packet)
+{
+	m_inputChannel->ProcessPacket(packet);
+}
+
+void PeerBase::SendPacket(const Buffer& buffer)
+{
+	m_outputChannel->WritePacket(buffer.ToSlice());
+}
+
+void PeerBase::Update()
+{
+	m_inputChannel->Update();
+}
+
 int PeerBase::ReadCompressedType(Buffer& buffer)
 {
 	uint8_t lead = buffer.Read<uint8_t>();
@@ -33,53 +96,146 @@ int PeerBase::ReadCompressedType(Buffer& buffer)
 
 	if (lead == 0)
 	{
-		result = -1;
+		// terminates lists of types - no type is sent as 0
+		result = 0;
 	}
 	else if (lead & 0x80)
 	{
 		result = buffer.Read<uint8_t>() << 7;
 		result |= (lead & ~0x80);
 	}
+	else
+	{
+		result = lead;
+	}
 
 	return result;
 }
 
-void PeerBase::ProcessEncapsulatedPacket(const std::vector<uint8_t>& buffer)
+void PeerBase::WriteCompressedType(Buffer& buffer, int type)
+{
+	if (type < 0x80)
+	{
+		buffer.Write<uint8_t>(static_cast<uint8_t>(type));
+	}
+	else
+	{
+		buffer.Write<uint8_t>(static_cast<uint8_t>((type & 0x7F) | 0x80));
+		buffer.Write<uint8_t>(static_cast<uint8_t>(type >> 7));
+	}
+}
+
+void PeerBase::WriteMappingPacket(Buffer& buffer)
+{
+	WriteCompressedType(buffer, MappingPacketType);
+
+	for (auto& entry : m_localToRemoteMapping)
+	{
+		WriteCompressedType(buffer, entry.second);
+		buffer.Write<uint32_t>(entry.first);
+	}
+
+	// terminator
+	WriteCompressedType(buffer, 0);
+}
+
+void PeerBase::WriteAcknowledgementPacket(Buffer& buffer)
 {
-	Buffer netBuffer(buffer);
+	msg::msgPeerAck::Writer ack;
+	ack.sequence = m_inputChannel->GetSequence();
+	ack.selectiveAcks = m_inputChannel->GetSelectiveAcks();
+
+	WriteCompressedType(buffer, AcknowledgementPacketType);
+	ack.Write(buffer);
+}
+
+int PeerBase::GetWireType(uint32_t type)
+{
+	auto it = m_localToRemoteMapping.find(type);
+
+	return (it != m_localToRemoteMapping.end()) ? it->second : -1;
+}
+
+void PeerBase::ProcessEncapsulatedPacket(const Slice& packet)
+{
+	// this shares the packet's block if it has one, and only copies borrowed packets
+	Buffer netBuffer(packet);
+
+	int type = ReadCompressedType(netBuffer);
+
+	if (type == MappingPacketType)
+	{
+		ProcessMappingPacket(netBuffer);
+		return;
+	}
+	else if (type == AcknowledgementPacketType)
+	{
+		ProcessAcknowledgementPacket(netBuffer);
+		return;
+	}
 
 	// if we don't have a list of remote trusted packets, only expect such
-	if (m_remoteToLocalMapping.empty())
+	if (!m_receivedMapping)
+	{
+		return;
+	}
+
+	const NetProcessor* processor = (type > 0 && static_cast<size_t>(type) < m_dispatchTable.size()) ? m_dispatchTable[type] : nullptr;
+
+	if (!processor)
 	{
-		int type = ReadCompressedType(netBuffer);
+		trace("Peer %s sent unknown packet type %d.\n", GetName().c_str(), type);
+		return;
+	}
 
-		if (type == 1)
-		{
-			ProcessMappingPacket(netBuffer);
-		}
+	(*processor)(this, netBuffer);
+}
+
+void PeerBase::ProcessAcknowledgementPacket(Buffer& buffer)
+{
+	msg::msgPeerAck::Reader ack(buffer);
+
+	if (!ack.IsValid())
+	{
+		return;
 	}
+
+	m_outputChannel->ProcessAcknowledgement(ack.GetSequence(), ack.GetSelectiveAcks());
 }
 
 void PeerBase::ProcessMappingPacket(Buffer& buffer)
 {
-	// while the packet type isn't -1
-	int type;
+	m_dispatchTable.clear();
 
-	do
+	// read until the terminating type of 0
+	while (buffer.GetRemainingBytes() > 0)
 	{
-		type = ReadCompressedType(buffer);
+		int type = ReadCompressedType(buffer);
 
-		if (type >= 0)
+		if (type <= 0 || buffer.GetRemainingBytes() < sizeof(uint32_t))
 		{
-			uint32_t mappedType = buffer.Read<uint32_t>();
+			break;
+		}
+
+		uint32_t mappedType = buffer.Read<uint32_t>();
 
-			if (m_processors.find(mappedType) == m_processors.end())
-			{
-				trace("Peer %s knows to send mapped type 0x%08x, but we don't know to handle it...\n", GetName().c_str(), mappedType);
-			}
+		auto it = m_processors.find(mappedType);
+
+		if (it == m_processors.end())
+		{
+			trace("Peer %s knows to send mapped type 0x%08x, but we don't know to handle it...\n", GetName().c_str(), mappedType);
+			continue;
+		}
 
-			m_remoteToLocalMapping[type] = mappedType;
+		// resolve the processor once, so dispatching is an index into the table
+		if (static_cast<size_t>(type) >= m_dispatchTable.size())
+		{
+			m_dispatchTable.resize(type + 1, nullptr);
 		}
-	} while (type >= 0);
+
+		m_dispatchTable[type] = &it->second;
+	}
+
+	m_receivedMapping = true;
 }
 }
\ No newline at end of file
@@ -0,0 +1,94 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetSlice.h"
+
+namespace net
+{
+Slice::Slice()
+	: m_data(nullptr), m_length(0)
+{
+
+}
+
+Slice::Slice(const fwRefContainer<BufferBlock>& block, size_t offset, size_t length)
+	: m_block(block), m_data(block->GetData() + offset), m_length(length)
+{
+	assert(offset + length <= block->GetCapacity());
+}
+
+Slice::Slice(std::vector<uint8_t>&& data)
+	: m_data(nullptr), m_length(0)
+{
+	if (!data.empty())
+	{
+		m_block = new VectorBufferBlock(std::move(data));
+		m_data = m_block->GetData();
+		m_length = m_block->GetCapacity();
+	}
+}
+
+Slice Slice::Copy(const void* data, size_t length)
+{
+	if (length == 0)
+	{
+		return Slice();
+	}
+
+	BufferPool* pool = BufferPool::GetForSize(length);
+
+	if (!pool)
+	{
+		// too large for any of the pools, so fall back to the heap
+		std::vector<uint8_t> bytes(length);
+		memcpy(&bytes[0], data, length);
+
+		return Slice(std::move(bytes));
+	}
+
+	fwRefContainer<BufferBlock> block = pool->Allocate();
+	memcpy(block->GetData(), data, length);
+
+	return Slice(block, 0, length);
+}
+
+Slice Slice::Borrow(const void* data, size_t length)
+{
+	Slice slice;
+	slice.m_data = reinterpret_cast<const uint8_t*>(data);
+	slice.m_length = length;
+
+	return slice;
+}
+
+Slice Slice::SubSlice(size_t offset, size_t length) const
+{
+	assert(offset + length <= m_length);
+
+	Slice slice(*this);
+	slice.m_data += offset;
+	slice.m_length = length;
+
+	return slice;
+}
+
+Slice Slice::Retain() const
+{
+	if (IsOwned())
+	{
+		return *this;
+	}
+
+	return Copy(m_data, m_length);
+}
+
+std::vector<uint8_t> Slice::ToVector() const
+{
+	return std::vector<uint8_t>(begin(), end());
+}
+}
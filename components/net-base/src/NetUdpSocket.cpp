@@ -144,7 +144,7 @@ bool UdpSocket::SendTo(const std::vector<uint8_t>& data, const PeerAddress& outA
 
 		if (lastError != EAGAIN)
 		{
-			trace("Failed to send to socket - error code %d.\n");
+			trace("Failed to send to socket - error code %d.\n", lastError);
 
 			return false;
 		}
@@ -152,4 +152,277 @@ bool UdpSocket::SendTo(const std::vector<uint8_t>& data, const PeerAddress& outA
 
 	return true;
 }
-}
\ No newline at end of file
+
+// gets the block to receive a datagram into, reusing the datagram's current block if possible
+static BufferBlock* GetReceiveBlock(UdpDatagram& datagram, size_t maxSize)
+{
+	const fwRefContainer<BufferBlock>& block = datagram.data.GetBlock();
+
+	// the datagram's slice holds one reference - anything more means somebody retained it
+	if (block.GetRef() && block->GetRefCount() == 1 && block->GetCapacity() >= maxSize)
+	{
+		return block.GetRef();
+	}
+
+	BufferPool* pool = BufferPool::GetForSize(maxSize);
+
+	if (!pool)
+	{
+		pool = BufferPool::GetForSize(BufferPool::MaxPooledSize);
+	}
+
+	fwRefContainer<BufferBlock> newBlock = pool->Allocate();
+	datagram.data = Slice(newBlock, 0, 0);
+
+	return newBlock.GetRef();
+}
+
+#ifdef __linux__
+// the amount of messages passed to a single recvmmsg/sendmmsg call
+static const size_t MaxMessagesPerCall = 64;
+
+size_t UdpSocket::ReceiveBatch(UdpDatagram* datagrams, size_t count, size_t maxSize)
+{
+	if (!IsValidSocket())
+	{
+		trace("Failed to receive from socket - socket is not valid.\n");
+
+		return 0;
+	}
+
+	maxSize = std::min(maxSize, BufferPool::MaxPooledSize);
+
+	mmsghdr messages[MaxMessagesPerCall];
+	iovec buffers[MaxMessagesPerCall];
+	sockaddr_storage addresses[MaxMessagesPerCall];
+
+	size_t received = 0;
+	bool waited = false;
+
+	while (received < count)
+	{
+		size_t callCount = std::min(count - received, MaxMessagesPerCall);
+
+		for (size_t i = 0; i < callCount; i++)
+		{
+			BufferBlock* block = GetReceiveBlock(datagrams[received + i], maxSize);
+
+			buffers[i].iov_base = block->GetData();
+			buffers[i].iov_len = maxSize;
+
+			memset(&messages[i], 0, sizeof(messages[i]));
+			messages[i].msg_hdr.msg_iov = &buffers[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+			messages[i].msg_hdr.msg_name = &addresses[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(addresses[i]);
+		}
+
+		// only wait for the first datagram of the batch - after that, take whatever is pending
+		int result = recvmmsg(m_socket, messages, callCount, (!waited) ? MSG_WAITFORONE : MSG_DONTWAIT, nullptr);
+		waited = true;
+
+		if (result < 0)
+		{
+			int lastError = GetLastNetError();
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to receive from socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+
+		size_t kept = 0;
+
+		for (int i = 0; i < result; i++)
+		{
+			UdpDatagram& datagram = datagrams[received + i];
+
+			// datagrams larger than maxSize got cut off, and are dropped rather than passed on incomplete
+			if (messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+			{
+				trace("Dropped a datagram larger than %d bytes.\n", static_cast<int>(maxSize));
+				continue;
+			}
+
+			datagram.data = Slice(datagram.data.GetBlock(), 0, messages[i].msg_len);
+			datagram.address = PeerAddress(reinterpret_cast<sockaddr*>(&addresses[i]), messages[i].msg_hdr.msg_namelen);
+
+			// close the gap left by dropped datagrams - the dropped ones' blocks get reused by the next call
+			if (kept != static_cast<size_t>(i))
+			{
+				std::swap(datagrams[received + kept], datagram);
+			}
+
+			kept++;
+		}
+
+		received += kept;
+
+		// the socket ran dry
+		if (result < static_cast<int>(callCount))
+		{
+			break;
+		}
+	}
+
+	return received;
+}
+
+size_t UdpSocket::SendBatch(const UdpDatagram* datagrams, size_t count)
+{
+	if (!IsValidSocket())
+	{
+		trace("Failed to send to socket - socket is not valid.\n");
+
+		return 0;
+	}
+
+	mmsghdr messages[MaxMessagesPerCall];
+	iovec buffers[MaxMessagesPerCall];
+
+	size_t sent = 0;
+
+	while (sent < count)
+	{
+		size_t callCount = std::min(count - sent, MaxMessagesPerCall);
+
+		for (size_t i = 0; i < callCount; i++)
+		{
+			const UdpDatagram& datagram = datagrams[sent + i];
+
+			buffers[i].iov_base = const_cast<uint8_t*>(datagram.data.GetData());
+			buffers[i].iov_len = datagram.data.GetLength();
+
+			memset(&messages[i], 0, sizeof(messages[i]));
+			messages[i].msg_hdr.msg_iov = &buffers[i];
+			messages[i].msg_hdr.msg_iovlen = 1;
+			messages[i].msg_hdr.msg_name = const_cast<sockaddr*>(datagram.address.GetSocketAddress());
+			messages[i].msg_hdr.msg_namelen = datagram.address.GetSocketAddressLength();
+		}
+
+		int result = sendmmsg(m_socket, messages, callCount, 0);
+
+		if (result < 0)
+		{
+			int lastError = GetLastNetError();
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to send to socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+
+		sent += result;
+
+		if (result < static_cast<int>(callCount))
+		{
+			break;
+		}
+	}
+
+	return sent;
+}
+#else
+size_t UdpSocket::ReceiveBatch(UdpDatagram* datagrams, size_t count, size_t maxSize)
+{
+	if (!IsValidSocket())
+	{
+		trace("Failed to receive from socket - socket is not valid.\n");
+
+		return 0;
+	}
+
+	maxSize = std::min(maxSize, BufferPool::MaxPooledSize);
+
+	size_t received = 0;
+	bool waited = false;
+
+	while (received < count)
+	{
+		// only wait for the first datagram of the batch - after that, take whatever is pending
+		if (waited)
+		{
+			u_long pendingBytes = 0;
+
+			if (ioctlsocket(m_socket, FIONREAD, &pendingBytes) != 0 || pendingBytes == 0)
+			{
+				break;
+			}
+		}
+
+		UdpDatagram& datagram = datagrams[received];
+		BufferBlock* block = GetReceiveBlock(datagram, maxSize);
+
+		sockaddr_storage fromAddr = { 0 };
+		socklen_t fromLen = sizeof(fromAddr);
+
+		int len = recvfrom(m_socket, reinterpret_cast<char*>(block->GetData()), static_cast<int>(maxSize), 0, reinterpret_cast<sockaddr*>(&fromAddr), &fromLen);
+		waited = true;
+
+		if (len < 0)
+		{
+			int lastError = GetLastNetError();
+
+			// datagrams larger than maxSize got cut off, and are dropped rather than passed on incomplete
+			if (lastError == WSAEMSGSIZE)
+			{
+				trace("Dropped a datagram larger than %d bytes.\n", static_cast<int>(maxSize));
+				continue;
+			}
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to receive from socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+
+		datagram.data = Slice(datagram.data.GetBlock(), 0, len);
+		datagram.address = PeerAddress(reinterpret_cast<sockaddr*>(&fromAddr), fromLen);
+
+		received++;
+	}
+
+	return received;
+}
+
+size_t UdpSocket::SendBatch(const UdpDatagram* datagrams, size_t count)
+{
+	if (!IsValidSocket())
+	{
+		trace("Failed to send to socket - socket is not valid.\n");
+
+		return 0;
+	}
+
+	size_t sent = 0;
+
+	for (; sent < count; sent++)
+	{
+		const UdpDatagram& datagram = datagrams[sent];
+
+		int len = sendto(m_socket, reinterpret_cast<const char*>(datagram.data.GetData()), static_cast<int>(datagram.data.GetLength()), 0,
+			datagram.address.GetSocketAddress(), datagram.address.GetSocketAddressLength());
+
+		if (len < 0)
+		{
+			int lastError = GetLastNetError();
+
+			if (lastError != EAGAIN)
+			{
+				trace("Failed to send to socket - error code %d.\n", lastError);
+			}
+
+			break;
+		}
+	}
+
+	return sent;
+}
+#endif
+}
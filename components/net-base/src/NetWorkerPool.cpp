@@ -0,0 +1,150 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetWorkerPool.h"
+
+namespace net
+{
+WorkerPool::WorkerPool(size_t threadCount)
+	: m_shouldExit(false)
+{
+	for (size_t i = 0; i < threadCount; i++)
+	{
+		m_threads.emplace_back([=] ()
+		{
+			RunThread();
+		});
+	}
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_shouldExit = true;
+	}
+
+	m_wakeCondition.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+}
+
+void WorkerPool::RunThread()
+{
+	while (true)
+	{
+		TCallback callback;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_wakeCondition.wait(lock, [=] ()
+			{
+				return (m_shouldExit || !m_queue.empty());
+			});
+
+			if (m_queue.empty())
+			{
+				return;
+			}
+
+			callback = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		callback();
+	}
+}
+
+void WorkerPool::Enqueue(const TCallback& callback)
+{
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_queue.push_back(callback);
+	}
+
+	m_wakeCondition.notify_one();
+}
+
+WorkerStrand::WorkerStrand(WorkerPool* pool)
+	: m_pool(pool), m_running(false)
+{
+
+}
+
+void WorkerStrand::Post(const TCallback& callback)
+{
+	bool shouldSchedule = false;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_queue.push_back(callback);
+
+		if (!m_running)
+		{
+			m_running = true;
+			shouldSchedule = true;
+		}
+	}
+
+	if (shouldSchedule)
+	{
+		auto self = shared_from_this();
+
+		m_pool->Enqueue([self] ()
+		{
+			self->Run();
+		});
+	}
+}
+
+void WorkerStrand::Run()
+{
+	// give other strands a chance to run if we keep getting more work
+	static const int MaxCallbacksPerRun = 16;
+
+	for (int i = 0; i < MaxCallbacksPerRun; i++)
+	{
+		TCallback callback;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			if (m_queue.empty())
+			{
+				m_running = false;
+				return;
+			}
+
+			callback = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+
+		callback();
+	}
+
+	// still running, so go to the back of the pool's queue
+	auto self = shared_from_this();
+
+	m_pool->Enqueue([self] ()
+	{
+		self->Run();
+	});
+}
+
+WorkerPool* WorkerPool::GetDefault()
+{
+	// intentionally leaked, as callbacks may still be enqueued during shutdown
+	static WorkerPool* pool = new WorkerPool(std::max(std::thread::hardware_concurrency(), 2u));
+
+	return pool;
+}
+}
@@ -11,21 +11,56 @@
 namespace net
 {
 SequencedInputDatagramChannel::SequencedInputDatagramChannel()
-	: SequencedDatagramChannel()
+	: SequencedDatagramChannel(), m_pendingCount(0), m_maxReorderDelay(0), m_lostPackets(0), m_duplicatePackets(0), m_reorderedPackets(0), m_latePackets(0), m_deliveredHistory(1)
 {
 
 }
 
+void SequencedInputDatagramChannel::SetReorderWindow(size_t packetCount, std::chrono::milliseconds maxDelay)
+{
+	// release anything held in the old window
+	if (m_pendingCount > 0)
+	{
+		SkipTo(GetSequence() + static_cast<uint32_t>(m_pendingPackets.size()));
+	}
+
+	m_pendingPackets.clear();
+	m_pendingPackets.resize(packetCount);
+
+	for (auto& slot : m_pendingPackets)
+	{
+		slot.present = false;
+	}
+
+	m_maxReorderDelay = maxDelay;
+}
+
+SequencedInputDatagramChannel::PendingPacket& SequencedInputDatagramChannel::GetPendingSlot(uint32_t sequence)
+{
+	return m_pendingPackets[sequence % m_pendingPackets.size()];
+}
+
 void SequencedInputDatagramChannel::ProcessPacket(const std::vector<uint8_t>& packet)
 {
-	if (packet.size() <= 4)
+	ProcessPacket(Slice::Borrow(packet.data(), packet.size()));
+}
+
+void SequencedInputDatagramChannel::ProcessPacket(const Slice& packet)
+{
+	ProcessPacket(packet, std::chrono::steady_clock::now());
+}
+
+void SequencedInputDatagramChannel::ProcessPacket(const Slice& packet, TTimePoint now)
+{
+	if (packet.GetLength() <= 4)
 	{
 		return;
 	}
 
-	uint32_t thisSequence = *reinterpret_cast<const uint32_t*>(&packet[0]);
+	uint32_t thisSequence;
+	memcpy(&thisSequence, packet.GetData(), sizeof(thisSequence));
 
-	if (thisSequence == 0xFFFFFFFF)
+	if (thisSequence == OutOfBandSequence)
 	{
 		// TODO: handle OOB requests
 		return;
@@ -33,24 +68,208 @@ void SequencedInputDatagramChannel::ProcessPacket(const std::vector<uint8_t>& pa
 
 	uint32_t lastSequence = GetSequence();
 
-	if (thisSequence <= lastSequence)
+	// compare using the difference, so the sequence can wrap around
+	int32_t distance = static_cast<int32_t>(thisSequence - lastSequence);
+
+	if (distance <= 0)
 	{
-		trace("out-of-order or duplicate packet (%u, %u)\n", thisSequence, lastSequence);
+		uint32_t age = static_cast<uint32_t>(-static_cast<int64_t>(distance));
+
+		// anything older than the history can't be told apart, and is most likely late rather than sent twice
+		if (age < 64 && (m_deliveredHistory & (1ULL << age)) != 0)
+		{
+			m_duplicatePackets++;
+		}
+		else
+		{
+			m_latePackets++;
+
+			if (age < 64)
+			{
+				m_deliveredHistory |= (1ULL << age);
+			}
+		}
+
 		return;
 	}
 
-	if (thisSequence != (lastSequence + 1))
+	Slice payload = packet.SubSlice(4, packet.GetLength() - 4);
+
+	if (m_pendingPackets.empty())
 	{
-		trace("dropped packet (%u, %u)\n", thisSequence, lastSequence);
+		if (distance != 1)
+		{
+			trace("dropped packet (%u, %u)\n", thisSequence, lastSequence);
+
+			uint32_t outOfBandDistance = OutOfBandSequence - lastSequence;
+
+			m_lostPackets += distance - 1;
+
+			// the out-of-band sequence isn't a packet we could've lost
+			if (outOfBandDistance >= 1 && outOfBandDistance < static_cast<uint32_t>(distance))
+			{
+				m_lostPackets--;
+			}
+		}
+
+		Deliver(thisSequence, payload);
 	}
+	else
+	{
+		// if the packet is too far ahead to hold, give up on what it has to skip over
+		if (static_cast<size_t>(distance) > m_pendingPackets.size())
+		{
+			SkipTo(thisSequence - static_cast<uint32_t>(m_pendingPackets.size()));
+		}
+
+		if (thisSequence == GetSequence() + 1)
+		{
+			Deliver(thisSequence, payload);
+			ReleaseInOrder();
+		}
+		else
+		{
+			PendingPacket& slot = GetPendingSlot(thisSequence);
 
-	SetSequence(thisSequence);
+			if (slot.present && slot.sequence == thisSequence)
+			{
+				m_duplicatePackets++;
+			}
+			else
+			{
+				// held packets outlive the caller's buffer
+				slot.data = payload.Retain();
+				slot.sequence = thisSequence;
+				slot.present = true;
+				slot.arrivalTime = now;
 
-	// copy packet and write it back
-	std::vector<uint8_t> nextPacket(packet.size() - 4);
-	memcpy(&nextPacket[0], &packet[4], nextPacket.size());
+				m_pendingCount++;
+			}
+		}
+	}
+
+	Update(now);
+}
+
+void SequencedInputDatagramChannel::Advance(uint32_t sequence, bool delivered)
+{
+	uint32_t shift = sequence - GetSequence();
+
+	m_deliveredHistory = (shift < 64) ? (m_deliveredHistory << shift) : 0;
+
+	if (delivered)
+	{
+		m_deliveredHistory |= 1;
+	}
+
+	SetSequence(sequence);
+
+	// the remote never sends the out-of-band sequence, so there's no point waiting for it
+	if (sequence + 1 == OutOfBandSequence)
+	{
+		Advance(OutOfBandSequence, true);
+	}
+}
+
+void SequencedInputDatagramChannel::Deliver(uint32_t sequence, const Slice& payload)
+{
+	Advance(sequence, true);
+
+	GetSink()->WritePacket(payload);
+}
+
+void SequencedInputDatagramChannel::ReleaseInOrder()
+{
+	while (m_pendingCount > 0)
+	{
+		uint32_t nextSequence = GetSequence() + 1;
+		PendingPacket& slot = GetPendingSlot(nextSequence);
+
+		if (!slot.present || slot.sequence != nextSequence)
+		{
+			break;
+		}
+
+		Slice payload = std::move(slot.data);
+		slot.data = Slice();
+		slot.present = false;
+
+		m_pendingCount--;
+		m_reorderedPackets++;
+
+		Deliver(nextSequence, payload);
+	}
+}
+
+void SequencedInputDatagramChannel::SkipTo(uint32_t sequence)
+{
+	while (static_cast<int32_t>(sequence - GetSequence()) > 0)
+	{
+		uint32_t nextSequence = GetSequence() + 1;
+		PendingPacket& slot = GetPendingSlot(nextSequence);
+
+		if (slot.present && slot.sequence == nextSequence)
+		{
+			ReleaseInOrder();
+		}
+		else
+		{
+			m_lostPackets++;
+
+			Advance(nextSequence, false);
+		}
+	}
+
+	ReleaseInOrder();
+}
+
+void SequencedInputDatagramChannel::Update()
+{
+	Update(std::chrono::steady_clock::now());
+}
+
+void SequencedInputDatagramChannel::Update(TTimePoint now)
+{
+	while (m_pendingCount > 0)
+	{
+		// find the first held packet - everything before it is missing
+		uint32_t sequence = GetSequence() + 2;
+
+		while (!GetPendingSlot(sequence).present || GetPendingSlot(sequence).sequence != sequence)
+		{
+			sequence++;
+		}
+
+		if ((now - GetPendingSlot(sequence).arrivalTime) < m_maxReorderDelay)
+		{
+			break;
+		}
+
+		SkipTo(sequence);
+	}
+}
+
+uint32_t SequencedInputDatagramChannel::GetSelectiveAcks()
+{
+	uint32_t acks = 0;
+
+	if (m_pendingCount == 0)
+	{
+		return acks;
+	}
+
+	for (uint32_t i = 0; i < 32 && (i + 2) <= m_pendingPackets.size(); i++)
+	{
+		uint32_t sequence = GetSequence() + 2 + i;
+		const PendingPacket& slot = GetPendingSlot(sequence);
+
+		if (slot.present && slot.sequence == sequence)
+		{
+			acks |= (1u << i);
+		}
+	}
 
-	GetSink()->WritePacket(nextPacket);
+	return acks;
 }
 }
 
@@ -11,21 +11,74 @@
 namespace net
 {
 SequencedOutputDatagramChannel::SequencedOutputDatagramChannel()
-	: SequencedDatagramChannel()
+	: SequencedDatagramChannel(), m_lossCheckedSequence(0), m_receivedAcknowledgement(false)
 {
 
 }
 
 void SequencedOutputDatagramChannel::WritePacket(const std::vector<uint8_t>& packet)
 {
-	// copy packet and write it back
-	std::vector<uint8_t> nextPacket(packet.size() + 4);
-	memcpy(&nextPacket[4], &packet[0], nextPacket.size());
+	WritePacket(Slice::Borrow(packet.data(), packet.size()));
+}
+
+void SequencedOutputDatagramChannel::WritePacket(const Slice& packet)
+{
+	size_t length = packet.GetLength() + 4;
+
+	// write sequence and packet into a single block
+	BufferPool* pool = BufferPool::GetForSize(length);
+	fwRefContainer<BufferBlock> block = (pool) ? pool->Allocate() : new VectorBufferBlock(std::vector<uint8_t>(length));
 
-	// write sequence to the packet
 	SetSequence(GetSequence() + 1);
-	*reinterpret_cast<uint32_t*>(&nextPacket[0]) = GetSequence();
 
-	GetSink()->WritePacket(nextPacket);
+	if (GetSequence() == OutOfBandSequence)
+	{
+		SetSequence(0);
+	}
+
+	uint32_t sequence = GetSequence();
+	memcpy(block->GetData(), &sequence, sizeof(sequence));
+	memcpy(block->GetData() + 4, packet.GetData(), packet.GetLength());
+
+	GetSink()->WritePacket(Slice(block, 0, length));
+}
+
+void SequencedOutputDatagramChannel::ProcessAcknowledgement(uint32_t ackSequence, uint32_t selectiveAcks)
+{
+	if (!m_receivedAcknowledgement || static_cast<int32_t>(ackSequence - m_lossCheckedSequence) > 0)
+	{
+		m_lossCheckedSequence = ackSequence;
+		m_receivedAcknowledgement = true;
+	}
+
+	if (!m_lossCallback)
+	{
+		return;
+	}
+
+	// the first missing packet is implied, followed by one bit per packet
+	int laterAcks = 0;
+
+	for (uint32_t acks = selectiveAcks; acks; acks &= (acks - 1))
+	{
+		laterAcks++;
+	}
+
+	for (int i = -1; i < 32 && laterAcks >= FastRetransmitThreshold; i++)
+	{
+		uint32_t sequence = ackSequence + 2 + i;
+		bool received = (i >= 0 && (selectiveAcks & (1u << i)) != 0);
+
+		if (received)
+		{
+			laterAcks--;
+		}
+		else if (sequence != OutOfBandSequence && static_cast<int32_t>(sequence - m_lossCheckedSequence) > 0)
+		{
+			m_lossCheckedSequence = sequence;
+
+			m_lossCallback(sequence);
+		}
+	}
 }
 }
\ No newline at end of file
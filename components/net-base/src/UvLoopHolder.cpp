@@ -0,0 +1,329 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "UvLoopHolder.h"
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+
+#include "memdbgon.h"
+
+namespace net
+{
+// destroys holders that lost their last reference on their own loop thread, which can't wait for itself to exit
+class UvLoopTeardownThread
+{
+private:
+	std::thread m_thread;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_wakeCondition;
+
+	std::deque<std::function<void()>> m_queue;
+
+	bool m_shouldExit;
+
+public:
+	UvLoopTeardownThread()
+		: m_shouldExit(false)
+	{
+		m_thread = std::thread([this] ()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			while (true)
+			{
+				m_wakeCondition.wait(lock, [this] () { return m_shouldExit || !m_queue.empty(); });
+
+				if (m_queue.empty())
+				{
+					break;
+				}
+
+				auto teardown = std::move(m_queue.front());
+				m_queue.pop_front();
+
+				lock.unlock();
+				teardown();
+				lock.lock();
+			}
+		});
+	}
+
+	// tears down anything that's still queued before returning
+	~UvLoopTeardownThread()
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_shouldExit = true;
+		}
+
+		m_wakeCondition.notify_one();
+		m_thread.join();
+	}
+
+	void Post(const std::function<void()>& teardown)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queue.push_back(teardown);
+		}
+
+		m_wakeCondition.notify_one();
+	}
+
+	static UvLoopTeardownThread* Get()
+	{
+		static UvLoopTeardownThread thread;
+		return &thread;
+	}
+};
+
+UvLoopHolder::UvLoopHolder(const std::string& loopTag)
+	: m_shouldExit(false), m_activeProducers(0), m_loopTag(loopTag)
+{
+	// initialize the callback queue
+	m_queueStub.next = nullptr;
+	m_queueHead = &m_queueStub;
+	m_queueTail = &m_queueStub;
+
+	ResetCallbackLatencyHistogram();
+
+	// initialize the libuv loop
+	uv_loop_init(&m_loop);
+
+	// assign our pointer to the loop
+	m_loop.data = this;
+
+	// initialize the wake handle - as this stays referenced, the loop will not run out of handles while we live
+	uv_async_init(&m_loop, &m_wakeAsync, [] (uv_async_t* async)
+	{
+		UvLoopHolder* holder = reinterpret_cast<UvLoopHolder*>(async->data);
+
+		holder->RunCallbacks();
+
+		if (holder->m_shouldExit)
+		{
+			holder->m_timerWheel->Close();
+
+			uv_close(reinterpret_cast<uv_handle_t*>(&holder->m_wakeAsync), nullptr);
+			uv_stop(&holder->m_loop);
+		}
+	});
+
+	m_wakeAsync.data = this;
+
+	// 100ms ticks over 600 slots make for a minute per rotation
+	m_timerWheel = std::make_unique<UvTimerWheel>(&m_loop, std::chrono::milliseconds(100), 600);
+
+	// start the loop's runtime thread
+	m_thread = std::thread([=] ()
+	{
+		// run the loop until we're told to stop
+		uv_run(&m_loop, UV_RUN_DEFAULT);
+
+		// nothing gets queued anymore once we're exiting, but some thread may still be midway through queueing
+		while (m_activeProducers.load() != 0)
+		{
+			std::this_thread::yield();
+		}
+
+		// so run whatever got queued before
+		RunCallbacks();
+
+		// give any pending close callbacks a chance to run
+		uv_run(&m_loop, UV_RUN_NOWAIT);
+
+		// clean up the libuv loop
+		uv_loop_close(&m_loop);
+	});
+}
+
+UvLoopHolder::~UvLoopHolder()
+{
+	// mark the thread as needing to exit
+	m_shouldExit = true;
+
+	// wake the loop so it notices
+	uv_async_send(&m_wakeAsync);
+
+	// wait for the thread to exit cleanly - Release makes sure this isn't the thread itself
+	assert(!IsInLoopThread());
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+bool UvLoopHolder::Release()
+{
+	// nobody else holds a reference to add one, so this can't race
+	if (GetRefCount() == 1 && IsInLoopThread())
+	{
+		// let the teardown thread destroy us once this callback returned
+		UvLoopTeardownThread::Get()->Post([this] ()
+		{
+			fwRefCountable::Release();
+		});
+
+		return false;
+	}
+
+	return fwRefCountable::Release();
+}
+
+void UvLoopHolder::PushCallbackNode(CallbackNode* node)
+{
+	node->next.store(nullptr, std::memory_order_relaxed);
+
+	CallbackNode* prev = m_queueHead.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+UvLoopHolder::CallbackNode* UvLoopHolder::PopCallbackNode()
+{
+	CallbackNode* tail = m_queueTail;
+	CallbackNode* next = tail->next.load(std::memory_order_acquire);
+
+	// skip over the stub node
+	if (tail == &m_queueStub)
+	{
+		if (!next)
+		{
+			return nullptr;
+		}
+
+		m_queueTail = next;
+		tail = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if (next)
+	{
+		m_queueTail = next;
+		return tail;
+	}
+
+	// a producer may be midway through pushing - in that case, we'll get woken again once it completes
+	if (tail != m_queueHead.load(std::memory_order_acquire))
+	{
+		return nullptr;
+	}
+
+	// re-insert the stub so the last node can be detached
+	PushCallbackNode(&m_queueStub);
+
+	next = tail->next.load(std::memory_order_acquire);
+
+	if (next)
+	{
+		m_queueTail = next;
+		return tail;
+	}
+
+	return nullptr;
+}
+
+void UvLoopHolder::RunCallbacks()
+{
+	CallbackNode* node;
+
+	while ((node = PopCallbackNode()) != nullptr)
+	{
+		// record the time the callback spent in the queue
+		auto waitTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - node->enqueueTime).count();
+
+		size_t bucket = 0;
+
+		while (bucket < (LatencyBucketCount - 1) && waitTime >= (1LL << bucket))
+		{
+			bucket++;
+		}
+
+		m_latencyHistogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+		// and run it
+		node->callback();
+
+		delete node;
+	}
+}
+
+bool UvLoopHolder::EnqueueCallback(const TCallback& callback)
+{
+	// checked after announcing ourselves, so the loop thread either waits for this push, or we see it's exiting
+	m_activeProducers++;
+
+	if (m_shouldExit)
+	{
+		m_activeProducers--;
+		return false;
+	}
+
+	CallbackNode* node = new CallbackNode;
+	node->callback = callback;
+	node->enqueueTime = std::chrono::high_resolution_clock::now();
+
+	PushCallbackNode(node);
+
+	uv_async_send(&m_wakeAsync);
+
+	m_activeProducers--;
+	return true;
+}
+
+bool UvLoopHolder::InvokeCallback(const TCallback& callback)
+{
+	if (IsInLoopThread())
+	{
+		callback();
+		return true;
+	}
+
+	std::promise<void> completion;
+
+	bool queued = EnqueueCallback([&] ()
+	{
+		callback();
+
+		completion.set_value();
+	});
+
+	// anything that got queued is guaranteed to run, even while exiting
+	if (queued)
+	{
+		completion.get_future().wait();
+	}
+
+	return queued;
+}
+
+UvLoopHolder::TLatencyHistogram UvLoopHolder::GetCallbackLatencyHistogram() const
+{
+	TLatencyHistogram histogram;
+
+	for (size_t i = 0; i < LatencyBucketCount; i++)
+	{
+		histogram[i] = m_latencyHistogram[i].load(std::memory_order_relaxed);
+	}
+
+	return histogram;
+}
+
+void UvLoopHolder::ResetCallbackLatencyHistogram()
+{
+	for (auto& bucket : m_latencyHistogram)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+}
+}
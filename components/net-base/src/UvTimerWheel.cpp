@@ -0,0 +1,190 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "UvTimerWheel.h"
+
+#include "memdbgon.h"
+
+namespace net
+{
+UvWheelTimer::UvWheelTimer()
+	: m_prev(nullptr), m_next(nullptr), m_wheel(nullptr), m_expiryTick(0)
+{
+
+}
+
+UvWheelTimer::~UvWheelTimer()
+{
+	Stop();
+}
+
+void UvWheelTimer::Unlink()
+{
+	m_prev->m_next = m_next;
+	m_next->m_prev = m_prev;
+
+	m_prev = nullptr;
+	m_next = nullptr;
+}
+
+void UvWheelTimer::Stop()
+{
+	if (!m_wheel)
+	{
+		return;
+	}
+
+	Unlink();
+
+	// let the loop sleep if nothing is waiting
+	if (--m_wheel->m_activeTimers == 0)
+	{
+		uv_timer_stop(&m_wheel->m_tickTimer);
+	}
+
+	m_wheel = nullptr;
+
+	// the callback may hold the last reference to whatever owns us, so don't touch the timer once it's released
+	TCallback callback = std::move(m_callback);
+	m_callback = TCallback();
+}
+
+UvTimerWheel::UvTimerWheel(uv_loop_t* loop, std::chrono::milliseconds tickLength, size_t slotCount)
+	: m_loop(loop), m_tickLength(std::max<uint64_t>(tickLength.count(), 1)), m_slots(slotCount), m_activeTimers(0)
+{
+	for (auto& slot : m_slots)
+	{
+		slot.m_prev = &slot;
+		slot.m_next = &slot;
+	}
+
+	m_currentTick = uv_now(loop) / m_tickLength;
+
+	uv_timer_init(loop, &m_tickTimer);
+	m_tickTimer.data = this;
+
+	// timeouts on their own shouldn't keep the loop alive
+	uv_unref(reinterpret_cast<uv_handle_t*>(&m_tickTimer));
+}
+
+UvTimerWheel::~UvTimerWheel()
+{
+	for (auto& slot : m_slots)
+	{
+		while (slot.m_next != &slot)
+		{
+			slot.m_next->Stop();
+		}
+
+		slot.m_prev = nullptr;
+		slot.m_next = nullptr;
+	}
+}
+
+void UvTimerWheel::Close()
+{
+	uv_close(reinterpret_cast<uv_handle_t*>(&m_tickTimer), nullptr);
+}
+
+void UvTimerWheel::Start(UvWheelTimer* timer, std::chrono::milliseconds timeout, const UvWheelTimer::TCallback& callback)
+{
+	timer->Stop();
+
+	uint64_t nowTick = uv_now(m_loop) / m_tickLength;
+
+	// nothing to expire while idle, so just catch up
+	if (m_activeTimers == 0)
+	{
+		m_currentTick = nowTick;
+	}
+
+	uint64_t ticks = (static_cast<uint64_t>(timeout.count()) + m_tickLength - 1) / m_tickLength;
+
+	timer->m_expiryTick = std::max(nowTick, m_currentTick) + std::max<uint64_t>(ticks, 1);
+	timer->m_callback = callback;
+	timer->m_wheel = this;
+
+	Link(timer);
+
+	if (m_activeTimers++ == 0)
+	{
+		uv_timer_start(&m_tickTimer, [] (uv_timer_t* handle)
+		{
+			reinterpret_cast<UvTimerWheel*>(handle->data)->OnTick();
+		}, m_tickLength, m_tickLength);
+	}
+}
+
+void UvTimerWheel::Link(UvWheelTimer* timer)
+{
+	UvWheelTimer* slot = &m_slots[timer->m_expiryTick % m_slots.size()];
+
+	timer->m_prev = slot->m_prev;
+	timer->m_next = slot;
+
+	slot->m_prev->m_next = timer;
+	slot->m_prev = timer;
+}
+
+void UvTimerWheel::OnTick()
+{
+	// libuv timers can fire late, so catch up on any ticks we missed
+	AdvanceTo(uv_now(m_loop) / m_tickLength);
+}
+
+void UvTimerWheel::AdvanceTo(uint64_t tick)
+{
+	while (m_currentTick < tick && m_activeTimers > 0)
+	{
+		m_currentTick++;
+
+		UvWheelTimer* slot = &m_slots[m_currentTick % m_slots.size()];
+
+		if (slot->m_next == slot)
+		{
+			continue;
+		}
+
+		// move the slot's timers to a local list, as callbacks may stop or start any timer
+		UvWheelTimer pending;
+		pending.m_next = slot->m_next;
+		pending.m_prev = slot->m_prev;
+		pending.m_next->m_prev = &pending;
+		pending.m_prev->m_next = &pending;
+
+		slot->m_next = slot;
+		slot->m_prev = slot;
+
+		while (pending.m_next != &pending)
+		{
+			UvWheelTimer* timer = pending.m_next;
+			timer->Unlink();
+
+			// timers further away than a full rotation share the slot
+			if (timer->m_expiryTick > m_currentTick)
+			{
+				Link(timer);
+				continue;
+			}
+
+			UvWheelTimer::TCallback callback = std::move(timer->m_callback);
+			timer->m_callback = UvWheelTimer::TCallback();
+			timer->m_wheel = nullptr;
+
+			m_activeTimers--;
+
+			callback();
+		}
+	}
+
+	if (m_activeTimers == 0)
+	{
+		uv_timer_stop(&m_tickTimer);
+	}
+}
+}
@@ -0,0 +1,387 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "UvUdpSocket.h"
+#include "UvLoopManager.h"
+
+#include "memdbgon.h"
+
+// recvmmsg support got made opt-in (using uv_udp_init_ex) in libuv 1.40
+#if UV_VERSION_HEX >= ((1 << 16) | (40 << 8))
+#define UV_UDP_HAS_RECVMMSG
+#endif
+
+namespace net
+{
+// the largest datagram libuv will read into a buffer, and the size of each recvmmsg chunk
+static const size_t MaxDatagramSize = 65536;
+
+// datagrams up to this size get copied into a block of their own size, so retaining them doesn't pin the receive block
+static const size_t MaxCopiedDatagramSize = 16384;
+
+// a send that couldn't complete immediately, keeping the data alive until it did
+struct UvUdpSendReq
+{
+	uv_udp_send_t req;
+
+	Slice data;
+};
+
+UvUdpSocket::UvUdpSocket(const fwRefContainer<UvLoopHolder>& loop)
+	: m_loop(loop), m_usingMultipleMessages(false)
+{
+
+}
+
+UvUdpSocket::~UvUdpSocket()
+{
+	Close();
+}
+
+#ifdef SO_REUSEPORT
+static bool OpenReusePortSocket(uv_udp_t* handle, const PeerAddress& bindAddress)
+{
+	PlatformSocketType socketHandle = socket(bindAddress.GetAddressFamily(), SOCK_DGRAM, IPPROTO_UDP);
+
+	if (socketHandle < 0)
+	{
+		trace("Could not create a UDP socket - error code %d.\n", GetLastNetError());
+		return false;
+	}
+
+	// allow multiple sockets to bind to the same address - the kernel will distribute incoming datagrams between them
+	int on = 1;
+
+	if (setsockopt(socketHandle, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&on), sizeof(on)) != 0)
+	{
+		trace("Could not set SO_REUSEPORT on a UDP socket - error code %d.\n", GetLastNetError());
+
+		closesocket(socketHandle);
+		return false;
+	}
+
+	int result = uv_udp_open(handle, socketHandle);
+
+	if (result != 0)
+	{
+		trace("Could not open a UDP socket - libuv error %s.\n", uv_strerror(result));
+
+		closesocket(socketHandle);
+		return false;
+	}
+
+	return true;
+}
+#endif
+
+bool UvUdpSocket::Bind(const PeerAddress& bindAddress, const TReceiveCallback& callback, bool reusePort)
+{
+	bool bound = false;
+
+	m_loop->InvokeCallback([&] ()
+	{
+		if (m_handle)
+		{
+			trace("UDP socket for %s is already bound.\n", bindAddress.ToString().c_str());
+			return;
+		}
+
+		m_receiveCallback = callback;
+
+		std::unique_ptr<uv_udp_t> handle = std::make_unique<uv_udp_t>();
+
+#ifdef UV_UDP_HAS_RECVMMSG
+		uv_udp_init_ex(m_loop->GetLoop(), handle.get(), UV_UDP_RECVMMSG);
+#else
+		uv_udp_init(m_loop->GetLoop(), handle.get());
+#endif
+
+		handle->data = this;
+
+#ifdef SO_REUSEPORT
+		if (reusePort && !OpenReusePortSocket(handle.get(), bindAddress))
+		{
+			UvClose(std::move(handle));
+			return;
+		}
+#else
+		if (reusePort)
+		{
+			trace("SO_REUSEPORT is not supported on this platform - %s will only be bound once.\n", bindAddress.ToString().c_str());
+		}
+#endif
+
+		int result = uv_udp_bind(handle.get(), bindAddress.GetSocketAddress(), 0);
+
+		if (result == 0)
+		{
+			result = uv_udp_recv_start(handle.get(), [] (uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buffer)
+			{
+				reinterpret_cast<UvUdpSocket*>(handle->data)->OnAllocate(suggestedSize, buffer);
+			}, [] (uv_udp_t* handle, ssize_t length, const uv_buf_t* buffer, const sockaddr* address, unsigned int flags)
+			{
+				reinterpret_cast<UvUdpSocket*>(handle->data)->OnReceive(length, buffer, address, flags);
+			});
+		}
+
+		if (result != 0)
+		{
+			trace("Could not bind a UDP socket to %s - libuv error %s.\n", bindAddress.ToString().c_str(), uv_strerror(result));
+
+			UvClose(std::move(handle));
+			return;
+		}
+
+#ifdef UV_UDP_HAS_RECVMMSG
+		m_usingMultipleMessages = (uv_udp_using_recvmmsg(handle.get()) != 0);
+#endif
+
+		m_handle = std::move(handle);
+		bound = true;
+	});
+
+	return bound;
+}
+
+PeerAddress UvUdpSocket::GetLocalAddress()
+{
+	sockaddr_storage addr = { 0 };
+	int addrlen = sizeof(addr);
+
+	m_loop->InvokeCallback([&] ()
+	{
+		if (m_handle)
+		{
+			uv_udp_getsockname(m_handle.get(), reinterpret_cast<sockaddr*>(&addr), &addrlen);
+		}
+	});
+
+	return PeerAddress(reinterpret_cast<sockaddr*>(&addr), addrlen);
+}
+
+void UvUdpSocket::OnAllocate(size_t suggestedSize, uv_buf_t* buffer)
+{
+	// keep receiving into the same block, unless a large datagram in it got retained
+	if (!m_receiveBlock.GetRef() || m_receiveBlock->GetRefCount() > 1)
+	{
+		// recvmmsg needs a contiguous buffer, but never gives out slices of it, so this only gets allocated once
+		if (m_usingMultipleMessages)
+		{
+			m_receiveBlock = new VectorBufferBlock(std::vector<uint8_t>(MaxDatagramSize * MultipleMessageCount));
+		}
+		else
+		{
+			m_receiveBlock = BufferPool::GetForSize(MaxDatagramSize)->Allocate();
+		}
+	}
+
+	*buffer = uv_buf_init(reinterpret_cast<char*>(m_receiveBlock->GetData()), static_cast<unsigned int>(m_receiveBlock->GetCapacity()));
+}
+
+void UvUdpSocket::OnReceive(ssize_t length, const uv_buf_t* buffer, const sockaddr* address, unsigned int flags)
+{
+	if (length < 0)
+	{
+		trace("Failed to receive from a UDP socket - libuv error %s.\n", uv_strerror(static_cast<int>(length)));
+		return;
+	}
+
+	// no address means there was nothing (more) to read - this also marks the end of a recvmmsg batch
+	if (!address || !m_receiveCallback)
+	{
+		return;
+	}
+
+	socklen_t addressLength = (address->sa_family == AF_INET6) ? sizeof(sockaddr_in6) : sizeof(sockaddr_in);
+
+	// large datagrams fill most of a pooled block anyway, so those get handed out without copying
+	if (length > MaxCopiedDatagramSize && !m_usingMultipleMessages)
+	{
+		size_t offset = reinterpret_cast<uint8_t*>(buffer->base) - m_receiveBlock->GetData();
+
+		m_receiveCallback(Slice(m_receiveBlock, offset, length), PeerAddress(address, addressLength));
+		return;
+	}
+
+	m_receiveCallback(Slice::Copy(buffer->base, length), PeerAddress(address, addressLength));
+}
+
+void UvUdpSocket::SendTo(const Slice& data, const PeerAddress& address)
+{
+	if (m_loop->IsInLoopThread())
+	{
+		SendOnLoop(data, address);
+		return;
+	}
+
+	fwRefContainer<UvUdpSocket> thisRef = this;
+	Slice retainedData = data.Retain();
+
+	m_loop->EnqueueCallback([thisRef, retainedData, address] ()
+	{
+		thisRef->SendOnLoop(retainedData, address);
+	});
+}
+
+void UvUdpSocket::SendOnLoop(const Slice& data, const PeerAddress& address)
+{
+	if (!m_handle)
+	{
+		return;
+	}
+
+	uv_buf_t buffer = uv_buf_init(const_cast<char*>(reinterpret_cast<const char*>(data.GetData())), static_cast<unsigned int>(data.GetLength()));
+
+	// most sends complete immediately - this fails with EAGAIN if earlier sends are still queued, which keeps the order
+	int result = uv_udp_try_send(m_handle.get(), &buffer, 1, address.GetSocketAddress());
+
+	if (result >= 0)
+	{
+		return;
+	}
+
+	if (result != UV_EAGAIN && result != UV_ENOSYS)
+	{
+		trace("Failed to send to %s - libuv error %s.\n", address.ToString().c_str(), uv_strerror(result));
+		return;
+	}
+
+	UvUdpSendReq* req = new UvUdpSendReq;
+	req->data = data.Retain();
+
+	buffer = uv_buf_init(const_cast<char*>(reinterpret_cast<const char*>(req->data.GetData())), static_cast<unsigned int>(req->data.GetLength()));
+
+	result = uv_udp_send(&req->req, m_handle.get(), &buffer, 1, address.GetSocketAddress(), [] (uv_udp_send_t* sendReq, int status)
+	{
+		delete reinterpret_cast<UvUdpSendReq*>(sendReq);
+	});
+
+	if (result != 0)
+	{
+		trace("Failed to send to %s - libuv error %s.\n", address.ToString().c_str(), uv_strerror(result));
+
+		delete req;
+	}
+}
+
+void UvUdpSocket::Close()
+{
+	m_loop->InvokeCallback([=] ()
+	{
+		CloseOnLoop();
+	});
+}
+
+void UvUdpSocket::CloseOnLoop()
+{
+	if (m_handle)
+	{
+		// closing the handle stops receiving, so no more callbacks will point at us
+		uv_udp_recv_stop(m_handle.get());
+
+		UvClose(std::move(m_handle));
+	}
+
+	m_receiveCallback = TReceiveCallback();
+	m_receiveBlock = nullptr;
+}
+
+UvUdpSocketGroup::UvUdpSocketGroup(const std::string& loopTag, int loopCount)
+{
+	int socketCount = 1;
+
+#ifdef SO_REUSEPORT
+	socketCount = std::max(loopCount, 1);
+#else
+	if (loopCount > 1)
+	{
+		trace("SO_REUSEPORT is not supported on this platform - UDP sockets on %s will only use a single loop.\n", loopTag.c_str());
+	}
+#endif
+
+	for (int i = 0; i < socketCount; i++)
+	{
+		std::string socketLoopTag = (i == 0) ? loopTag : loopTag + "_" + std::to_string(i);
+
+		m_sockets.push_back(new UvUdpSocket(Instance<UvLoopManager>::Get()->GetOrCreate(socketLoopTag)));
+	}
+}
+
+UvUdpSocketGroup::~UvUdpSocketGroup()
+{
+	Close();
+}
+
+bool UvUdpSocketGroup::Bind(const PeerAddress& bindAddress, const UvUdpSocket::TReceiveCallback& callback)
+{
+	bool reusePort = (m_sockets.size() > 1);
+
+	for (auto& socket : m_sockets)
+	{
+		if (!socket->Bind(bindAddress, callback, reusePort))
+		{
+			Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// hashes the parts of an address identifying a peer (FNV-1a)
+static size_t HashPeerAddress(const PeerAddress& address)
+{
+	const sockaddr* sa = address.GetSocketAddress();
+
+	const uint8_t* bytes;
+	size_t length;
+	uint16_t port;
+
+	if (sa->sa_family == AF_INET6)
+	{
+		const sockaddr_in6* in6 = reinterpret_cast<const sockaddr_in6*>(sa);
+
+		bytes = reinterpret_cast<const uint8_t*>(&in6->sin6_addr);
+		length = sizeof(in6->sin6_addr);
+		port = in6->sin6_port;
+	}
+	else
+	{
+		const sockaddr_in* in4 = reinterpret_cast<const sockaddr_in*>(sa);
+
+		bytes = reinterpret_cast<const uint8_t*>(&in4->sin_addr);
+		length = sizeof(in4->sin_addr);
+		port = in4->sin_port;
+	}
+
+	uint32_t hash = 2166136261u;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+
+	hash = (hash ^ (port & 0xFF)) * 16777619u;
+	hash = (hash ^ (port >> 8)) * 16777619u;
+
+	return hash;
+}
+
+void UvUdpSocketGroup::SendTo(const Slice& data, const PeerAddress& address)
+{
+	m_sockets[HashPeerAddress(address) % m_sockets.size()]->SendTo(data, address);
+}
+
+void UvUdpSocketGroup::Close()
+{
+	for (auto& socket : m_sockets)
+	{
+		socket->Close();
+	}
+}
+}
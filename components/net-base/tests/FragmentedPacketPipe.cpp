@@ -0,0 +1,170 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <FragmentedPacketPipe.h>
+
+using namespace net;
+
+class RecordingPipe : public NetPipe
+{
+public:
+	std::vector<Buffer> packets;
+
+	virtual void Reset() override
+	{
+		packets.clear();
+	}
+
+	virtual void PassPacket(Buffer data) override
+	{
+		packets.push_back(std::move(data));
+	}
+};
+
+static std::vector<uint8_t> MakePayload(size_t length, uint8_t seed)
+{
+	std::vector<uint8_t> payload(length);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		payload[i] = static_cast<uint8_t>((i * 31) + seed);
+	}
+
+	return payload;
+}
+
+// fragments a packet the way a remote pipe would
+static std::vector<Buffer> Fragment(const std::vector<uint8_t>& payload)
+{
+	fwRefContainer<RecordingPipe> outgoing = new RecordingPipe();
+	fwRefContainer<FragmentedPacketPipe> sender = new FragmentedPacketPipe(outgoing, new RecordingPipe());
+
+	sender->PassPacket(Buffer(payload));
+
+	return outgoing->packets;
+}
+
+TEST(FragmentedPacketPipe, ReassemblesFragmentsInAnyOrder)
+{
+	fwRefContainer<RecordingPipe> incoming = new RecordingPipe();
+	fwRefContainer<FragmentedPacketPipe> receiver = new FragmentedPacketPipe(new RecordingPipe(), incoming);
+
+	std::vector<uint8_t> payload = MakePayload(10000, 1);
+	std::vector<Buffer> fragments = Fragment(payload);
+
+	ASSERT_GT(fragments.size(), 1);
+
+	for (auto it = fragments.rbegin(); it != fragments.rend(); it++)
+	{
+		receiver->PassIncomingPacket(*it);
+	}
+
+	ASSERT_EQ(1, incoming->packets.size());
+	EXPECT_EQ(payload, incoming->packets[0].ToVector());
+	EXPECT_EQ(0, receiver->GetReassemblyMemory());
+}
+
+TEST(FragmentedPacketPipe, IgnoresPacketsClaimingToExceedTheMaximumSize)
+{
+	fwRefContainer<FragmentedPacketPipe> receiver = new FragmentedPacketPipe(new RecordingPipe(), new RecordingPipe());
+
+	// a single small fragment claiming to be the first of 65535
+	Buffer fragment;
+	fragment.Write<uint8_t>(1);
+	fragment.Write<uint16_t>(0);
+	fragment.Write<uint16_t>(0);
+	fragment.Write<uint16_t>(65535);
+	fragment.Write<uint16_t>(16);
+	fragment.Write(MakePayload(16, 0).data(), 16);
+
+	receiver->PassIncomingPacket(fragment);
+
+	EXPECT_EQ(0, receiver->GetPendingPacketCount());
+	EXPECT_EQ(0, receiver->GetReassemblyMemory());
+}
+
+TEST(FragmentedPacketPipe, GrowsReassemblyWithReceivedFragments)
+{
+	fwRefContainer<RecordingPipe> incoming = new RecordingPipe();
+	fwRefContainer<FragmentedPacketPipe> receiver = new FragmentedPacketPipe(new RecordingPipe(), incoming);
+
+	std::vector<uint8_t> payload = MakePayload(60000, 2);
+	std::vector<Buffer> fragments = Fragment(payload);
+
+	receiver->PassIncomingPacket(fragments[0]);
+
+	EXPECT_EQ(1, receiver->GetPendingPacketCount());
+	EXPECT_LT(receiver->GetReassemblyMemory(), payload.size());
+
+	for (size_t i = 1; i < fragments.size(); i++)
+	{
+		receiver->PassIncomingPacket(fragments[i]);
+	}
+
+	ASSERT_EQ(1, incoming->packets.size());
+	EXPECT_EQ(payload, incoming->packets[0].ToVector());
+}
+
+TEST(FragmentedPacketPipe, MemoryLimitEvictsOldestPacket)
+{
+	fwRefContainer<RecordingPipe> incoming = new RecordingPipe();
+	fwRefContainer<FragmentedPacketPipe> receiver = new FragmentedPacketPipe(new RecordingPipe(), incoming);
+
+	const size_t memoryLimit = 90 * 1024;
+	receiver->SetMaxReassemblyMemory(memoryLimit);
+
+	auto now = std::chrono::steady_clock::now();
+
+	std::vector<uint8_t> payloads[3] = { MakePayload(60000, 3), MakePayload(60000, 4), MakePayload(60000, 5) };
+	std::vector<Buffer> fragments[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		// the message id is in the header, so give each packet its own
+		fragments[i] = Fragment(payloads[i]);
+
+		for (auto& fragment : fragments[i])
+		{
+			const_cast<uint8_t*>(fragment.GetBuffer())[1] = static_cast<uint8_t>(i);
+		}
+	}
+
+	// start all three, so each only has a small block
+	for (int i = 0; i < 3; i++)
+	{
+		receiver->PassIncomingPacket(fragments[i][0], now + std::chrono::milliseconds(i));
+	}
+
+	EXPECT_EQ(3, receiver->GetPendingPacketCount());
+	EXPECT_LE(receiver->GetReassemblyMemory(), memoryLimit);
+
+	// completing the newest packet needs its full size, which pushes out the oldest
+	for (size_t f = 1; f < fragments[2].size(); f++)
+	{
+		receiver->PassIncomingPacket(fragments[2][f], now + std::chrono::milliseconds(10));
+
+		EXPECT_LE(receiver->GetReassemblyMemory(), memoryLimit);
+	}
+
+	ASSERT_EQ(1, incoming->packets.size());
+	EXPECT_EQ(payloads[2], incoming->packets[0].ToVector());
+
+	EXPECT_EQ(1, receiver->GetEvictedPacketCount());
+	EXPECT_EQ(1, receiver->GetPendingPacketCount());
+
+	// the packet that got pushed out never completes
+	for (size_t f = 1; f < fragments[0].size(); f++)
+	{
+		receiver->PassIncomingPacket(fragments[0][f], now + std::chrono::milliseconds(20));
+	}
+
+	EXPECT_EQ(1, incoming->packets.size());
+}
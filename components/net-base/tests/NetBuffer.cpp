@@ -0,0 +1,218 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <ConcatPipe.h>
+#include <NetBuffer.h>
+#include <NetBufferPool.h>
+
+#include <numeric>
+
+using namespace net;
+
+static std::vector<uint8_t> MakeBytes(size_t length)
+{
+	std::vector<uint8_t> bytes(length);
+	std::iota(bytes.begin(), bytes.end(), 0);
+
+	return bytes;
+}
+
+TEST(NetBuffer, GrowsFromInlineIntoABlock)
+{
+	std::vector<uint8_t> bytes = MakeBytes(Buffer::InlineCapacity + 1);
+
+	Buffer buffer;
+	buffer.Write(bytes.data(), Buffer::InlineCapacity);
+
+	EXPECT_FALSE(buffer.IsShared());
+
+	// the byte that doesn't fit moves everything into a block
+	buffer.Write(&bytes[Buffer::InlineCapacity], 1);
+
+	EXPECT_TRUE(buffer.IsShared());
+	EXPECT_EQ(bytes, buffer.ToVector());
+}
+
+TEST(NetBuffer, CopiesShareBlocksUntilGrown)
+{
+	std::vector<uint8_t> bytes = MakeBytes(200);
+
+	Buffer original(bytes);
+	Buffer copy(original);
+
+	EXPECT_EQ(original.GetBuffer(), copy.GetBuffer());
+	EXPECT_EQ(0, copy.GetCurOffset());
+
+	// growing the copy gets it its own block, leaving the original alone
+	std::vector<uint8_t> skipped(bytes.size());
+	copy.Read(skipped.data(), skipped.size());
+	copy.Write<uint8_t>(0xFF);
+
+	EXPECT_NE(original.GetBuffer(), copy.GetBuffer());
+	EXPECT_EQ(bytes, original.ToVector());
+
+	bytes.push_back(0xFF);
+	EXPECT_EQ(bytes, copy.ToVector());
+}
+
+TEST(NetBuffer, ReadToAnEmptyBufferViewsTheData)
+{
+	Buffer buffer(MakeBytes(300));
+	buffer.Read<uint32_t>();
+
+	Buffer view;
+	ASSERT_TRUE(buffer.ReadTo(view, 200));
+
+	EXPECT_EQ(buffer.GetBuffer() + 4, view.GetBuffer());
+	EXPECT_EQ(200, view.GetLength());
+	EXPECT_EQ(204, buffer.GetCurOffset());
+
+	// small reads are cheaper to copy than to keep the block alive for
+	Buffer smallCopy;
+	ASSERT_TRUE(buffer.ReadTo(smallCopy, 16));
+
+	EXPECT_FALSE(smallCopy.IsShared());
+	EXPECT_EQ(buffer.GetBuffer()[204], smallCopy.GetBuffer()[0]);
+
+	// reading into a buffer with data in it appends a copy
+	Buffer appended(MakeBytes(8));
+	appended.Read<uint64_t>();
+
+	ASSERT_TRUE(buffer.ReadTo(appended, 50));
+
+	EXPECT_EQ(58, appended.GetLength());
+	EXPECT_EQ(0, memcmp(appended.GetBuffer() + 8, buffer.GetBuffer() + 220, 50));
+
+	// and nothing gets read past the end
+	Buffer tooLong;
+	EXPECT_FALSE(buffer.ReadTo(tooLong, buffer.GetRemainingBytes() + 1));
+}
+
+TEST(NetBuffer, MovesTakeTheData)
+{
+	Buffer large(MakeBytes(500));
+	const uint8_t* largeData = large.GetBuffer();
+
+	Buffer movedLarge(std::move(large));
+
+	EXPECT_EQ(largeData, movedLarge.GetBuffer());
+	EXPECT_EQ(0, large.GetLength());
+	EXPECT_FALSE(large.IsShared());
+
+	// inline data has to be copied along
+	Buffer small(MakeBytes(10));
+
+	Buffer movedSmall;
+	movedSmall = std::move(small);
+
+	EXPECT_EQ(MakeBytes(10), movedSmall.ToVector());
+	EXPECT_EQ(0, small.GetLength());
+
+	// vectors get adopted rather than copied
+	std::vector<uint8_t> bytes = MakeBytes(1000);
+	const uint8_t* vectorData = bytes.data();
+
+	Buffer adopted(std::move(bytes));
+
+	EXPECT_EQ(vectorData, adopted.GetBuffer());
+}
+
+// forwards packets, taking them by value as every pipe does
+class ForwardingPipe : public NetPipe
+{
+private:
+	fwRefContainer<NetPipe> m_target;
+
+public:
+	ForwardingPipe(const fwRefContainer<NetPipe>& target)
+		: m_target(target)
+	{
+
+	}
+
+	virtual void Reset() override
+	{
+
+	}
+
+	virtual void PassPacket(Buffer data) override
+	{
+		m_target->PassPacket(std::move(data));
+	}
+};
+
+class CountingPipe : public NetPipe
+{
+public:
+	size_t packets = 0;
+
+	size_t bytes = 0;
+
+	virtual void Reset() override
+	{
+
+	}
+
+	virtual void PassPacket(Buffer data) override
+	{
+		packets++;
+		bytes += data.GetLength();
+	}
+};
+
+// not a pass/fail benchmark, but it fails if a pipe chain allocates at steady state
+TEST(NetBuffer, PipeChainBenchmark)
+{
+	const size_t packetLength = 600;
+	const int warmupPackets = 1000;
+	const int measuredPackets = 100000;
+
+	fwRefContainer<CountingPipe> left = new CountingPipe();
+	fwRefContainer<CountingPipe> right = new CountingPipe();
+
+	// concatenating pairs of packets, passing them through a few stages and splitting them up again
+	fwRefContainer<NetPipe> chain = new ConcatInputPipe(left, right);
+
+	for (int i = 0; i < 3; i++)
+	{
+		chain = new ForwardingPipe(chain);
+	}
+
+	chain = new ConcatOutputPipe(chain);
+
+	Buffer packet(MakeBytes(packetLength));
+
+	for (int i = 0; i < warmupPackets; i++)
+	{
+		chain->PassPacket(packet);
+	}
+
+	BufferPool* pool = BufferPool::GetForSize((packetLength * 2) + 2);
+	uint64_t heapAllocations = pool->GetHeapAllocationCount();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < measuredPackets; i++)
+	{
+		chain->PassPacket(packet);
+	}
+
+	auto elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	EXPECT_EQ((warmupPackets + measuredPackets) / 2, left->packets);
+	EXPECT_EQ(left->packets * packetLength, right->bytes);
+
+	double allocationsPerPacket = double(pool->GetHeapAllocationCount() - heapAllocations) / measuredPackets;
+	double nanosecondsPerPacket = double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / measuredPackets;
+
+	printf("%d packets through the pipe chain: %.1f ns and %.4f block allocations per packet\n", measuredPackets, nanosecondsPerPacket, allocationsPerPacket);
+
+	EXPECT_EQ(0, pool->GetHeapAllocationCount() - heapAllocations);
+}
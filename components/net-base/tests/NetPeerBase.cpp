@@ -0,0 +1,190 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <NetPeerBase.h>
+#include <PeerMessages.h>
+
+using namespace net;
+
+static int g_receivedTests;
+
+// where the last test message's payload was read from
+static const uint8_t* g_lastTestData;
+
+class TestPeerHandler : public PeerHandler
+{
+public:
+	TestPeerHandler()
+	{
+		RegisterType(MessageType("msgTest"), [] (PeerBase*, Buffer& buffer)
+		{
+			g_receivedTests++;
+			g_lastTestData = buffer.GetBuffer();
+		}, [] (PeerBase*, Buffer&)
+		{
+
+		});
+	}
+};
+
+// sets up a peer sending to another
+struct PeerPair
+{
+	fwRefContainer<PeerBase> sender;
+
+	fwRefContainer<PeerBase> receiver;
+
+	// packets the sender sent, if kept in a block of their own before the receiver got them
+	std::vector<Slice> retainedPackets;
+
+	bool retainPackets;
+
+	PeerPair()
+		: retainPackets(false)
+	{
+		receiver = new PeerBase(new FunctionDatagramSink([] (const Slice&)
+		{
+
+		}));
+
+		PeerBase* receiverPtr = receiver.GetRef();
+
+		sender = new PeerBase(new FunctionDatagramSink([=] (const Slice& packet)
+		{
+			if (retainPackets)
+			{
+				retainedPackets.push_back(packet.Retain());
+				receiverPtr->ProcessPacket(retainedPackets.back());
+
+				return;
+			}
+
+			receiverPtr->ProcessPacket(packet);
+		}));
+
+		sender->RegisterHandler<TestPeerHandler>();
+		receiver->RegisterHandler<TestPeerHandler>();
+
+		g_receivedTests = 0;
+		g_lastTestData = nullptr;
+	}
+
+	void SendTest(int wireType, size_t payloadLength = 4)
+	{
+		Buffer buffer;
+		buffer.Write<uint8_t>(static_cast<uint8_t>(wireType));
+
+		std::vector<uint8_t> payload(payloadLength);
+		buffer.Write(payload.data(), payload.size());
+
+		sender->SendPacket(buffer);
+	}
+};
+
+TEST(PeerBase, MappingPacketEnablesDispatch)
+{
+	PeerPair peers;
+
+	int wireType = peers.sender->GetWireType(HashMessageName("msgTest"));
+
+	ASSERT_GT(wireType, 0);
+
+	// nothing gets dispatched before the mapping arrived
+	peers.SendTest(wireType);
+
+	EXPECT_EQ(0, g_receivedTests);
+
+	Buffer mapping;
+	peers.sender->WriteMappingPacket(mapping);
+	peers.sender->SendPacket(mapping);
+
+	peers.SendTest(wireType);
+
+	EXPECT_EQ(1, g_receivedTests);
+}
+
+TEST(PeerBase, MappingPacketEndsAtTerminator)
+{
+	PeerPair peers;
+
+	int wireType = peers.sender->GetWireType(HashMessageName("msgTest"));
+
+	// anything past the terminator isn't part of the mapping
+	Buffer mapping;
+	peers.sender->WriteMappingPacket(mapping);
+	mapping.Write<uint8_t>(static_cast<uint8_t>(wireType + 1));
+	mapping.Write<uint32_t>(HashMessageName("msgTest"));
+
+	peers.sender->SendPacket(mapping);
+
+	peers.SendTest(wireType + 1);
+
+	EXPECT_EQ(0, g_receivedTests);
+
+	peers.SendTest(wireType);
+
+	EXPECT_EQ(1, g_receivedTests);
+}
+
+TEST(PeerBase, GeneratedMessageRoundTrip)
+{
+	msg::msgPeerAck::Writer writer;
+	writer.sequence = 1234;
+	writer.selectiveAcks = 0x80000001;
+
+	Buffer buffer;
+	writer.Write(buffer);
+
+	EXPECT_EQ(writer.GetSize(), buffer.GetLength());
+
+	buffer.Reset();
+
+	msg::msgPeerAck::Reader reader(buffer);
+
+	ASSERT_TRUE(reader.IsValid());
+	EXPECT_EQ(1234, reader.GetSequence());
+	EXPECT_EQ(0x80000001, reader.GetSelectiveAcks());
+
+	// a truncated message doesn't parse
+	msg::msgPeerAck::Reader truncated(buffer.GetSubBuffer(0, 6));
+
+	EXPECT_FALSE(truncated.IsValid());
+}
+
+TEST(PeerBase, DispatchReadsOwnedPacketsInPlace)
+{
+	PeerPair peers;
+
+	int wireType = peers.sender->GetWireType(HashMessageName("msgTest"));
+
+	Buffer mapping;
+	peers.sender->WriteMappingPacket(mapping);
+	peers.sender->SendPacket(mapping);
+
+	// a packet in a block of its own gets read from that block, rather than from a copy
+	peers.retainPackets = true;
+	peers.SendTest(wireType, 200);
+
+	ASSERT_EQ(1, g_receivedTests);
+	ASSERT_EQ(1, peers.retainedPackets.size());
+
+	const Slice& packet = peers.retainedPackets[0];
+
+	ASSERT_TRUE(packet.IsOwned());
+	EXPECT_GE(g_lastTestData, packet.GetData());
+	EXPECT_LT(g_lastTestData, packet.GetData() + packet.GetLength());
+
+	// whereas a borrowed one has to be copied, as it's only valid during the call
+	peers.retainPackets = false;
+	peers.SendTest(wireType, 200);
+
+	EXPECT_EQ(2, g_receivedTests);
+}
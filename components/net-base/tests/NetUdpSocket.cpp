@@ -0,0 +1,161 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <NetBufferPool.h>
+#include <NetUdpSocket.h>
+
+using namespace net;
+
+// a socket bound to a free port on the loopback interface
+static fwRefContainer<UdpSocket> MakeLoopbackSocket()
+{
+	fwRefContainer<UdpSocket> socket = new UdpSocket();
+
+	sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	EXPECT_TRUE(socket->Bind(PeerAddress(reinterpret_cast<sockaddr*>(&addr), sizeof(addr))));
+
+	return socket;
+}
+
+static std::vector<UdpDatagram> MakeDatagrams(const std::vector<size_t>& lengths, const PeerAddress& address)
+{
+	std::vector<UdpDatagram> datagrams;
+
+	for (size_t i = 0; i < lengths.size(); i++)
+	{
+		datagrams.push_back({ Slice(std::vector<uint8_t>(lengths[i], static_cast<uint8_t>(i))), address });
+	}
+
+	return datagrams;
+}
+
+// receives datagrams into the array until there are at least the passed amount, returning how many there are
+static size_t ReceiveAtLeast(UdpSocket* socket, std::vector<UdpDatagram>& datagrams, size_t count, size_t maxSize = 2048)
+{
+	size_t received = 0;
+
+	while (received < count)
+	{
+		size_t batchReceived = socket->ReceiveBatch(&datagrams[received], datagrams.size() - received, maxSize);
+
+		if (batchReceived == 0)
+		{
+			break;
+		}
+
+		received += batchReceived;
+	}
+
+	return received;
+}
+
+TEST(UdpSocket, BatchesRoundTripAndReuseBlocks)
+{
+	fwRefContainer<UdpSocket> receiver = MakeLoopbackSocket();
+	fwRefContainer<UdpSocket> sender = MakeLoopbackSocket();
+
+	std::vector<size_t> lengths = { 1, 100, 1200, 2048, 7 };
+	std::vector<UdpDatagram> outgoing = MakeDatagrams(lengths, receiver->GetLocalAddress());
+
+	ASSERT_EQ(outgoing.size(), sender->SendBatch(outgoing.data(), outgoing.size()));
+
+	std::vector<UdpDatagram> incoming(8);
+	ASSERT_EQ(lengths.size(), ReceiveAtLeast(receiver.GetRef(), incoming, lengths.size()));
+
+	std::vector<const uint8_t*> blocks;
+
+	for (size_t i = 0; i < lengths.size(); i++)
+	{
+		EXPECT_EQ(std::vector<uint8_t>(lengths[i], static_cast<uint8_t>(i)), std::vector<uint8_t>(incoming[i].data.begin(), incoming[i].data.end()));
+		EXPECT_EQ(sender->GetLocalAddress().ToString(), incoming[i].address.ToString());
+
+		blocks.push_back(incoming[i].data.GetBlock()->GetData());
+	}
+
+	// a datagram that got retained keeps its block, so the next receive into its slot needs another one
+	Slice retained = incoming[0].data;
+
+	ASSERT_EQ(outgoing.size(), sender->SendBatch(outgoing.data(), outgoing.size()));
+	ASSERT_EQ(lengths.size(), ReceiveAtLeast(receiver.GetRef(), incoming, lengths.size()));
+
+	EXPECT_NE(blocks[0], incoming[0].data.GetBlock()->GetData());
+
+	for (size_t i = 1; i < lengths.size(); i++)
+	{
+		EXPECT_EQ(blocks[i], incoming[i].data.GetBlock()->GetData());
+	}
+}
+
+TEST(UdpSocket, ReceiveBatchDropsTruncatedDatagrams)
+{
+	fwRefContainer<UdpSocket> receiver = MakeLoopbackSocket();
+	fwRefContainer<UdpSocket> sender = MakeLoopbackSocket();
+
+	std::vector<UdpDatagram> outgoing = MakeDatagrams({ 100, 3000, 200 }, receiver->GetLocalAddress());
+
+	ASSERT_EQ(outgoing.size(), sender->SendBatch(outgoing.data(), outgoing.size()));
+
+	std::vector<UdpDatagram> incoming(3);
+	ASSERT_EQ(2, ReceiveAtLeast(receiver.GetRef(), incoming, 2, 1024));
+
+	// the datagrams around the dropped one stay in order
+	EXPECT_EQ(100, incoming[0].data.GetLength());
+	EXPECT_EQ(200, incoming[1].data.GetLength());
+	EXPECT_EQ(2, incoming[1].data.GetData()[0]);
+}
+
+// not a pass/fail benchmark - reports loopback throughput, and how many calls a datagram costs. batches fit a single
+// recvmmsg/sendmmsg call, so on Linux that's also the amount of system calls.
+TEST(UdpSocket, LoopbackBatchBenchmark)
+{
+	fwRefContainer<UdpSocket> receiver = MakeLoopbackSocket();
+	fwRefContainer<UdpSocket> sender = MakeLoopbackSocket();
+
+	const size_t datagramLength = 200;
+	const size_t totalDatagrams = 50000;
+
+	for (size_t batchSize : { 1, 8, 32, 64 })
+	{
+		std::vector<UdpDatagram> outgoing = MakeDatagrams(std::vector<size_t>(batchSize, datagramLength), receiver->GetLocalAddress());
+		std::vector<UdpDatagram> incoming(batchSize);
+
+		size_t sendCalls = 0;
+		size_t receiveCalls = 0;
+		size_t received = 0;
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		while (received < totalDatagrams)
+		{
+			// send no more than one batch ahead, as an overflowing receive buffer would drop datagrams
+			size_t sent = sender->SendBatch(outgoing.data(), outgoing.size());
+			sendCalls++;
+
+			ASSERT_EQ(batchSize, sent);
+
+			for (size_t batchReceived = 0; batchReceived < batchSize; )
+			{
+				batchReceived += receiver->ReceiveBatch(&incoming[batchReceived], batchSize - batchReceived, 2048);
+				receiveCalls++;
+			}
+
+			received += batchSize;
+		}
+
+		auto elapsed = std::chrono::high_resolution_clock::now() - start;
+		double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+
+		printf("batches of %3d: %.0f datagrams/s, %.3f send and %.3f receive calls per datagram\n", static_cast<int>(batchSize),
+			received / seconds, double(sendCalls) / received, double(receiveCalls) / received);
+	}
+}
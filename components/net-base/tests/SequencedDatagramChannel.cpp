@@ -0,0 +1,287 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <NetPeerBase.h>
+#include <SequencedInputDatagramChannel.h>
+#include <SequencedOutputDatagramChannel.h>
+
+using namespace net;
+
+// records the packets written to it, or passes them on
+class RecordingDatagramSink : public DatagramSink
+{
+public:
+	std::vector<std::vector<uint8_t>> packets;
+
+	std::function<void(const std::vector<uint8_t>&)> forward;
+
+	virtual void WritePacket(const std::vector<uint8_t>& packet) override
+	{
+		packets.push_back(packet);
+
+		if (forward)
+		{
+			forward(packet);
+		}
+	}
+};
+
+// lets tests start channels right before the sequence wraps around
+template<typename TChannel>
+class WrappingChannel : public TChannel
+{
+public:
+	using TChannel::SetSequence;
+};
+
+static std::vector<uint8_t> MakePacket(uint32_t sequence)
+{
+	std::vector<uint8_t> packet(8);
+	memcpy(&packet[0], &sequence, sizeof(sequence));
+	memcpy(&packet[4], &sequence, sizeof(sequence));
+
+	return packet;
+}
+
+// the payload of test packets is their own sequence
+static std::vector<uint32_t> GetDeliveredSequences(const fwRefContainer<RecordingDatagramSink>& sink)
+{
+	std::vector<uint32_t> sequences;
+
+	for (auto& packet : sink->packets)
+	{
+		uint32_t sequence;
+		memcpy(&sequence, packet.data(), sizeof(sequence));
+
+		sequences.push_back(sequence);
+	}
+
+	return sequences;
+}
+
+TEST(SequencedInputDatagramChannel, ReorderWindowReleasesInOrder)
+{
+	fwRefContainer<RecordingDatagramSink> sink = new RecordingDatagramSink();
+
+	SequencedInputDatagramChannel channel;
+	channel.SetSink(sink);
+	channel.SetReorderWindow(8, std::chrono::milliseconds(100));
+
+	for (uint32_t sequence : { 1, 3, 4, 2 })
+	{
+		channel.ProcessPacket(MakePacket(sequence));
+	}
+
+	EXPECT_EQ(std::vector<uint32_t>({ 1, 2, 3, 4 }), GetDeliveredSequences(sink));
+	EXPECT_EQ(2, channel.GetReorderedPacketCount());
+	EXPECT_EQ(0, channel.GetLostPacketCount());
+}
+
+TEST(SequencedInputDatagramChannel, ReorderWindowReusesSlots)
+{
+	fwRefContainer<RecordingDatagramSink> sink = new RecordingDatagramSink();
+
+	SequencedInputDatagramChannel channel;
+	channel.SetSink(sink);
+	channel.SetReorderWindow(4, std::chrono::milliseconds(100));
+
+	std::vector<uint32_t> expected;
+
+	// swap every pair, so each slot gets used many times over
+	for (uint32_t sequence = 1; sequence <= 40; sequence += 2)
+	{
+		channel.ProcessPacket(MakePacket(sequence + 1));
+		channel.ProcessPacket(MakePacket(sequence));
+
+		expected.push_back(sequence);
+		expected.push_back(sequence + 1);
+	}
+
+	EXPECT_EQ(expected, GetDeliveredSequences(sink));
+	EXPECT_EQ(0, channel.GetLostPacketCount());
+}
+
+TEST(SequencedInputDatagramChannel, SelectiveAcksReportPacketsPastAGap)
+{
+	fwRefContainer<RecordingDatagramSink> sink = new RecordingDatagramSink();
+
+	SequencedInputDatagramChannel channel;
+	channel.SetSink(sink);
+	channel.SetReorderWindow(33, std::chrono::milliseconds(100));
+
+	EXPECT_EQ(0, channel.GetSelectiveAcks());
+
+	for (uint32_t sequence : { 1, 3, 5, 33 })
+	{
+		channel.ProcessPacket(MakePacket(sequence));
+	}
+
+	EXPECT_EQ(1, channel.GetSequence());
+	EXPECT_EQ((1u << 0) | (1u << 2) | (1u << 30), channel.GetSelectiveAcks());
+
+	// filling the gap moves the acks along
+	channel.ProcessPacket(MakePacket(2));
+
+	EXPECT_EQ(3, channel.GetSequence());
+	EXPECT_EQ((1u << 0) | (1u << 28), channel.GetSelectiveAcks());
+}
+
+TEST(SequencedInputDatagramChannel, LatePacketsAreNotDuplicates)
+{
+	fwRefContainer<RecordingDatagramSink> sink = new RecordingDatagramSink();
+
+	SequencedInputDatagramChannel channel;
+	channel.SetSink(sink);
+	channel.SetReorderWindow(4, std::chrono::milliseconds(10));
+
+	auto now = std::chrono::steady_clock::now();
+
+	channel.ProcessPacket(Slice::Copy(MakePacket(1).data(), 8), now);
+	channel.ProcessPacket(Slice::Copy(MakePacket(3).data(), 8), now);
+
+	// give up on 2
+	channel.Update(now + std::chrono::milliseconds(20));
+
+	EXPECT_EQ(std::vector<uint32_t>({ 1, 3 }), GetDeliveredSequences(sink));
+	EXPECT_EQ(1, channel.GetLostPacketCount());
+
+	channel.ProcessPacket(MakePacket(2));
+
+	EXPECT_EQ(1, channel.GetLatePacketCount());
+	EXPECT_EQ(0, channel.GetDuplicatePacketCount());
+
+	// once it showed up, further copies are duplicates - as is a copy of anything delivered
+	channel.ProcessPacket(MakePacket(2));
+	channel.ProcessPacket(MakePacket(3));
+
+	EXPECT_EQ(1, channel.GetLatePacketCount());
+	EXPECT_EQ(2, channel.GetDuplicatePacketCount());
+	EXPECT_EQ(2, sink->packets.size());
+}
+
+TEST(SequencedOutputDatagramChannel, SelectiveAcksReportLossOnce)
+{
+	fwRefContainer<RecordingDatagramSink> sink = new RecordingDatagramSink();
+
+	SequencedOutputDatagramChannel channel;
+	channel.SetSink(sink);
+
+	std::vector<uint32_t> lost;
+
+	channel.SetLossCallback([&] (uint32_t sequence)
+	{
+		lost.push_back(sequence);
+	});
+
+	// 2 is missing, and only two packets past it arrived so far
+	channel.ProcessAcknowledgement(1, (1u << 0) | (1u << 1));
+
+	EXPECT_TRUE(lost.empty());
+
+	channel.ProcessAcknowledgement(1, (1u << 0) | (1u << 1) | (1u << 2));
+	channel.ProcessAcknowledgement(1, (1u << 0) | (1u << 1) | (1u << 2) | (1u << 3));
+
+	EXPECT_EQ(std::vector<uint32_t>({ 2 }), lost);
+}
+
+TEST(SequencedDatagramChannel, SequenceWrapSkipsOutOfBand)
+{
+	fwRefContainer<RecordingDatagramSink> sentSink = new RecordingDatagramSink();
+	fwRefContainer<RecordingDatagramSink> receivedSink = new RecordingDatagramSink();
+
+	WrappingChannel<SequencedOutputDatagramChannel> output;
+	output.SetSink(sentSink);
+	output.SetSequence(0xFFFFFFFC);
+
+	WrappingChannel<SequencedInputDatagramChannel> input;
+	input.SetSink(receivedSink);
+	input.SetReorderWindow(8, std::chrono::milliseconds(100));
+	input.SetSequence(0xFFFFFFFC);
+
+	std::vector<uint32_t> lost;
+
+	output.SetLossCallback([&] (uint32_t sequence)
+	{
+		lost.push_back(sequence);
+	});
+
+	for (int i = 0; i < 6; i++)
+	{
+		output.WritePacket(std::vector<uint8_t>(4));
+	}
+
+	std::vector<uint32_t> sent = GetDeliveredSequences(sentSink);
+
+	EXPECT_EQ(std::vector<uint32_t>({ 0xFFFFFFFD, 0xFFFFFFFE, 0, 1, 2, 3 }), sent);
+
+	// hold back 0xFFFFFFFE until three packets past the wrap arrived
+	for (size_t index : { 0, 2, 3, 4 })
+	{
+		input.ProcessPacket(sentSink->packets[index]);
+	}
+
+	EXPECT_EQ(0xFFFFFFFD, input.GetSequence());
+
+	output.ProcessAcknowledgement(input.GetSequence(), input.GetSelectiveAcks());
+
+	EXPECT_EQ(std::vector<uint32_t>({ 0xFFFFFFFE }), lost);
+
+	input.ProcessPacket(sentSink->packets[1]);
+	input.ProcessPacket(sentSink->packets[5]);
+
+	EXPECT_EQ(3, input.GetSequence());
+	EXPECT_EQ(6, receivedSink->packets.size());
+	EXPECT_EQ(0, input.GetLostPacketCount());
+}
+
+TEST(PeerBase, AcknowledgementsReportLostPackets)
+{
+	fwRefContainer<RecordingDatagramSink> toB = new RecordingDatagramSink();
+	fwRefContainer<RecordingDatagramSink> toA = new RecordingDatagramSink();
+
+	fwRefContainer<PeerBase> peerA = new PeerBase(toB);
+	fwRefContainer<PeerBase> peerB = new PeerBase(toA);
+
+	toA->forward = [&] (const std::vector<uint8_t>& packet)
+	{
+		peerA->ProcessPacket(packet);
+	};
+
+	std::vector<uint32_t> lost;
+
+	peerA->SetLossCallback([&] (uint32_t sequence)
+	{
+		lost.push_back(sequence);
+	});
+
+	for (int i = 0; i < 5; i++)
+	{
+		Buffer buffer;
+		buffer.Write<uint32_t>(0);
+
+		peerA->SendPacket(buffer);
+	}
+
+	// drop the second packet
+	for (size_t i = 0; i < toB->packets.size(); i++)
+	{
+		if (i != 1)
+		{
+			peerB->ProcessPacket(toB->packets[i]);
+		}
+	}
+
+	Buffer ack;
+	peerB->WriteAcknowledgementPacket(ack);
+	peerB->SendPacket(ack);
+
+	EXPECT_EQ(std::vector<uint32_t>({ 2 }), lost);
+}
@@ -0,0 +1,147 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <UvLoopHolder.h>
+
+#include <future>
+#include <numeric>
+
+using namespace net;
+
+TEST(UvLoopHolder, LatencyHistogramCountsQueuedCallbacks)
+{
+	fwRefContainer<UvLoopHolder> holder = new UvLoopHolder("test");
+
+	// the histogram starts out empty, and counts every callback that ran
+	auto histogram = holder->GetCallbackLatencyHistogram();
+	EXPECT_EQ(0, std::accumulate(histogram.begin(), histogram.end(), uint64_t(0)));
+
+	for (int i = 0; i < 100; i++)
+	{
+		holder->EnqueueCallback([] () {});
+	}
+
+	holder->InvokeCallback([] () {});
+
+	histogram = holder->GetCallbackLatencyHistogram();
+	EXPECT_EQ(101, std::accumulate(histogram.begin(), histogram.end(), uint64_t(0)));
+
+	holder->ResetCallbackLatencyHistogram();
+
+	// a callback stuck behind a slow one waited at least as long as that took - 20ms is past the 2^14 us bucket
+	holder->EnqueueCallback([] ()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	});
+
+	holder->InvokeCallback([] () {});
+
+	histogram = holder->GetCallbackLatencyHistogram();
+
+	EXPECT_EQ(2, std::accumulate(histogram.begin(), histogram.end(), uint64_t(0)));
+	EXPECT_EQ(1, std::accumulate(histogram.begin() + 15, histogram.end(), uint64_t(0)));
+}
+
+TEST(UvLoopHolder, LastReleaseOnOwnLoopDestroysElsewhere)
+{
+	class TestLoopHolder : public UvLoopHolder
+	{
+	public:
+		std::promise<std::thread::id> destroyed;
+
+		TestLoopHolder()
+			: UvLoopHolder("test")
+		{
+
+		}
+
+		virtual ~TestLoopHolder() override
+		{
+			destroyed.set_value(std::this_thread::get_id());
+		}
+	};
+
+	fwRefContainer<TestLoopHolder> holder = new TestLoopHolder();
+	TestLoopHolder* holderPtr = holder.GetRef();
+
+	auto destroyed = holderPtr->destroyed.get_future();
+
+	// hold up the loop until the callback after this one holds the last reference
+	std::promise<void> unblock;
+	auto unblockFuture = unblock.get_future().share();
+
+	holderPtr->EnqueueCallback([unblockFuture] ()
+	{
+		unblockFuture.wait();
+	});
+
+	std::thread::id loopThread;
+
+	holderPtr->EnqueueCallback([holder, &loopThread] () mutable
+	{
+		loopThread = std::this_thread::get_id();
+		holder = nullptr;
+	});
+
+	holder = nullptr;
+	unblock.set_value();
+
+	ASSERT_EQ(std::future_status::ready, destroyed.wait_for(std::chrono::seconds(5)));
+
+	std::thread::id destroyingThread = destroyed.get();
+
+	EXPECT_NE(std::this_thread::get_id(), destroyingThread);
+	EXPECT_NE(loopThread, destroyingThread);
+}
+
+TEST(UvLoopHolder, RefusesCallbacksOnceExiting)
+{
+	fwRefContainer<UvLoopHolder> holder = new UvLoopHolder("test");
+	UvLoopHolder* holderPtr = holder.GetRef();
+
+	// hold up the loop, so exiting is stuck after it started
+	std::atomic<bool> unblock(false);
+
+	holder->EnqueueCallback([&] ()
+	{
+		while (!unblock)
+		{
+			std::this_thread::yield();
+		}
+	});
+
+	// anything queued before exiting still runs
+	std::atomic<bool> ranQueued(false);
+
+	holder->EnqueueCallback([&] ()
+	{
+		ranQueued = true;
+	});
+
+	auto destruction = std::async(std::launch::async, [&] ()
+	{
+		holder = nullptr;
+	});
+
+	// the holder is alive until its loop exits, which can't happen until we unblock it
+	while (holderPtr->EnqueueCallback([] () {}))
+	{
+		std::this_thread::yield();
+	}
+
+	// this would wait forever for a loop that won't run it
+	bool invoked = holderPtr->InvokeCallback([] () {});
+
+	unblock = true;
+	destruction.wait();
+
+	EXPECT_FALSE(invoked);
+	EXPECT_TRUE(ranQueued);
+}
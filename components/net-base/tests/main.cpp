@@ -0,0 +1,141 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <UvUdpSocket.h>
+
+#include <algorithm>
+#include <condition_variable>
+
+using namespace net;
+
+// the loopback address, on a port picked when binding
+static PeerAddress GetLoopbackAddress()
+{
+	sockaddr_in addr;
+	uv_ip4_addr("127.0.0.1", 0, &addr);
+
+	return PeerAddress(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+}
+
+TEST(UvUdpSocket, RetainedDatagramsUseRightSizedBlocks)
+{
+	fwRefContainer<UvLoopHolder> loop = new UvLoopHolder("udp_test");
+
+	fwRefContainer<UvUdpSocket> receiver = new UvUdpSocket(loop);
+	fwRefContainer<UvUdpSocket> sender = new UvUdpSocket(loop);
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<Slice> received;
+
+	ASSERT_TRUE(receiver->Bind(GetLoopbackAddress(), [&] (const Slice& data, const PeerAddress& address)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		received.push_back(data.Retain());
+		condition.notify_all();
+	}));
+
+	ASSERT_TRUE(sender->Bind(GetLoopbackAddress(), [] (const Slice& data, const PeerAddress& address) {}));
+
+	PeerAddress receiverAddress = receiver->GetLocalAddress();
+
+	const size_t lengths[] = { 100, 1200, 30000 };
+
+	for (size_t length : lengths)
+	{
+		std::vector<uint8_t> datagram(length, static_cast<uint8_t>(length));
+		sender->SendTo(Slice(std::move(datagram)), receiverAddress);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		ASSERT_TRUE(condition.wait_for(lock, std::chrono::seconds(5), [&] ()
+		{
+			return received.size() == 3;
+		}));
+	}
+
+	for (size_t i = 0; i < received.size(); i++)
+	{
+		ASSERT_EQ(lengths[i], received[i].GetLength());
+		EXPECT_EQ(std::vector<uint8_t>(lengths[i], static_cast<uint8_t>(lengths[i])), received[i].ToVector());
+	}
+
+	// small datagrams mustn't keep a full receive buffer alive
+	EXPECT_LE(received[0].GetBlock()->GetCapacity(), 256u);
+	EXPECT_LE(received[1].GetBlock()->GetCapacity(), 2048u);
+	EXPECT_NE(received[0].GetBlock().GetRef(), received[1].GetBlock().GetRef());
+
+	receiver->Close();
+	sender->Close();
+}
+
+TEST(UvUdpSocket, DeliversDatagramsWithinAMillisecond)
+{
+	fwRefContainer<UvLoopHolder> loop = new UvLoopHolder("udp_latency_test");
+
+	fwRefContainer<UvUdpSocket> receiver = new UvUdpSocket(loop);
+	fwRefContainer<UvUdpSocket> sender = new UvUdpSocket(loop);
+
+	const int datagramCount = 1000;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::vector<std::chrono::nanoseconds> latencies;
+
+	// each datagram carries the time it got sent at
+	ASSERT_TRUE(receiver->Bind(GetLoopbackAddress(), [&] (const Slice& data, const PeerAddress& address)
+	{
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+
+		std::chrono::steady_clock::rep sentAt;
+		memcpy(&sentAt, data.GetData(), sizeof(sentAt));
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		latencies.push_back(now - std::chrono::steady_clock::duration(sentAt));
+		condition.notify_all();
+	}));
+
+	ASSERT_TRUE(sender->Bind(GetLoopbackAddress(), [] (const Slice& data, const PeerAddress& address) {}));
+
+	PeerAddress receiverAddress = receiver->GetLocalAddress();
+
+	for (int i = 0; i < datagramCount; i++)
+	{
+		std::chrono::steady_clock::rep sentAt = std::chrono::steady_clock::now().time_since_epoch().count();
+
+		sender->SendTo(Slice::Copy(&sentAt, sizeof(sentAt)), receiverAddress);
+
+		// one at a time, so this measures the latency of an idle loop rather than a queue of datagrams
+		std::unique_lock<std::mutex> lock(mutex);
+
+		ASSERT_TRUE(condition.wait_for(lock, std::chrono::seconds(5), [&] ()
+		{
+			return latencies.size() == static_cast<size_t>(i + 1);
+		}));
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+
+	auto median = latencies[datagramCount / 2];
+	auto p99 = latencies[(datagramCount * 99) / 100];
+
+	printf("send-to-callback latency: median %d us, 99th percentile %d us\n",
+		static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(median).count()),
+		static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(p99).count()));
+
+	EXPECT_LT(median, std::chrono::milliseconds(1));
+
+	receiver->Close();
+	sender->Close();
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "HttpServer.h"
+
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+struct z_stream_s;
+
+namespace net
+{
+enum class ContentEncoding
+{
+	Identity,
+	Gzip,
+	Deflate
+};
+
+//
+// Picks the best content coding the client accepts, going by the request's Accept-Encoding header.
+//
+ContentEncoding NegotiateContentEncoding(const HttpRequest* request);
+
+const char* GetContentEncodingName(ContentEncoding encoding);
+
+//
+// Checks if a content type is worth compressing - most media formats are compressed already.
+//
+bool IsCompressibleContentType(const std::string& contentType);
+
+//
+// A deflate stream producing one of the compressed content codings.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	HttpCompressor
+{
+private:
+	z_stream_s* m_stream;
+
+public:
+	HttpCompressor(ContentEncoding encoding);
+
+	~HttpCompressor();
+
+	// compresses more data, appending whatever output is ready - pass finish for the last part
+	bool Compress(const void* data, size_t length, bool finish, std::string& out);
+
+	static bool CompressBuffer(const void* data, size_t length, ContentEncoding encoding, std::string& out);
+};
+
+//
+// A size-bounded cache of compressed variants of files, keyed by the content hash of the uncompressed data.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	CompressedVariantCache
+{
+private:
+	struct Entry
+	{
+		std::string key;
+
+		std::shared_ptr<const std::string> data;
+	};
+
+	std::mutex m_mutex;
+
+	// most recently used entries first
+	std::list<Entry> m_entries;
+
+	std::unordered_map<std::string, std::list<Entry>::iterator> m_entryMap;
+
+	// variants currently being built
+	std::unordered_set<std::string> m_pendingKeys;
+
+	size_t m_size;
+
+	size_t m_maxSize;
+
+private:
+	static std::string GetKey(const std::array<uint8_t, 20>& hash, ContentEncoding encoding);
+
+	void Evict();
+
+public:
+	CompressedVariantCache(size_t maxSize);
+
+	std::shared_ptr<const std::string> Get(const std::array<uint8_t, 20>& hash, ContentEncoding encoding);
+
+	void Put(const std::array<uint8_t, 20>& hash, ContentEncoding encoding, const std::shared_ptr<const std::string>& data);
+
+	// marks a variant as being built - returns false if it's being built already, so concurrent misses share one build
+	bool BeginBuild(const std::array<uint8_t, 20>& hash, ContentEncoding encoding);
+
+	// has to be called once a build started with BeginBuild is done, whether it succeeded or not
+	void EndBuild(const std::array<uint8_t, 20>& hash, ContentEncoding encoding);
+
+	void SetMaxSize(size_t maxSize);
+
+	inline size_t GetMaxSize()
+	{
+		return m_maxSize;
+	}
+};
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "HttpServer.h"
+#include "HttpCompression.h"
+
+#include <NetWorkerPool.h>
+#include <VFSDevice.h>
+
+#include <array>
+#include <memory>
+
+namespace net
+{
+//
+// Serves static files below an URL prefix, either from a directory on the local file system or from a VFS device.
+//
+// Supports single byte ranges (with If-Range), and conditional requests using entity tags. Files on the local file system
+// are sent using the client stream's SendFile where possible.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	HttpFileHandler : public HttpHandler
+{
+public:
+	// gets the SHA1 hash of a file's content (such as the ones the resource cache already knows), returning false if unknown
+	typedef std::function<bool(const std::string& path, std::array<uint8_t, 20>& hash)> THashProvider;
+
+private:
+	// an open file on the VFS device, closed once the last reference goes away
+	struct DeviceFile;
+
+	struct FileEntry
+	{
+		// set for files on the local file system
+		std::string nativePath;
+
+		// set for files on the VFS device
+		std::shared_ptr<DeviceFile> deviceFile;
+
+		uint64_t size;
+
+		int64_t modificationTime;
+	};
+
+private:
+	std::string m_urlPrefix;
+
+	// set when serving from the local file system
+	std::string m_rootPath;
+
+	// set when serving from a VFS device
+	fwRefContainer<vfs::Device> m_device;
+
+	std::string m_devicePrefix;
+
+	THashProvider m_hashProvider;
+
+	bool m_compressionEnabled;
+
+	CompressedVariantCache m_variantCache;
+
+private:
+	bool GetFilePath(const std::string& requestPath, std::string* filePath);
+
+	bool OpenFile(const std::string& filePath, FileEntry* entry);
+
+	bool ReadFile(const FileEntry& entry, std::string& data);
+
+	std::string GetEntityTag(const FileEntry& entry, const std::array<uint8_t, 20>* hash);
+
+	// returns a cached compressed variant - on a miss, it gets built on the worker pool and null is returned meanwhile
+	std::shared_ptr<const std::string> GetCompressedVariant(const std::string& filePath, const std::array<uint8_t, 20>& hash, ContentEncoding encoding);
+
+	void SendFile(fwRefContainer<HttpResponse> response, const FileEntry& entry, uint64_t offset, uint64_t length);
+
+public:
+	//
+	// Serves files from a directory on the local file system.
+	//
+	HttpFileHandler(const std::string& urlPrefix, const std::string& rootPath);
+
+	//
+	// Serves files from a VFS device, with file paths being relative to the passed device prefix.
+	//
+	HttpFileHandler(const std::string& urlPrefix, fwRefContainer<vfs::Device> device, const std::string& devicePrefix);
+
+	// the hash provider gets called for every request, so it should only look up hashes that are known already
+	inline void SetHashProvider(const THashProvider& hashProvider)
+	{
+		m_hashProvider = hashProvider;
+	}
+
+	// compression makes responses vary by Accept-Encoding: sibling '.gz' files are sent as they are, compressible files
+	// with a known hash get their compressed variant cached (built on the worker pool, while the first requests get
+	// compressed on the fly), and other compressible files get compressed on the fly
+	inline void SetCompressionEnabled(bool enabled)
+	{
+		m_compressionEnabled = enabled;
+	}
+
+	inline CompressedVariantCache& GetVariantCache()
+	{
+		return m_variantCache;
+	}
+
+	virtual bool HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response) override;
+
+public:
+	static std::string GetContentType(const std::string& path);
+};
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include "HttpServer.h"
+
+#include <NetWorkerPool.h>
+
+#include <map>
+#include <unordered_map>
+
+namespace net
+{
+//
+// Dispatches requests to handlers by method and path.
+//
+// Route patterns are split into segments: literal segments have to match exactly, segments starting with a colon
+// (':name') capture a single segment into a request parameter, and a trailing '*' matches any remainder of the path,
+// which gets captured as the '*' parameter. Literal segments are preferred over captures, which are preferred over
+// remainders. Dispatch cost depends on the length of the path, not on the amount of routes.
+//
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	HttpRouter : public HttpHandler
+{
+public:
+	typedef std::function<void(const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)> TRouteHandler;
+
+	// route handlers running on a worker pool get the complete request body passed along, as it's read on the stream's thread
+	typedef std::function<void(const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const std::vector<uint8_t>& body)> TAsyncRouteHandler;
+
+	// a stage running before the route handler - it calls next to continue, or completes the response itself
+	typedef std::function<void(const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const TRouteHandler& next)> TMiddleware;
+
+private:
+	struct Node
+	{
+		std::unordered_map<std::string, std::unique_ptr<Node>> children;
+
+		std::unique_ptr<Node> parameterChild;
+
+		std::string parameterName;
+
+		// handlers by method, an empty method matching any
+		std::map<std::string, TRouteHandler> handlers;
+
+		std::map<std::string, TRouteHandler> remainderHandlers;
+	};
+
+	struct Segment
+	{
+		size_t start;
+
+		size_t length;
+	};
+
+private:
+	std::unique_ptr<Node> m_root;
+
+	std::vector<TMiddleware> m_middleware;
+
+	size_t m_routeCount;
+
+private:
+	static const TRouteHandler* FindHandler(const std::map<std::string, TRouteHandler>& handlers, const std::string& method);
+
+	static const TRouteHandler* Match(const Node* node, const std::string& path, const std::vector<Segment>& segments, size_t index, const std::string& method,
+		std::vector<std::pair<std::string, std::string>>& parameters);
+
+public:
+	HttpRouter();
+
+	//
+	// Adds a stage that wraps all routes registered after this call. Stages get composed with the handler once, at
+	// registration.
+	//
+	void AddMiddleware(const TMiddleware& middleware);
+
+	//
+	// Registers a route - an empty method matches any method, and GET routes also serve HEAD requests.
+	//
+	void AddRoute(const std::string& method, const std::string& pattern, const TRouteHandler& handler);
+
+	//
+	// Registers a route running on a worker pool rather than the thread the request came in on. Any request body is read
+	// in full on the stream's thread first, and the handler only gets queued once it's complete.
+	//
+	void AddAsyncRoute(const std::string& method, const std::string& pattern, const TAsyncRouteHandler& handler, WorkerPool* pool = WorkerPool::GetDefault());
+
+	inline size_t GetRouteCount() const
+	{
+		return m_routeCount;
+	}
+
+	virtual bool HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response) override;
+
+public:
+	static TMiddleware MakeLoggingStage();
+
+	static TMiddleware MakeCompressionStage();
+
+	// rejects requests with a 401 unless the validator accepts their Authorization header
+	static TMiddleware MakeAuthorizationStage(const std::function<bool(const std::string& authorization)>& validator, const std::string& realm);
+};
+}
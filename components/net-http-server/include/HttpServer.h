@@ -9,6 +9,12 @@
 
 #include "TcpServer.h"
 
+#include <NetWorkerPool.h>
+
+#include <array>
+#include <memory>
+#include <thread>
+
 namespace net
 {
 struct HeaderComparator : std::binary_function<std::string, std::string, bool>
@@ -21,8 +27,31 @@ struct HeaderComparator : std::binary_function<std::string, std::string, bool>
 
 typedef std::map<std::string, std::string, HeaderComparator> HeaderMap;
 
-class HttpRequest : public fwRefCountable
+class HttpConnection;
+
+class HttpCompressor;
+
+class HttpRouter;
+
+// a header as it appeared in the request, pointing into the request's head buffer
+struct HttpHeaderView
+{
+	const char* name;
+	size_t nameLength;
+
+	const char* value;
+	size_t valueLength;
+};
+
+class
+#ifdef COMPILING_NET_HTTP_SERVER
+	DLL_EXPORT
+#endif
+	HttpRequest : public fwRefCountable
 {
+public:
+	static const size_t MaxHeaderCount = 50;
+
 private:
 	int m_httpVersionMajor;
 	int m_httpVersionMinor;
@@ -31,13 +60,33 @@ private:
 
 	std::string m_path;
 
-	HeaderMap m_headerList;
+	// the raw request head the header views point into
+	Slice m_head;
+
+	std::array<HttpHeaderView, MaxHeaderCount> m_headerViews;
+
+	size_t m_numHeaders;
+
+	// only built once someone asks for the full header map
+	mutable HeaderMap m_headerList;
+
+	mutable bool m_headerListBuilt;
 
 	std::function<void(const std::vector<uint8_t>&)> m_dataHandler;
 
+	bool m_hasBody;
+
+	// captured by the route the request got dispatched to
+	std::vector<std::pair<std::string, std::string>> m_parameters;
+
 public:
 	HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderMap& headerList);
 
+	//
+	// Creates a request from a parsed head - the header views have to point into the head slice, which gets retained.
+	//
+	HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const Slice& head, const HttpHeaderView* headers, size_t numHeaders);
+
 	virtual ~HttpRequest() override;
 
 	inline const std::function<void(const std::vector<uint8_t>& data)>& GetDataHandler() const
@@ -45,11 +94,23 @@ public:
 		return m_dataHandler;
 	}
 
+	// sets the callback receiving the complete body - this has to happen on the stream's thread, while handling the request
 	inline void SetDataHandler(const std::function<void(const std::vector<uint8_t>& data)>& handler)
 	{
 		m_dataHandler = handler;
 	}
 
+	// whether the request announced a body, which the data handler will get called with
+	inline bool HasBody() const
+	{
+		return m_hasBody;
+	}
+
+	inline void SetHasBody(bool hasBody)
+	{
+		m_hasBody = hasBody;
+	}
+
 	inline std::pair<int, int> GetHttpVersion() const
 	{
 		return std::make_pair(m_httpVersionMajor, m_httpVersionMinor);
@@ -65,17 +126,21 @@ public:
 		return m_path;
 	}
 
-	inline const HeaderMap& GetHeaders() const
+	const HeaderMap& GetHeaders() const;
+
+	std::string GetHeader(const std::string& key, const std::string& defaultValue = std::string()) const;
+
+	inline void SetParameters(const std::vector<std::pair<std::string, std::string>>& parameters)
 	{
-		return m_headerList;
+		m_parameters = parameters;
 	}
 
-	inline const std::string& GetHeader(const std::string& key, const std::string& default = std::string()) const
-	{
-		auto it = m_headerList.find(key);
+	std::string GetParameter(const std::string& name, const std::string& defaultValue = std::string()) const;
 
-		return (it != m_headerList.end()) ? it->second : default;
-	}
+	//
+	// Looks up a header without copying it - the value stays valid for as long as the request lives.
+	//
+	bool FindHeader(const char* name, const char** value, size_t* valueLength) const;
 };
 
 class
@@ -84,9 +149,18 @@ class
 #endif
 	HttpResponse : public fwRefCountable
 {
+public:
+	// appends the next part of the body to the passed string, returning false once the body is complete
+	typedef std::function<bool(std::string&)> TStreamProducer;
+
+	// like a stream producer, but may block - setting the passed flag if the rest of the body can't be produced
+	typedef std::function<bool(std::string&, bool&)> TBlockingStreamProducer;
+
 private:
 	fwRefContainer<HttpRequest> m_request;
 
+	fwRefContainer<HttpConnection> m_connection;
+
 	fwRefContainer<TcpServerStream> m_clientStream;
 
 	int m_statusCode;
@@ -97,13 +171,74 @@ private:
 
 	bool m_closeConnection;
 
+	bool m_chunked;
+
 	HeaderMap m_headerList;
 
+	TStreamProducer m_streamProducer;
+
+	std::shared_ptr<TBlockingStreamProducer> m_blockingProducer;
+
+	WorkerPool* m_producerPool;
+
+	// set while the blocking producer is running on the pool
+	bool m_producing;
+
+	// output held back until the responses to earlier pipelined requests have ended
+	std::vector<Slice> m_bufferedData;
+
+	bool m_compressionEnabled;
+
+	// set once the body is being compressed
+	std::unique_ptr<HttpCompressor> m_compressor;
+
+	// the thread of the stream the request came in on - writing from any other thread schedules the write onto it
+	std::thread::id m_owningThread;
+
 private:
 	static std::string GetStatusMessage(int statusCode);
 
+	void PumpStream();
+
+	void OnBlockingChunk(const std::string& chunk, bool hasMore, bool failed);
+
+	std::string FormatHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers);
+
+	bool IsHttp11();
+
+	bool HasBody();
+
+	bool IsWritable();
+
+	void WriteData(const Slice* slices, size_t count);
+
+	bool WriteBody(const std::string& data);
+
+	void StartCompression();
+
+	inline bool IsOwningThread()
+	{
+		return (std::this_thread::get_id() == m_owningThread);
+	}
+
+private:
+	friend class HttpConnection;
+
+	void OnBecameHead();
+
+	void OnDrain();
+
+	void OnConnectionClosed();
+
+	inline bool ShouldCloseConnection()
+	{
+		return m_closeConnection;
+	}
+
 public:
-	HttpResponse(fwRefContainer<TcpServerStream> clientStream, fwRefContainer<HttpRequest> request);
+	HttpResponse(fwRefContainer<HttpConnection> connection, fwRefContainer<HttpRequest> request);
+
+	virtual ~HttpResponse() override;
 
 	std::string GetHeader(const std::string& name);
 
@@ -119,7 +254,31 @@ public:
 
 	void WriteHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers);
 
-	void Write(const std::string& data);
+	// sends an interim '100 Continue' response
+	void WriteContinue();
+
+	// writes part of the body - if no Content-Length was set, the body gets sent chunked (or, for HTTP/1.0 clients,
+	// ended by closing the connection)
+	//
+	// returns false if the client isn't keeping up, in which case further writes should wait for the stream to drain
+	bool Write(const std::string& data);
+
+	// streams the body from a producer, which only gets called for as long as the client keeps up
+	void WriteStream(const TStreamProducer& producer);
+
+	// streams the body from a producer that may block (e.g. on reading a file), which gets called on the passed pool
+	// rather than the stream's thread - one call at a time, and only for as long as the client keeps up
+	void WriteBlockingStream(const TBlockingStreamProducer& producer, WorkerPool* pool = WorkerPool::GetDefault());
+
+	// compresses the body using a content coding the client accepts, if any - has to be called before the head is sent,
+	// and only applies to full (200) responses
+	void EnableCompression();
+
+	// sends a range of a file on the local file system as the rest of the body, and ends the response - this avoids
+	// copying the file through user space if the client stream supports it
+	void SendFile(const std::string& nativePath, uint64_t offset, uint64_t length);
+
+	size_t GetQueuedBytes();
 
 	void End();
 
@@ -144,6 +303,12 @@ public:
 	{
 		return m_ended;
 	}
+
+	// makes the connection close once this response ended - for when the promised body can't be sent in full
+	inline void CloseConnection()
+	{
+		m_closeConnection = true;
+	}
 };
 
 class HttpHandler : public fwRefCountable
@@ -158,5 +323,8 @@ public:
 	virtual void AttachToServer(fwRefContainer<TcpServer> server) = 0;
 
 	virtual void RegisterHandler(fwRefContainer<HttpHandler> handler) = 0;
+
+	// the route table gets consulted before any handlers - routes have to be added before the server takes requests
+	virtual fwRefContainer<HttpRouter> GetRouter() = 0;
 };
 };
\ No newline at end of file
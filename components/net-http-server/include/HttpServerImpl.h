@@ -8,11 +8,50 @@
 #pragma once
 
 #include "HttpServer.h"
+#include "HttpRouter.h"
 
+#include <deque>
 #include <forward_list>
 
 namespace net
 {
+// keeps the responses on a connection in the order their requests arrived in
+class HttpConnection : public fwRefCountable
+{
+private:
+	fwRefContainer<TcpServerStream> m_stream;
+
+	std::deque<fwRefContainer<HttpResponse>> m_responses;
+
+	bool m_closed;
+
+	bool m_processingResponses;
+
+public:
+	HttpConnection(fwRefContainer<TcpServerStream> stream);
+
+	inline fwRefContainer<TcpServerStream> GetStream()
+	{
+		return m_stream;
+	}
+
+	inline bool IsClosed()
+	{
+		return m_closed;
+	}
+
+	void QueueResponse(fwRefContainer<HttpResponse> response);
+
+	// whether the response is the oldest one pending, and can write to the stream directly
+	bool IsHead(HttpResponse* response);
+
+	void OnResponseEnded(HttpResponse* response);
+
+	void OnDrain();
+
+	void OnClose();
+};
+
 class 
 #ifdef COMPILING_NET_HTTP_SERVER
 	DLL_EXPORT
@@ -22,6 +61,8 @@ class
 private:
 	fwRefContainer<TcpServer> m_server;
 
+	fwRefContainer<HttpRouter> m_router;
+
 	std::forward_list<fwRefContainer<HttpHandler>> m_handlers;
 
 private:
@@ -35,5 +76,7 @@ public:
 	virtual void AttachToServer(fwRefContainer<TcpServer> server) override;
 
 	virtual void RegisterHandler(fwRefContainer<HttpHandler> handler) override;
+
+	virtual fwRefContainer<HttpRouter> GetRouter() override;
 };
 }
\ No newline at end of file
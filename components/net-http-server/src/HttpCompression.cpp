@@ -0,0 +1,298 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "HttpCompression.h"
+
+#include <zlib.h>
+
+#include "memdbgon.h"
+
+namespace net
+{
+ContentEncoding NegotiateContentEncoding(const HttpRequest* request)
+{
+	const char* header;
+	size_t headerLength;
+
+	if (!request->FindHeader("accept-encoding", &header, &headerLength))
+	{
+		return ContentEncoding::Identity;
+	}
+
+	std::string acceptEncoding(header, headerLength);
+
+	float gzipQuality = -1.0f;
+	float deflateQuality = -1.0f;
+	float anyQuality = -1.0f;
+
+	size_t start = 0;
+
+	while (start < acceptEncoding.size())
+	{
+		size_t end = acceptEncoding.find(',', start);
+
+		if (end == std::string::npos)
+		{
+			end = acceptEncoding.size();
+		}
+
+		std::string coding = acceptEncoding.substr(start, end - start);
+		float quality = 1.0f;
+
+		// split off parameters - the only one we care about is the quality value
+		size_t parameters = coding.find(';');
+
+		if (parameters != std::string::npos)
+		{
+			size_t qualityStart = coding.find("q=", parameters);
+
+			if (qualityStart != std::string::npos)
+			{
+				quality = static_cast<float>(atof(coding.c_str() + qualityStart + 2));
+			}
+
+			coding = coding.substr(0, parameters);
+		}
+
+		size_t nameStart = coding.find_first_not_of(" \t");
+		size_t nameEnd = coding.find_last_not_of(" \t");
+
+		if (nameStart != std::string::npos)
+		{
+			coding = coding.substr(nameStart, nameEnd - nameStart + 1);
+
+			if (_stricmp(coding.c_str(), "gzip") == 0 || _stricmp(coding.c_str(), "x-gzip") == 0)
+			{
+				gzipQuality = quality;
+			}
+			else if (_stricmp(coding.c_str(), "deflate") == 0)
+			{
+				deflateQuality = quality;
+			}
+			else if (coding == "*")
+			{
+				anyQuality = quality;
+			}
+		}
+
+		start = end + 1;
+	}
+
+	// codings that weren't named explicitly fall under the wildcard
+	if (gzipQuality < 0.0f)
+	{
+		gzipQuality = anyQuality;
+	}
+
+	if (deflateQuality < 0.0f)
+	{
+		deflateQuality = anyQuality;
+	}
+
+	// a zero quality means 'not acceptable' - prefer gzip on ties, as some clients historically got deflate wrong
+	if (gzipQuality > 0.0f && gzipQuality >= deflateQuality)
+	{
+		return ContentEncoding::Gzip;
+	}
+	else if (deflateQuality > 0.0f)
+	{
+		return ContentEncoding::Deflate;
+	}
+
+	return ContentEncoding::Identity;
+}
+
+const char* GetContentEncodingName(ContentEncoding encoding)
+{
+	switch (encoding)
+	{
+		case ContentEncoding::Gzip:
+			return "gzip";
+		case ContentEncoding::Deflate:
+			return "deflate";
+		default:
+			return "identity";
+	}
+}
+
+bool IsCompressibleContentType(const std::string& contentType)
+{
+	static const char* compressibleTypes[] =
+	{
+		"text/",
+		"application/javascript",
+		"application/json",
+		"application/xml",
+		"application/wasm",
+		"image/svg+xml",
+		"image/x-icon",
+	};
+
+	for (auto& type : compressibleTypes)
+	{
+		if (_strnicmp(contentType.c_str(), type, strlen(type)) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+HttpCompressor::HttpCompressor(ContentEncoding encoding)
+{
+	m_stream = new z_stream;
+	memset(m_stream, 0, sizeof(*m_stream));
+
+	// 'deflate' is actually the zlib format - adding 16 to the window bits gets us a gzip wrapper instead
+	deflateInit2(m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, (encoding == ContentEncoding::Gzip) ? (15 + 16) : 15, 8, Z_DEFAULT_STRATEGY);
+}
+
+HttpCompressor::~HttpCompressor()
+{
+	deflateEnd(m_stream);
+
+	delete m_stream;
+}
+
+bool HttpCompressor::Compress(const void* data, size_t length, bool finish, std::string& out)
+{
+	uint8_t buffer[16384];
+
+	m_stream->next_in = reinterpret_cast<Bytef*>(const_cast<void*>(data));
+	m_stream->avail_in = static_cast<uInt>(length);
+
+	do
+	{
+		m_stream->next_out = buffer;
+		m_stream->avail_out = sizeof(buffer);
+
+		int result = deflate(m_stream, (finish) ? Z_FINISH : Z_NO_FLUSH);
+
+		if (result == Z_STREAM_ERROR)
+		{
+			trace("compressing HTTP response failed\n");
+			return false;
+		}
+
+		out.append(reinterpret_cast<char*>(buffer), sizeof(buffer) - m_stream->avail_out);
+	} while (m_stream->avail_out == 0);
+
+	return true;
+}
+
+bool HttpCompressor::CompressBuffer(const void* data, size_t length, ContentEncoding encoding, std::string& out)
+{
+	HttpCompressor compressor(encoding);
+
+	// text tends to compress to well below a quarter of its size
+	out.reserve(out.size() + (length / 4));
+
+	return compressor.Compress(data, length, true, out);
+}
+
+CompressedVariantCache::CompressedVariantCache(size_t maxSize)
+	: m_size(0), m_maxSize(maxSize)
+{
+
+}
+
+std::string CompressedVariantCache::GetKey(const std::array<uint8_t, 20>& hash, ContentEncoding encoding)
+{
+	std::string key(reinterpret_cast<const char*>(hash.data()), hash.size());
+	key += static_cast<char>(encoding);
+
+	return key;
+}
+
+std::shared_ptr<const std::string> CompressedVariantCache::Get(const std::array<uint8_t, 20>& hash, ContentEncoding encoding)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_entryMap.find(GetKey(hash, encoding));
+
+	if (it == m_entryMap.end())
+	{
+		return nullptr;
+	}
+
+	// mark as most recently used
+	m_entries.splice(m_entries.begin(), m_entries, it->second);
+
+	return it->second->data;
+}
+
+void CompressedVariantCache::Put(const std::array<uint8_t, 20>& hash, ContentEncoding encoding, const std::shared_ptr<const std::string>& data)
+{
+	// don't let a single variant flush the entire cache
+	if (data->size() > m_maxSize / 4)
+	{
+		return;
+	}
+
+	std::string key = GetKey(hash, encoding);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// another request may have compressed the same file in the meantime
+	if (m_entryMap.find(key) != m_entryMap.end())
+	{
+		return;
+	}
+
+	m_entries.push_front({ key, data });
+	m_entryMap[key] = m_entries.begin();
+
+	m_size += data->size();
+
+	Evict();
+}
+
+bool CompressedVariantCache::BeginBuild(const std::array<uint8_t, 20>& hash, ContentEncoding encoding)
+{
+	std::string key = GetKey(hash, encoding);
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	if (m_entryMap.find(key) != m_entryMap.end())
+	{
+		return false;
+	}
+
+	return m_pendingKeys.insert(key).second;
+}
+
+void CompressedVariantCache::EndBuild(const std::array<uint8_t, 20>& hash, ContentEncoding encoding)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_pendingKeys.erase(GetKey(hash, encoding));
+}
+
+void CompressedVariantCache::SetMaxSize(size_t maxSize)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	m_maxSize = maxSize;
+
+	Evict();
+}
+
+void CompressedVariantCache::Evict()
+{
+	while (m_size > m_maxSize && !m_entries.empty())
+	{
+		auto& entry = m_entries.back();
+
+		m_size -= entry.data->size();
+		m_entryMap.erase(entry.key);
+
+		m_entries.pop_back();
+	}
+}
+}
@@ -0,0 +1,686 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "HttpFileHandler.h"
+
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include "memdbgon.h"
+
+namespace net
+{
+struct HttpFileHandler::DeviceFile
+{
+	fwRefContainer<vfs::Device> device;
+
+	vfs::Device::THandle handle;
+
+	DeviceFile(fwRefContainer<vfs::Device> device, vfs::Device::THandle handle)
+		: device(device), handle(handle)
+	{
+
+	}
+
+	~DeviceFile()
+	{
+		device->Close(handle);
+	}
+};
+
+static const size_t DefaultVariantCacheSize = 32 * 1024 * 1024;
+
+static std::string EnsureTrailingSlash(const std::string& path)
+{
+	if (path.empty() || path.back() != '/')
+	{
+		return path + "/";
+	}
+
+	return path;
+}
+
+static bool ParseDecimal(const std::string& string, uint64_t* value)
+{
+	if (string.empty() || string.find_first_not_of("0123456789") != std::string::npos)
+	{
+		return false;
+	}
+
+	*value = strtoull(string.c_str(), nullptr, 10);
+	return true;
+}
+
+// parses a single byte range - returns false if the header should be ignored, in which case the full file gets sent
+static bool ParseRange(const std::string& rangeHeader, uint64_t size, uint64_t* first, uint64_t* last, bool* satisfiable)
+{
+	if (_strnicmp(rangeHeader.c_str(), "bytes=", 6) != 0)
+	{
+		return false;
+	}
+
+	std::string range = rangeHeader.substr(6);
+
+	// we're allowed to answer requests for multiple ranges with the full file
+	if (range.find(',') != std::string::npos)
+	{
+		return false;
+	}
+
+	size_t separator = range.find('-');
+
+	if (separator == std::string::npos)
+	{
+		return false;
+	}
+
+	std::string firstString = range.substr(0, separator);
+	std::string lastString = range.substr(separator + 1);
+
+	uint64_t firstValue;
+	uint64_t lastValue;
+
+	*satisfiable = true;
+
+	if (firstString.empty())
+	{
+		// a suffix range, asking for the last n bytes
+		if (!ParseDecimal(lastString, &lastValue))
+		{
+			return false;
+		}
+
+		if (lastValue == 0 || size == 0)
+		{
+			*satisfiable = false;
+			return true;
+		}
+
+		*first = size - std::min(lastValue, size);
+		*last = size - 1;
+
+		return true;
+	}
+
+	if (!ParseDecimal(firstString, &firstValue))
+	{
+		return false;
+	}
+
+	if (lastString.empty())
+	{
+		lastValue = UINT64_MAX;
+	}
+	else if (!ParseDecimal(lastString, &lastValue) || lastValue < firstValue)
+	{
+		return false;
+	}
+
+	if (firstValue >= size)
+	{
+		*satisfiable = false;
+		return true;
+	}
+
+	*first = firstValue;
+	*last = std::min(lastValue, size - 1);
+
+	return true;
+}
+
+// checks a list of entity tags from If-None-Match, which uses weak comparison
+static bool MatchesEntityTag(const std::string& tagList, const std::string& entityTag)
+{
+	auto stripWeak = [] (const std::string& tag)
+	{
+		return (tag.compare(0, 2, "W/") == 0) ? tag.substr(2) : tag;
+	};
+
+	std::string ourTag = stripWeak(entityTag);
+
+	size_t start = 0;
+
+	while (start < tagList.size())
+	{
+		size_t end = tagList.find(',', start);
+
+		if (end == std::string::npos)
+		{
+			end = tagList.size();
+		}
+
+		std::string tag = tagList.substr(start, end - start);
+
+		size_t tagStart = tag.find_first_not_of(" \t");
+		size_t tagEnd = tag.find_last_not_of(" \t");
+
+		if (tagStart != std::string::npos)
+		{
+			tag = tag.substr(tagStart, tagEnd - tagStart + 1);
+
+			if (tag == "*" || stripWeak(tag) == ourTag)
+			{
+				return true;
+			}
+		}
+
+		start = end + 1;
+	}
+
+	return false;
+}
+
+static int HexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	else if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	else if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+HttpFileHandler::HttpFileHandler(const std::string& urlPrefix, const std::string& rootPath)
+	: m_urlPrefix(EnsureTrailingSlash(urlPrefix)), m_rootPath(EnsureTrailingSlash(rootPath)), m_compressionEnabled(true), m_variantCache(DefaultVariantCacheSize)
+{
+
+}
+
+HttpFileHandler::HttpFileHandler(const std::string& urlPrefix, fwRefContainer<vfs::Device> device, const std::string& devicePrefix)
+	: m_urlPrefix(EnsureTrailingSlash(urlPrefix)), m_device(device), m_devicePrefix(EnsureTrailingSlash(devicePrefix)), m_compressionEnabled(true),
+	  m_variantCache(DefaultVariantCacheSize)
+{
+
+}
+
+bool HttpFileHandler::GetFilePath(const std::string& requestPath, std::string* filePath)
+{
+	// ignore the query string
+	std::string path = requestPath.substr(0, requestPath.find('?'));
+
+	if (path.compare(0, m_urlPrefix.size(), m_urlPrefix) != 0)
+	{
+		return false;
+	}
+
+	// decode the remainder
+	std::string decodedPath;
+	decodedPath.reserve(path.size() - m_urlPrefix.size());
+
+	for (size_t i = m_urlPrefix.size(); i < path.size(); i++)
+	{
+		char c = path[i];
+
+		if (c == '%')
+		{
+			int high = (i + 2 < path.size()) ? HexValue(path[i + 1]) : -1;
+			int low = (high >= 0) ? HexValue(path[i + 2]) : -1;
+
+			if (low < 0)
+			{
+				return false;
+			}
+
+			c = static_cast<char>((high << 4) | low);
+			i += 2;
+		}
+
+		// these have no business being in a file name, and could be used to get outside of the root
+		if (c == '\0' || c == '\\' || c == ':')
+		{
+			return false;
+		}
+
+		decodedPath += c;
+	}
+
+	// don't allow parent references
+	size_t segmentStart = 0;
+
+	while (segmentStart <= decodedPath.size())
+	{
+		size_t segmentEnd = decodedPath.find('/', segmentStart);
+
+		if (segmentEnd == std::string::npos)
+		{
+			segmentEnd = decodedPath.size();
+		}
+
+		if (decodedPath.compare(segmentStart, segmentEnd - segmentStart, "..") == 0)
+		{
+			return false;
+		}
+
+		segmentStart = segmentEnd + 1;
+	}
+
+	// the prefix has a trailing slash, so any leading ones are redundant
+	size_t nameStart = decodedPath.find_first_not_of('/');
+	decodedPath = (nameStart == std::string::npos) ? std::string() : decodedPath.substr(nameStart);
+
+	if (decodedPath.empty() || decodedPath.back() == '/')
+	{
+		decodedPath += "index.html";
+	}
+
+	*filePath = decodedPath;
+	return true;
+}
+
+bool HttpFileHandler::OpenFile(const std::string& filePath, FileEntry* entry)
+{
+	entry->modificationTime = 0;
+
+	if (m_device.GetRef())
+	{
+		vfs::Device::THandle handle = m_device->Open(m_devicePrefix + filePath, true);
+
+		if (handle == vfs::Device::InvalidHandle)
+		{
+			return false;
+		}
+
+		entry->deviceFile = std::make_shared<DeviceFile>(m_device, handle);
+		entry->size = m_device->GetLength(handle);
+
+		return true;
+	}
+
+	entry->nativePath = m_rootPath + filePath;
+
+	struct stat fileStat;
+
+	if (stat(entry->nativePath.c_str(), &fileStat) != 0 || (fileStat.st_mode & S_IFMT) != S_IFREG)
+	{
+		return false;
+	}
+
+	entry->size = fileStat.st_size;
+	entry->modificationTime = fileStat.st_mtime;
+
+	return true;
+}
+
+bool HttpFileHandler::ReadFile(const FileEntry& entry, std::string& data)
+{
+	data.resize(static_cast<size_t>(entry.size));
+
+	if (data.empty())
+	{
+		return true;
+	}
+
+	if (entry.deviceFile)
+	{
+		auto& file = entry.deviceFile;
+
+		file->device->Seek(file->handle, 0, SEEK_SET);
+
+		return (file->device->Read(file->handle, &data[0], data.size()) == data.size());
+	}
+
+	std::ifstream stream(entry.nativePath, std::ios::binary);
+	stream.read(&data[0], data.size());
+
+	return (static_cast<size_t>(stream.gcount()) == data.size());
+}
+
+std::string HttpFileHandler::GetEntityTag(const FileEntry& entry, const std::array<uint8_t, 20>* hash)
+{
+	if (hash)
+	{
+		// the content hash makes for a strong validator
+		char hashString[41];
+
+		for (size_t i = 0; i < hash->size(); i++)
+		{
+			snprintf(&hashString[i * 2], 3, "%02x", (*hash)[i]);
+		}
+
+		return "\"" + std::string(hashString) + "\"";
+	}
+
+	// the size and modification time are only good enough for a weak one - VFS devices don't give us the latter
+	if (!entry.deviceFile)
+	{
+		char tagString[64];
+		snprintf(tagString, sizeof(tagString), "W/\"%llx-%llx\"", static_cast<unsigned long long>(entry.size), static_cast<unsigned long long>(entry.modificationTime));
+
+		return tagString;
+	}
+
+	return std::string();
+}
+
+std::shared_ptr<const std::string> HttpFileHandler::GetCompressedVariant(const std::string& filePath, const std::array<uint8_t, 20>& hash, ContentEncoding encoding)
+{
+	std::shared_ptr<const std::string> variant = m_variantCache.Get(hash, encoding);
+
+	if (variant || !m_variantCache.BeginBuild(hash, encoding))
+	{
+		return variant;
+	}
+
+	// the request may be reading from its own handle at the same time, so the build gets one of its own
+	FileEntry entry;
+
+	if (!OpenFile(filePath, &entry))
+	{
+		m_variantCache.EndBuild(hash, encoding);
+		return nullptr;
+	}
+
+	// reading and compressing a whole file would stall every other connection on the loop
+	fwRefContainer<HttpFileHandler> self = this;
+
+	WorkerPool::GetDefault()->Enqueue([self, entry, hash, encoding] ()
+	{
+		std::string data;
+		auto compressedData = std::make_shared<std::string>();
+
+		if (self->ReadFile(entry, data) && HttpCompressor::CompressBuffer(data.c_str(), data.size(), encoding, *compressedData))
+		{
+			self->m_variantCache.Put(hash, encoding, compressedData);
+		}
+
+		self->m_variantCache.EndBuild(hash, encoding);
+	});
+
+	return nullptr;
+}
+
+bool HttpFileHandler::HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response)
+{
+	// larger files get compressed on the fly instead of ending up in the variant cache
+	static const uint64_t MaxCachedVariantSource = 8 * 1024 * 1024;
+
+	const std::string& method = request->GetRequestMethod();
+
+	if (method != "GET" && method != "HEAD")
+	{
+		return false;
+	}
+
+	std::string filePath;
+
+	if (!GetFilePath(request->GetPath(), &filePath))
+	{
+		return false;
+	}
+
+	FileEntry file;
+
+	if (!OpenFile(filePath, &file))
+	{
+		return false;
+	}
+
+	std::array<uint8_t, 20> hash;
+	bool hasHash = (m_hashProvider && m_hashProvider(filePath, hash));
+
+	std::string entityTag = GetEntityTag(file, (hasHash) ? &hash : nullptr);
+	std::string contentType = GetContentType(filePath);
+
+	response->SetHeader(std::string("Content-Type"), contentType);
+	response->SetHeader(std::string("Accept-Ranges"), std::string("bytes"));
+
+	// pick the variant to send
+	std::shared_ptr<const std::string> fileData;
+	bool compressOnTheFly = false;
+
+	ContentEncoding encoding = ContentEncoding::Identity;
+
+	if (m_compressionEnabled)
+	{
+		response->SetHeader(std::string("Vary"), std::string("Accept-Encoding"));
+
+		encoding = NegotiateContentEncoding(request.GetRef());
+		bool compressible = IsCompressibleContentType(contentType);
+
+		FileEntry precompressedFile;
+		bool usesVariant = false;
+
+		if (encoding == ContentEncoding::Gzip && OpenFile(filePath + ".gz", &precompressedFile))
+		{
+			file = precompressedFile;
+			usesVariant = true;
+
+			// the sibling may not be in sync with the original, so it's tagged by its own content
+			std::array<uint8_t, 20> precompressedHash;
+			bool hasPrecompressedHash = (m_hashProvider && m_hashProvider(filePath + ".gz", precompressedHash));
+
+			entityTag = GetEntityTag(file, (hasPrecompressedHash) ? &precompressedHash : nullptr);
+		}
+		else if (encoding != ContentEncoding::Identity && compressible)
+		{
+			if (hasHash && file.size <= MaxCachedVariantSource)
+			{
+				fileData = GetCompressedVariant(filePath, hash, encoding);
+				usesVariant = (fileData != nullptr);
+			}
+
+			// until a cached variant is built (or if it won't be), compress on the fly - unless a range is asked for, as
+			// that'd refer to the compressed data, which we don't know the layout of in advance
+			if (!usesVariant && request->GetHeader(std::string("range")).empty())
+			{
+				compressOnTheFly = true;
+				usesVariant = true;
+			}
+		}
+
+		if (usesVariant)
+		{
+			if (!compressOnTheFly)
+			{
+				response->SetHeader(std::string("Content-Encoding"), GetContentEncodingName(encoding));
+			}
+
+			// variants need a tag of their own, or caches would mix them up
+			if (!entityTag.empty())
+			{
+				entityTag.insert(entityTag.size() - 1, std::string("-") + GetContentEncodingName(encoding));
+			}
+		}
+	}
+
+	uint64_t size = (fileData) ? fileData->size() : file.size;
+
+	if (!entityTag.empty())
+	{
+		response->SetHeader(std::string("ETag"), entityTag);
+
+		std::string ifNoneMatch = request->GetHeader(std::string("if-none-match"));
+
+		if (!ifNoneMatch.empty() && MatchesEntityTag(ifNoneMatch, entityTag))
+		{
+			if (!compressOnTheFly)
+			{
+				response->SetHeader(std::string("Content-Length"), std::to_string(size));
+			}
+
+			response->SetStatusCode(304);
+			response->End();
+
+			return true;
+		}
+	}
+
+	if (compressOnTheFly)
+	{
+		// a HEAD response gets the same headers - short of the length, which we'd only know after compressing
+		if (method == "HEAD")
+		{
+			response->SetHeader(std::string("Content-Encoding"), GetContentEncodingName(encoding));
+			response->WriteHead(200);
+			response->End();
+
+			return true;
+		}
+
+		response->EnableCompression();
+
+		SendFile(response, file, 0, file.size);
+		return true;
+	}
+
+	uint64_t offset = 0;
+	uint64_t length = size;
+
+	std::string rangeHeader = request->GetHeader(std::string("range"));
+
+	if (!rangeHeader.empty())
+	{
+		// a range only applies to the file the client has part of already - which weak tags can't tell
+		std::string ifRange = request->GetHeader(std::string("if-range"));
+		bool rangeApplies = (ifRange.empty() || (ifRange == entityTag && entityTag.compare(0, 1, "\"") == 0));
+
+		uint64_t first;
+		uint64_t last;
+		bool satisfiable;
+
+		if (rangeApplies && ParseRange(rangeHeader, size, &first, &last, &satisfiable))
+		{
+			if (!satisfiable)
+			{
+				response->SetHeader(std::string("Content-Range"), "bytes */" + std::to_string(size));
+				response->SetStatusCode(416);
+				response->End();
+
+				return true;
+			}
+
+			offset = first;
+			length = last - first + 1;
+
+			response->SetHeader(std::string("Content-Range"), "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size));
+			response->SetStatusCode(206);
+		}
+	}
+
+	response->SetHeader(std::string("Content-Length"), std::to_string(length));
+
+	if (method == "HEAD")
+	{
+		response->End();
+	}
+	else if (fileData)
+	{
+		response->End((offset == 0 && length == size) ? *fileData : fileData->substr(static_cast<size_t>(offset), static_cast<size_t>(length)));
+	}
+	else
+	{
+		SendFile(response, file, offset, length);
+	}
+
+	return true;
+}
+
+void HttpFileHandler::SendFile(fwRefContainer<HttpResponse> response, const FileEntry& entry, uint64_t offset, uint64_t length)
+{
+	if (!entry.deviceFile)
+	{
+		response->SendFile(entry.nativePath, offset, length);
+		return;
+	}
+
+	// VFS devices may well block (or be backed by an archive), so they're read off the loop
+	auto file = entry.deviceFile;
+	uint64_t remaining = length;
+	bool seeked = false;
+
+	response->WriteBlockingStream([=] (std::string& chunk, bool& failed) mutable
+	{
+		static const size_t ChunkSize = 65536;
+
+		if (!seeked)
+		{
+			file->device->Seek(file->handle, static_cast<intptr_t>(offset), SEEK_SET);
+			seeked = true;
+		}
+
+		chunk.resize(static_cast<size_t>(std::min(remaining, static_cast<uint64_t>(ChunkSize))));
+
+		size_t readLength = (chunk.empty()) ? 0 : file->device->Read(file->handle, &chunk[0], chunk.size());
+
+		if (readLength == static_cast<size_t>(-1))
+		{
+			readLength = 0;
+		}
+
+		chunk.resize(readLength);
+		remaining -= readLength;
+
+		if (readLength == 0 && remaining > 0)
+		{
+			trace("reading a file for an HTTP response failed\n");
+
+			failed = true;
+			return false;
+		}
+
+		return (remaining > 0);
+	});
+}
+
+std::string HttpFileHandler::GetContentType(const std::string& path)
+{
+	static const std::pair<const char*, const char*> contentTypes[] =
+	{
+		{ "html", "text/html; charset=utf-8" },
+		{ "htm", "text/html; charset=utf-8" },
+		{ "css", "text/css; charset=utf-8" },
+		{ "js", "application/javascript; charset=utf-8" },
+		{ "json", "application/json; charset=utf-8" },
+		{ "xml", "application/xml; charset=utf-8" },
+		{ "txt", "text/plain; charset=utf-8" },
+		{ "png", "image/png" },
+		{ "jpg", "image/jpeg" },
+		{ "jpeg", "image/jpeg" },
+		{ "gif", "image/gif" },
+		{ "svg", "image/svg+xml" },
+		{ "ico", "image/x-icon" },
+		{ "webp", "image/webp" },
+		{ "woff", "font/woff" },
+		{ "woff2", "font/woff2" },
+		{ "ttf", "font/ttf" },
+		{ "ogg", "audio/ogg" },
+		{ "mp3", "audio/mpeg" },
+		{ "wav", "audio/wav" },
+		{ "mp4", "video/mp4" },
+		{ "webm", "video/webm" },
+		{ "zip", "application/zip" },
+		{ "wasm", "application/wasm" },
+	};
+
+	size_t extensionStart = path.find_last_of("./");
+
+	if (extensionStart != std::string::npos && path[extensionStart] == '.')
+	{
+		const char* extension = &path[extensionStart + 1];
+
+		for (auto& contentType : contentTypes)
+		{
+			if (_stricmp(extension, contentType.first) == 0)
+			{
+				return contentType.second;
+			}
+		}
+	}
+
+	return "application/octet-stream";
+}
+}
@@ -0,0 +1,296 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "HttpRouter.h"
+
+#include "memdbgon.h"
+
+namespace net
+{
+HttpRouter::HttpRouter()
+	: m_root(std::make_unique<Node>()), m_routeCount(0)
+{
+
+}
+
+void HttpRouter::AddMiddleware(const TMiddleware& middleware)
+{
+	m_middleware.push_back(middleware);
+}
+
+void HttpRouter::AddRoute(const std::string& method, const std::string& pattern, const TRouteHandler& handler)
+{
+	// wrap the handler in the stages registered so far - the first stage added runs first
+	TRouteHandler composedHandler = handler;
+
+	for (auto it = m_middleware.rbegin(); it != m_middleware.rend(); it++)
+	{
+		TMiddleware stage = *it;
+		TRouteHandler next = composedHandler;
+
+		composedHandler = [stage, next] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+		{
+			stage(request, response, next);
+		};
+	}
+
+	// walk the pattern down the tree, adding nodes as needed
+	Node* node = m_root.get();
+	bool isRemainder = false;
+
+	size_t start = 0;
+
+	while (start < pattern.size())
+	{
+		size_t end = pattern.find('/', start);
+
+		if (end == std::string::npos)
+		{
+			end = pattern.size();
+		}
+
+		std::string segment = pattern.substr(start, end - start);
+		start = end + 1;
+
+		if (segment.empty())
+		{
+			continue;
+		}
+
+		if (segment == "*")
+		{
+			if (start < pattern.size())
+			{
+				trace("route pattern %s has segments after a '*' - these will be ignored\n", pattern.c_str());
+			}
+
+			isRemainder = true;
+			break;
+		}
+
+		if (segment[0] == ':')
+		{
+			if (!node->parameterChild)
+			{
+				node->parameterChild = std::make_unique<Node>();
+				node->parameterName = segment.substr(1);
+			}
+			else if (node->parameterName != segment.substr(1))
+			{
+				trace("route pattern %s names parameter %s, but an earlier route named it %s\n", pattern.c_str(), segment.c_str() + 1, node->parameterName.c_str());
+			}
+
+			node = node->parameterChild.get();
+		}
+		else
+		{
+			auto& child = node->children[segment];
+
+			if (!child)
+			{
+				child = std::make_unique<Node>();
+			}
+
+			node = child.get();
+		}
+	}
+
+	auto& handlers = (isRemainder) ? node->remainderHandlers : node->handlers;
+	handlers[method] = composedHandler;
+
+	m_routeCount++;
+}
+
+void HttpRouter::AddAsyncRoute(const std::string& method, const std::string& pattern, const TAsyncRouteHandler& handler, WorkerPool* pool)
+{
+	// middleware still runs on the stream's thread, so it can reject requests without a round trip through the pool
+	AddRoute(method, pattern, [handler, pool] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		if (!request->HasBody())
+		{
+			pool->Enqueue([=] ()
+			{
+				handler(request, response, std::vector<uint8_t>());
+			});
+
+			return;
+		}
+
+		// the stream reuses the buffer it passes, and is done with the request once it has been called
+		request->SetDataHandler([=] (const std::vector<uint8_t>& data)
+		{
+			auto body = std::make_shared<std::vector<uint8_t>>(data);
+
+			pool->Enqueue([=] ()
+			{
+				handler(request, response, *body);
+			});
+		});
+	});
+}
+
+const HttpRouter::TRouteHandler* HttpRouter::FindHandler(const std::map<std::string, TRouteHandler>& handlers, const std::string& method)
+{
+	auto it = handlers.find(method);
+
+	if (it == handlers.end() && method == "HEAD")
+	{
+		it = handlers.find("GET");
+	}
+
+	if (it == handlers.end())
+	{
+		it = handlers.find(std::string());
+	}
+
+	return (it != handlers.end()) ? &it->second : nullptr;
+}
+
+const HttpRouter::TRouteHandler* HttpRouter::Match(const Node* node, const std::string& path, const std::vector<Segment>& segments, size_t index, const std::string& method,
+	std::vector<std::pair<std::string, std::string>>& parameters)
+{
+	if (index == segments.size())
+	{
+		const TRouteHandler* handler = FindHandler(node->handlers, method);
+
+		if (handler)
+		{
+			return handler;
+		}
+	}
+	else
+	{
+		const Segment& segment = segments[index];
+
+		auto it = node->children.find(path.substr(segment.start, segment.length));
+
+		if (it != node->children.end())
+		{
+			const TRouteHandler* handler = Match(it->second.get(), path, segments, index + 1, method, parameters);
+
+			if (handler)
+			{
+				return handler;
+			}
+		}
+
+		if (node->parameterChild)
+		{
+			parameters.emplace_back(node->parameterName, path.substr(segment.start, segment.length));
+
+			const TRouteHandler* handler = Match(node->parameterChild.get(), path, segments, index + 1, method, parameters);
+
+			if (handler)
+			{
+				return handler;
+			}
+
+			parameters.pop_back();
+		}
+	}
+
+	if (!node->remainderHandlers.empty())
+	{
+		const TRouteHandler* handler = FindHandler(node->remainderHandlers, method);
+
+		if (handler)
+		{
+			parameters.emplace_back("*", (index < segments.size()) ? path.substr(segments[index].start, segments.back().start + segments.back().length - segments[index].start) : std::string());
+
+			return handler;
+		}
+	}
+
+	return nullptr;
+}
+
+bool HttpRouter::HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response)
+{
+	const std::string& path = request->GetPath();
+
+	// split the path, leaving out the query string
+	size_t pathLength = path.find('?');
+
+	if (pathLength == std::string::npos)
+	{
+		pathLength = path.size();
+	}
+
+	std::vector<Segment> segments;
+	size_t start = 0;
+
+	while (start < pathLength)
+	{
+		size_t end = path.find('/', start);
+
+		if (end == std::string::npos || end > pathLength)
+		{
+			end = pathLength;
+		}
+
+		if (end > start)
+		{
+			segments.push_back({ start, end - start });
+		}
+
+		start = end + 1;
+	}
+
+	std::vector<std::pair<std::string, std::string>> parameters;
+
+	const TRouteHandler* handler = Match(m_root.get(), path, segments, 0, request->GetRequestMethod(), parameters);
+
+	if (!handler)
+	{
+		return false;
+	}
+
+	request->SetParameters(parameters);
+
+	(*handler)(request, response);
+
+	return true;
+}
+
+HttpRouter::TMiddleware HttpRouter::MakeLoggingStage()
+{
+	return [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const TRouteHandler& next)
+	{
+		trace("%s %s\n", request->GetRequestMethod().c_str(), request->GetPath().c_str());
+
+		next(request, response);
+	};
+}
+
+HttpRouter::TMiddleware HttpRouter::MakeCompressionStage()
+{
+	return [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const TRouteHandler& next)
+	{
+		response->EnableCompression();
+
+		next(request, response);
+	};
+}
+
+HttpRouter::TMiddleware HttpRouter::MakeAuthorizationStage(const std::function<bool(const std::string& authorization)>& validator, const std::string& realm)
+{
+	return [=] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const TRouteHandler& next)
+	{
+		if (!validator(request->GetHeader(std::string("authorization"))))
+		{
+			response->SetHeader(std::string("WWW-Authenticate"), "Basic realm=\"" + realm + "\"");
+			response->SetStatusCode(401);
+			response->End(std::string("Unauthorized."));
+
+			return;
+		}
+
+		next(request, response);
+	};
+}
+}
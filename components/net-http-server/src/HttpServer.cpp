@@ -8,10 +8,12 @@
 #include "StdInc.h"
 #include "HttpServer.h"
 #include "HttpServerImpl.h"
+#include "HttpCompression.h"
 #include "TLSServer.h"
 
 #include <ctime>
 #include <deque>
+#include <fstream>
 #include <iomanip>
 #include <memory>
 #include <sstream>
@@ -22,7 +24,126 @@
 
 namespace net
 {
+	// requests that don't fit in this get the connection closed on them
+	static const size_t MaxRequestLength = 1024 * 1024 * 5;
+
+	enum class BodyFraming
+	{
+		None,
+		Length,
+		Chunked,
+		Invalid,
+		TooLarge
+	};
+
+	static bool ParseContentLength(const char* value, size_t valueLength, uint64_t* contentLength)
+	{
+		// only plain digits - atoi-style parsing would turn '-1', '1e3' or an overflowing value into a different length
+		// than a proxy in front of us might have used
+		if (valueLength == 0)
+		{
+			return false;
+		}
+
+		uint64_t length = 0;
+
+		for (size_t i = 0; i < valueLength; i++)
+		{
+			if (value[i] < '0' || value[i] > '9')
+			{
+				return false;
+			}
+
+			length = (length * 10) + (value[i] - '0');
+
+			// anything this long gets rejected anyway, so stop before it could overflow
+			if (length > MaxRequestLength)
+			{
+				length = MaxRequestLength + 1;
+			}
+		}
+
+		*contentLength = length;
+		return true;
+	}
+
+	//
+	// Works out how a request body is delimited. Anything ambiguous is invalid: a request that we frame differently from
+	// a proxy in front of us could smuggle another request in on a persistent connection.
+	//
+	static BodyFraming GetBodyFraming(const phr_header* headers, size_t numHeaders, uint64_t* contentLength)
+	{
+		bool hasContentLength = false;
+		bool hasTransferEncoding = false;
+
+		for (size_t i = 0; i < numHeaders; i++)
+		{
+			auto& header = headers[i];
+
+			// continuation lines in either of these are ambiguous as well
+			if (!header.name)
+			{
+				if (i > 0 && headers[i - 1].name &&
+					((headers[i - 1].name_len == 14 && _strnicmp(headers[i - 1].name, "content-length", 14) == 0) ||
+					 (headers[i - 1].name_len == 17 && _strnicmp(headers[i - 1].name, "transfer-encoding", 17) == 0)))
+				{
+					return BodyFraming::Invalid;
+				}
+
+				continue;
+			}
+
+			if (header.name_len == 14 && _strnicmp(header.name, "content-length", 14) == 0)
+			{
+				uint64_t length;
+
+				if (!ParseContentLength(header.value, header.value_len, &length))
+				{
+					return BodyFraming::Invalid;
+				}
+
+				// repeating the header is only fine if it keeps the same length
+				if (hasContentLength && length != *contentLength)
+				{
+					return BodyFraming::Invalid;
+				}
+
+				hasContentLength = true;
+				*contentLength = length;
+			}
+			else if (header.name_len == 17 && _strnicmp(header.name, "transfer-encoding", 17) == 0)
+			{
+				// chunked is the only transfer coding we understand, and it may only be applied once
+				if (hasTransferEncoding || header.value_len != 7 || _strnicmp(header.value, "chunked", 7) != 0)
+				{
+					return BodyFraming::Invalid;
+				}
+
+				hasTransferEncoding = true;
+			}
+		}
+
+		// either framing on its own is fine, but a request carrying both is most likely trying to confuse someone
+		if (hasTransferEncoding)
+		{
+			return (hasContentLength) ? BodyFraming::Invalid : BodyFraming::Chunked;
+		}
+
+		if (hasContentLength)
+		{
+			if (*contentLength > MaxRequestLength)
+			{
+				return BodyFraming::TooLarge;
+			}
+
+			return (*contentLength > 0) ? BodyFraming::Length : BodyFraming::None;
+		}
+
+		return BodyFraming::None;
+	}
+
 	HttpServerImpl::HttpServerImpl()
+		: m_router(new HttpRouter())
 	{
 
 	}
@@ -42,26 +163,39 @@ namespace net
 		m_handlers.push_front(handler);
 	}
 
+	fwRefContainer<HttpRouter> HttpServerImpl::GetRouter()
+	{
+		return m_router;
+	}
+
 	void HttpServerImpl::OnConnection(fwRefContainer<TcpServerStream> stream)
 	{
 		enum HttpConnectionReadState
 		{
 			ReadStateRequest,
 			ReadStateBody,
-			ReadStateChunked
+			ReadStateChunked,
+			// a request was rejected, and the connection will close once its response went out
+			ReadStateRejected
 		};
 
 		struct HttpConnectionData
 		{
 			HttpConnectionReadState readState;
 
-			std::deque<uint8_t> readBuffer;
+			// contiguous read buffer - bytes before readOffset have been consumed already
+			std::vector<uint8_t> readBuffer;
+
+			size_t readOffset;
 
-			std::vector<uint8_t> requestData;
+			// the decoded request body, reused between requests
+			std::vector<uint8_t> bodyData;
 
 			size_t lastLength;
 
-			phr_header headers[50];
+			phr_header headers[HttpRequest::MaxHeaderCount];
+
+			HttpHeaderView headerViews[HttpRequest::MaxHeaderCount];
 
 			phr_chunked_decoder decoder;
 
@@ -69,48 +203,97 @@ namespace net
 
 			fwRefContainer<HttpResponse> response;
 
-			int contentLength;
+			size_t contentLength;
 
 			HttpConnectionData()
-				: readState(ReadStateRequest), lastLength(0), contentLength(0)
+				: readState(ReadStateRequest), readOffset(0), lastLength(0), contentLength(0)
+			{
+
+			}
+
+			inline const uint8_t* GetReadData()
+			{
+				return readBuffer.data() + readOffset;
+			}
+
+			inline size_t GetReadLength()
 			{
+				return readBuffer.size() - readOffset;
+			}
+
+			void Append(const net::Slice& data)
+			{
+				if (readOffset == readBuffer.size())
+				{
+					// everything was consumed, so we can start over
+					readBuffer.clear();
+					readOffset = 0;
+				}
+				else if (readOffset > 0 && (readBuffer.size() + data.GetLength()) > readBuffer.capacity())
+				{
+					// move the remainder to the front rather than growing the buffer
+					readBuffer.erase(readBuffer.begin(), readBuffer.begin() + readOffset);
+					readOffset = 0;
+				}
 
+				readBuffer.insert(readBuffer.end(), data.begin(), data.end());
 			}
 		};
 
 		std::shared_ptr<HttpConnectionData> connectionData = std::make_shared<HttpConnectionData>();
 
-		stream->SetReadCallback([=](const std::vector<uint8_t>& data)
+		fwRefContainer<HttpConnection> connection = new HttpConnection(stream);
+
+		stream->SetDrainCallback([=] ()
+		{
+			connection->OnDrain();
+		});
+
+		stream->SetCloseCallback([=] ()
+		{
+			connection->OnClose();
+		});
+
+		stream->SetReadCallback([=](const net::Slice& data)
 		{
 			// keep a reference to the connection data locally
 			std::shared_ptr<HttpConnectionData> localConnectionData = connectionData;
 
-			// place bytes in the read buffer
-			auto& readQueue = connectionData->readBuffer;
+			// and to the connection, as we might close
+			fwRefContainer<HttpConnection> localConnection = connection;
+
+			// anything following a rejected request isn't worth looking at
+			if (localConnectionData->readState == ReadStateRejected)
+			{
+				return;
+			}
 
-			size_t origSize = readQueue.size();
-			readQueue.resize(origSize + data.size());
+			// place bytes in the read buffer
+			localConnectionData->Append(data);
 
 			// close the stream if the length is too big
-			if (readQueue.size() > (1024 * 1024 * 5))
+			if (localConnectionData->GetReadLength() > MaxRequestLength)
 			{
 				stream->Close();
 				return;
 			}
 
-			// actually copy
-			std::copy(data.begin(), data.end(), readQueue.begin() + origSize);
-
 			// process request data until there's no need anymore
 			bool continueProcessing = true;
 
 			while (continueProcessing)
 			{
+				// a previous response may have closed the connection
+				if (localConnection->IsClosed())
+				{
+					return;
+				}
+
 				// depending on the state, perform an action
 				if (localConnectionData->readState == ReadStateRequest)
 				{
-					// copy the deque into a vector for data purposes
-					std::vector<uint8_t> requestData(readQueue.begin(), readQueue.end());
+					const char* requestData = reinterpret_cast<const char*>(localConnectionData->GetReadData());
+					size_t requestLength = localConnectionData->GetReadLength();
 
 					// define output variables
 					const char* requestMethod;
@@ -120,9 +303,10 @@ namespace net
 					size_t pathLength;
 
 					int minorVersion;
-					size_t numHeaders = 50;
+					size_t numHeaders = HttpRequest::MaxHeaderCount;
 
-					int result = phr_parse_request(reinterpret_cast<const char*>(&requestData[0]), requestData.size(), &requestMethod, &requestMethodLength,
+					// parse in place - passing the length of the previous attempt lets the parser skip rescanning for the end of the head
+					int result = phr_parse_request(requestData, requestLength, &requestMethod, &requestMethodLength,
 						&path, &pathLength, &minorVersion, localConnectionData->headers, &numHeaders, localConnectionData->lastLength);
 
 					if (result > 0)
@@ -131,69 +315,108 @@ namespace net
 						std::string requestMethodStr(requestMethod, requestMethodLength);
 						std::string pathStr(path, pathLength);
 
-						HeaderMap headerList;
+						// copy the head out of the read buffer (into a pooled block), and point the headers into it
+						net::Slice head = net::Slice::Copy(requestData, result);
+						const char* headBase = reinterpret_cast<const char*>(head.GetData());
 
-						for (int i = 0; i < numHeaders; i++)
+						for (size_t i = 0; i < numHeaders; i++)
 						{
 							auto& header = localConnectionData->headers[i];
+							auto& headerView = localConnectionData->headerViews[i];
 
-							headerList.insert(std::make_pair(std::string(header.name, header.name_len), std::string(header.value, header.value_len)));
+							// continuation lines don't have a name
+							headerView.name = (header.name) ? headBase + (header.name - requestData) : nullptr;
+							headerView.nameLength = header.name_len;
+							headerView.value = headBase + (header.value - requestData);
+							headerView.valueLength = header.value_len;
 						}
 
 						// remove the original bytes from the queue
-						readQueue.erase(readQueue.begin(), readQueue.begin() + result);
+						localConnectionData->readOffset += result;
 						localConnectionData->lastLength = 0;
 
 						// store the request in a request instance
-						fwRefContainer<HttpRequest> request = new HttpRequest(1, minorVersion, requestMethodStr, pathStr, headerList);
-						fwRefContainer<HttpResponse> response = new HttpResponse(stream, request);
+						fwRefContainer<HttpRequest> request = new HttpRequest(1, minorVersion, requestMethodStr, pathStr, head, localConnectionData->headerViews, numHeaders);
+						fwRefContainer<HttpResponse> response = new HttpResponse(localConnection, request);
+
+						// queue the response before anyone gets to write to it, so pipelined responses go out in order
+						localConnection->QueueResponse(response);
+
+						// see how the body is delimited before letting anyone look at the request
+						uint64_t contentLength = 0;
+						BodyFraming framing = GetBodyFraming(localConnectionData->headers, numHeaders, &contentLength);
+
+						if (framing == BodyFraming::Invalid || framing == BodyFraming::TooLarge)
+						{
+							// we can't tell where the next request would start, so this one is the last
+							localConnectionData->readState = ReadStateRejected;
 
-						for (auto& handler : m_handlers)
+							response->CloseConnection();
+							response->SetStatusCode((framing == BodyFraming::TooLarge) ? 413 : 400);
+							response->End(std::string((framing == BodyFraming::TooLarge) ? "Request too large." : "Bad request."));
+
+							return;
+						}
+
+						request->SetHasBody(framing != BodyFraming::None);
+
+						// the route table dispatches in one go, so only fall back to asking each handler if it has no match
+						bool handled = (m_router->GetRouteCount() > 0 && m_router->HandleRequest(request, response));
+
+						if (!handled)
 						{
-							if (handler->HandleRequest(request, response) || response->HasEnded())
+							for (auto& handler : m_handlers)
 							{
-								break;
+								if (handler->HandleRequest(request, response) || response->HasEnded())
+								{
+									handled = true;
+									break;
+								}
 							}
 						}
 
-						continueProcessing = (readQueue.size() > 0);
-
-						if (!response->HasEnded())
+						// don't leave the client (and any requests pipelined after this one) waiting forever
+						if (!handled)
 						{
-							// check to see if we'll have to read user data
-							static std::string contentLengthKey = "content-length";
-							static std::string contentLengthDefault = "0";
+							response->SetStatusCode(404);
+							response->End(std::string("Not found."));
+						}
 
-							auto& contentLengthStr = request->GetHeader(contentLengthKey, contentLengthDefault);
-							int contentLength = atoi(contentLengthStr.c_str());
+						continueProcessing = (localConnectionData->GetReadLength() > 0);
 
-							if (contentLength > 0)
-							{
-								localConnectionData->request = request;
-								localConnectionData->response = response;
-								localConnectionData->contentLength = contentLength;
+						// check to see if we'll have to read user data - even if the response has ended already, the body
+						// has to be consumed to get to the next request
+						if (framing == BodyFraming::Length)
+						{
+							localConnectionData->request = request;
+							localConnectionData->response = response;
+							localConnectionData->contentLength = static_cast<size_t>(contentLength);
 
-								localConnectionData->readState = ReadStateBody;
-							}
-							else
-							{
-								static std::string transferEncodingKey = "transfer-encoding";
-								static std::string transferEncodingDefault = "";
-								static std::string transferEncodingComparison = "chunked";
+							localConnectionData->readState = ReadStateBody;
+						}
+						else if (framing == BodyFraming::Chunked)
+						{
+							localConnectionData->request = request;
+							localConnectionData->response = response;
+							localConnectionData->contentLength = 0;
 
-								if (request->GetHeader(transferEncodingKey, transferEncodingDefault) == transferEncodingComparison)
-								{
-									localConnectionData->request = request;
-									localConnectionData->response = response;
-									localConnectionData->contentLength = -1;
+							localConnectionData->bodyData.clear();
 
-									localConnectionData->lastLength = 0;
+							localConnectionData->readState = ReadStateChunked;
 
-									localConnectionData->readState = ReadStateChunked;
+							memset(&localConnectionData->decoder, 0, sizeof(localConnectionData->decoder));
+							localConnectionData->decoder.consume_trailer = true;
+						}
 
-									memset(&localConnectionData->decoder, 0, sizeof(localConnectionData->decoder));
-									localConnectionData->decoder.consume_trailer = true;
-								}
+						// tell the client to go ahead with the body, unless a final response is already on its way
+						if (framing != BodyFraming::None && minorVersion >= 1 && !response->HasSentHeaders())
+						{
+							const char* headerValue;
+							size_t headerLength;
+
+							if (request->FindHeader("expect", &headerValue, &headerLength) && headerLength == 12 && _strnicmp(headerValue, "100-continue", 12) == 0)
+							{
+								response->WriteContinue();
 							}
 						}
 					}
@@ -205,233 +428,933 @@ namespace net
 					}
 					else if (result == -2)
 					{
-						localConnectionData->lastLength = requestData.size();
+						localConnectionData->lastLength = requestLength;
 
 						continueProcessing = false;
 					}
 				}
-				else if (connectionData->readState == ReadStateBody)
+				else if (localConnectionData->readState == ReadStateBody)
 				{
-					int contentLength = localConnectionData->contentLength;
+					size_t contentLength = localConnectionData->contentLength;
 
-					if (readQueue.size() >= contentLength)
+					if (localConnectionData->GetReadLength() >= contentLength)
 					{
-						// copy the deque into a vector for data purposes, again
-						std::vector<uint8_t> requestData(readQueue.begin(), readQueue.begin() + contentLength);
-
-						// remove the original bytes from the queue
-						readQueue.erase(readQueue.begin(), readQueue.begin() + contentLength);
+						const uint8_t* bodyStart = localConnectionData->GetReadData();
 
-						// call the data handler
-						auto& dataHandler = localConnectionData->request->GetDataHandler();
+						// call the data handler - taking it from the request first, as it may hand the request to another thread
+						auto dataHandler = localConnectionData->request->GetDataHandler();
+						localConnectionData->request->SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
 
 						if (dataHandler)
 						{
-							dataHandler(requestData);
+							// reuse the body buffer's storage
+							auto& bodyData = localConnectionData->bodyData;
+							bodyData.assign(bodyStart, bodyStart + contentLength);
 
-							localConnectionData->request->SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
+							dataHandler(bodyData);
 						}
 
+						// remove the original bytes from the queue
+						localConnectionData->readOffset += contentLength;
+
 						// clean up the req/res
 						localConnectionData->request = nullptr;
 						localConnectionData->response = nullptr;
 
 						localConnectionData->readState = ReadStateRequest;
 
-						continueProcessing = (readQueue.size() > 0);
+						continueProcessing = (localConnectionData->GetReadLength() > 0);
 					}
 					else
 					{
 						continueProcessing = false;
 					}
 				}
-				else if (connectionData->readState == ReadStateChunked)
+				else if (localConnectionData->readState == ReadStateChunked)
 				{
-					// append the remnant of the read queue to the vector
-					auto& requestData = localConnectionData->requestData;
+					// decode whatever we have in place
+					char* chunkData = reinterpret_cast<char*>(&localConnectionData->readBuffer[localConnectionData->readOffset]);
+					size_t chunkSize = localConnectionData->GetReadLength();
 
-					size_t addedSize = readQueue.size() - requestData.size();
-					size_t oldSize = requestData.size();
-					requestData.resize(readQueue.size());
+					int result = phr_decode_chunked(&localConnectionData->decoder, chunkData, &chunkSize);
 
-					// copy the appendant
-					std::copy(readQueue.begin() + oldSize, readQueue.end(), requestData.begin() + localConnectionData->lastLength);
-
-					// decode stuff
-					size_t requestSize = addedSize;
+					if (result == -1)
+					{
+						stream->Close();
+						return;
+					}
 
-					int result = phr_decode_chunked(&localConnectionData->decoder, reinterpret_cast<char*>(&requestData[localConnectionData->lastLength]), &requestSize);
+					// the decoded data is at the start of what we passed
+					auto& bodyData = localConnectionData->bodyData;
+					bodyData.insert(bodyData.end(), chunkData, chunkData + chunkSize);
 
 					if (result == -2)
 					{
-						localConnectionData->lastLength += requestSize;
+						// all input was consumed
+						localConnectionData->readOffset = localConnectionData->readBuffer.size();
 
 						continueProcessing = false;
 					}
-					else if (result == -1)
-					{
-						stream->Close();
-						return;
-					}
 					else
 					{
+						// anything left over follows the decoded data, and belongs to the next request
+						localConnectionData->readOffset += chunkSize;
+						localConnectionData->readBuffer.resize(localConnectionData->readOffset + result);
+
 						// call the data handler
-						auto& dataHandler = localConnectionData->request->GetDataHandler();
+						auto dataHandler = localConnectionData->request->GetDataHandler();
+						localConnectionData->request->SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
 
 						if (dataHandler)
 						{
-							requestData.resize(localConnectionData->lastLength);
-
-							dataHandler(requestData);
-
-							localConnectionData->request->SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
+							dataHandler(bodyData);
 						}
 
 						// clean up the req/res
 						localConnectionData->request = nullptr;
 						localConnectionData->response = nullptr;
 
-						localConnectionData->requestData.clear();
+						bodyData.clear();
 
 						localConnectionData->readState = ReadStateRequest;
 
-						continueProcessing = (readQueue.size() > 0);
+						continueProcessing = (localConnectionData->GetReadLength() > 0);
 					}
 				}
 			}
 		});
 	}
 
-	HttpRequest::HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderMap& headerList)
-		: m_httpVersionMajor(httpVersionMajor), m_httpVersionMinor(httpVersionMinor), m_requestMethod(requestMethod), m_path(path), m_headerList(headerList)
+	HttpConnection::HttpConnection(fwRefContainer<TcpServerStream> stream)
+		: m_stream(stream), m_closed(false), m_processingResponses(false)
 	{
+
 	}
 
-	HttpRequest::~HttpRequest()
+	void HttpConnection::QueueResponse(fwRefContainer<HttpResponse> response)
 	{
-		SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
+		m_responses.push_back(response);
 	}
 
-	HttpResponse::HttpResponse(fwRefContainer<TcpServerStream> clientStream, fwRefContainer<HttpRequest> request)
-		: m_clientStream(clientStream), m_ended(false), m_statusCode(200), m_sentHeaders(false), m_request(request), m_closeConnection(false)
+	bool HttpConnection::IsHead(HttpResponse* response)
 	{
-
+		return (!m_responses.empty() && m_responses.front().GetRef() == response);
 	}
 
-	std::string HttpResponse::GetHeader(const std::string& name)
+	void HttpConnection::OnResponseEnded(HttpResponse* response)
 	{
-		auto it = m_headerList.find(name);
+		// we'll get called again while flushing the following responses - the outer call takes care of them
+		if (m_processingResponses)
+		{
+			return;
+		}
 
-		return (it == m_headerList.end()) ? std::string() : it->second;
+		fwRefContainer<HttpConnection> thisRef = this;
+
+		m_processingResponses = true;
+
+		while (!m_closed && !m_responses.empty() && m_responses.front()->HasEnded())
+		{
+			fwRefContainer<HttpResponse> endedResponse = m_responses.front();
+			m_responses.pop_front();
+
+			if (endedResponse->ShouldCloseConnection())
+			{
+				// anything pipelined after this response will never be sent
+				m_stream->Close();
+				break;
+			}
+
+			// the next response can now write directly
+			if (!m_responses.empty())
+			{
+				m_responses.front()->OnBecameHead();
+			}
+		}
+
+		m_processingResponses = false;
 	}
 
-	void HttpResponse::SetHeader(const std::string& name, const std::string& value)
+	void HttpConnection::OnDrain()
 	{
-		m_headerList[name] = value;
+		if (!m_responses.empty())
+		{
+			fwRefContainer<HttpResponse> response = m_responses.front();
+			response->OnDrain();
+		}
 	}
 
-	void HttpResponse::RemoveHeader(const std::string& name)
+	void HttpConnection::OnClose()
 	{
-		m_headerList.erase(name);
+		m_closed = true;
+
+		// release the responses, and with them any references to us
+		std::deque<fwRefContainer<HttpResponse>> responses;
+		responses.swap(m_responses);
+
+		for (auto& response : responses)
+		{
+			response->OnConnectionClosed();
+		}
 	}
 
-	void HttpResponse::WriteHead(int statusCode)
+	HttpRequest::HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const HeaderMap& headerList)
+		: m_httpVersionMajor(httpVersionMajor), m_httpVersionMinor(httpVersionMinor), m_requestMethod(requestMethod), m_path(path), m_numHeaders(0), m_headerList(headerList), m_headerListBuilt(true), m_hasBody(false)
 	{
-		return HttpResponse::WriteHead(statusCode, std::string(""));
 	}
 
-	void HttpResponse::WriteHead(int statusCode, const HeaderMap& headers)
+	HttpRequest::HttpRequest(int httpVersionMajor, int httpVersionMinor, const std::string& requestMethod, const std::string& path, const Slice& head, const HttpHeaderView* headers, size_t numHeaders)
+		: m_httpVersionMajor(httpVersionMajor), m_httpVersionMinor(httpVersionMinor), m_requestMethod(requestMethod), m_path(path), m_head(head.Retain()), m_numHeaders((numHeaders < MaxHeaderCount) ? numHeaders : MaxHeaderCount), m_headerListBuilt(false), m_hasBody(false)
 	{
-		return HttpResponse::WriteHead(statusCode, std::string(""), headers);
+		assert(head.IsOwned());
+
+		std::copy(headers, headers + m_numHeaders, m_headerViews.begin());
 	}
 
-	void HttpResponse::WriteHead(int statusCode, const std::string& statusMessage)
+	const HeaderMap& HttpRequest::GetHeaders() const
 	{
-		return HttpResponse::WriteHead(statusCode, statusMessage, HeaderMap());
+		if (!m_headerListBuilt)
+		{
+			for (size_t i = 0; i < m_numHeaders; i++)
+			{
+				auto& header = m_headerViews[i];
+
+				// skip continuation lines
+				if (header.name)
+				{
+					m_headerList.insert(std::make_pair(std::string(header.name, header.nameLength), std::string(header.value, header.valueLength)));
+				}
+			}
+
+			m_headerListBuilt = true;
+		}
+
+		return m_headerList;
 	}
 
-	void HttpResponse::WriteHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers)
+	std::string HttpRequest::GetHeader(const std::string& key, const std::string& defaultValue) const
 	{
-		if (m_sentHeaders)
+		const char* value;
+		size_t valueLength;
+
+		if (FindHeader(key.c_str(), &value, &valueLength))
 		{
-			return;
+			return std::string(value, valueLength);
 		}
 
-		std::ostringstream outData;
-		outData.imbue(std::locale());
+		return defaultValue;
+	}
 
-		outData << "HTTP/1.0 " << std::to_string(statusCode) << " " << (statusMessage.empty() ? GetStatusMessage(statusCode) : statusMessage) << "\r\n";
+	std::string HttpRequest::GetParameter(const std::string& name, const std::string& defaultValue) const
+	{
+		for (auto& parameter : m_parameters)
+		{
+			if (parameter.first == name)
+			{
+				return parameter.second;
+			}
+		}
 
-		auto& usedHeaders = (headers.size() == 0) ? m_headerList : headers;
+		return defaultValue;
+	}
 
-		if (usedHeaders.find("date") == usedHeaders.end())
+	bool HttpRequest::FindHeader(const char* name, const char** value, size_t* valueLength) const
+	{
+		// requests that were created from a header map don't have any views
+		if (m_numHeaders == 0)
 		{
-			std::time_t timeVal;
-			std::time(&timeVal);
+			auto it = m_headerList.find(name);
 
-			std::tm time = *std::gmtime(&timeVal);
-			outData << "Date: " << std::put_time(&time, "%a, %d %b %Y %H:%M:%S %Z") << "\r\n";
+			if (it == m_headerList.end())
+			{
+				return false;
+			}
+
+			*value = it->second.c_str();
+			*valueLength = it->second.size();
+
+			return true;
 		}
 
-		auto requestConnection = m_request->GetHeader(std::string("connection"), std::string("close"));
+		size_t nameLength = strlen(name);
 
-		if (_stricmp(requestConnection.c_str(), "keep-alive") != 0)
+		for (size_t i = 0; i < m_numHeaders; i++)
 		{
-			outData << "Connection: close\r\n";
+			auto& header = m_headerViews[i];
 
-			m_closeConnection = true;
-		}
-		else
-		{
-			outData << "Connection: keep-alive\r\n";
-		}
+			if (header.name && header.nameLength == nameLength && _strnicmp(header.name, name, nameLength) == 0)
+			{
+				*value = header.value;
+				*valueLength = header.valueLength;
 
-		for (auto& header : usedHeaders)
-		{
-			outData << header.first << ": " << header.second << "\r\n";
+				return true;
+			}
 		}
 
-		outData << "\r\n";
-
-		std::string outStr = outData.str();
+		return false;
+	}
 
-		std::vector<uint8_t> dataBuffer(outStr.size());
-		memcpy(&dataBuffer[0], outStr.c_str(), outStr.size());
+	HttpRequest::~HttpRequest()
+	{
+		SetDataHandler(std::function<void(const std::vector<uint8_t>&)>());
+	}
 
-		m_clientStream->Write(dataBuffer);
+	HttpResponse::HttpResponse(fwRefContainer<HttpConnection> connection, fwRefContainer<HttpRequest> request)
+		: m_connection(connection), m_clientStream(connection->GetStream()), m_ended(false), m_statusCode(200), m_sentHeaders(false), m_request(request), m_closeConnection(false), m_chunked(false), m_producerPool(nullptr), m_producing(false), m_compressionEnabled(false),
+		  m_owningThread(std::this_thread::get_id())
+	{
 
-		m_sentHeaders = true;
 	}
 
-	void HttpResponse::Write(const std::string& data)
+	HttpResponse::~HttpResponse()
 	{
-		SetHeader(std::string("Content-Length"), std::to_string(data.size()));
 
-		if (!m_sentHeaders)
-		{
-			WriteHead(m_statusCode);
-		}
+	}
 
-		std::vector<uint8_t> dataBuffer(data.size());
-		memcpy(&dataBuffer[0], data.c_str(), data.size());
+	std::string HttpResponse::GetHeader(const std::string& name)
+	{
+		auto it = m_headerList.find(name);
 
-		m_clientStream->Write(dataBuffer);
+		return (it == m_headerList.end()) ? std::string() : it->second;
 	}
 
-	void HttpResponse::End(const std::string& data)
+	void HttpResponse::SetHeader(const std::string& name, const std::string& value)
 	{
-		Write(data);
-		End();
+		m_headerList[name] = value;
 	}
 
-	void HttpResponse::End()
+	void HttpResponse::RemoveHeader(const std::string& name)
 	{
-		if (m_closeConnection)
-		{
-			m_clientStream->Close();
-		}
+		m_headerList.erase(name);
+	}
+
+	void HttpResponse::WriteHead(int statusCode)
+	{
+		return HttpResponse::WriteHead(statusCode, std::string(""));
 	}
 
+	void HttpResponse::WriteHead(int statusCode, const HeaderMap& headers)
+	{
+		return HttpResponse::WriteHead(statusCode, std::string(""), headers);
+	}
+
+	void HttpResponse::WriteHead(int statusCode, const std::string& statusMessage)
+	{
+		return HttpResponse::WriteHead(statusCode, statusMessage, HeaderMap());
+	}
+
+	void HttpResponse::WriteHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers)
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->WriteHead(statusCode, statusMessage, headers);
+			});
+
+			return;
+		}
+		if (m_sentHeaders)
+		{
+			return;
+		}
+
+		m_statusCode = statusCode;
+
+		// explicitly passed headers replace ours entirely, so leave those alone
+		if (headers.empty())
+		{
+			StartCompression();
+		}
+
+		std::string outStr = FormatHead(statusCode, statusMessage, headers);
+
+		net::Slice head = net::Slice::Copy(outStr.c_str(), outStr.size());
+		WriteData(&head, 1);
+
+		m_sentHeaders = true;
+	}
+
+	bool HttpResponse::IsHttp11()
+	{
+		auto version = m_request->GetHttpVersion();
+
+		return (version.first > 1 || (version.first == 1 && version.second >= 1));
+	}
+
+	bool HttpResponse::HasBody()
+	{
+		if (m_request->GetRequestMethod() == "HEAD")
+		{
+			return false;
+		}
+
+		return !((m_statusCode >= 100 && m_statusCode < 200) || m_statusCode == 204 || m_statusCode == 304);
+	}
+
+	std::string HttpResponse::FormatHead(int statusCode, const std::string& statusMessage, const HeaderMap& headers)
+	{
+		std::ostringstream outData;
+		outData.imbue(std::locale());
+
+		bool isHttp11 = IsHttp11();
+
+		outData << (isHttp11 ? "HTTP/1.1 " : "HTTP/1.0 ") << std::to_string(statusCode) << " " << (statusMessage.empty() ? GetStatusMessage(statusCode) : statusMessage) << "\r\n";
+
+		auto& usedHeaders = (headers.size() == 0) ? m_headerList : headers;
+
+		if (usedHeaders.find("date") == usedHeaders.end())
+		{
+			std::time_t timeVal;
+			std::time(&timeVal);
+
+			std::tm time = *std::gmtime(&timeVal);
+			outData << "Date: " << std::put_time(&time, "%a, %d %b %Y %H:%M:%S %Z") << "\r\n";
+		}
+
+		// HTTP/1.1 connections persist unless asked not to, HTTP/1.0 ones only if asked to
+		auto requestConnection = m_request->GetHeader(std::string("connection"), std::string());
+
+		if (isHttp11)
+		{
+			if (_stricmp(requestConnection.c_str(), "close") == 0)
+			{
+				m_closeConnection = true;
+			}
+		}
+		else if (_stricmp(requestConnection.c_str(), "keep-alive") != 0)
+		{
+			m_closeConnection = true;
+		}
+
+		// if we don't know the length of the body, we need to either chunk it or end it by closing the connection
+		if (HasBody() && usedHeaders.find("content-length") == usedHeaders.end() && usedHeaders.find("transfer-encoding") == usedHeaders.end())
+		{
+			if (isHttp11)
+			{
+				outData << "Transfer-Encoding: chunked\r\n";
+
+				m_chunked = true;
+			}
+			else
+			{
+				m_closeConnection = true;
+			}
+		}
+
+		if (m_closeConnection)
+		{
+			outData << "Connection: close\r\n";
+		}
+		else if (!isHttp11)
+		{
+			outData << "Connection: keep-alive\r\n";
+		}
+
+		for (auto& header : usedHeaders)
+		{
+			outData << header.first << ": " << header.second << "\r\n";
+		}
+
+		outData << "\r\n";
+
+		return outData.str();
+	}
+
+	void HttpResponse::WriteData(const net::Slice* slices, size_t count)
+	{
+		if (m_connection->IsClosed())
+		{
+			return;
+		}
+
+		// only the oldest response on the connection may write - later ones wait for it to end
+		if (m_connection->IsHead(this))
+		{
+			m_clientStream->WriteV(slices, count);
+		}
+		else
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				m_bufferedData.push_back(slices[i].Retain());
+			}
+		}
+	}
+
+	void HttpResponse::WriteContinue()
+	{
+		static const char continueResponse[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+		net::Slice data = net::Slice::Borrow(continueResponse, sizeof(continueResponse) - 1);
+		WriteData(&data, 1);
+	}
+
+	bool HttpResponse::IsWritable()
+	{
+		return (!m_connection->IsClosed() && m_connection->IsHead(this) && m_clientStream->IsWritable());
+	}
+
+	void HttpResponse::EnableCompression()
+	{
+		m_compressionEnabled = true;
+	}
+
+	void HttpResponse::StartCompression()
+	{
+		if (!m_compressionEnabled || m_compressor || m_statusCode != 200 || !HasBody())
+		{
+			return;
+		}
+
+		// the handler may have compressed the body itself
+		if (m_headerList.find("Content-Encoding") != m_headerList.end())
+		{
+			return;
+		}
+
+		// caches have to keep variants apart, even if we end up not compressing
+		auto vary = m_headerList.find("Vary");
+
+		if (vary == m_headerList.end())
+		{
+			SetHeader(std::string("Vary"), std::string("Accept-Encoding"));
+		}
+		else if (vary->second.find("Accept-Encoding") == std::string::npos)
+		{
+			vary->second += ", Accept-Encoding";
+		}
+
+		ContentEncoding encoding = NegotiateContentEncoding(m_request.GetRef());
+
+		if (encoding == ContentEncoding::Identity)
+		{
+			return;
+		}
+
+		m_compressor = std::make_unique<HttpCompressor>(encoding);
+
+		// the length we may have been given is the uncompressed one
+		SetHeader(std::string("Content-Encoding"), GetContentEncodingName(encoding));
+		RemoveHeader(std::string("Content-Length"));
+	}
+
+	bool HttpResponse::Write(const std::string& data)
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->Write(data);
+			});
+
+			return m_clientStream->IsWritable();
+		}
+		if (m_ended)
+		{
+			return false;
+		}
+
+		if (!m_sentHeaders)
+		{
+			StartCompression();
+		}
+
+		if (m_compressor)
+		{
+			std::string compressed;
+			m_compressor->Compress(data.c_str(), data.size(), false, compressed);
+
+			return WriteBody(compressed);
+		}
+
+		return WriteBody(data);
+	}
+
+	bool HttpResponse::WriteBody(const std::string& data)
+	{
+		net::Slice slices[4];
+		size_t numSlices = 0;
+
+		std::string head;
+		char chunkHeader[32];
+
+		if (!m_sentHeaders)
+		{
+			head = FormatHead(m_statusCode, std::string(), HeaderMap());
+			slices[numSlices++] = net::Slice::Borrow(head.c_str(), head.size());
+
+			m_sentHeaders = true;
+		}
+
+		if (!data.empty() && HasBody())
+		{
+			if (m_chunked)
+			{
+				int chunkHeaderLength = snprintf(chunkHeader, sizeof(chunkHeader), "%x\r\n", static_cast<unsigned int>(data.size()));
+
+				slices[numSlices++] = net::Slice::Borrow(chunkHeader, chunkHeaderLength);
+			}
+
+			// the stream will copy the data if it needs to keep it around
+			slices[numSlices++] = net::Slice::Borrow(data.c_str(), data.size());
+
+			if (m_chunked)
+			{
+				slices[numSlices++] = net::Slice::Borrow("\r\n", 2);
+			}
+		}
+
+		// send the head and the body in a single write
+		if (numSlices > 0)
+		{
+			WriteData(slices, numSlices);
+		}
+
+		return IsWritable();
+	}
+
+	void HttpResponse::WriteStream(const TStreamProducer& producer)
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->WriteStream(producer);
+			});
+
+			return;
+		}
+		if (!m_sentHeaders)
+		{
+			WriteHead(m_statusCode);
+		}
+
+		m_streamProducer = producer;
+
+		PumpStream();
+	}
+
+	void HttpResponse::SendFile(const std::string& nativePath, uint64_t offset, uint64_t length)
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->SendFile(nativePath, offset, length);
+			});
+
+			return;
+		}
+		if (m_ended)
+		{
+			return;
+		}
+
+		if (!m_sentHeaders)
+		{
+			if (m_headerList.find("Content-Length") == m_headerList.end() && m_headerList.find("Transfer-Encoding") == m_headerList.end())
+			{
+				SetHeader(std::string("Content-Length"), std::to_string(length));
+			}
+
+			WriteHead(m_statusCode);
+		}
+
+		if (!HasBody() || length == 0)
+		{
+			End();
+			return;
+		}
+
+		// the stream can only send the file directly if nothing has to be framed around or done to it, or held back for
+		// earlier responses
+		if (!m_chunked && !m_compressor && !m_connection->IsClosed() && m_connection->IsHead(this))
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			bool sending = m_clientStream->SendFile(nativePath, offset, length, [=] (bool success)
+			{
+				// the client won't get the length we promised, so it can only tell by the connection closing
+				if (!success)
+				{
+					thisRef->m_closeConnection = true;
+				}
+
+				thisRef->End();
+			});
+
+			if (sending)
+			{
+				return;
+			}
+		}
+
+		// otherwise, read the file ourselves - off the loop, as even opening it may block
+		std::shared_ptr<std::ifstream> file;
+		uint64_t remaining = length;
+
+		WriteBlockingStream([=] (std::string& chunk, bool& failed) mutable
+		{
+			static const size_t ChunkSize = 65536;
+
+			if (!file)
+			{
+				file = std::make_shared<std::ifstream>(nativePath, std::ios::binary);
+				file->seekg(offset);
+			}
+
+			chunk.resize(static_cast<size_t>(std::min(remaining, static_cast<uint64_t>(ChunkSize))));
+			file->read(&chunk[0], chunk.size());
+
+			size_t readLength = static_cast<size_t>(file->gcount());
+			chunk.resize(readLength);
+
+			remaining -= readLength;
+
+			if (readLength == 0 && remaining > 0)
+			{
+				trace("reading %s for a response failed\n", nativePath.c_str());
+
+				failed = true;
+				return false;
+			}
+
+			return (remaining > 0);
+		});
+	}
+
+	void HttpResponse::WriteBlockingStream(const TBlockingStreamProducer& producer, WorkerPool* pool)
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->WriteBlockingStream(producer, pool);
+			});
+
+			return;
+		}
+
+		if (!m_sentHeaders)
+		{
+			WriteHead(m_statusCode);
+		}
+
+		// shared, as the producer keeps its state across the calls on the pool
+		m_blockingProducer = std::make_shared<TBlockingStreamProducer>(producer);
+		m_producerPool = pool;
+
+		PumpStream();
+	}
+
+	void HttpResponse::OnBlockingChunk(const std::string& chunk, bool hasMore, bool failed)
+	{
+		m_producing = false;
+
+		// the connection closed while the producer ran
+		if (!m_blockingProducer)
+		{
+			return;
+		}
+
+		Write(chunk);
+
+		if (!hasMore || failed)
+		{
+			m_blockingProducer.reset();
+
+			// the client won't get the length we promised, so it can only tell by the connection closing
+			if (failed)
+			{
+				m_closeConnection = true;
+			}
+
+			End();
+			return;
+		}
+
+		PumpStream();
+	}
+
+	void HttpResponse::PumpStream()
+	{
+		// keep a reference, as ending the response may release the last one held by the connection
+		fwRefContainer<HttpResponse> thisRef = this;
+
+		std::string chunk;
+
+		// if the client isn't keeping up (or we're waiting on an earlier response), we'll get called again on drain
+		while (m_streamProducer && IsWritable())
+		{
+			chunk.clear();
+
+			bool hasMore = m_streamProducer(chunk);
+			Write(chunk);
+
+			if (!hasMore)
+			{
+				m_streamProducer = TStreamProducer();
+
+				End();
+				break;
+			}
+		}
+
+		if (m_blockingProducer && !m_producing && IsWritable())
+		{
+			m_producing = true;
+
+			auto producer = m_blockingProducer;
+			auto stream = m_clientStream;
+
+			m_producerPool->Enqueue([thisRef, producer, stream] ()
+			{
+				auto chunk = std::make_shared<std::string>();
+				bool failed = false;
+
+				bool hasMore = (*producer)(*chunk, failed);
+
+				stream->ScheduleCallback([thisRef, chunk, hasMore, failed] ()
+				{
+					thisRef->OnBlockingChunk(*chunk, hasMore, failed);
+				});
+			});
+		}
+	}
+
+	void HttpResponse::OnBecameHead()
+	{
+		if (!m_bufferedData.empty())
+		{
+			std::vector<net::Slice> bufferedData;
+			bufferedData.swap(m_bufferedData);
+
+			m_clientStream->WriteV(bufferedData.data(), bufferedData.size());
+		}
+
+		PumpStream();
+	}
+
+	void HttpResponse::OnDrain()
+	{
+		PumpStream();
+	}
+
+	void HttpResponse::OnConnectionClosed()
+	{
+		m_streamProducer = TStreamProducer();
+		m_blockingProducer.reset();
+		m_bufferedData.clear();
+	}
+
+	size_t HttpResponse::GetQueuedBytes()
+	{
+		return m_clientStream->GetQueuedBytes();
+	}
+
+	void HttpResponse::End(const std::string& data)
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->End(data);
+			});
+
+			return;
+		}
+		// if this is all there is to the body, we know its length
+		if (!m_sentHeaders && m_headerList.find("Content-Length") == m_headerList.end() && m_headerList.find("Transfer-Encoding") == m_headerList.end())
+		{
+			StartCompression();
+
+			// ... even if it's compressed, as we can do so in one go
+			if (m_compressor)
+			{
+				std::string compressed;
+				m_compressor->Compress(data.c_str(), data.size(), true, compressed);
+
+				m_compressor.reset();
+
+				SetHeader(std::string("Content-Length"), std::to_string(compressed.size()));
+
+				WriteBody(compressed);
+				End();
+
+				return;
+			}
+
+			SetHeader(std::string("Content-Length"), std::to_string(data.size()));
+		}
+
+		Write(data);
+		End();
+	}
+
+	void HttpResponse::End()
+	{
+		if (!IsOwningThread())
+		{
+			fwRefContainer<HttpResponse> thisRef = this;
+
+			m_clientStream->ScheduleCallback([=] ()
+			{
+				thisRef->End();
+			});
+
+			return;
+		}
+		if (m_ended)
+		{
+			return;
+		}
+
+		if (!m_sentHeaders)
+		{
+			if (m_headerList.find("Content-Length") == m_headerList.end() && m_headerList.find("Transfer-Encoding") == m_headerList.end())
+			{
+				SetHeader(std::string("Content-Length"), std::string("0"));
+			}
+
+			// there's no body left to compress
+			m_compressionEnabled = false;
+
+			WriteHead(m_statusCode);
+		}
+
+		if (m_compressor)
+		{
+			std::string compressed;
+			m_compressor->Compress(nullptr, 0, true, compressed);
+
+			m_compressor.reset();
+
+			WriteBody(compressed);
+		}
+
+		if (m_chunked)
+		{
+			net::Slice terminator = net::Slice::Borrow("0\r\n\r\n", 5);
+			WriteData(&terminator, 1);
+		}
+
+		m_ended = true;
+
+		m_connection->OnResponseEnded(this);
+	}
 
 	std::string HttpResponse::GetStatusMessage(int statusCode)
 	{
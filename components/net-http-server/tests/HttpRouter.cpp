@@ -0,0 +1,69 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include "HttpTestServer.h"
+
+#include <future>
+
+using namespace net;
+
+TEST(HttpRouter, AsyncRoutesGetTheCompleteBody)
+{
+	WorkerPool pool(2);
+
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	std::promise<std::string> received;
+	std::thread::id handlerThread;
+
+	server.GetRouter()->AddAsyncRoute("POST", "/upload", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const std::vector<uint8_t>& body)
+	{
+		handlerThread = std::this_thread::get_id();
+
+		received.set_value(std::string(body.begin(), body.end()));
+	}, &pool);
+
+	// nothing gets queued until the body is complete
+	stream->Receive("POST /upload HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello");
+
+	auto future = received.get_future();
+
+	EXPECT_EQ(std::future_status::timeout, future.wait_for(std::chrono::milliseconds(50)));
+
+	// and the stream reusing its body buffer doesn't affect the body the handler got
+	stream->Receive(" worldPOST /other HTTP/1.1\r\nContent-Length: 11\r\n\r\nxxxxxxxxxxx");
+
+	ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds(5)));
+	EXPECT_EQ("hello world", future.get());
+	EXPECT_NE(std::this_thread::get_id(), handlerThread);
+}
+
+TEST(HttpRouter, AsyncRoutesWithoutBodyRunRightAway)
+{
+	WorkerPool pool(1);
+
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	std::promise<size_t> received;
+
+	server.GetRouter()->AddAsyncRoute("GET", "/info", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response, const std::vector<uint8_t>& body)
+	{
+		received.set_value(body.size());
+	}, &pool);
+
+	stream->Receive("GET /info HTTP/1.1\r\n\r\n");
+
+	auto future = received.get_future();
+
+	ASSERT_EQ(std::future_status::ready, future.wait_for(std::chrono::seconds(5)));
+	EXPECT_EQ(0, future.get());
+}
@@ -0,0 +1,545 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include "HttpTestServer.h"
+
+#include <fstream>
+
+using namespace net;
+
+TEST(HttpServer, KeepsHttp11ConnectionsOpen)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	server.GetRouter()->AddRoute("GET", "/hello", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->End(std::string("hello"));
+	});
+
+	stream->Receive("GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n");
+	stream->Receive("GET /hello HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(2, responses.size());
+	EXPECT_EQ(200, responses[1].statusCode);
+	EXPECT_EQ("hello", responses[1].body);
+	EXPECT_FALSE(stream->closed);
+
+	// unless asked not to
+	stream->Receive("GET /hello HTTP/1.1\r\nConnection: close\r\n\r\n");
+
+	EXPECT_EQ(3, ParseHttpResponses(stream->written).size());
+	EXPECT_TRUE(stream->closed);
+}
+
+TEST(HttpServer, ClosesHttp10ConnectionsUnlessKeptAlive)
+{
+	HttpTestServer server;
+
+	server.GetRouter()->AddRoute("GET", "/hello", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->End(std::string("hello"));
+	});
+
+	fwRefContainer<HttpTestStream> keptAlive = server.Connect();
+	keptAlive->Receive("GET /hello HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+
+	EXPECT_EQ(1, ParseHttpResponses(keptAlive->written).size());
+	EXPECT_FALSE(keptAlive->closed);
+
+	fwRefContainer<HttpTestStream> closed = server.Connect();
+	closed->Receive("GET /hello HTTP/1.0\r\n\r\n");
+
+	EXPECT_EQ("hello", closed->written.substr(closed->written.size() - 5));
+	EXPECT_TRUE(closed->closed);
+}
+
+TEST(HttpServer, PipelinedResponsesKeepRequestOrder)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	fwRefContainer<HttpResponse> slowResponse;
+
+	server.GetRouter()->AddRoute("GET", "/slow", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		// answered later
+		slowResponse = response;
+	});
+
+	server.GetRouter()->AddRoute("GET", "/fast", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->End(std::string("fast"));
+	});
+
+	stream->Receive("GET /slow HTTP/1.1\r\n\r\nGET /fast HTTP/1.1\r\n\r\n");
+
+	// the second response ended, but can't go out before the first
+	EXPECT_TRUE(stream->written.empty());
+
+	ASSERT_TRUE(slowResponse.GetRef());
+	slowResponse->End(std::string("slow"));
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(2, responses.size());
+	EXPECT_EQ("slow", responses[0].body);
+	EXPECT_EQ("fast", responses[1].body);
+}
+
+TEST(HttpServer, ReadsBodyByContentLength)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	std::vector<std::string> bodies;
+
+	server.GetRouter()->AddRoute("POST", "/echo", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		request->SetDataHandler([&bodies, response] (const std::vector<uint8_t>& data)
+		{
+			bodies.emplace_back(data.begin(), data.end());
+
+			response->End(bodies.back());
+		});
+	});
+
+	// split in the middle of the body, with the next request right behind it
+	stream->Receive("POST /echo HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello ");
+	stream->Receive("worldPOST /echo HTTP/1.1\r\nContent-Length: 0005\r\n\r\nagain");
+
+	ASSERT_EQ(2, bodies.size());
+	EXPECT_EQ("hello world", bodies[0]);
+	EXPECT_EQ("again", bodies[1]);
+	EXPECT_FALSE(stream->closed);
+}
+
+TEST(HttpServer, RejectsInvalidContentLength)
+{
+	for (const char* contentLength : { "-1", "abc", "1e3", "+5", "0x10", "5 5", "" })
+	{
+		HttpTestServer server;
+		fwRefContainer<HttpTestStream> stream = server.Connect();
+
+		int handled = 0;
+
+		server.GetRouter()->AddRoute("", "/*", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+		{
+			handled++;
+			response->End(std::string("handled"));
+		});
+
+		stream->Receive(std::string("POST /upload HTTP/1.1\r\nContent-Length: ") + contentLength + "\r\n\r\nGET /next HTTP/1.1\r\n\r\n");
+
+		auto responses = ParseHttpResponses(stream->written);
+
+		ASSERT_EQ(1, responses.size()) << contentLength;
+		EXPECT_EQ(400, responses[0].statusCode) << contentLength;
+		EXPECT_EQ(0, handled) << contentLength;
+		EXPECT_TRUE(stream->closed) << contentLength;
+	}
+}
+
+TEST(HttpServer, RejectsConflictingContentLengths)
+{
+	HttpTestServer server;
+
+	std::vector<std::string> bodies;
+
+	server.GetRouter()->AddRoute("POST", "/upload", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		request->SetDataHandler([&bodies, response] (const std::vector<uint8_t>& data)
+		{
+			bodies.emplace_back(data.begin(), data.end());
+
+			response->End();
+		});
+	});
+
+	// repeating the same length is fine
+	fwRefContainer<HttpTestStream> repeated = server.Connect();
+	repeated->Receive("POST /upload HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 3\r\n\r\nabc");
+
+	ASSERT_EQ(1, bodies.size());
+	EXPECT_EQ("abc", bodies[0]);
+	EXPECT_EQ(200, ParseHttpResponses(repeated->written)[0].statusCode);
+
+	fwRefContainer<HttpTestStream> conflicting = server.Connect();
+	conflicting->Receive("POST /upload HTTP/1.1\r\nContent-Length: 3\r\nContent-Length: 4\r\n\r\nabcd");
+
+	EXPECT_EQ(1, bodies.size());
+	EXPECT_EQ(400, ParseHttpResponses(conflicting->written)[0].statusCode);
+	EXPECT_TRUE(conflicting->closed);
+}
+
+TEST(HttpServer, RejectsContentLengthAlongWithChunked)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	std::vector<std::string> paths;
+
+	server.GetRouter()->AddRoute("", "/*", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		paths.push_back(request->GetPath());
+		response->End();
+	});
+
+	// depending on which header wins, the 'body' is either empty or a request of its own
+	stream->Receive("POST /upload HTTP/1.1\r\nContent-Length: 30\r\nTransfer-Encoding: chunked\r\n\r\n"
+		"0\r\n\r\nGET /smuggled HTTP/1.1\r\n\r\n");
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(1, responses.size());
+	EXPECT_EQ(400, responses[0].statusCode);
+	EXPECT_TRUE(paths.empty());
+	EXPECT_TRUE(stream->closed);
+}
+
+TEST(HttpServer, RejectsUnknownTransferCodings)
+{
+	for (const char* transferEncoding : { "gzip", "gzip, chunked", "chunked, chunked", "identity" })
+	{
+		HttpTestServer server;
+		fwRefContainer<HttpTestStream> stream = server.Connect();
+
+		stream->Receive(std::string("POST /upload HTTP/1.1\r\nTransfer-Encoding: ") + transferEncoding + "\r\n\r\n0\r\n\r\n");
+
+		auto responses = ParseHttpResponses(stream->written);
+
+		ASSERT_EQ(1, responses.size()) << transferEncoding;
+		EXPECT_EQ(400, responses[0].statusCode) << transferEncoding;
+		EXPECT_TRUE(stream->closed) << transferEncoding;
+	}
+}
+
+TEST(HttpServer, RejectsOversizedBodies)
+{
+	for (const char* contentLength : { "1000000000", "99999999999999999999999" })
+	{
+		HttpTestServer server;
+		fwRefContainer<HttpTestStream> stream = server.Connect();
+
+		stream->Receive(std::string("POST /upload HTTP/1.1\r\nContent-Length: ") + contentLength + "\r\n\r\n");
+
+		auto responses = ParseHttpResponses(stream->written);
+
+		ASSERT_EQ(1, responses.size()) << contentLength;
+		EXPECT_EQ(413, responses[0].statusCode) << contentLength;
+		EXPECT_TRUE(stream->closed) << contentLength;
+	}
+}
+
+TEST(HttpServer, RejectionWaitsForEarlierPipelinedResponses)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	fwRefContainer<HttpResponse> slowResponse;
+
+	server.GetRouter()->AddRoute("GET", "/slow", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		slowResponse = response;
+	});
+
+	stream->Receive("GET /slow HTTP/1.1\r\n\r\nPOST /upload HTTP/1.1\r\nContent-Length: -1\r\n\r\n");
+
+	EXPECT_FALSE(stream->closed);
+
+	// nothing after the rejected request gets looked at
+	stream->Receive("GET /slow HTTP/1.1\r\n\r\n");
+
+	ASSERT_TRUE(slowResponse.GetRef());
+	slowResponse->End(std::string("slow"));
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(2, responses.size());
+	EXPECT_EQ(200, responses[0].statusCode);
+	EXPECT_EQ(400, responses[1].statusCode);
+	EXPECT_TRUE(stream->closed);
+}
+
+TEST(HttpServer, ReadsChunkedBodies)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	std::vector<std::string> bodies;
+
+	server.GetRouter()->AddRoute("POST", "/echo", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		request->SetDataHandler([&bodies, response] (const std::vector<uint8_t>& data)
+		{
+			bodies.emplace_back(data.begin(), data.end());
+
+			response->End(bodies.back());
+		});
+	});
+
+	// chunks split across reads, with an extension and a trailer, and another request right behind
+	stream->Receive("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5;name=value\r\nhel");
+	stream->Receive("lo\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n");
+	stream->Receive("\r\nPOST /echo HTTP/1.1\r\nTransfer-Encoding: Chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n");
+
+	ASSERT_EQ(2, bodies.size());
+	EXPECT_EQ("hello world", bodies[0]);
+	EXPECT_EQ("abc", bodies[1]);
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(2, responses.size());
+	EXPECT_EQ("hello world", responses[0].body);
+	EXPECT_FALSE(stream->closed);
+}
+
+TEST(HttpServer, ClosesOnMalformedChunks)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	stream->Receive("POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n");
+
+	EXPECT_TRUE(stream->closed);
+}
+
+TEST(HttpServer, SendsContinueBeforeReadingBody)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	server.GetRouter()->AddRoute("POST", "/upload", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		request->SetDataHandler([response] (const std::vector<uint8_t>& data)
+		{
+			response->End(std::to_string(data.size()));
+		});
+	});
+
+	stream->Receive("POST /upload HTTP/1.1\r\nContent-Length: 4\r\nExpect: 100-continue\r\n\r\n");
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(1, responses.size());
+	EXPECT_EQ(100, responses[0].statusCode);
+
+	stream->Receive("data");
+
+	responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(2, responses.size());
+	EXPECT_EQ(200, responses[1].statusCode);
+	EXPECT_EQ("4", responses[1].body);
+
+	// a response that's already final makes the interim one pointless
+	stream->Receive("POST /missing HTTP/1.1\r\nContent-Length: 4\r\nExpect: 100-continue\r\n\r\n");
+
+	responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(3, responses.size());
+	EXPECT_EQ(404, responses[2].statusCode);
+
+	// and HTTP/1.0 clients don't know about it
+	stream->Receive("data");
+	stream->Receive("POST /upload HTTP/1.0\r\nConnection: keep-alive\r\nContent-Length: 4\r\nExpect: 100-continue\r\n\r\ndata");
+
+	responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(4, responses.size());
+	EXPECT_EQ(200, responses[3].statusCode);
+}
+
+TEST(HttpServer, LooksUpHeadersInPlace)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	std::vector<fwRefContainer<HttpRequest>> requests;
+
+	server.GetRouter()->AddRoute("GET", "/*", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		requests.push_back(request);
+		response->End();
+	});
+
+	stream->Receive("GET /first?query HTTP/1.1\r\nHost: localhost\r\nX-Padded:   value  \r\nX-Folded: start\r\n continued\r\nx-case: lower\r\n\r\n");
+
+	// reusing the read buffer mustn't affect requests that are still around
+	stream->Receive("GET /second HTTP/1.1\r\nHost: overwritten-host-name-that-is-longer\r\n\r\n");
+
+	ASSERT_EQ(2, requests.size());
+
+	auto& request = requests[0];
+
+	EXPECT_EQ("GET", request->GetRequestMethod());
+	EXPECT_EQ("/first?query", request->GetPath());
+	EXPECT_EQ(1, request->GetHttpVersion().second);
+
+	const char* value;
+	size_t valueLength;
+
+	ASSERT_TRUE(request->FindHeader("host", &value, &valueLength));
+	EXPECT_EQ("localhost", std::string(value, valueLength));
+
+	EXPECT_EQ("value", request->GetHeader("X-PADDED"));
+	EXPECT_EQ("lower", request->GetHeader("X-Case"));
+	EXPECT_EQ("default", request->GetHeader("missing", "default"));
+	EXPECT_FALSE(request->FindHeader("missing", &value, &valueLength));
+
+	// continuation lines don't turn into headers of their own
+	auto& headers = request->GetHeaders();
+
+	EXPECT_EQ(4, headers.size());
+	EXPECT_EQ("start", headers.find("x-folded")->second);
+
+	EXPECT_EQ("overwritten-host-name-that-is-longer", requests[1]->GetHeader("Host"));
+}
+
+TEST(HttpServer, AnswersUnhandledRequestsWith404)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	stream->Receive("GET /nothing HTTP/1.1\r\n\r\nGET /nothing HTTP/1.1\r\n\r\n");
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(2, responses.size());
+	EXPECT_EQ(404, responses[0].statusCode);
+	EXPECT_EQ(404, responses[1].statusCode);
+	EXPECT_FALSE(stream->closed);
+}
+
+TEST(HttpServer, FallsBackToHandlersWithoutMatchingRoute)
+{
+	class TestHandler : public HttpHandler
+	{
+	public:
+		std::vector<std::string> paths;
+
+		virtual bool HandleRequest(fwRefContainer<HttpRequest> request, fwRefContainer<HttpResponse> response) override
+		{
+			paths.push_back(request->GetPath());
+
+			if (request->GetPath() != "/handler")
+			{
+				return false;
+			}
+
+			response->End(std::string("handler"));
+			return true;
+		}
+	};
+
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	fwRefContainer<TestHandler> handler = new TestHandler();
+	server.RegisterHandler(handler);
+
+	server.GetRouter()->AddRoute("GET", "/route", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->End(std::string("route"));
+	});
+
+	stream->Receive("GET /route HTTP/1.1\r\n\r\nGET /handler HTTP/1.1\r\n\r\nGET /neither HTTP/1.1\r\n\r\n");
+
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(3, responses.size());
+	EXPECT_EQ("route", responses[0].body);
+	EXPECT_EQ("handler", responses[1].body);
+	EXPECT_EQ(404, responses[2].statusCode);
+
+	// routes don't go through the handlers at all
+	EXPECT_EQ(std::vector<std::string>({ "/handler", "/neither" }), handler->paths);
+}
+
+TEST(HttpServer, ClosesOnMalformedRequests)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	stream->Receive("GET\r\n\r\n");
+
+	EXPECT_TRUE(stream->closed);
+}
+
+TEST(HttpServer, ReadsFilesOffTheStreamThread)
+{
+	std::string path = ::testing::TempDir() + "http_send_file.bin";
+	std::string contents;
+
+	for (int i = 0; i < 200000; i++)
+	{
+		contents += static_cast<char>('a' + (i % 26));
+	}
+
+	{
+		std::ofstream file(path, std::ios::binary);
+		file << contents;
+	}
+
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	server.GetRouter()->AddRoute("GET", "/file", [&] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->SendFile(path, 10, contents.size() - 20);
+	});
+
+	server.GetRouter()->AddRoute("GET", "/after", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->End(std::string("after"));
+	});
+
+	stream->Receive("GET /file HTTP/1.1\r\n\r\nGET /after HTTP/1.1\r\n\r\n");
+
+	// nothing of the body can be there yet, as reading it is left to the pool
+	auto responses = ParseHttpResponses(stream->written);
+
+	ASSERT_EQ(1, responses.size());
+	EXPECT_TRUE(responses[0].body.empty());
+
+	ASSERT_TRUE(stream->RunScheduled([&] ()
+	{
+		return ParseHttpResponses(stream->written).size() == 2;
+	}));
+
+	responses = ParseHttpResponses(stream->written);
+
+	EXPECT_EQ(contents.substr(10, contents.size() - 20), responses[0].body);
+	EXPECT_EQ("after", responses[1].body);
+	EXPECT_FALSE(stream->closed);
+
+	remove(path.c_str());
+}
+
+TEST(HttpServer, ClosesWhenFileCantBeRead)
+{
+	HttpTestServer server;
+	fwRefContainer<HttpTestStream> stream = server.Connect();
+
+	server.GetRouter()->AddRoute("GET", "/file", [] (const fwRefContainer<HttpRequest>& request, const fwRefContainer<HttpResponse>& response)
+	{
+		response->SendFile(::testing::TempDir() + "http_missing_file.bin", 0, 100);
+	});
+
+	stream->Receive("GET /file HTTP/1.1\r\n\r\n");
+
+	// the length was promised already, so closing is the only way to tell the client
+	EXPECT_TRUE(stream->RunScheduled([&] ()
+	{
+		return stream->closed;
+	}));
+}
@@ -0,0 +1,266 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <HttpServerImpl.h>
+
+#include <TcpServer.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// a stream that records what gets written to it, and gets fed requests by the test - the thread creating it owns it, and
+// callbacks scheduled from other threads run once that thread calls RunScheduled
+class HttpTestStream : public net::TcpServerStream
+{
+private:
+	std::thread::id m_owningThread = std::this_thread::get_id();
+
+	std::mutex m_scheduledMutex;
+
+	std::condition_variable m_scheduledCondition;
+
+	std::deque<TScheduledCallback> m_scheduled;
+
+public:
+	std::string written;
+
+	bool closed = false;
+
+	using net::TcpServerStream::Write;
+
+	virtual net::PeerAddress GetPeerAddress() override
+	{
+		return net::PeerAddress();
+	}
+
+	virtual int GetLoopIndex() override
+	{
+		return 0;
+	}
+
+	virtual void Write(const net::Slice& data) override
+	{
+		written.append(reinterpret_cast<const char*>(data.GetData()), data.GetLength());
+	}
+
+	virtual void Close() override
+	{
+		if (closed)
+		{
+			return;
+		}
+
+		closed = true;
+
+		fwRefContainer<HttpTestStream> thisRef = this;
+
+		if (GetCloseCallback())
+		{
+			GetCloseCallback()();
+		}
+	}
+
+	virtual void ScheduleCallback(const TScheduledCallback& callback) override
+	{
+		if (std::this_thread::get_id() == m_owningThread)
+		{
+			callback();
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(m_scheduledMutex);
+		m_scheduled.push_back(callback);
+
+		m_scheduledCondition.notify_all();
+	}
+
+	// runs callbacks scheduled from other threads until the predicate holds, returning false if it didn't in time
+	template<typename TPredicate>
+	bool RunScheduled(const TPredicate& predicate, std::chrono::milliseconds timeout = std::chrono::seconds(5))
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+
+		while (!predicate())
+		{
+			std::deque<TScheduledCallback> scheduled;
+
+			{
+				std::unique_lock<std::mutex> lock(m_scheduledMutex);
+
+				if (!m_scheduledCondition.wait_until(lock, deadline, [this] () { return !m_scheduled.empty(); }))
+				{
+					return false;
+				}
+
+				scheduled.swap(m_scheduled);
+			}
+
+			for (auto& callback : scheduled)
+			{
+				callback();
+			}
+		}
+
+		return true;
+	}
+
+	void Receive(const std::string& data)
+	{
+		if (closed)
+		{
+			return;
+		}
+
+		fwRefContainer<HttpTestStream> thisRef = this;
+
+		GetReadCallback()(net::Slice::Borrow(data.data(), data.size()));
+	}
+};
+
+// an HTTP server taking connections from test streams rather than a socket
+class HttpTestServer
+{
+private:
+	class TestTcpServer : public net::TcpServer
+	{
+	public:
+		void Connect(fwRefContainer<net::TcpServerStream> stream)
+		{
+			GetConnectionCallback()(stream);
+		}
+	};
+
+	fwRefContainer<TestTcpServer> m_tcpServer;
+
+	fwRefContainer<net::HttpServerImpl> m_httpServer;
+
+public:
+	HttpTestServer()
+		: m_tcpServer(new TestTcpServer()), m_httpServer(new net::HttpServerImpl())
+	{
+		m_httpServer->AttachToServer(m_tcpServer);
+	}
+
+	fwRefContainer<HttpTestStream> Connect()
+	{
+		fwRefContainer<HttpTestStream> stream = new HttpTestStream();
+		m_tcpServer->Connect(stream);
+
+		return stream;
+	}
+
+	fwRefContainer<net::HttpRouter> GetRouter()
+	{
+		return m_httpServer->GetRouter();
+	}
+
+	void RegisterHandler(fwRefContainer<net::HttpHandler> handler)
+	{
+		m_httpServer->RegisterHandler(handler);
+	}
+};
+
+struct ParsedHttpResponse
+{
+	int statusCode;
+
+	// with lowercase names
+	std::map<std::string, std::string> headers;
+
+	std::string body;
+
+	bool chunked;
+};
+
+// splits the output of a stream into responses - interim responses are included, and bodies are delimited by their
+// Content-Length or chunked encoding, or by the end of the data
+inline std::vector<ParsedHttpResponse> ParseHttpResponses(const std::string& data)
+{
+	std::vector<ParsedHttpResponse> responses;
+
+	size_t offset = 0;
+
+	while (offset < data.size())
+	{
+		size_t headEnd = data.find("\r\n\r\n", offset);
+
+		if (headEnd == std::string::npos)
+		{
+			break;
+		}
+
+		ParsedHttpResponse response;
+		response.statusCode = atoi(data.c_str() + offset + 9);
+		response.chunked = false;
+
+		size_t lineStart = data.find("\r\n", offset) + 2;
+
+		while (lineStart < headEnd + 2)
+		{
+			size_t lineEnd = data.find("\r\n", lineStart);
+			size_t colon = data.find(':', lineStart);
+
+			std::string name = data.substr(lineStart, colon - lineStart);
+			std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+			response.headers[name] = data.substr(colon + 2, lineEnd - colon - 2);
+
+			lineStart = lineEnd + 2;
+		}
+
+		offset = headEnd + 4;
+
+		if (response.statusCode >= 100 && response.statusCode < 200)
+		{
+			responses.push_back(response);
+			continue;
+		}
+
+		auto contentLength = response.headers.find("content-length");
+		auto transferEncoding = response.headers.find("transfer-encoding");
+
+		if (transferEncoding != response.headers.end() && transferEncoding->second == "chunked")
+		{
+			response.chunked = true;
+
+			while (offset < data.size())
+			{
+				size_t chunkLength = strtoul(data.c_str() + offset, nullptr, 16);
+				offset = data.find("\r\n", offset) + 2;
+
+				response.body += data.substr(offset, chunkLength);
+				offset += chunkLength + 2;
+
+				if (chunkLength == 0)
+				{
+					break;
+				}
+			}
+		}
+		else if (contentLength != response.headers.end())
+		{
+			size_t length = strtoul(contentLength->second.c_str(), nullptr, 10);
+
+			response.body = data.substr(offset, length);
+			offset += length;
+		}
+		else
+		{
+			response.body = data.substr(offset);
+			offset = data.size();
+		}
+
+		responses.push_back(response);
+	}
+
+	return responses;
+}
@@ -0,0 +1,141 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <HttpCompression.h>
+
+#include <zlib.h>
+
+using namespace net;
+
+static std::string Inflate(const std::string& data)
+{
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+
+	// detect either a zlib or a gzip header
+	inflateInit2(&stream, 15 + 32);
+
+	std::string out;
+	char buffer[16384];
+
+	stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	stream.avail_in = static_cast<uInt>(data.size());
+
+	int result;
+
+	do
+	{
+		stream.next_out = reinterpret_cast<Bytef*>(buffer);
+		stream.avail_out = sizeof(buffer);
+
+		result = inflate(&stream, Z_NO_FLUSH);
+
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+	} while (result == Z_OK);
+
+	inflateEnd(&stream);
+
+	return (result == Z_STREAM_END) ? out : std::string();
+}
+
+static std::string MakeText(size_t length)
+{
+	std::string text;
+
+	while (text.size() < length)
+	{
+		text += "resource_manifest_version '44febabe-d386-4d18-afbe-5e627f4af937' -- " + std::to_string(text.size()) + "\n";
+	}
+
+	text.resize(length);
+
+	return text;
+}
+
+TEST(HttpCompressor, BufferRoundTrip)
+{
+	std::string text = MakeText(256 * 1024);
+
+	for (auto encoding : { ContentEncoding::Gzip, ContentEncoding::Deflate })
+	{
+		std::string compressed;
+		ASSERT_TRUE(HttpCompressor::CompressBuffer(text.data(), text.size(), encoding, compressed));
+
+		EXPECT_LT(compressed.size(), text.size() / 4);
+		EXPECT_EQ(text, Inflate(compressed));
+	}
+}
+
+TEST(HttpCompressor, StreamedRoundTrip)
+{
+	std::string text = MakeText(100000);
+
+	HttpCompressor compressor(ContentEncoding::Gzip);
+	std::string compressed;
+
+	for (size_t offset = 0; offset < text.size(); offset += 7000)
+	{
+		size_t length = std::min<size_t>(7000, text.size() - offset);
+
+		ASSERT_TRUE(compressor.Compress(text.data() + offset, length, false, compressed));
+	}
+
+	ASSERT_TRUE(compressor.Compress(nullptr, 0, true, compressed));
+
+	EXPECT_EQ(text, Inflate(compressed));
+}
+
+TEST(CompressedVariantCache, ConcurrentMissesShareOneBuild)
+{
+	CompressedVariantCache cache(1024 * 1024);
+
+	std::array<uint8_t, 20> hash = { 1, 2, 3 };
+
+	EXPECT_TRUE(cache.BeginBuild(hash, ContentEncoding::Gzip));
+	EXPECT_FALSE(cache.BeginBuild(hash, ContentEncoding::Gzip));
+
+	// other encodings are separate variants
+	EXPECT_TRUE(cache.BeginBuild(hash, ContentEncoding::Deflate));
+	cache.EndBuild(hash, ContentEncoding::Deflate);
+
+	// a failed build lets the next miss try again
+	cache.EndBuild(hash, ContentEncoding::Gzip);
+	EXPECT_TRUE(cache.BeginBuild(hash, ContentEncoding::Gzip));
+
+	cache.Put(hash, ContentEncoding::Gzip, std::make_shared<std::string>("data"));
+	cache.EndBuild(hash, ContentEncoding::Gzip);
+
+	// built variants don't need building again
+	EXPECT_FALSE(cache.BeginBuild(hash, ContentEncoding::Gzip));
+	ASSERT_TRUE(cache.Get(hash, ContentEncoding::Gzip));
+	EXPECT_EQ("data", *cache.Get(hash, ContentEncoding::Gzip));
+}
+
+TEST(CompressedVariantCache, EvictsLeastRecentlyUsed)
+{
+	CompressedVariantCache cache(4096);
+
+	std::array<uint8_t, 20> first = { 1 };
+	std::array<uint8_t, 20> second = { 2 };
+	std::array<uint8_t, 20> third = { 3 };
+
+	cache.Put(first, ContentEncoding::Gzip, std::make_shared<std::string>(1024, 'a'));
+	cache.Put(second, ContentEncoding::Gzip, std::make_shared<std::string>(1024, 'b'));
+
+	// make the first one the most recently used
+	EXPECT_TRUE(cache.Get(first, ContentEncoding::Gzip));
+
+	cache.Put(third, ContentEncoding::Gzip, std::make_shared<std::string>(1024, 'c'));
+	cache.SetMaxSize(2048);
+
+	EXPECT_TRUE(cache.Get(first, ContentEncoding::Gzip));
+	EXPECT_FALSE(cache.Get(second, ContentEncoding::Gzip));
+	EXPECT_TRUE(cache.Get(third, ContentEncoding::Gzip));
+}
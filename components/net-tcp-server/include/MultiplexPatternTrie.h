@@ -0,0 +1,137 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#ifdef COMPILING_NET_TCP_SERVER
+#define TCP_SERVER_EXPORT DLL_EXPORT
+#else
+#define TCP_SERVER_EXPORT DLL_IMPORT
+#endif
+
+namespace net
+{
+enum class MultiplexPatternMatchResult
+{
+	NoMatch,
+	Match,
+	InsufficientData
+};
+
+//
+// A declarative description of the bytes a protocol starts with.
+//
+struct MultiplexPattern
+{
+	// the bytes a connection has to start with
+	std::vector<uint8_t> prefix;
+
+	// bits to compare for each prefix byte - bytes past the end of the mask get compared entirely
+	std::vector<uint8_t> mask;
+
+	// the amount of bytes needed before the pattern can match - the prefix length is implied
+	size_t minLength;
+
+	inline MultiplexPattern()
+		: minLength(0)
+	{
+
+	}
+
+	inline bool MatchesByte(size_t index, uint8_t byte) const
+	{
+		uint8_t byteMask = (index < mask.size()) ? mask[index] : 0xFF;
+
+		return ((byte & byteMask) == (prefix[index] & byteMask));
+	}
+
+	inline size_t GetMinLength() const
+	{
+		return (minLength > prefix.size()) ? minLength : prefix.size();
+	}
+
+	static inline MultiplexPattern FromPrefix(const std::string& prefix, size_t minLength = 0)
+	{
+		MultiplexPattern pattern;
+		pattern.prefix.assign(prefix.begin(), prefix.end());
+		pattern.minLength = minLength;
+
+		return pattern;
+	}
+
+	static inline MultiplexPattern FromMaskedPrefix(const std::vector<uint8_t>& prefix, const std::vector<uint8_t>& mask, size_t minLength = 0)
+	{
+		MultiplexPattern pattern;
+		pattern.prefix = prefix;
+		pattern.mask = mask;
+		pattern.minLength = minLength;
+
+		return pattern;
+	}
+};
+
+//
+// A set of patterns compiled into a decision trie over the initial bytes of a connection, so matching costs a table
+// lookup per byte no matter how many patterns there are.
+//
+// Each trie state has a 256-entry transition table, the root state's acting as a first-byte filter. Masked bytes get
+// expanded into every value they accept, and patterns sharing a prefix share states.
+//
+class TCP_SERVER_EXPORT MultiplexPatternTrie
+{
+private:
+	struct Pattern
+	{
+		MultiplexPattern pattern;
+
+		// what to report on a match
+		size_t tag;
+	};
+
+	struct State
+	{
+		size_t depth;
+
+		// patterns still matching at this state, in the order they were added
+		std::vector<uint32_t> candidates;
+
+		// set if all candidates had their prefix matched, so no further bytes have to be looked at
+		bool terminal;
+
+		// the state to go to for each possible next byte, or -1 if no pattern accepts it
+		std::array<int32_t, 256> next;
+	};
+
+private:
+	std::vector<Pattern> m_patterns;
+
+	std::vector<State> m_states;
+
+public:
+	MultiplexPatternTrie();
+
+	void AddPattern(const MultiplexPattern& pattern, size_t tag);
+
+	// builds the states - needs to be called after adding patterns, before matching
+	void Compile();
+
+	//
+	// Matches the initial bytes of a connection. On a match, outTag receives the tag of the first added pattern that
+	// matched.
+	//
+	MultiplexPatternMatchResult Match(const uint8_t* data, size_t length, size_t* outTag) const;
+
+	inline size_t GetStateCount() const
+	{
+		return m_states.size();
+	}
+};
+}
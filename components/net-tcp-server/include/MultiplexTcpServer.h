@@ -9,6 +9,11 @@
 
 #include "TcpServer.h"
 #include "TcpServerFactory.h"
+#include "MultiplexPatternTrie.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
 
 #ifdef COMPILING_NET_TCP_SERVER
 #define TCP_SERVER_EXPORT DLL_EXPORT
@@ -25,10 +30,12 @@ class MultiplexTcpChildServerStream : public TcpServerStream
 private:
 	fwRefContainer<TcpServerStream> m_baseStream;
 
-	std::vector<uint8_t> m_initialData;
+	Slice m_initialData;
 
 	MultiplexTcpChildServer* m_server;
 
+	int m_loopIndex;
+
 private:
 	void TrySendInitialData();
 
@@ -40,20 +47,35 @@ protected:
 public:
 	MultiplexTcpChildServerStream(MultiplexTcpChildServer* server, fwRefContainer<TcpServerStream> baseStream);
 
-	void SetInitialData(const std::vector<uint8_t>& initialData);
+	void SetInitialData(const Slice& initialData);
 
 	virtual PeerAddress GetPeerAddress() override;
 
-	virtual void Write(const std::vector<uint8_t>& data) override;
+	virtual int GetLoopIndex() override;
 
-	virtual void Close() override;
-};
+	using TcpServerStream::Write;
 
-enum class MultiplexPatternMatchResult
-{
-	NoMatch,
-	Match,
-	InsufficientData
+	virtual void Write(const Slice& data) override;
+
+	virtual void WriteV(const Slice* slices, size_t count) override;
+
+	virtual void Cork() override;
+
+	virtual void Uncork() override;
+
+	virtual size_t GetQueuedBytes() override;
+
+	virtual void SetWriteWatermarks(size_t lowWatermark, size_t highWatermark) override;
+
+	virtual void SetDrainCallback(const TDrainCallback& callback) override;
+
+	virtual bool SendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback) override;
+
+	virtual void ScheduleCallback(const TScheduledCallback& callback) override;
+
+	virtual void SetReadTimeout(std::chrono::milliseconds timeout) override;
+
+	virtual void Close() override;
 };
 
 typedef std::function<MultiplexPatternMatchResult(const std::vector<uint8_t>& bytes)> MultiplexPatternMatchFn;
@@ -63,7 +85,10 @@ class MultiplexTcpChildServer : public TcpServer
 private:
 	MultiplexPatternMatchFn m_patternMatcher;
 
-	std::set<fwRefContainer<TcpServerStream>> m_connections;
+	std::vector<MultiplexPattern> m_patterns;
+
+	// connections, partitioned by the loop they're running on
+	std::array<std::set<fwRefContainer<TcpServerStream>>, TCP_SERVER_MAX_LOOPS> m_connections;
 
 public:
 	inline const MultiplexPatternMatchFn& GetPatternMatcher()
@@ -73,25 +98,77 @@ public:
 
 	void SetPatternMatcher(const MultiplexPatternMatchFn& function);
 
-	void AttachToResult(const std::vector<uint8_t>& existingData, fwRefContainer<TcpServerStream> baseStream);
+	inline const std::vector<MultiplexPattern>& GetPatterns()
+	{
+		return m_patterns;
+	}
+
+	void SetPatterns(const std::vector<MultiplexPattern>& patterns);
+
+	void AttachToResult(const Slice& existingData, fwRefContainer<TcpServerStream> baseStream);
 
 	void CloseStream(MultiplexTcpChildServerStream* stream);
 };
 
 class TCP_SERVER_EXPORT MultiplexTcpServer : public fwRefCountable
 {
+private:
+	// the child servers and their compiled patterns - replaced as a whole when adding a server, as connections on the
+	// loop threads may be matching against it
+	struct MatchTable
+	{
+		std::vector<fwRefContainer<MultiplexTcpChildServer>> servers;
+
+		// tagged with the index of the server in the list above
+		MultiplexPatternTrie trie;
+
+		// whether any of the servers still use a match function
+		bool hasMatchFunctions;
+	};
+
 private:
 	fwRefContainer<TcpServerFactory> m_factory;
 	fwRefContainer<TcpServer> m_rootServer;
 
+	// in milliseconds - read by the loop threads for every new connection
+	std::atomic<int64_t> m_sniffTimeout;
+
 private:
 	std::vector<fwRefContainer<MultiplexTcpChildServer>> m_childServers;
 
+	std::shared_ptr<MatchTable> m_matchTable;
+
+private:
+	void AddServer(const fwRefContainer<MultiplexTcpChildServer>& server);
+
+	void OnConnection(const fwRefContainer<TcpServerStream>& stream);
+
 public:
 	MultiplexTcpServer(const fwRefContainer<TcpServerFactory>& factory);
 
 	void Bind(const PeerAddress& bindAddress);
 
+	// gets the server accepting the connections, for setting connection limits - only set once bound
+	inline fwRefContainer<TcpServer> GetRootServer()
+	{
+		return m_rootServer;
+	}
+
 	fwRefContainer<TcpServer> CreateServer(const MultiplexPatternMatchFn& patternMatchFunction);
+
+	//
+	// Creates a server for connections starting with any of the passed patterns. These are matched using a single
+	// trie for all servers, rather than calling a function per server for every read.
+	//
+	fwRefContainer<TcpServer> CreateServer(const std::vector<MultiplexPattern>& patterns);
+
+	//
+	// Sets how long a new connection can go without sending data before being closed, while it hasn't sent enough to
+	// tell which server it belongs to.
+	//
+	inline void SetSniffTimeout(std::chrono::milliseconds timeout)
+	{
+		m_sniffTimeout = timeout.count();
+	}
 };
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <vector>
+
+#ifdef COMPILING_NET_TCP_SERVER
+#define TCP_SERVER_EXPORT DLL_EXPORT
+#else
+#define TCP_SERVER_EXPORT DLL_IMPORT
+#endif
+
+namespace net
+{
+//
+// Reads the session ticket extension from a serialized TLS client hello - the message body, without the handshake
+// header in front of it. The ticket is left empty if the client didn't send one.
+//
+// Returns false if the message is malformed.
+//
+TCP_SERVER_EXPORT bool ReadClientHelloSessionTicket(const uint8_t* data, size_t length, std::vector<uint8_t>* ticket);
+}
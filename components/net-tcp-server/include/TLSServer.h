@@ -10,10 +10,19 @@
 #include "TcpServer.h"
 #include "TcpServerFactory.h"
 
+#include <NetWorkerPool.h>
+
 #ifdef min
 #undef min
 #endif
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+
 #include <botan/auto_rng.h>
 
 #include <botan/tls_server.h>
@@ -29,6 +38,81 @@ namespace net
 {
 class TLSServer;
 
+class TLSStreamCredentials;
+
+//
+// The keys session tickets get encrypted with. A key gets replaced once it's a lifetime old, and the replaced key still
+// decrypts tickets for another lifetime, so tickets stay valid for as long as they claim to.
+//
+class TCP_SERVER_EXPORT TLSTicketKeys
+{
+private:
+	std::mutex m_mutex;
+
+	Botan::SymmetricKey m_key;
+
+	// only used to decrypt tickets issued before the last rotation
+	Botan::SymmetricKey m_previousKey;
+
+	std::chrono::steady_clock::time_point m_keyTime;
+
+	std::chrono::seconds m_keyLifetime;
+
+public:
+	TLSTicketKeys(std::chrono::seconds keyLifetime);
+
+	// the key to encrypt new tickets with
+	Botan::SymmetricKey GetEncryptionKey(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+	// the key that decrypts the passed ticket - if no key does, the current one, so decrypting fails as it would otherwise
+	Botan::SymmetricKey GetDecryptionKey(const std::vector<uint8_t>& ticket, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+	inline std::chrono::seconds GetKeyLifetime() const
+	{
+		return m_keyLifetime;
+	}
+
+private:
+	// replaces the current key if it's too old, with the mutex held
+	void RotateKey(std::chrono::steady_clock::time_point now);
+};
+
+//
+// A server-wide cache of TLS sessions, letting reconnecting clients resume their session by ID rather than going through
+// a full handshake. Once full, the least recently used sessions get dropped.
+//
+class TCP_SERVER_EXPORT TLSSessionCache : public Botan::TLS::Session_Manager
+{
+private:
+	typedef std::list<Botan::TLS::Session> TSessionList;
+
+	std::mutex m_mutex;
+
+	// most recently used first
+	TSessionList m_sessions;
+
+	std::map<std::vector<uint8_t>, TSessionList::iterator> m_sessionMap;
+
+	size_t m_maxSessions;
+
+	std::chrono::seconds m_sessionLifetime;
+
+public:
+	TLSSessionCache(size_t maxSessions, std::chrono::seconds sessionLifetime);
+
+	virtual bool load_from_session_id(const std::vector<uint8_t>& sessionId, Botan::TLS::Session& session) override;
+
+	virtual bool load_from_server_info(const Botan::TLS::Server_Information& info, Botan::TLS::Session& session) override;
+
+	virtual void remove_entry(const std::vector<uint8_t>& sessionId) override;
+
+	virtual void save(const Botan::TLS::Session& session) override;
+
+	virtual std::chrono::seconds session_lifetime() const override;
+
+	size_t GetSessionCount();
+};
+
 class TLSServerStream : public TcpServerStream
 {
 private:
@@ -38,20 +122,61 @@ private:
 
 	TLSServer* m_parentServer;
 
-	Botan::AutoSeeded_RNG m_rng;
+	int m_loopIndex;
 
-	std::unique_ptr<Botan::TLS::Session_Manager> m_sessionManager;
+	Botan::AutoSeeded_RNG m_rng;
 
 	std::unique_ptr<Botan::TLS::Policy> m_policy;
 
+	// the server's credentials, along with the session ticket this connection's client sent
+	std::shared_ptr<TLSStreamCredentials> m_credentials;
+
 	bool m_closing;
 
+	// set once the current handshake exchanged keys, which resumed handshakes skip
+	bool m_fullHandshake;
+
+	// if set, the TLS engine only runs on this strand, off the stream's loop thread
+	std::shared_ptr<WorkerStrand> m_cryptoStrand;
+
+	// records written by the TLS engine during a call into it, sent off as one write once it returns
+	std::vector<Slice> m_pendingRecords;
+
+	// the pooled block records get copied into, and how much of it is in use
+	fwRefContainer<BufferBlock> m_recordBlock;
+
+	size_t m_recordBlockOffset;
+
+	// plaintext written, but still waiting for the crypto strand to encrypt it
+	std::atomic<size_t> m_pendingPlaintext;
+
+	// set if pending plaintext took the queue over the high watermark, which the base stream doesn't know about
+	std::atomic<bool> m_drainPending;
+
 public:
 	TLSServerStream(TLSServer* server, fwRefContainer<TcpServerStream> baseStream);
 
 	virtual PeerAddress GetPeerAddress() override;
 
-	virtual void Write(const std::vector<uint8_t>& data) override;
+	virtual int GetLoopIndex() override;
+
+	using TcpServerStream::Write;
+
+	virtual void Write(const Slice& data) override;
+
+	virtual void Cork() override;
+
+	virtual void Uncork() override;
+
+	virtual size_t GetQueuedBytes() override;
+
+	virtual void SetWriteWatermarks(size_t lowWatermark, size_t highWatermark) override;
+
+	virtual void SetDrainCallback(const TDrainCallback& callback) override;
+
+	virtual void ScheduleCallback(const TScheduledCallback& callback) override;
+
+	virtual void SetReadTimeout(std::chrono::milliseconds timeout) override;
 
 	virtual void Close() override;
 
@@ -67,6 +192,15 @@ private:
 private:
 	void Initialize();
 
+	// runs a call into the TLS engine on the crypto strand, or right away if not offloading, and writes the records it
+	// produced
+	void RunEngine(const std::function<void()>& callback);
+
+	void FlushRecords();
+
+	// calls the drain callback if writers got held back by pending plaintext, and the queue is short enough again
+	void CheckDrain();
+
 	void CloseInternal();
 };
 
@@ -77,16 +211,76 @@ private:
 
 	std::shared_ptr<Botan::Credentials_Manager> m_credentials;
 
-	std::set<fwRefContainer<TLSServerStream>> m_connections;
+	std::shared_ptr<TLSSessionCache> m_sessionCache;
+
+	std::shared_ptr<TLSTicketKeys> m_ticketKeys;
+
+	std::atomic<uint64_t> m_fullHandshakes;
+
+	std::atomic<uint64_t> m_resumedHandshakes;
+
+	WorkerPool* m_cryptoPool;
+
+	// connections, partitioned by the loop they're running on
+	std::array<std::set<fwRefContainer<TLSServerStream>>, TCP_SERVER_MAX_LOOPS> m_connections;
 
 public:
 	TLSServer(fwRefContainer<TcpServer> baseServer, const std::string& certificatePath, const std::string& keyPath);
 
+	TLSServer(fwRefContainer<TcpServer> baseServer, std::shared_ptr<Botan::Credentials_Manager> credentials);
+
 	inline std::shared_ptr<Botan::Credentials_Manager> GetCredentials()
 	{
 		return m_credentials;
 	}
 
+	inline std::shared_ptr<TLSSessionCache> GetSessionCache()
+	{
+		return m_sessionCache;
+	}
+
+	inline std::shared_ptr<TLSTicketKeys> GetTicketKeys()
+	{
+		return m_ticketKeys;
+	}
+
+	//
+	// Runs handshakes and record encryption for connections accepted from now on on the passed worker pool, so key
+	// exchanges don't stall every other connection on the same loop. Results still get delivered on the stream's loop,
+	// in order. Pass nullptr to run these on the loop again.
+	//
+	inline void SetCryptoPool(WorkerPool* pool)
+	{
+		m_cryptoPool = pool;
+	}
+
+	inline WorkerPool* GetCryptoPool()
+	{
+		return m_cryptoPool;
+	}
+
+	inline void RecordHandshake(bool resumed)
+	{
+		if (resumed)
+		{
+			m_resumedHandshakes++;
+		}
+		else
+		{
+			m_fullHandshakes++;
+		}
+	}
+
+	inline uint64_t GetFullHandshakeCount() const
+	{
+		return m_fullHandshakes;
+	}
+
+	inline uint64_t GetResumedHandshakeCount() const
+	{
+		return m_resumedHandshakes;
+	}
+
 	inline void InvokeConnectionCallback(TLSServerStream* stream)
 	{
 		if (GetConnectionCallback())
@@ -97,7 +291,10 @@ public:
 
 	inline void CloseStream(TLSServerStream* stream)
 	{
-		m_connections.erase(stream);
+		m_connections[stream->GetLoopIndex()].erase(stream);
 	}
+
+private:
+	void Initialize();
 };
 }
\ No newline at end of file
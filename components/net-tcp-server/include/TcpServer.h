@@ -7,7 +7,11 @@
 
 #pragma once
 
+#include <chrono>
+#include <initializer_list>
+
 #include "NetAddress.h"
+#include "NetSlice.h"
 
 #ifdef COMPILING_NET_TCP_SERVER
 #define TCP_SERVER_EXPORT DLL_EXPORT
@@ -15,20 +19,36 @@
 #define TCP_SERVER_EXPORT DLL_IMPORT
 #endif
 
+// the maximum amount of event loops a single TCP server can be sharded across
+#define TCP_SERVER_MAX_LOOPS 32
+
 namespace net
 {
 class TCP_SERVER_EXPORT TcpServerStream : public fwRefCountable
 {
 public:
-	typedef std::function<void(const std::vector<uint8_t>&)> TReadCallback;
+	// the slice passed is only valid for the duration of the callback - use Slice::Retain to keep the data around
+	typedef std::function<void(const Slice&)> TReadCallback;
 
 	typedef std::function<void()> TCloseCallback;
 
+	typedef std::function<void()> TDrainCallback;
+
+	typedef std::function<void(bool success)> TSendFileCallback;
+
+	typedef std::function<void()> TScheduledCallback;
+
 private:
 	TReadCallback m_readCallback;
 
 	TCloseCallback m_closeCallback;
 
+	TDrainCallback m_drainCallback;
+
+	size_t m_lowWatermark;
+
+	size_t m_highWatermark;
+
 protected:
 	inline const TReadCallback& GetReadCallback()
 	{
@@ -40,12 +60,70 @@ protected:
 		return m_closeCallback;
 	}
 
+	inline const TDrainCallback& GetDrainCallback()
+	{
+		return m_drainCallback;
+	}
+
+	inline size_t GetLowWatermark() const
+	{
+		return m_lowWatermark;
+	}
+
+	inline size_t GetHighWatermark() const
+	{
+		return m_highWatermark;
+	}
+
 	virtual void OnFirstSetReadCallback() {}
 
 public:
 	virtual PeerAddress GetPeerAddress() = 0;
 
-	virtual void Write(const std::vector<uint8_t>& data) = 0;
+	// gets the index of the event loop this stream is pinned to - all callbacks for the stream are invoked on that loop,
+	// so state partitioned by this index can be accessed without locking
+	virtual int GetLoopIndex() = 0;
+
+	// copies the data into a pooled buffer before writing
+	void Write(const std::vector<uint8_t>& data);
+
+	// takes ownership of the data, without copying it
+	void Write(std::vector<uint8_t>&& data);
+
+	// streams retain the data if they need it past the call, so borrowed slices can be passed safely
+	virtual void Write(const Slice& data) = 0;
+
+	// writes a list of slices as a single operation, without concatenating them first
+	void Write(std::initializer_list<Slice> slices);
+
+	virtual void WriteV(const Slice* slices, size_t count);
+
+	// while a stream is corked, writes get coalesced and only get submitted once it's fully uncorked again - calls nest
+	virtual void Cork() {}
+
+	virtual void Uncork() {}
+
+	// gets the amount of bytes that were written to the stream, but not yet handed to the operating system
+	virtual size_t GetQueuedBytes() { return 0; }
+
+	// sends a range of a file on the local filesystem without it passing through user space, after anything written
+	// before - returns false if the stream doesn't support this or is still sending another file (in which case the
+	// caller should write the data itself), otherwise the callback will be invoked on completion
+	virtual bool SendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback) { return false; }
+
+	// runs a callback on the thread owning the stream - right away if that's the calling thread, for code that isn't
+	// safe to run concurrently with the stream's own callbacks
+	virtual void ScheduleCallback(const TScheduledCallback& callback) { callback(); }
+
+	// closes the stream if nothing gets read from it for the specified time - every read restarts the timeout, and a
+	// zero timeout disables it again
+	virtual void SetReadTimeout(std::chrono::milliseconds timeout) {}
+
+	// whether the client is keeping up - once this returns false, writers should wait for the drain callback
+	inline bool IsWritable()
+	{
+		return (GetQueuedBytes() < m_highWatermark);
+	}
 
 	virtual void Close() = 0;
 
@@ -53,8 +131,14 @@ public:
 
 	void SetCloseCallback(const TCloseCallback& callback);
 
+	// sets the queue sizes for backpressure: once highWatermark bytes or more are queued, the drain callback will be
+	// called as soon as the queue shrinks to lowWatermark bytes or less
+	virtual void SetWriteWatermarks(size_t lowWatermark, size_t highWatermark);
+
+	virtual void SetDrainCallback(const TDrainCallback& callback);
+
 protected:
-	TcpServerStream() { }
+	TcpServerStream();
 };
 
 class TCP_SERVER_EXPORT TcpServer : public fwRefCountable
@@ -74,6 +158,17 @@ protected:
 public:
 	void SetConnectionCallback(const TConnectionCallback& callback);
 
+	// limits the amount of connections open at once - once reached, the server stops accepting until connections close,
+	// with 0 meaning no limit
+	virtual void SetMaxConnections(size_t maxConnections) {}
+
+	// limits the amount of connections open at once from a single IP address - further connections get closed right
+	// after accepting them, with 0 meaning no limit
+	virtual void SetMaxConnectionsPerAddress(size_t maxConnections) {}
+
+	// closes connections that didn't read or write anything for the specified time, with 0 disabling the timeout
+	virtual void SetIdleTimeout(std::chrono::milliseconds timeout) {}
+
 protected:
 	// don't allow construction
 	TcpServer();
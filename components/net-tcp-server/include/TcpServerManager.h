@@ -28,10 +28,14 @@ class TCP_SERVER_EXPORT TcpServerManager : public TcpServerFactory
 private:
 	std::set<fwRefContainer<UvTcpServer>> m_servers;
 
-	fwRefContainer<UvLoopHolder> m_uvLoop;
+	std::vector<fwRefContainer<UvLoopHolder>> m_uvLoops;
 
 public:
-	TcpServerManager();
+	//
+	// Creates a TCP stack running on `loopCount` event loops. If more than one loop is used, servers created by this
+	// manager will bind a listener on each loop (using SO_REUSEPORT) so connections are distributed over all of them.
+	//
+	TcpServerManager(int loopCount = 1);
 
 	virtual ~TcpServerManager();
 
@@ -40,7 +44,17 @@ public:
 
 	inline uv_loop_t* GetLoop()
 	{
-		return m_uvLoop->GetLoop();
+		return m_uvLoops[0]->GetLoop();
+	}
+
+	inline uv_loop_t* GetLoop(int index)
+	{
+		return m_uvLoops[index]->GetLoop();
+	}
+
+	inline int GetLoopCount() const
+	{
+		return static_cast<int>(m_uvLoops.size());
 	}
 };
 }
\ No newline at end of file
@@ -9,39 +9,135 @@
 
 #include <uv.h>
 
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "TcpServer.h"
+#include "UvLoopHolder.h"
 
 namespace net
 {
 class UvTcpServer;
+class UvTcpServerStream;
+
+struct UvSendFileReq;
+
+// a pending write on a stream - these get recycled through a per-loop free list
+struct UvWriteReq
+{
+	uv_write_t write;
+
+	// the vectors keep their capacity while the request sits in the free list
+	std::vector<uv_buf_t> buffers;
+
+	std::vector<Slice> data;
+
+	size_t length;
+
+	fwRefContainer<UvTcpServerStream> stream;
+};
 
 class UvTcpServerStream : public TcpServerStream
 {
 private:
 	UvTcpServer* m_server;
 
+	UvLoopHolder* m_loop;
+
 	std::unique_ptr<uv_tcp_t> m_client;
 
-	std::vector<char> m_readBuffer;
+	// pooled block reads are received into - reused for as long as no read callback retains a slice of it
+	fwRefContainer<BufferBlock> m_readBlock;
+
+	int m_loopIndex;
+
+	// cork state - only touched from the loop thread
+	int m_corkDepth;
+
+	std::vector<Slice> m_corkedData;
+
+	// bytes accepted by Write that haven't completed yet - updated from any writing thread
+	std::atomic<size_t> m_queuedBytes;
+
+	// set once the queue reaches the high watermark
+	std::atomic<bool> m_drainPending;
+
+	// writes submitted to libuv that haven't completed yet
+	int m_inFlightWrites;
+
+	// an active (or pending) file send - regular writes are held back by corking the stream until it completes
+	std::unique_ptr<UvSendFileReq> m_sendFile;
+
+	// set from the SendFile call until the send completes, so concurrent calls from other threads get turned down
+	std::atomic<bool> m_sendingFile;
+
+	// set if the stream got closed while a file send was still using the socket
+	bool m_closePending;
+
+	// the key the server counts this connection under, for per-address limits
+	std::string m_addressKey;
+
+	PeerAddress m_peerAddress;
+
+	// fires at the nearest of the read and idle deadlines - reads and writes don't restart it, but just get recorded.
+	// holds a reference to the stream while armed.
+	UvWheelTimer m_timeoutTimer;
+
+	std::chrono::milliseconds m_readTimeout;
+
+	std::chrono::milliseconds m_idleTimeout;
+
+	// loop times (in milliseconds) of the last read, and of the last read or completed write
+	uint64_t m_lastReadTime;
+
+	uint64_t m_lastActivityTime;
 
 private:
 	void HandleRead(ssize_t nread, const uv_buf_t* buf);
 
 	void CloseClient();
 
-	inline std::vector<char>& GetReadBuffer()
-	{
-		return m_readBuffer;
-	}
+	void WriteInternal(const Slice* slices, size_t count);
+
+	void SubmitWrite(const Slice* slices, size_t count);
+
+	void FlushCorked();
+
+	void ReleaseQueuedBytes(size_t length);
+
+	void BeginSendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback);
+
+	void StartSendFile();
+
+	void ContinueSendFile();
+
+	void WaitForWritable();
+
+	void FinishSendFile(bool success);
+
+	void UpdateTimeout();
+
+	BufferBlock* GetReadBlock();
 
 public:
-	UvTcpServerStream(UvTcpServer* server);
+	UvTcpServerStream(UvTcpServer* server, UvLoopHolder* loop, int loopIndex);
 
 	virtual ~UvTcpServerStream();
 
-	bool Accept(std::unique_ptr<uv_tcp_t>&& client);
+	bool Accept(std::unique_ptr<uv_tcp_t>&& client, const std::string& addressKey);
+
+	inline const std::string& GetAddressKey() const
+	{
+		return m_addressKey;
+	}
+
+	// only to be called from the loop thread
+	void SetIdleTimeout(std::chrono::milliseconds timeout);
+
+	void CancelTimeouts();
 
 	virtual void AddRef() override
 	{
@@ -56,7 +152,25 @@ public:
 public:
 	virtual PeerAddress GetPeerAddress() override;
 
-	virtual void Write(const std::vector<uint8_t>& data) override;
+	virtual int GetLoopIndex() override;
+
+	using TcpServerStream::Write;
+
+	virtual void Write(const Slice& data) override;
+
+	virtual void WriteV(const Slice* slices, size_t count) override;
+
+	virtual void Cork() override;
+
+	virtual void Uncork() override;
+
+	virtual size_t GetQueuedBytes() override;
+
+	virtual bool SendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback) override;
+
+	virtual void ScheduleCallback(const TScheduledCallback& callback) override;
+
+	virtual void SetReadTimeout(std::chrono::milliseconds timeout) override;
 
 	virtual void Close() override;
 };
@@ -65,29 +179,124 @@ class TcpServerManager;
 
 class UvTcpServer : public TcpServer
 {
+private:
+	struct Listener
+	{
+		UvTcpServer* server;
+
+		int loopIndex;
+
+		std::unique_ptr<uv_tcp_t> handle;
+
+		// set while a connection is left pending as the server is at its connection limit
+		bool paused;
+
+		std::chrono::milliseconds backoff;
+
+		UvWheelTimer backoffTimer;
+	};
+
 private:
 	TcpServerManager* m_manager;
 
-	std::unique_ptr<uv_tcp_t> m_server;
+	std::vector<std::unique_ptr<Listener>> m_listeners;
+
+	// client streams, partitioned by loop so each loop thread only ever touches its own set
+	std::array<std::set<fwRefContainer<UvTcpServerStream>>, TCP_SERVER_MAX_LOOPS> m_clients;
 
-	std::set<fwRefContainer<UvTcpServerStream>> m_clients;
+	// recycled write requests, per loop
+	std::array<std::vector<UvWriteReq*>, TCP_SERVER_MAX_LOOPS> m_freeWriteReqs;
+
+	std::atomic<size_t> m_maxConnections;
+
+	std::atomic<size_t> m_maxConnectionsPerAddress;
+
+	std::atomic<int64_t> m_idleTimeout;
+
+	// connections open across all loops
+	std::atomic<size_t> m_connectionCount;
+
+	std::atomic<uint64_t> m_rejectedConnections;
+
+	// write requests that had to be allocated, as none were free - at steady state, this should stop increasing
+	std::atomic<uint64_t> m_writeReqAllocations;
+
+	// writes submitted to libuv, each of which may carry any amount of coalesced writes
+	std::atomic<uint64_t> m_submittedWrites;
+
+	std::mutex m_addressMutex;
+
+	std::unordered_map<std::string, size_t> m_addressConnections;
+
+	// set once the last release started tearing down the listeners
+	std::atomic<bool> m_tearingDown;
 
 private:
-	void OnConnection(int status);
+	void OnConnection(Listener* listener, int status);
+
+	void AcceptConnection(Listener* listener);
+
+	void PauseListener(Listener* listener);
+
+	void ResumeListener(Listener* listener);
+
+	bool IsAtConnectionLimit();
+
+	// counts a new connection, unless its address is at its limit
+	bool AddConnection(const std::string& addressKey);
+
+	void RemoveConnection(const std::string& addressKey);
+
+	void TearDownListener(Listener* listener);
 
 public:
 	UvTcpServer(TcpServerManager* manager);
 
 	virtual ~UvTcpServer();
 
-	bool Listen(std::unique_ptr<uv_tcp_t>&& server);
+	// the last release tears down the listeners on their loops, and only deletes the server once they're done
+	virtual bool Release() override;
+
+	bool Listen(int loopIndex, std::unique_ptr<uv_tcp_t>&& server);
+
+	virtual void SetMaxConnections(size_t maxConnections) override;
+
+	virtual void SetMaxConnectionsPerAddress(size_t maxConnections) override;
+
+	virtual void SetIdleTimeout(std::chrono::milliseconds timeout) override;
+
+	inline size_t GetConnectionCount() const
+	{
+		return m_connectionCount;
+	}
 
-	inline uv_tcp_t* GetServer()
+	// connections closed right away for exceeding the per-address limit
+	inline uint64_t GetRejectedConnectionCount() const
 	{
-		return m_server.get();
+		return m_rejectedConnections;
+	}
+
+	inline uint64_t GetWriteReqAllocationCount() const
+	{
+		return m_writeReqAllocations;
+	}
+
+	inline uint64_t GetSubmittedWriteCount() const
+	{
+		return m_submittedWrites;
 	}
 
 public:
 	void RemoveStream(UvTcpServerStream* stream);
+
+	// allocates a write request - only to be called from the thread of the specified loop
+	UvWriteReq* AllocateWriteReq(int loopIndex);
+
+	void FreeWriteReq(int loopIndex, UvWriteReq* req);
+
+	inline void CountSubmittedWrite()
+	{
+		m_submittedWrites++;
+	}
 };
 }
\ No newline at end of file
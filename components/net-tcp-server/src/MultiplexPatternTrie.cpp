@@ -0,0 +1,152 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "MultiplexPatternTrie.h"
+
+#include <deque>
+#include <map>
+
+#include "memdbgon.h"
+
+namespace net
+{
+MultiplexPatternTrie::MultiplexPatternTrie()
+{
+	Compile();
+}
+
+void MultiplexPatternTrie::AddPattern(const MultiplexPattern& pattern, size_t tag)
+{
+	m_patterns.push_back({ pattern, tag });
+}
+
+void MultiplexPatternTrie::Compile()
+{
+	m_states.clear();
+
+	// states are identified by their depth and the set of patterns still matching - reaching the same set at the same
+	// depth through different bytes leads to the same state
+	std::map<std::pair<size_t, std::vector<uint32_t>>, int32_t> stateIndices;
+	std::deque<int32_t> pendingStates;
+
+	auto getState = [&] (size_t depth, const std::vector<uint32_t>& candidates)
+	{
+		auto key = std::make_pair(depth, candidates);
+		auto it = stateIndices.find(key);
+
+		if (it != stateIndices.end())
+		{
+			return it->second;
+		}
+
+		State state;
+		state.depth = depth;
+		state.candidates = candidates;
+		state.terminal = true;
+		state.next.fill(-1);
+
+		for (uint32_t candidate : candidates)
+		{
+			if (m_patterns[candidate].pattern.prefix.size() > depth)
+			{
+				state.terminal = false;
+				break;
+			}
+		}
+
+		int32_t index = static_cast<int32_t>(m_states.size());
+		m_states.push_back(state);
+
+		stateIndices.insert({ key, index });
+		pendingStates.push_back(index);
+
+		return index;
+	};
+
+	std::vector<uint32_t> allPatterns;
+
+	for (uint32_t i = 0; i < m_patterns.size(); i++)
+	{
+		allPatterns.push_back(i);
+	}
+
+	getState(0, allPatterns);
+
+	while (!pendingStates.empty())
+	{
+		int32_t stateIndex = pendingStates.front();
+		pendingStates.pop_front();
+
+		if (m_states[stateIndex].terminal)
+		{
+			continue;
+		}
+
+		// copied, as adding states may move the vector around
+		size_t depth = m_states[stateIndex].depth;
+		std::vector<uint32_t> candidates = m_states[stateIndex].candidates;
+
+		for (int byte = 0; byte < 256; byte++)
+		{
+			std::vector<uint32_t> nextCandidates;
+
+			for (uint32_t candidate : candidates)
+			{
+				const MultiplexPattern& pattern = m_patterns[candidate].pattern;
+
+				// patterns with a fully matched prefix accept anything that follows
+				if (depth >= pattern.prefix.size() || pattern.MatchesByte(depth, static_cast<uint8_t>(byte)))
+				{
+					nextCandidates.push_back(candidate);
+				}
+			}
+
+			if (!nextCandidates.empty())
+			{
+				int32_t nextState = getState(depth + 1, nextCandidates);
+				m_states[stateIndex].next[byte] = nextState;
+			}
+		}
+	}
+}
+
+MultiplexPatternMatchResult MultiplexPatternTrie::Match(const uint8_t* data, size_t length, size_t* outTag) const
+{
+	const State* state = &m_states[0];
+
+	for (size_t i = 0; i < length && !state->terminal; i++)
+	{
+		int32_t next = state->next[data[i]];
+
+		if (next < 0)
+		{
+			return MultiplexPatternMatchResult::NoMatch;
+		}
+
+		state = &m_states[next];
+	}
+
+	bool needMoreData = false;
+
+	for (uint32_t candidate : state->candidates)
+	{
+		const Pattern& entry = m_patterns[candidate];
+
+		// the first pattern that matches wins, even if a pattern added before it still needs more data to decide
+		if (entry.pattern.prefix.size() <= state->depth && length >= entry.pattern.GetMinLength())
+		{
+			*outTag = entry.tag;
+			return MultiplexPatternMatchResult::Match;
+		}
+
+		needMoreData = true;
+	}
+
+	return (needMoreData) ? MultiplexPatternMatchResult::InsufficientData : MultiplexPatternMatchResult::NoMatch;
+}
+}
@@ -16,9 +16,9 @@
 namespace net
 {
 MultiplexTcpServer::MultiplexTcpServer(const fwRefContainer<TcpServerFactory>& factory)
-	: m_factory(factory)
+	: m_factory(factory), m_sniffTimeout(10000), m_matchTable(std::make_shared<MatchTable>())
 {
-	
+	m_matchTable->hasMatchFunctions = false;
 }
 
 void MultiplexTcpServer::Bind(const PeerAddress& bindAddress)
@@ -35,73 +35,154 @@ void MultiplexTcpServer::Bind(const PeerAddress& bindAddress)
 	{
 		m_rootServer->SetConnectionCallback([=] (fwRefContainer<TcpServerStream> stream)
 		{
-			// start the attachment process for the stream
-			std::shared_ptr<std::vector<uint8_t>> recvQueue = std::make_shared<std::vector<uint8_t>>();
+			OnConnection(stream);
+		});
+	}
+	else
+	{
+		trace("Could not bind MultiplexTcpServer to %s.\n", bindAddress.ToString().c_str());
+	}
+}
+
+void MultiplexTcpServer::OnConnection(const fwRefContainer<TcpServerStream>& stream)
+{
+	// start the attachment process for the stream
+	std::shared_ptr<std::vector<uint8_t>> recvQueue = std::make_shared<std::vector<uint8_t>>();
+
+	// servers added from now on won't get considered for this stream
+	std::shared_ptr<MatchTable> matchTable = std::atomic_load(&m_matchTable);
+
+	// don't let clients hold on to connections without ever telling us what they are
+	std::chrono::milliseconds sniffTimeout(m_sniffTimeout.load());
+
+	if (sniffTimeout.count() > 0)
+	{
+		stream->SetReadTimeout(sniffTimeout);
+	}
+
+	TcpServerStream::TReadCallback readCallback = [=] (const Slice& data)
+	{
+		if (data.GetLength() == 0)
+		{
+			return;
+		}
+
+		// match functions take a vector, but otherwise the first read can be matched without copying it anywhere
+		Slice matchData = data;
+
+		if (!recvQueue->empty() || matchTable->hasMatchFunctions)
+		{
+			recvQueue->insert(recvQueue->end(), data.begin(), data.end());
+
+			matchData = Slice::Borrow(recvQueue->data(), recvQueue->size());
+		}
+
+		size_t serverIndex = 0;
+		MultiplexPatternMatchResult matchResult = matchTable->trie.Match(matchData.GetData(), matchData.GetLength(), &serverIndex);
+
+		bool needMoreData = (matchResult == MultiplexPatternMatchResult::InsufficientData);
 
-			TcpServerStream::TReadCallback readCallback = [=] (const std::vector<uint8_t>& data)
+		// servers using match functions that were added before the matched server still take precedence
+		if (matchTable->hasMatchFunctions)
+		{
+			size_t serverCount = (matchResult == MultiplexPatternMatchResult::Match) ? serverIndex : matchTable->servers.size();
+
+			for (size_t i = 0; i < serverCount; i++)
 			{
-				if (data.size() > 0)
+				auto& matchFunction = matchTable->servers[i]->GetPatternMatcher();
+
+				if (!matchFunction)
 				{
-					// copy to the receive queue
-					size_t origSize = recvQueue->size();
-					recvQueue->resize(origSize + data.size());
-
-					std::copy(data.begin(), data.end(), recvQueue->begin() + origSize);
-
-					// check all the servers for a pattern match
-					bool needMoreData = false;
-
-					for (auto& server : m_childServers)
-					{
-						auto& matchFunction = server->GetPatternMatcher();
-						auto matchResult = matchFunction(*recvQueue);
-
-						// if we matched on this server
-						if (matchResult == MultiplexPatternMatchResult::Match)
-						{
-							// keep a scope-local reference to the receive queue/stream (as we'll lose the stored reference soon)
-							auto localStream = stream;
-							auto localRecvQueue = recvQueue;
-
-							// unset our read callback
-							stream->SetReadCallback(TcpServerStream::TReadCallback());
-
-							// forward the result
-							server->AttachToResult(*localRecvQueue, localStream);
-
-							// return so that the stream doesn't end up closed
-							return;
-						}
-						else if (matchResult == MultiplexPatternMatchResult::InsufficientData)
-						{
-							needMoreData = true;
-						}
-					}
-
-					if (!needMoreData)
-					{
-						// nobody matched, and we don't need more data - this stream is useless to us
-						stream->Close();
-					}
+					continue;
 				}
-			};
 
-			stream->SetReadCallback(readCallback);
-		});
-	}
-	else
+				auto functionResult = matchFunction(*recvQueue);
+
+				if (functionResult == MultiplexPatternMatchResult::Match)
+				{
+					matchResult = functionResult;
+					serverIndex = i;
+
+					break;
+				}
+				else if (functionResult == MultiplexPatternMatchResult::InsufficientData)
+				{
+					needMoreData = true;
+				}
+			}
+		}
+
+		// keep scope-local references to what we need, as unsetting the read callback will free the captured ones
+		auto localStream = stream;
+
+		if (matchResult == MultiplexPatternMatchResult::Match)
+		{
+			auto server = matchTable->servers[serverIndex];
+			Slice initialData = (recvQueue->empty()) ? data.Retain() : Slice(std::move(*recvQueue));
+
+			// the server we hand the stream to can set its own timeouts
+			localStream->SetReadTimeout(std::chrono::milliseconds(0));
+
+			// unset our read callback
+			localStream->SetReadCallback(TcpServerStream::TReadCallback());
+
+			// forward the result
+			server->AttachToResult(initialData, localStream);
+
+			// return so that the stream doesn't end up closed
+			return;
+		}
+
+		if (!needMoreData)
+		{
+			// nobody matched, and we don't need more data - this stream is useless to us
+			localStream->Close();
+			return;
+		}
+
+		// keep the data around for the next read
+		if (recvQueue->empty())
+		{
+			recvQueue->assign(data.begin(), data.end());
+		}
+	};
+
+	stream->SetReadCallback(readCallback);
+}
+
+void MultiplexTcpServer::AddServer(const fwRefContainer<MultiplexTcpChildServer>& server)
+{
+	m_childServers.push_back(server);
+
+	std::shared_ptr<MatchTable> matchTable = std::make_shared<MatchTable>();
+	matchTable->servers = m_childServers;
+	matchTable->hasMatchFunctions = false;
+
+	for (size_t i = 0; i < m_childServers.size(); i++)
 	{
-		trace("Could not bind MultiplexTcpServer to %s.\n", bindAddress.ToString().c_str());
+		for (auto& pattern : m_childServers[i]->GetPatterns())
+		{
+			matchTable->trie.AddPattern(pattern, i);
+		}
+
+		if (m_childServers[i]->GetPatternMatcher())
+		{
+			matchTable->hasMatchFunctions = true;
+		}
 	}
+
+	matchTable->trie.Compile();
+
+	std::atomic_store(&m_matchTable, matchTable);
 }
 
-void MultiplexTcpChildServer::AttachToResult(const std::vector<uint8_t>& existingData, fwRefContainer<TcpServerStream> baseStream)
+void MultiplexTcpChildServer::AttachToResult(const Slice& existingData, fwRefContainer<TcpServerStream> baseStream)
 {
 	fwRefContainer<MultiplexTcpChildServerStream> stream = new MultiplexTcpChildServerStream(this, baseStream);
 	stream->SetInitialData(existingData);
 
 	// keep a local reference to the connection
-	m_connections.insert(stream);
+	m_connections[stream->GetLoopIndex()].insert(stream);
 
 	// invoke the connection callback
 	auto connectionCallback = GetConnectionCallback();
@@ -114,7 +195,7 @@ void MultiplexTcpChildServer::AttachToResult(const std::vector<uint8_t>& existin
 
 void MultiplexTcpChildServer::CloseStream(MultiplexTcpChildServerStream* stream)
 {
-	m_connections.erase(stream);
+	m_connections[stream->GetLoopIndex()].erase(stream);
 }
 
 void MultiplexTcpChildServer::SetPatternMatcher(const MultiplexPatternMatchFn& function)
@@ -122,10 +203,15 @@ void MultiplexTcpChildServer::SetPatternMatcher(const MultiplexPatternMatchFn& f
 	m_patternMatcher = function;
 }
 
+void MultiplexTcpChildServer::SetPatterns(const std::vector<MultiplexPattern>& patterns)
+{
+	m_patterns = patterns;
+}
+
 MultiplexTcpChildServerStream::MultiplexTcpChildServerStream(MultiplexTcpChildServer* server, fwRefContainer<TcpServerStream> baseStream)
-	: m_baseStream(baseStream), m_server(server)
+	: m_baseStream(baseStream), m_server(server), m_loopIndex(baseStream->GetLoopIndex())
 {
-	baseStream->SetReadCallback([=] (const std::vector<uint8_t>& data)
+	baseStream->SetReadCallback([=] (const Slice& data)
 	{
 		auto ourReadCallback = GetReadCallback();
 
@@ -149,10 +235,13 @@ void MultiplexTcpChildServerStream::TrySendInitialData()
 
 	if (ourReadCallback)
 	{
-		if (!m_initialData.empty())
+		if (!m_initialData.IsEmpty())
 		{
-			ourReadCallback(m_initialData);
-			m_initialData.clear();
+			// hand over the initial data, leaving ours empty in case the callback re-enters
+			Slice initialData = m_initialData;
+			m_initialData = Slice();
+
+			ourReadCallback(initialData);
 		}
 	}
 }
@@ -176,6 +265,7 @@ void MultiplexTcpChildServerStream::CloseInternal()
 	}
 
 	SetReadCallback(TReadCallback());
+	SetDrainCallback(TDrainCallback());
 
 	m_server->CloseStream(this);
 }
@@ -194,19 +284,103 @@ void MultiplexTcpChildServerStream::Close()
 	CloseInternal();
 }
 
-void MultiplexTcpChildServerStream::Write(const std::vector<uint8_t>& data)
+void MultiplexTcpChildServerStream::Write(const Slice& data)
 {
 	m_baseStream->Write(data);
 }
 
+void MultiplexTcpChildServerStream::WriteV(const Slice* slices, size_t count)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->WriteV(slices, count);
+	}
+}
+
+void MultiplexTcpChildServerStream::SetReadTimeout(std::chrono::milliseconds timeout)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetReadTimeout(timeout);
+	}
+}
+
+void MultiplexTcpChildServerStream::ScheduleCallback(const TScheduledCallback& callback)
+{
+	if (!m_baseStream.GetRef())
+	{
+		callback();
+		return;
+	}
+
+	m_baseStream->ScheduleCallback(callback);
+}
+
+size_t MultiplexTcpChildServerStream::GetQueuedBytes()
+{
+	return (m_baseStream.GetRef()) ? m_baseStream->GetQueuedBytes() : 0;
+}
+
+void MultiplexTcpChildServerStream::SetWriteWatermarks(size_t lowWatermark, size_t highWatermark)
+{
+	TcpServerStream::SetWriteWatermarks(lowWatermark, highWatermark);
+
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetWriteWatermarks(lowWatermark, highWatermark);
+	}
+}
+
+void MultiplexTcpChildServerStream::SetDrainCallback(const TDrainCallback& callback)
+{
+	TcpServerStream::SetDrainCallback(callback);
+
+	// the base stream is the one actually queueing data
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetDrainCallback(callback);
+	}
+}
+
+bool MultiplexTcpChildServerStream::SendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback)
+{
+	if (!m_baseStream.GetRef())
+	{
+		return false;
+	}
+
+	return m_baseStream->SendFile(nativePath, offset, length, callback);
+}
+
+void MultiplexTcpChildServerStream::Cork()
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->Cork();
+	}
+}
+
+void MultiplexTcpChildServerStream::Uncork()
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->Uncork();
+	}
+}
+
 PeerAddress MultiplexTcpChildServerStream::GetPeerAddress()
 {
 	return m_baseStream->GetPeerAddress();
 }
 
-void MultiplexTcpChildServerStream::SetInitialData(const std::vector<uint8_t>& initialData)
+int MultiplexTcpChildServerStream::GetLoopIndex()
+{
+	return m_loopIndex;
+}
+
+void MultiplexTcpChildServerStream::SetInitialData(const Slice& initialData)
 {
-	m_initialData = initialData;
+	m_initialData = initialData.Retain();
 }
 
 fwRefContainer<TcpServer> MultiplexTcpServer::CreateServer(const MultiplexPatternMatchFn& patternMatchFunction)
@@ -214,7 +388,17 @@ fwRefContainer<TcpServer> MultiplexTcpServer::CreateServer(const MultiplexPatter
 	fwRefContainer<MultiplexTcpChildServer> child = new MultiplexTcpChildServer();
 	child->SetPatternMatcher(patternMatchFunction);
 
-	m_childServers.push_back(child);
+	AddServer(child);
+
+	return child;
+}
+
+fwRefContainer<TcpServer> MultiplexTcpServer::CreateServer(const std::vector<MultiplexPattern>& patterns)
+{
+	fwRefContainer<MultiplexTcpChildServer> child = new MultiplexTcpChildServer();
+	child->SetPatterns(patterns);
+
+	AddServer(child);
 
 	return child;
 }
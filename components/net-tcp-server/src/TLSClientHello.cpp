@@ -0,0 +1,128 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "TLSClientHello.h"
+
+#include "memdbgon.h"
+
+namespace net
+{
+// the extension type of session tickets, from RFC 5077
+static const uint16_t SessionTicketExtension = 35;
+
+class ClientHelloReader
+{
+private:
+	const uint8_t* m_data;
+
+	size_t m_length;
+
+	size_t m_offset;
+
+public:
+	inline ClientHelloReader(const uint8_t* data, size_t length)
+		: m_data(data), m_length(length), m_offset(0)
+	{
+
+	}
+
+	inline size_t GetRemaining() const
+	{
+		return m_length - m_offset;
+	}
+
+	inline bool Skip(size_t length)
+	{
+		if (GetRemaining() < length)
+		{
+			return false;
+		}
+
+		m_offset += length;
+		return true;
+	}
+
+	// reads a big-endian integer of 1 or 2 bytes
+	inline bool ReadInteger(size_t size, size_t* value)
+	{
+		if (GetRemaining() < size)
+		{
+			return false;
+		}
+
+		*value = 0;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			*value = (*value << 8) | m_data[m_offset + i];
+		}
+
+		m_offset += size;
+		return true;
+	}
+
+	// skips a vector prefixed with its length
+	inline bool SkipVector(size_t lengthSize)
+	{
+		size_t length;
+
+		return ReadInteger(lengthSize, &length) && Skip(length);
+	}
+
+	inline const uint8_t* GetCurrent() const
+	{
+		return m_data + m_offset;
+	}
+};
+
+bool ReadClientHelloSessionTicket(const uint8_t* data, size_t length, std::vector<uint8_t>* ticket)
+{
+	ticket->clear();
+
+	ClientHelloReader reader(data, length);
+
+	// the version and random, followed by the session ID, cipher suites and compression methods
+	if (!reader.Skip(2 + 32) || !reader.SkipVector(1) || !reader.SkipVector(2) || !reader.SkipVector(1))
+	{
+		return false;
+	}
+
+	// extensions are optional
+	if (reader.GetRemaining() == 0)
+	{
+		return true;
+	}
+
+	size_t extensionsLength;
+
+	if (!reader.ReadInteger(2, &extensionsLength) || extensionsLength != reader.GetRemaining())
+	{
+		return false;
+	}
+
+	while (reader.GetRemaining() > 0)
+	{
+		size_t type;
+		size_t extensionLength;
+
+		if (!reader.ReadInteger(2, &type) || !reader.ReadInteger(2, &extensionLength) || reader.GetRemaining() < extensionLength)
+		{
+			return false;
+		}
+
+		if (type == SessionTicketExtension)
+		{
+			ticket->assign(reader.GetCurrent(), reader.GetCurrent() + extensionLength);
+		}
+
+		reader.Skip(extensionLength);
+	}
+
+	return true;
+}
+}
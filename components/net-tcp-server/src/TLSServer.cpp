@@ -7,16 +7,35 @@
 
 #include "StdInc.h"
 #include "TLSServer.h"
+#include "TLSClientHello.h"
 
 #include "memdbgon.h"
 
 #include <botan/auto_rng.h>
 #include <botan/credentials_manager.h>
 #include <botan/pkcs8.h>
+#include <botan/tls_handshake_msg.h>
 #include <botan/tls_policy.h>
 
 #include <fstream>
 
+// session tickets are issued using a key that gets replaced once it's this old - tickets older than their key's lifetime
+// fall back to the session cache, and otherwise to a full handshake.
+static const std::chrono::seconds TicketKeyLifetime(12 * 60 * 60);
+
+static bool CanDecryptTicket(const std::vector<uint8_t>& ticket, const Botan::SymmetricKey& key)
+{
+	try
+	{
+		Botan::TLS::Session::decrypt(ticket, key);
+		return true;
+	}
+	catch (std::exception& e)
+	{
+		return false;
+	}
+}
+
 class CredentialManager : public Botan::Credentials_Manager
 {
 private:
@@ -106,30 +125,298 @@ public:
 	{
 		return Botan::TLS::Policy::acceptable_ciphersuite(suite);
 	}
+
+	virtual Botan::u32bit session_ticket_lifetime() const override
+	{
+		return static_cast<Botan::u32bit>(TicketKeyLifetime.count());
+	}
 };
 
 #include <sstream>
 
 namespace net
 {
+TLSTicketKeys::TLSTicketKeys(std::chrono::seconds keyLifetime)
+	: m_keyLifetime(keyLifetime)
+{
+
+}
+
+void TLSTicketKeys::RotateKey(std::chrono::steady_clock::time_point now)
+{
+	if (m_key.length() > 0 && (now - m_keyTime) < m_keyLifetime)
+	{
+		return;
+	}
+
+	// if nothing asked for a key in a while, even tickets using the current one are expired already
+	m_previousKey = (m_key.length() > 0 && (now - m_keyTime) < (m_keyLifetime * 2)) ? m_key : Botan::SymmetricKey();
+
+	Botan::AutoSeeded_RNG rng;
+
+	m_key = Botan::SymmetricKey(rng, 32);
+	m_keyTime = now;
+}
+
+Botan::SymmetricKey TLSTicketKeys::GetEncryptionKey(std::chrono::steady_clock::time_point now)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	RotateKey(now);
+
+	return m_key;
+}
+
+Botan::SymmetricKey TLSTicketKeys::GetDecryptionKey(const std::vector<uint8_t>& ticket, std::chrono::steady_clock::time_point now)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	RotateKey(now);
+
+	if (m_previousKey.length() > 0 && !CanDecryptTicket(ticket, m_key) && CanDecryptTicket(ticket, m_previousKey))
+	{
+		return m_previousKey;
+	}
+
+	return m_key;
+}
+
+//
+// The credentials of a single connection's TLS engine. Botan asks for the session ticket key without saying if it's to
+// decrypt a ticket, so this keeps the ticket the client sent to tell - everything else comes from the server's
+// credentials.
+//
+class TLSStreamCredentials : public Botan::Credentials_Manager
+{
+private:
+	std::shared_ptr<Botan::Credentials_Manager> m_credentials;
+
+	std::shared_ptr<TLSTicketKeys> m_ticketKeys;
+
+	std::vector<uint8_t> m_pendingTicket;
+
+public:
+	TLSStreamCredentials(const std::shared_ptr<Botan::Credentials_Manager>& credentials, const std::shared_ptr<TLSTicketKeys>& ticketKeys)
+		: m_credentials(credentials), m_ticketKeys(ticketKeys)
+	{
+
+	}
+
+	inline void SetPendingTicket(std::vector<uint8_t>&& ticket)
+	{
+		m_pendingTicket = std::move(ticket);
+	}
+
+	inline void ClearPendingTicket()
+	{
+		m_pendingTicket.clear();
+	}
+
+	virtual Botan::SymmetricKey psk(const std::string& type, const std::string& context, const std::string& identity) override
+	{
+		if (type != "tls-server" || context != "session-ticket")
+		{
+			return m_credentials->psk(type, context, identity);
+		}
+
+		// the first request while a ticket is pending is the one to decrypt it - new tickets always use the current key
+		if (!m_pendingTicket.empty())
+		{
+			std::vector<uint8_t> ticket = std::move(m_pendingTicket);
+			m_pendingTicket.clear();
+
+			return m_ticketKeys->GetDecryptionKey(ticket);
+		}
+
+		return m_ticketKeys->GetEncryptionKey();
+	}
+
+	virtual std::vector<Botan::Certificate_Store*> trusted_certificate_authorities(const std::string& type, const std::string& context) override
+	{
+		return m_credentials->trusted_certificate_authorities(type, context);
+	}
+
+	virtual void verify_certificate_chain(const std::string& type, const std::string& hostname, const std::vector<Botan::X509_Certificate>& cert_chain) override
+	{
+		m_credentials->verify_certificate_chain(type, hostname, cert_chain);
+	}
+
+	virtual std::vector<Botan::X509_Certificate> cert_chain(const std::vector<std::string>& cert_key_types, const std::string& type, const std::string& context) override
+	{
+		return m_credentials->cert_chain(cert_key_types, type, context);
+	}
+
+	virtual Botan::Private_Key* private_key_for(const Botan::X509_Certificate& cert, const std::string& type, const std::string& context) override
+	{
+		return m_credentials->private_key_for(cert, type, context);
+	}
+
+	virtual bool attempt_srp(const std::string& type, const std::string& context) override
+	{
+		return m_credentials->attempt_srp(type, context);
+	}
+
+	virtual std::string srp_identifier(const std::string& type, const std::string& context) override
+	{
+		return m_credentials->srp_identifier(type, context);
+	}
+
+	virtual std::string srp_password(const std::string& type, const std::string& context, const std::string& identifier) override
+	{
+		return m_credentials->srp_password(type, context, identifier);
+	}
+
+	virtual bool srp_verifier(const std::string& type, const std::string& context, const std::string& identifier, std::string& group_name, Botan::BigInt& verifier, std::vector<uint8_t>& salt, bool generate_fake_on_unknown) override
+	{
+		return m_credentials->srp_verifier(type, context, identifier, group_name, verifier, salt, generate_fake_on_unknown);
+	}
+
+	virtual std::string psk_identity_hint(const std::string& type, const std::string& context) override
+	{
+		return m_credentials->psk_identity_hint(type, context);
+	}
+
+	virtual std::string psk_identity(const std::string& type, const std::string& context, const std::string& identity_hint) override
+	{
+		return m_credentials->psk_identity(type, context, identity_hint);
+	}
+};
+
+TLSSessionCache::TLSSessionCache(size_t maxSessions, std::chrono::seconds sessionLifetime)
+	: m_maxSessions(maxSessions), m_sessionLifetime(sessionLifetime)
+{
+
+}
+
+bool TLSSessionCache::load_from_session_id(const std::vector<uint8_t>& sessionId, Botan::TLS::Session& session)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_sessionMap.find(sessionId);
+
+	if (it == m_sessionMap.end())
+	{
+		return false;
+	}
+
+	// expired sessions can't be resumed anymore
+	if ((std::chrono::system_clock::now() - it->second->start_time()) > m_sessionLifetime)
+	{
+		m_sessions.erase(it->second);
+		m_sessionMap.erase(it);
+
+		return false;
+	}
+
+	// mark as most recently used
+	m_sessions.splice(m_sessions.begin(), m_sessions, it->second);
+
+	session = *it->second;
+	return true;
+}
+
+bool TLSSessionCache::load_from_server_info(const Botan::TLS::Server_Information& info, Botan::TLS::Session& session)
+{
+	// only clients look up sessions by server
+	return false;
+}
+
+void TLSSessionCache::remove_entry(const std::vector<uint8_t>& sessionId)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_sessionMap.find(sessionId);
+
+	if (it != m_sessionMap.end())
+	{
+		m_sessions.erase(it->second);
+		m_sessionMap.erase(it);
+	}
+}
+
+void TLSSessionCache::save(const Botan::TLS::Session& session)
+{
+	// sessions resumed from a ticket don't have an ID
+	if (session.session_id().empty())
+	{
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	auto it = m_sessionMap.find(session.session_id());
+
+	if (it != m_sessionMap.end())
+	{
+		m_sessions.erase(it->second);
+		m_sessionMap.erase(it);
+	}
+
+	m_sessions.push_front(session);
+	m_sessionMap[session.session_id()] = m_sessions.begin();
+
+	while (m_sessions.size() > m_maxSessions)
+	{
+		m_sessionMap.erase(m_sessions.back().session_id());
+		m_sessions.pop_back();
+	}
+}
+
+std::chrono::seconds TLSSessionCache::session_lifetime() const
+{
+	return m_sessionLifetime;
+}
+
+size_t TLSSessionCache::GetSessionCount()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	return m_sessions.size();
+}
+
 TLSServerStream::TLSServerStream(TLSServer* server, fwRefContainer<TcpServerStream> baseStream)
-	: m_parentServer(server), m_baseStream(baseStream), m_closing(false)
+	: m_parentServer(server), m_baseStream(baseStream), m_loopIndex(baseStream->GetLoopIndex()), m_closing(false), m_fullHandshake(false), m_recordBlockOffset(0),
+	  m_pendingPlaintext(0), m_drainPending(false)
 {
+	if (server->GetCryptoPool())
+	{
+		m_cryptoStrand = std::make_shared<WorkerStrand>(server->GetCryptoPool());
+	}
+
 	Initialize();
 }
 
 void TLSServerStream::Initialize()
 {
 	m_policy = std::make_unique<TLSPolicy>();
-	m_sessionManager = std::make_unique<Botan::TLS::Session_Manager_In_Memory>(m_rng);
+	m_credentials = std::make_shared<TLSStreamCredentials>(m_parentServer->GetCredentials(), m_parentServer->GetTicketKeys());
 
 	m_tlsServer.reset(new Botan::TLS::Server(
 		std::bind(&TLSServerStream::WriteToClient, this, std::placeholders::_1, std::placeholders::_2),
 		std::bind(&TLSServerStream::ReceivedData, this, std::placeholders::_1, std::placeholders::_2),
 		std::bind(&TLSServerStream::ReceivedAlert, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
 		std::bind(&TLSServerStream::HandshakeComplete, this, std::placeholders::_1),
-		*(m_sessionManager.get()),
-		*m_parentServer->GetCredentials(),
+		[=] (const Botan::TLS::Handshake_Message& message)
+		{
+			// resumed handshakes (by session ID or ticket) skip the key exchange, which is what's costly
+			if (message.type() == Botan::TLS::CLIENT_KEX)
+			{
+				m_fullHandshake = true;
+			}
+			else if (message.type() == Botan::TLS::CLIENT_HELLO)
+			{
+				// this gets called before the server processes the message, so it's around once the ticket key is asked for
+				std::vector<uint8_t> clientHello = message.serialize();
+				std::vector<uint8_t> ticket;
+
+				if (ReadClientHelloSessionTicket(clientHello.data(), clientHello.size(), &ticket))
+				{
+					m_credentials->SetPendingTicket(std::move(ticket));
+				}
+			}
+		},
+		*m_parentServer->GetSessionCache(),
+		*m_credentials,
 		*(m_policy.get()),
 		m_rng,
 		[] (std::vector<std::string> protocols)
@@ -138,59 +425,274 @@ void TLSServerStream::Initialize()
 		}
 	));
 
-	m_baseStream->SetReadCallback([=] (const std::vector<uint8_t>& data)
+	m_baseStream->SetReadCallback([=] (const Slice& data)
 	{
 		// keep a reference to the TLS server in case we close due to a TLS alert
 		fwRefContainer<TLSServerStream> self = this;
 
+		// the data may get used after we return, if offloading
+		Slice ciphertext = (m_cryptoStrand) ? data.Retain() : data;
+
+		self->RunEngine([self, ciphertext] ()
+		{
+			self->m_tlsServer->received_data(ciphertext.GetData(), ciphertext.GetLength());
+		});
+	});
+
+	m_baseStream->SetCloseCallback([=] ()
+	{
+		CloseInternal();
+	});
+}
+
+PeerAddress TLSServerStream::GetPeerAddress()
+{
+	return m_baseStream->GetPeerAddress();
+}
+
+int TLSServerStream::GetLoopIndex()
+{
+	return m_loopIndex;
+}
+
+void TLSServerStream::RunEngine(const std::function<void()>& callback)
+{
+	fwRefContainer<TLSServerStream> thisRef = this;
+
+	auto runCallback = [thisRef, callback] ()
+	{
 		try
 		{
-			self->m_tlsServer->received_data(data);
+			callback();
 		}
 		catch (std::exception& e)
 		{
 			trace("%s\n", e.what());
 		}
+
+		// a ticket the server didn't try to decrypt mustn't be taken for one sent later
+		thisRef->m_credentials->ClearPendingTicket();
+
+		// all records the engine produced go out in a single write
+		thisRef->FlushRecords();
+
+		thisRef->CheckDrain();
+	};
+
+	if (!m_cryptoStrand)
+	{
+		runCallback();
+		return;
+	}
+
+	m_cryptoStrand->Post(runCallback);
+}
+
+void TLSServerStream::FlushRecords()
+{
+	// don't keep the block around while idle - the slices pointing into it keep it alive until written
+	m_recordBlock = nullptr;
+	m_recordBlockOffset = 0;
+
+	if (m_pendingRecords.empty() || !m_baseStream.GetRef())
+	{
+		m_pendingRecords.clear();
+		return;
+	}
+
+	std::vector<Slice> records;
+	records.swap(m_pendingRecords);
+
+	// writes from other threads get queued to the loop in order, so records can't get reordered
+	m_baseStream->WriteV(records.data(), records.size());
+}
+
+void TLSServerStream::CheckDrain()
+{
+	if (!m_drainPending || GetQueuedBytes() > GetLowWatermark())
+	{
+		return;
+	}
+
+	m_drainPending = false;
+
+	fwRefContainer<TLSServerStream> self = this;
+
+	ScheduleCallback([self] ()
+	{
+		auto drainCallback = self->GetDrainCallback();
+
+		if (drainCallback)
+		{
+			drainCallback();
+		}
 	});
+}
 
-	m_baseStream->SetCloseCallback([=] ()
+void TLSServerStream::Write(const Slice& data)
+{
+	if (!m_cryptoStrand)
 	{
-		CloseInternal();
+		// the engine reads the caller's data directly
+		RunEngine([=] ()
+		{
+			m_tlsServer->send(data.GetData(), data.GetLength());
+		});
+
+		return;
+	}
+
+	// until the strand gets to it, the data counts towards the queue - or writers wouldn't see any backpressure
+	Slice plaintext = data.Retain();
+	size_t length = plaintext.GetLength();
+
+	if ((m_pendingPlaintext.fetch_add(length) + length) > GetHighWatermark())
+	{
+		m_drainPending = true;
+	}
+
+	RunEngine([=] ()
+	{
+		m_tlsServer->send(plaintext.GetData(), plaintext.GetLength());
+
+		m_pendingPlaintext -= length;
 	});
 }
 
-PeerAddress TLSServerStream::GetPeerAddress()
+void TLSServerStream::ScheduleCallback(const TScheduledCallback& callback)
 {
-	return m_baseStream->GetPeerAddress();
+	if (!m_baseStream.GetRef())
+	{
+		callback();
+		return;
+	}
+
+	m_baseStream->ScheduleCallback(callback);
+}
+
+void TLSServerStream::SetReadTimeout(std::chrono::milliseconds timeout)
+{
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetReadTimeout(timeout);
+	}
+}
+
+size_t TLSServerStream::GetQueuedBytes()
+{
+	return m_pendingPlaintext + ((m_baseStream.GetRef()) ? m_baseStream->GetQueuedBytes() : 0);
+}
+
+void TLSServerStream::SetWriteWatermarks(size_t lowWatermark, size_t highWatermark)
+{
+	TcpServerStream::SetWriteWatermarks(lowWatermark, highWatermark);
+
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetWriteWatermarks(lowWatermark, highWatermark);
+	}
 }
 
-void TLSServerStream::Write(const std::vector<uint8_t>& data)
+void TLSServerStream::SetDrainCallback(const TDrainCallback& callback)
 {
-	m_tlsServer->send(data);
+	TcpServerStream::SetDrainCallback(callback);
+
+	// the base stream is the one actually queueing data
+	if (m_baseStream.GetRef())
+	{
+		m_baseStream->SetDrainCallback(callback);
+	}
+}
+
+void TLSServerStream::Cork()
+{
+	// records get written once the engine ran, so when offloading, corking has to wait for any earlier writes too
+	RunEngine([=] ()
+	{
+		if (m_baseStream.GetRef())
+		{
+			m_baseStream->Cork();
+		}
+	});
+}
+
+void TLSServerStream::Uncork()
+{
+	RunEngine([=] ()
+	{
+		if (m_baseStream.GetRef())
+		{
+			m_baseStream->Uncork();
+		}
+	});
 }
 
 void TLSServerStream::Close()
 {
-	m_tlsServer->close();
+	RunEngine([=] ()
+	{
+		m_tlsServer->close();
+	});
 }
 
 void TLSServerStream::WriteToClient(const uint8_t buf[], size_t length)
 {
-	std::vector<uint8_t> data(buf, buf + length);
-	
-	if (m_baseStream.GetRef())
+	// Botan only lends us the record, so it has to be copied once - pack consecutive records into a shared pooled block,
+	// so a batch of records ends up as a single contiguous range
+	if (length > BufferPool::MaxPooledSize)
+	{
+		m_pendingRecords.push_back(Slice::Copy(buf, length));
+		return;
+	}
+
+	if (!m_recordBlock.GetRef() || (m_recordBlockOffset + length) > m_recordBlock->GetCapacity())
+	{
+		m_recordBlock = BufferPool::GetForSize(BufferPool::MaxPooledSize)->Allocate();
+		m_recordBlockOffset = 0;
+	}
+
+	memcpy(m_recordBlock->GetData() + m_recordBlockOffset, buf, length);
+
+	if (!m_pendingRecords.empty())
 	{
-		m_baseStream->Write(data);
+		Slice& lastRecord = m_pendingRecords.back();
+
+		if (lastRecord.GetBlock().GetRef() == m_recordBlock.GetRef() && lastRecord.end() == m_recordBlock->GetData() + m_recordBlockOffset)
+		{
+			lastRecord = Slice(m_recordBlock, lastRecord.GetData() - m_recordBlock->GetData(), lastRecord.GetLength() + length);
+			m_recordBlockOffset += length;
+
+			return;
+		}
 	}
+
+	m_pendingRecords.push_back(Slice(m_recordBlock, m_recordBlockOffset, length));
+	m_recordBlockOffset += length;
 }
 
 void TLSServerStream::ReceivedData(const uint8_t buf[], size_t length)
 {
-	if (GetReadCallback())
+	if (m_cryptoStrand)
 	{
-		std::vector<uint8_t> data(buf, buf + length);
+		// read callbacks only ever run on the stream's loop
+		fwRefContainer<TLSServerStream> thisRef = this;
+		Slice plaintext = Slice::Copy(buf, length);
+
+		m_baseStream->ScheduleCallback([thisRef, plaintext] ()
+		{
+			if (thisRef->GetReadCallback())
+			{
+				thisRef->GetReadCallback()(plaintext);
+			}
+		});
+
+		return;
+	}
 
-		GetReadCallback()(data);
+	// the plaintext is only valid until we return, which is what borrowed slices are for
+	if (GetReadCallback())
+	{
+		GetReadCallback()(Slice::Borrow(buf, length));
 	}
 }
 
@@ -202,6 +704,16 @@ void TLSServerStream::ReceivedAlert(Botan::TLS::Alert alert, const uint8_t[], si
 	{
 		fwRefContainer<TLSServerStream> thisRef = this;
 
+		// send anything still pending (such as our own close_notify) before closing
+		FlushRecords();
+
+		// the base stream is still used from the loop thread, so leave it to the close callback to release it
+		if (m_cryptoStrand)
+		{
+			m_baseStream->Close();
+			return;
+		}
+
 		if (m_baseStream.GetRef())
 		{
 			m_baseStream->Close();
@@ -212,6 +724,22 @@ void TLSServerStream::ReceivedAlert(Botan::TLS::Alert alert, const uint8_t[], si
 
 bool TLSServerStream::HandshakeComplete(const Botan::TLS::Session& session)
 {
+	m_parentServer->RecordHandshake(!m_fullHandshake);
+	m_fullHandshake = false;
+
+	if (m_cryptoStrand)
+	{
+		// data read after the handshake gets scheduled after this, so the connection callback still sees it first
+		fwRefContainer<TLSServerStream> thisRef = this;
+
+		m_baseStream->ScheduleCallback([thisRef] ()
+		{
+			thisRef->m_parentServer->InvokeConnectionCallback(thisRef.GetRef());
+		});
+
+		return true;
+	}
+
 	m_parentServer->InvokeConnectionCallback(this);
 
 	return true;
@@ -231,20 +759,36 @@ void TLSServerStream::CloseInternal()
 	}
 
 	SetReadCallback(TReadCallback());
+	SetDrainCallback(TDrainCallback());
 
 	m_parentServer->CloseStream(this);
 }
 
 TLSServer::TLSServer(fwRefContainer<TcpServer> baseServer, const std::string& certificatePath, const std::string& keyPath)
-	: m_baseServer(baseServer)
+	: m_baseServer(baseServer), m_fullHandshakes(0), m_resumedHandshakes(0), m_cryptoPool(nullptr)
 {
 	// initialize credentials
 	Botan::AutoSeeded_RNG rng;
 	m_credentials = std::make_shared<CredentialManager>(rng, MakeRelativeCitPath(certificatePath), MakeRelativeCitPath(keyPath));
-	
+
+	Initialize();
+}
+
+TLSServer::TLSServer(fwRefContainer<TcpServer> baseServer, std::shared_ptr<Botan::Credentials_Manager> credentials)
+	: m_baseServer(baseServer), m_credentials(credentials), m_fullHandshakes(0), m_resumedHandshakes(0), m_cryptoPool(nullptr)
+{
+	Initialize();
+}
+
+void TLSServer::Initialize()
+{
+	// shared by all connections, so clients can resume sessions established on any loop
+	m_sessionCache = std::make_shared<TLSSessionCache>(10000, std::chrono::seconds(2 * 60 * 60));
+	m_ticketKeys = std::make_shared<TLSTicketKeys>(TicketKeyLifetime);
+
 	m_baseServer->SetConnectionCallback([=] (fwRefContainer<TcpServerStream> stream)
 	{
-		m_connections.insert(new TLSServerStream(this, stream));
+		m_connections[stream->GetLoopIndex()].insert(new TLSServerStream(this, stream));
 	});
 }
 }
\ No newline at end of file
@@ -26,6 +26,53 @@ void TcpServerStream::SetCloseCallback(const TCloseCallback& callback)
 	m_closeCallback = callback;
 }
 
+TcpServerStream::TcpServerStream()
+	: m_lowWatermark(64 * 1024), m_highWatermark(256 * 1024)
+{
+
+}
+
+void TcpServerStream::SetWriteWatermarks(size_t lowWatermark, size_t highWatermark)
+{
+	assert(lowWatermark <= highWatermark);
+
+	m_lowWatermark = lowWatermark;
+	m_highWatermark = highWatermark;
+}
+
+void TcpServerStream::SetDrainCallback(const TDrainCallback& callback)
+{
+	m_drainCallback = callback;
+}
+
+void TcpServerStream::Write(const std::vector<uint8_t>& data)
+{
+	Write(Slice::Copy(data.data(), data.size()));
+}
+
+void TcpServerStream::Write(std::vector<uint8_t>&& data)
+{
+	Write(Slice(std::move(data)));
+}
+
+void TcpServerStream::Write(std::initializer_list<Slice> slices)
+{
+	WriteV(slices.begin(), slices.size());
+}
+
+void TcpServerStream::WriteV(const Slice* slices, size_t count)
+{
+	// streams without native support get the slices as a corked run of writes
+	Cork();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		Write(slices[i]);
+	}
+
+	Uncork();
+}
+
 void TcpServerStream::SetReadCallback(const TReadCallback& callback)
 {
 	bool wasFirst = !static_cast<bool>(m_readCallback);
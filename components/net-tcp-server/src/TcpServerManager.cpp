@@ -12,9 +12,17 @@
 
 namespace net
 {
-TcpServerManager::TcpServerManager()
+TcpServerManager::TcpServerManager(int loopCount /* = 1 */)
 {
-	m_uvLoop = Instance<UvLoopManager>::Get()->GetOrCreate(std::string("default"));
+	loopCount = std::min(std::max(loopCount, 1), TCP_SERVER_MAX_LOOPS);
+
+	for (int i = 0; i < loopCount; i++)
+	{
+		// the first loop keeps the original tag, so single-loop managers still share the 'default' loop
+		std::string loopTag = (i == 0) ? std::string("default") : "default_" + std::to_string(i);
+
+		m_uvLoops.push_back(Instance<UvLoopManager>::Get()->GetOrCreate(loopTag));
+	}
 }
 
 TcpServerManager::~TcpServerManager()
@@ -22,30 +30,118 @@ TcpServerManager::~TcpServerManager()
 	
 }
 
-fwRefContainer<TcpServer> TcpServerManager::CreateServer(const PeerAddress& bindAddress)
+#ifdef SO_REUSEPORT
+static bool OpenReusePortSocket(uv_tcp_t* handle, const PeerAddress& bindAddress)
 {
-	// allocate an owning pointer for the server handle
-	std::unique_ptr<uv_tcp_t> serverHandle = std::make_unique<uv_tcp_t>();
+	PlatformSocketType socketHandle = socket(bindAddress.GetAddressFamily(), SOCK_STREAM, IPPROTO_TCP);
+
+	if (socketHandle < 0)
+	{
+		trace("Could not create a listening socket - error code %d.\n", GetLastNetError());
+		return false;
+	}
+
+	// allow multiple sockets to bind to the same address - the kernel will distribute incoming connections between them
+	int on = 1;
+
+	if (setsockopt(socketHandle, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&on), sizeof(on)) != 0)
+	{
+		trace("Could not set SO_REUSEPORT on a listening socket - error code %d.\n", GetLastNetError());
+
+		closesocket(socketHandle);
+		return false;
+	}
+
+	int result = uv_tcp_open(handle, socketHandle);
+
+	if (result != 0)
+	{
+		trace("Could not open a listening socket - libuv error %s.\n", uv_strerror(result));
+
+		closesocket(socketHandle);
+		return false;
+	}
 
-	// clear and associate the server handle with our loop
-	uv_tcp_init(m_uvLoop->GetLoop(), serverHandle.get());
+	return true;
+}
+#endif
 
-	// set the socket binding to the peer address
-	uv_tcp_bind(serverHandle.get(), bindAddress.GetSocketAddress(), 0);
+fwRefContainer<TcpServer> TcpServerManager::CreateServer(const PeerAddress& bindAddress)
+{
+	// without SO_REUSEPORT, only a single socket can be bound - all connections will then be served by the first loop
+	int listenerCount = 1;
 
-	// create a server instance and associate it with the handle
+#ifdef SO_REUSEPORT
+	listenerCount = GetLoopCount();
+#else
+	if (GetLoopCount() > 1)
+	{
+		trace("SO_REUSEPORT is not supported on this platform - %s will only be served by a single loop.\n", bindAddress.ToString().c_str());
+	}
+#endif
+
+	// create a server instance
 	fwRefContainer<UvTcpServer> tcpServer = new UvTcpServer(this);
-	serverHandle->data = tcpServer.GetRef();
 
-	// attempt listening on the socket
-	if (tcpServer->Listen(std::move(serverHandle)))
+	for (int i = 0; i < listenerCount; i++)
 	{
-		// insert to the owned list
-		m_servers.insert(tcpServer);
+		bool listening = false;
+
+		// libuv handles may only be touched from their loop's thread, so set up the listener there
+		m_uvLoops[i]->InvokeCallback([&] ()
+		{
+			// allocate an owning pointer for the server handle
+			std::unique_ptr<uv_tcp_t> serverHandle = std::make_unique<uv_tcp_t>();
+
+			// clear and associate the server handle with the loop
+			uv_tcp_init(GetLoop(i), serverHandle.get());
+
+#ifdef SO_REUSEPORT
+			// if we're sharding, create the socket ourselves so it can share the port with the other loops
+			if (listenerCount > 1 && !OpenReusePortSocket(serverHandle.get(), bindAddress))
+			{
+				// if even the first socket can't be shared, fall back to a single listener on the first loop
+				if (i == 0)
+				{
+					trace("Falling back to a single loop for %s.\n", bindAddress.ToString().c_str());
+
+					listenerCount = 1;
+				}
+				else
+				{
+					UvClose(std::move(serverHandle));
+					return;
+				}
+			}
+#endif
+
+			// set the socket binding to the peer address
+			int result = uv_tcp_bind(serverHandle.get(), bindAddress.GetSocketAddress(), 0);
+
+			if (result != 0)
+			{
+				trace("Could not bind to %s - libuv error %s.\n", bindAddress.ToString().c_str(), uv_strerror(result));
+
+				UvClose(std::move(serverHandle));
+				return;
+			}
+
+			// attempt listening on the socket - the server takes ownership of the handle even if this fails
+			listening = tcpServer->Listen(i, std::move(serverHandle));
+		});
+
+		if (!listening)
+		{
+			// this closes any listeners that did get created
+			tcpServer = nullptr;
+			break;
+		}
 	}
-	else
+
+	if (tcpServer.GetRef())
 	{
-		tcpServer = nullptr;
+		// insert to the owned list
+		m_servers.insert(tcpServer);
 	}
 
 	return tcpServer;
@@ -66,7 +162,7 @@ static InitFunction initFunction([] ()
 		{
 			trace("Received a connection from %s.\n", stream->GetPeerAddress().ToString().c_str());
 
-			stream->SetReadCallback([=] (const std::vector<uint8_t>& buf)
+			stream->SetReadCallback([=] (const net::Slice& buf)
 			{
 				for (auto& entry : buf)
 				{
@@ -86,31 +182,15 @@ static InitFunction initFunction([] ()
 		fwRefContainer<net::MultiplexTcpServer> ms = new net::MultiplexTcpServer(sm);
 		ms->Bind(net::PeerAddress::FromString("0.0.0.0:30150").get());
 
-		fwRefContainer<net::TcpServer> cakeServer = ms->CreateServer([] (const std::vector<uint8_t>& data)
-		{
-			if (data.size() < 4)
-			{
-				return net::MultiplexPatternMatchResult::InsufficientData;
-			}
-
-			return (memcmp(&data[0], "cake", 4) == 0) ? net::MultiplexPatternMatchResult::Match : net::MultiplexPatternMatchResult::NoMatch;
-		});
+		fwRefContainer<net::TcpServer> cakeServer = ms->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern::FromPrefix("cake") });
 
-		fwRefContainer<net::TcpServer> bakeServer = ms->CreateServer([] (const std::vector<uint8_t>& data)
-		{
-			if (data.size() < 4)
-			{
-				return net::MultiplexPatternMatchResult::InsufficientData;
-			}
-
-			return (memcmp(&data[0], "bake", 4) == 0) ? net::MultiplexPatternMatchResult::Match : net::MultiplexPatternMatchResult::NoMatch;
-		});
+		fwRefContainer<net::TcpServer> bakeServer = ms->CreateServer(std::vector<net::MultiplexPattern>{ net::MultiplexPattern::FromPrefix("bake") });
 
 		cakeServer->SetConnectionCallback([=] (fwRefContainer<net::TcpServerStream> stream)
 		{
 			trace("Received a cake connection from %s.\n", stream->GetPeerAddress().ToString().c_str());
 
-			stream->SetReadCallback([=] (const std::vector<uint8_t>& buf)
+			stream->SetReadCallback([=] (const net::Slice& buf)
 			{
 				trace("[cake]: ");
 
@@ -127,7 +207,7 @@ static InitFunction initFunction([] ()
 		{
 			trace("Received a bake connection from %s.\n", stream->GetPeerAddress().ToString().c_str());
 
-			stream->SetReadCallback([=] (const std::vector<uint8_t>& buf)
+			stream->SetReadCallback([=] (const net::Slice& buf)
 			{
 				trace("[bake]: ");
 
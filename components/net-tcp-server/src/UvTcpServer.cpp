@@ -10,6 +10,10 @@
 #include "TcpServerManager.h"
 #include "memdbgon.h"
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 template<typename Handle, class Class, typename T1, void(Class::*Callable)(T1)>
 void UvCallback(Handle* handle, T1 a1)
 {
@@ -22,51 +26,133 @@ void UvCallback(Handle* handle, T1 a1, T2 a2)
 	(reinterpret_cast<Class*>(handle->data)->*Callable)(a1, a2);
 }
 
-// wrapper to make sure the libuv handle only gets freed after the close completes
-template<typename Handle>
-void UvClose(std::unique_ptr<Handle> handle)
+namespace net
 {
-	struct TempCloseData
-	{
-		std::unique_ptr<Handle> item;
-	};
+// state of a file being sent straight from the file system to a stream's socket
+struct UvSendFileReq
+{
+	uv_fs_t fsReq;
 
-	// create temporary object and give it our reference
-	TempCloseData* tempCloseData = new TempCloseData;
-	tempCloseData->item = std::move(handle);
-	tempCloseData->item->data = tempCloseData;
+	std::string path;
 
-	// close the libuv handle
-	uv_close(reinterpret_cast<uv_handle_t*>(tempCloseData->item.get()), [] (uv_handle_t* handle)
-	{
-		// delete the close holder
-		delete reinterpret_cast<TempCloseData*>(handle->data);
-	});
-}
+	uv_file file;
+
+	uint64_t offset;
+
+	uint64_t remaining;
+
+	// set once the request stopped waiting for earlier writes to complete
+	bool started;
+
+	// watches a duplicate of the socket for writability while its send buffer is full
+	std::unique_ptr<uv_poll_t> writablePoll;
+
+	int pollSocket;
+
+	TcpServerStream::TSendFileCallback callback;
+
+	fwRefContainer<UvTcpServerStream> stream;
+};
 
-namespace net
-{
 UvTcpServer::UvTcpServer(TcpServerManager* manager)
-	: m_manager(manager)
+	: m_manager(manager), m_maxConnections(0), m_maxConnectionsPerAddress(0), m_idleTimeout(0), m_connectionCount(0), m_rejectedConnections(0), m_writeReqAllocations(0), m_submittedWrites(0), m_tearingDown(false)
 {
 
 }
 
 UvTcpServer::~UvTcpServer()
 {
-	m_clients.clear();
+	// the listeners and clients got torn down on their loops by Release
+}
+
+bool UvTcpServer::Release()
+{
+	// nobody else holds a reference to add one, so this can't race
+	if (GetRefCount() != 1 || m_listeners.empty() || m_tearingDown.exchange(true))
+	{
+		return fwRefCountable::Release();
+	}
+
+	// listeners and clients can only be touched from their loop threads - rather than waiting on each loop in turn (which
+	// deadlocks if one of them is waiting on us), each loop tears down its share, and the last one to finish deletes us
+	auto remaining = std::make_shared<std::atomic<size_t>>(m_listeners.size() + 1);
+
+	auto releaseOne = [this, remaining] ()
+	{
+		if (--(*remaining) == 0)
+		{
+			fwRefCountable::Release();
+		}
+	};
+
+	for (auto& listener : m_listeners)
+	{
+		Listener* listenerRef = listener.get();
+
+		// the loop has to stay around until the callback ran
+		fwRefContainer<UvLoopHolder> loop = reinterpret_cast<UvLoopHolder*>(listener->handle->loop->data);
+
+		bool queued = loop->EnqueueCallback([loop, listenerRef, releaseOne] ()
+		{
+			listenerRef->server->TearDownListener(listenerRef);
+
+			releaseOne();
+		});
+
+		// an exiting loop won't run anything anymore, so there's nothing left to tear down on it
+		if (!queued)
+		{
+			releaseOne();
+		}
+	}
+
+	releaseOne();
+
+	return false;
+}
+
+void UvTcpServer::TearDownListener(Listener* listener)
+{
+	listener->backoffTimer.Stop();
+
+	// timers can only be touched from the loop thread, and clients may outlive us
+	for (auto& client : m_clients[listener->loopIndex])
+	{
+		client->CancelTimeouts();
+	}
 
-	if (m_server.get())
+	m_clients[listener->loopIndex].clear();
+
+	for (auto& req : m_freeWriteReqs[listener->loopIndex])
 	{
-		UvClose(std::move(m_server));
+		delete req;
 	}
+
+	m_freeWriteReqs[listener->loopIndex].clear();
+
+	UvClose(std::move(listener->handle));
 }
 
-bool UvTcpServer::Listen(std::unique_ptr<uv_tcp_t>&& server)
+bool UvTcpServer::Listen(int loopIndex, std::unique_ptr<uv_tcp_t>&& server)
 {
-	m_server = std::move(server);
+	// create a listener for the loop, owning the handle
+	std::unique_ptr<Listener> listener = std::make_unique<Listener>();
+	listener->server = this;
+	listener->loopIndex = loopIndex;
+	listener->handle = std::move(server);
+	listener->handle->data = listener.get();
+	listener->paused = false;
+	listener->backoff = std::chrono::milliseconds(0);
+
+	Listener* listenerRef = listener.get();
+	m_listeners.push_back(std::move(listener));
+
+	int result = uv_listen(reinterpret_cast<uv_stream_t*>(listenerRef->handle.get()), SOMAXCONN, [] (uv_stream_t* handle, int status)
+	{
+		Listener* listener = reinterpret_cast<Listener*>(handle->data);
 
-	int result = uv_listen(reinterpret_cast<uv_stream_t*>(m_server.get()), 0, UvCallback<uv_stream_t, UvTcpServer, int, &UvTcpServer::OnConnection>);
+		listener->server->OnConnection(listener, status);
+	});
 
 	bool retval = (result == 0);
 
@@ -78,7 +164,7 @@ bool UvTcpServer::Listen(std::unique_ptr<uv_tcp_t>&& server)
 	return retval;
 }
 
-void UvTcpServer::OnConnection(int status)
+void UvTcpServer::OnConnection(Listener* listener, int status)
 {
 	// check for error conditions
 	if (status < 0)
@@ -87,18 +173,77 @@ void UvTcpServer::OnConnection(int status)
 		return;
 	}
 
-	// initialize a handle for the client
+	// leaving the connection pending makes libuv stop polling the listener until we accept it
+	if (IsAtConnectionLimit())
+	{
+		PauseListener(listener);
+		return;
+	}
+
+	AcceptConnection(listener);
+}
+
+// gets the peer's IP address (without the port) as raw bytes
+static std::string GetAddressKey(uv_tcp_t* handle)
+{
+	sockaddr_storage addr;
+	int len = sizeof(addr);
+
+	if (uv_tcp_getpeername(handle, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+	{
+		return std::string();
+	}
+
+	if (addr.ss_family == AF_INET6)
+	{
+		auto in6 = reinterpret_cast<sockaddr_in6*>(&addr);
+		return std::string(reinterpret_cast<const char*>(&in6->sin6_addr), sizeof(in6->sin6_addr));
+	}
+
+	auto in = reinterpret_cast<sockaddr_in*>(&addr);
+	return std::string(reinterpret_cast<const char*>(&in->sin_addr), sizeof(in->sin_addr));
+}
+
+void UvTcpServer::AcceptConnection(Listener* listener)
+{
+	// initialize a handle for the client on the same loop as the listener
 	std::unique_ptr<uv_tcp_t> clientHandle = std::make_unique<uv_tcp_t>();
-	uv_tcp_init(m_manager->GetLoop(), clientHandle.get());
+	uv_tcp_init(listener->handle->loop, clientHandle.get());
+
+	int result = uv_accept(reinterpret_cast<uv_stream_t*>(listener->handle.get()), reinterpret_cast<uv_stream_t*>(clientHandle.get()));
+
+	if (result != 0)
+	{
+		trace("accepting a connection failed - %s\n", uv_strerror(result));
+
+		UvClose(std::move(clientHandle));
+		return;
+	}
+
+	std::string addressKey = GetAddressKey(clientHandle.get());
+
+	// the connection has to be accepted to know where it's from, but we can still drop it before doing anything else
+	if (!AddConnection(addressKey))
+	{
+		m_rejectedConnections++;
+
+		UvClose(std::move(clientHandle));
+		return;
+	}
 
 	// create a stream instance and associate
-	fwRefContainer<UvTcpServerStream> stream(new UvTcpServerStream(this));
+	fwRefContainer<UvTcpServerStream> stream(new UvTcpServerStream(this, reinterpret_cast<UvLoopHolder*>(listener->handle->loop->data), listener->loopIndex));
 	clientHandle->data = stream.GetRef();
 
-	// attempt accepting the connection
-	if (stream->Accept(std::move(clientHandle)))
+	// start reading from the connection
+	if (stream->Accept(std::move(clientHandle), addressKey))
 	{
-		m_clients.insert(stream);
+		m_clients[listener->loopIndex].insert(stream);
+
+		if (m_idleTimeout > 0)
+		{
+			stream->SetIdleTimeout(std::chrono::milliseconds(m_idleTimeout.load()));
+		}
 		
 		// invoke the connection callback
 		if (GetConnectionCallback())
@@ -108,17 +253,218 @@ void UvTcpServer::OnConnection(int status)
 	}
 	else
 	{
+		RemoveConnection(addressKey);
+
 		stream = nullptr;
 	}
 }
 
+void UvTcpServer::PauseListener(Listener* listener)
+{
+	// back off exponentially while we stay at the limit - connections closing will resume accepting sooner
+	static const std::chrono::milliseconds MinBackoff(50);
+	static const std::chrono::milliseconds MaxBackoff(2000);
+
+	if (!listener->paused)
+	{
+		trace("Connection limit (%d) reached - not accepting new connections for now.\n", static_cast<int>(m_maxConnections.load()));
+	}
+
+	listener->paused = true;
+	listener->backoff = (listener->backoff.count() == 0) ? MinBackoff : std::min(listener->backoff * 2, MaxBackoff);
+
+	UvLoopHolder* loop = reinterpret_cast<UvLoopHolder*>(listener->handle->loop->data);
+
+	loop->GetTimerWheel()->Start(&listener->backoffTimer, listener->backoff, [=] ()
+	{
+		ResumeListener(listener);
+	});
+}
+
+void UvTcpServer::ResumeListener(Listener* listener)
+{
+	if (!listener->paused)
+	{
+		return;
+	}
+
+	if (IsAtConnectionLimit())
+	{
+		PauseListener(listener);
+		return;
+	}
+
+	listener->paused = false;
+	listener->backoff = std::chrono::milliseconds(0);
+	listener->backoffTimer.Stop();
+
+	// accept the connection we left pending - this also makes libuv poll the listener again
+	AcceptConnection(listener);
+}
+
+bool UvTcpServer::IsAtConnectionLimit()
+{
+	size_t maxConnections = m_maxConnections;
+
+	return (maxConnections > 0 && m_connectionCount >= maxConnections);
+}
+
+bool UvTcpServer::AddConnection(const std::string& addressKey)
+{
+	size_t maxConnections = m_maxConnectionsPerAddress;
+
+	std::unique_lock<std::mutex> lock(m_addressMutex);
+
+	size_t& count = m_addressConnections[addressKey];
+
+	if (maxConnections > 0 && count >= maxConnections)
+	{
+		return false;
+	}
+
+	count++;
+	m_connectionCount++;
+
+	return true;
+}
+
+void UvTcpServer::RemoveConnection(const std::string& addressKey)
+{
+	std::unique_lock<std::mutex> lock(m_addressMutex);
+
+	auto it = m_addressConnections.find(addressKey);
+
+	if (it != m_addressConnections.end() && --it->second == 0)
+	{
+		m_addressConnections.erase(it);
+	}
+
+	m_connectionCount--;
+}
+
 void UvTcpServer::RemoveStream(UvTcpServerStream* stream)
 {
-	m_clients.erase(stream);
+	int loopIndex = stream->GetLoopIndex();
+
+	// only count the stream once, no matter how often it gets closed
+	if (m_clients[loopIndex].erase(stream) == 0)
+	{
+		return;
+	}
+
+	RemoveConnection(stream->GetAddressKey());
+
+	// a slot freed up, so don't wait for the backoff to pass
+	for (auto& listener : m_listeners)
+	{
+		if (listener->loopIndex == loopIndex && listener->paused)
+		{
+			ResumeListener(listener.get());
+		}
+	}
+}
+
+void UvTcpServer::SetMaxConnections(size_t maxConnections)
+{
+	m_maxConnections = maxConnections;
+}
+
+void UvTcpServer::SetMaxConnectionsPerAddress(size_t maxConnections)
+{
+	m_maxConnectionsPerAddress = maxConnections;
+}
+
+void UvTcpServer::SetIdleTimeout(std::chrono::milliseconds timeout)
+{
+	// only applies to connections accepted from now on
+	m_idleTimeout = timeout.count();
+}
+
+UvWriteReq* UvTcpServer::AllocateWriteReq(int loopIndex)
+{
+	auto& freeList = m_freeWriteReqs[loopIndex];
+
+	if (freeList.empty())
+	{
+		m_writeReqAllocations++;
+
+		return new UvWriteReq;
+	}
+
+	UvWriteReq* req = freeList.back();
+	freeList.pop_back();
+
+	return req;
+}
+
+void UvTcpServer::FreeWriteReq(int loopIndex, UvWriteReq* req)
+{
+	// don't keep around an unbounded amount of requests after a burst of writes
+	static const size_t MaxFreeWriteReqs = 1024;
+
+	auto& freeList = m_freeWriteReqs[loopIndex];
+
+	if (freeList.size() < MaxFreeWriteReqs)
+	{
+		freeList.push_back(req);
+	}
+	else
+	{
+		delete req;
+	}
+}
+
+// a client handle that's being shut down once its pending writes went out
+struct UvShutdownReq
+{
+	uv_shutdown_t req;
+
+	std::unique_ptr<uv_tcp_t> client;
+
+	// a peer that stops reading would keep the shutdown from ever completing
+	UvWheelTimer lingerTimer;
+};
+
+static void ShutdownClient(UvLoopHolder* loop, std::unique_ptr<uv_tcp_t>&& client)
+{
+	static const std::chrono::milliseconds MaxLinger(10000);
+
+	UvShutdownReq* req = new UvShutdownReq;
+	req->req.data = req;
+	req->client = std::move(client);
+
+	// the shutdown only completes after all earlier writes did - closing right away would cancel those
+	int result = uv_shutdown(&req->req, reinterpret_cast<uv_stream_t*>(req->client.get()), [] (uv_shutdown_t* shutdownReq, int status)
+	{
+		UvShutdownReq* req = reinterpret_cast<UvShutdownReq*>(shutdownReq->data);
+
+		// the client is already gone if the linger timeout closed it
+		if (req->client)
+		{
+			UvClose(std::move(req->client));
+		}
+
+		delete req;
+	});
+
+	if (result < 0)
+	{
+		UvClose(std::move(req->client));
+
+		delete req;
+		return;
+	}
+
+	loop->GetTimerWheel()->Start(&req->lingerTimer, MaxLinger, [req] ()
+	{
+		// this cancels the shutdown, which then frees the request
+		UvClose(std::move(req->client));
+	});
 }
 
-UvTcpServerStream::UvTcpServerStream(UvTcpServer* server)
-	: m_server(server)
+UvTcpServerStream::UvTcpServerStream(UvTcpServer* server, UvLoopHolder* loop, int loopIndex)
+	: m_server(server), m_loop(loop), m_loopIndex(loopIndex), m_corkDepth(0), m_queuedBytes(0), m_drainPending(false), m_inFlightWrites(0),
+	  m_sendingFile(false), m_closePending(false), m_readTimeout(0), m_idleTimeout(0), m_lastReadTime(0), m_lastActivityTime(0)
 {
 
 }
@@ -130,48 +476,112 @@ UvTcpServerStream::~UvTcpServerStream()
 
 void UvTcpServerStream::CloseClient()
 {
+	// an armed timeout holds a reference to us, so if we're being destroyed off the loop thread, it's inactive already
+	if (m_loop->IsInLoopThread())
+	{
+		m_timeoutTimer.Stop();
+	}
+
 	if (m_client.get())
 	{
-		uv_read_stop(reinterpret_cast<uv_stream_t*>(m_client.get()));
+		if (m_loop->IsInLoopThread())
+		{
+			uv_read_stop(reinterpret_cast<uv_stream_t*>(m_client.get()));
+
+			// a file send may still be using the socket from the thread pool - close once it returns
+			if (m_sendFile.get() && m_sendFile->started)
+			{
+				m_closePending = true;
+				return;
+			}
+
+			if (m_inFlightWrites > 0)
+			{
+				ShutdownClient(m_loop, std::move(m_client));
+			}
+			else
+			{
+				UvClose(std::move(m_client));
+			}
+		}
+		else
+		{
+			// handles can only be closed from the loop thread
+			uv_tcp_t* client = m_client.release();
 
-		UvClose(std::move(m_client));
+			m_loop->EnqueueCallback([=] ()
+			{
+				uv_read_stop(reinterpret_cast<uv_stream_t*>(client));
+
+				UvClose(std::unique_ptr<uv_tcp_t>(client));
+			});
+		}
 	}
 }
 
-bool UvTcpServerStream::Accept(std::unique_ptr<uv_tcp_t>&& client)
+bool UvTcpServerStream::Accept(std::unique_ptr<uv_tcp_t>&& client, const std::string& addressKey)
 {
 	m_client = std::move(client);
+	m_addressKey = addressKey;
 
-	int result = uv_accept(reinterpret_cast<uv_stream_t*>(m_server->GetServer()),
-						   reinterpret_cast<uv_stream_t*>(m_client.get()));
+	// keep the address around, as the client handle goes away on close
+	sockaddr_storage addr;
+	int len = sizeof(addr);
 
-	if (result == 0)
+	if (uv_tcp_getpeername(m_client.get(), reinterpret_cast<sockaddr*>(&addr), &len) == 0)
 	{
-		uv_read_start(reinterpret_cast<uv_stream_t*>(m_client.get()), [] (uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buf)
-		{
-			UvTcpServerStream* stream = reinterpret_cast<UvTcpServerStream*>(handle->data);
+		m_peerAddress = PeerAddress(reinterpret_cast<sockaddr*>(&addr), static_cast<socklen_t>(len));
+	}
 
-			auto& readBuffer = stream->GetReadBuffer();
-			readBuffer.resize(suggestedSize);
+	m_lastReadTime = uv_now(m_loop->GetLoop());
+	m_lastActivityTime = m_lastReadTime;
 
-			buf->base = &readBuffer[0];
-			buf->len = suggestedSize;
-		}, UvCallback<uv_stream_t, UvTcpServerStream, ssize_t, const uv_buf_t*, &UvTcpServerStream::HandleRead>);
-	}
+	int result = uv_read_start(reinterpret_cast<uv_stream_t*>(m_client.get()), [] (uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buf)
+	{
+		UvTcpServerStream* stream = reinterpret_cast<UvTcpServerStream*>(handle->data);
+
+		BufferBlock* readBlock = stream->GetReadBlock();
+
+		buf->base = reinterpret_cast<char*>(readBlock->GetData());
+		buf->len = readBlock->GetCapacity();
+	}, UvCallback<uv_stream_t, UvTcpServerStream, ssize_t, const uv_buf_t*, &UvTcpServerStream::HandleRead>);
 
 	return (result == 0);
 }
 
+BufferBlock* UvTcpServerStream::GetReadBlock()
+{
+	// only reuse the current block if nobody else holds on to it
+	if (!m_readBlock.GetRef() || m_readBlock->GetRefCount() > 1)
+	{
+		m_readBlock = BufferPool::GetForSize(BufferPool::MaxPooledSize)->Allocate();
+	}
+
+	return m_readBlock.GetRef();
+}
+
 void UvTcpServerStream::HandleRead(ssize_t nread, const uv_buf_t* buf)
 {
 	if (nread > 0)
 	{
-		std::vector<uint8_t> targetBuf(nread);
-		memcpy(&targetBuf[0], buf->base, targetBuf.size());
+		// the timeout timer will notice this once it fires
+		m_lastReadTime = uv_now(m_loop->GetLoop());
+		m_lastActivityTime = m_lastReadTime;
 
 		if (GetReadCallback())
 		{
-			GetReadCallback()(targetBuf);
+			// keep a reference in case the callback closes us
+			fwRefContainer<UvTcpServerStream> selfRef = this;
+
+			// hand out a view of the read block - the callback retaining it will make us switch to a fresh block
+			Slice data(m_readBlock, 0, nread);
+
+			// coalesce any writes made in response to this read
+			Cork();
+
+			GetReadCallback()(data);
+
+			Uncork();
 		}
 	}
 	else if (nread < 0)
@@ -187,57 +597,641 @@ void UvTcpServerStream::HandleRead(ssize_t nread, const uv_buf_t* buf)
 
 PeerAddress UvTcpServerStream::GetPeerAddress()
 {
-	sockaddr_storage addr;
-	int len = sizeof(addr);
+	return m_peerAddress;
+}
 
-	uv_tcp_getpeername(m_client.get(), reinterpret_cast<sockaddr*>(&addr), &len);
+int UvTcpServerStream::GetLoopIndex()
+{
+	return m_loopIndex;
+}
 
-	return PeerAddress(reinterpret_cast<sockaddr*>(&addr), static_cast<socklen_t>(len));
+void UvTcpServerStream::Write(const Slice& data)
+{
+	WriteV(&data, 1);
 }
 
-void UvTcpServerStream::Write(const std::vector<uint8_t>& data)
+void UvTcpServerStream::WriteV(const Slice* slices, size_t count)
 {
-	// write request structure
-	struct UvWriteReq
-	{
-		std::vector<uint8_t> sendData;
-		uv_buf_t buffer;
-		uv_write_t write;
+	// account for the data right away, so writers on other threads see the queue grow
+	size_t length = 0;
 
-		fwRefContainer<UvTcpServerStream> stream;
-	};
+	for (size_t i = 0; i < count; i++)
+	{
+		length += slices[i].GetLength();
+	}
 
-	// prepare a write request
-	UvWriteReq* writeReq = new UvWriteReq;
-	writeReq->sendData = data;
-	writeReq->buffer.base = reinterpret_cast<char*>(&writeReq->sendData[0]);
-	writeReq->buffer.len = writeReq->sendData.size();
-	writeReq->stream = this;
-	
-	writeReq->write.data = writeReq;
+	// the stream stops being writable at the high watermark, so the writer waits for a drain from there on
+	if ((m_queuedBytes.fetch_add(length) + length) >= GetHighWatermark())
+	{
+		m_drainPending = true;
+	}
 
-	// send the write request
-	uv_write(&writeReq->write, reinterpret_cast<uv_stream_t*>(m_client.get()), &writeReq->buffer, 1, [] (uv_write_t* write, int status)
+	// libuv isn't thread-safe - submit the write from the loop thread if we're not on it
+	if (m_loop->IsInLoopThread())
 	{
-		UvWriteReq* req = reinterpret_cast<UvWriteReq*>(write->data);
+		WriteInternal(slices, count);
+	}
+	else
+	{
+		fwRefContainer<UvTcpServerStream> selfRef = this;
 
-		if (status < 0)
+		std::vector<Slice> ownedData;
+		ownedData.reserve(count);
+
+		for (size_t i = 0; i < count; i++)
 		{
-			trace("write to %s failed - %s\n", req->stream->GetPeerAddress().ToString().c_str(), uv_strerror(status));
+			ownedData.push_back(slices[i].Retain());
 		}
 
-		delete req;
-	});
+		m_loop->EnqueueCallback([=] ()
+		{
+			selfRef->WriteInternal(ownedData.data(), ownedData.size());
+		});
+	}
 }
 
-void UvTcpServerStream::Close()
+void UvTcpServerStream::Cork()
 {
-	// keep a reference in scope
-	fwRefContainer<UvTcpServerStream> selfRef = this;
+	if (!m_loop->IsInLoopThread())
+	{
+		fwRefContainer<UvTcpServerStream> selfRef = this;
 
-	CloseClient();
+		m_loop->EnqueueCallback([=] ()
+		{
+			selfRef->Cork();
+		});
+
+		return;
+	}
+
+	m_corkDepth++;
+}
+
+void UvTcpServerStream::Uncork()
+{
+	if (!m_loop->IsInLoopThread())
+	{
+		fwRefContainer<UvTcpServerStream> selfRef = this;
+
+		m_loop->EnqueueCallback([=] ()
+		{
+			selfRef->Uncork();
+		});
+
+		return;
+	}
+
+	assert(m_corkDepth > 0);
+
+	if (--m_corkDepth == 0)
+	{
+		FlushCorked();
+	}
+}
+
+void UvTcpServerStream::FlushCorked()
+{
+	if (!m_corkedData.empty())
+	{
+		// swap the list out, as the write may fail and re-enter us
+		std::vector<Slice> corkedData;
+		corkedData.swap(m_corkedData);
+
+		SubmitWrite(corkedData.data(), corkedData.size());
+
+		// hand the storage back so we don't reallocate the list on every cork cycle
+		corkedData.clear();
+
+		if (m_corkedData.empty())
+		{
+			m_corkedData.swap(corkedData);
+		}
+	}
+}
+
+void UvTcpServerStream::WriteInternal(const Slice* slices, size_t count)
+{
+	if (m_corkDepth > 0)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!slices[i].IsEmpty())
+			{
+				m_corkedData.push_back(slices[i].Retain());
+			}
+		}
+
+		return;
+	}
+
+	SubmitWrite(slices, count);
+}
+
+void UvTcpServerStream::SubmitWrite(const Slice* slices, size_t count)
+{
+	// the stream may have been closed in the meantime
+	if (!m_client.get() || m_closePending)
+	{
+		size_t length = 0;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			length += slices[i].GetLength();
+		}
+
+		ReleaseQueuedBytes(length);
+		return;
+	}
+
+	// prepare a write request - this only copies the data if the caller didn't give us ownership of it
+	UvWriteReq* writeReq = m_server->AllocateWriteReq(m_loopIndex);
+	writeReq->length = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!slices[i].IsEmpty())
+		{
+			writeReq->data.push_back(slices[i].Retain());
+
+			const Slice& slice = writeReq->data.back();
+			writeReq->buffers.push_back(uv_buf_init(reinterpret_cast<char*>(const_cast<uint8_t*>(slice.GetData())), slice.GetLength()));
+
+			writeReq->length += slice.GetLength();
+		}
+	}
+
+	if (writeReq->buffers.empty())
+	{
+		m_server->FreeWriteReq(m_loopIndex, writeReq);
+		return;
+	}
+
+	writeReq->stream = this;
+	writeReq->write.data = writeReq;
+
+	// send the write request - libuv will submit all buffers using a single vectored write
+	int result = uv_write(&writeReq->write, reinterpret_cast<uv_stream_t*>(m_client.get()), writeReq->buffers.data(), writeReq->buffers.size(), [] (uv_write_t* write, int status)
+	{
+		UvWriteReq* req = reinterpret_cast<UvWriteReq*>(write->data);
+
+		if (status < 0)
+		{
+			// writes only get cancelled by the client getting closed, which isn't worth a trace
+			if (status != UV_ECANCELED)
+			{
+				trace("write to %s failed - %s\n", req->stream->GetPeerAddress().ToString().c_str(), uv_strerror(status));
+			}
+		}
+		else
+		{
+			req->stream->m_lastActivityTime = uv_now(write->handle->loop);
+		}
+
+		// release the data and the stream before recycling the request
+		fwRefContainer<UvTcpServerStream> stream = req->stream;
+		size_t length = req->length;
+
+		req->data.clear();
+		req->buffers.clear();
+		req->stream = nullptr;
+
+		stream->m_server->FreeWriteReq(stream->m_loopIndex, req);
+
+		stream->m_inFlightWrites--;
+
+		// this may call the drain callback, which will likely write more
+		stream->ReleaseQueuedBytes(length);
+
+		// a file send waits for the socket to be free of earlier writes
+		if (stream->m_inFlightWrites == 0 && stream->m_sendFile.get() && !stream->m_sendFile->started)
+		{
+			stream->StartSendFile();
+		}
+	});
+
+	if (result < 0)
+	{
+		trace("write to %s failed - %s\n", GetPeerAddress().ToString().c_str(), uv_strerror(result));
+
+		size_t length = writeReq->length;
+
+		writeReq->data.clear();
+		writeReq->buffers.clear();
+		writeReq->stream = nullptr;
+
+		m_server->FreeWriteReq(m_loopIndex, writeReq);
+
+		ReleaseQueuedBytes(length);
+
+		return;
+	}
+
+	m_inFlightWrites++;
+	m_server->CountSubmittedWrite();
+}
+
+void UvTcpServerStream::ReleaseQueuedBytes(size_t length)
+{
+	size_t queuedBytes = m_queuedBytes.fetch_sub(length) - length;
+
+	if (queuedBytes <= GetLowWatermark() && m_drainPending.exchange(false))
+	{
+		// get it locally, as the callback may replace itself
+		auto drainCallback = GetDrainCallback();
+
+		if (drainCallback)
+		{
+			drainCallback();
+		}
+	}
+}
+
+size_t UvTcpServerStream::GetQueuedBytes()
+{
+	return m_queuedBytes;
+}
+
+bool UvTcpServerStream::SendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback)
+{
+#ifdef _WIN32
+	// libuv's sendfile takes CRT file descriptors, which sockets aren't on Windows
+	return false;
+#else
+	// only one file gets sent at a time - decided right away, so callers on other threads can still write it themselves
+	if (m_sendingFile.exchange(true))
+	{
+		return false;
+	}
+
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	if (!m_loop->IsInLoopThread())
+	{
+		m_loop->EnqueueCallback([=] ()
+		{
+			selfRef->BeginSendFile(nativePath, offset, length, callback);
+		});
+
+		return true;
+	}
+
+	BeginSendFile(nativePath, offset, length, callback);
+	return true;
+#endif
+}
+
+void UvTcpServerStream::BeginSendFile(const std::string& nativePath, uint64_t offset, uint64_t length, const TSendFileCallback& callback)
+{
+	if (!m_client.get() || m_closePending)
+	{
+		m_sendingFile = false;
+
+		if (callback)
+		{
+			callback(false);
+		}
+
+		return;
+	}
+
+	m_sendFile = std::make_unique<UvSendFileReq>();
+	m_sendFile->path = nativePath;
+	m_sendFile->file = -1;
+	m_sendFile->pollSocket = -1;
+	m_sendFile->offset = offset;
+	m_sendFile->remaining = length;
+	m_sendFile->started = false;
+	m_sendFile->callback = callback;
+	m_sendFile->stream = this;
+
+	// anything written up to now has to reach the socket before the file does, and anything written after has to wait for it
+	FlushCorked();
+	Cork();
+
+	if (m_inFlightWrites == 0)
+	{
+		StartSendFile();
+	}
+}
+
+void UvTcpServerStream::StartSendFile()
+{
+	UvSendFileReq* req = m_sendFile.get();
+	req->started = true;
+	req->fsReq.data = req;
+
+	int result = uv_fs_open(m_loop->GetLoop(), &req->fsReq, req->path.c_str(), O_RDONLY, 0, [] (uv_fs_t* fsReq)
+	{
+		UvSendFileReq* req = reinterpret_cast<UvSendFileReq*>(fsReq->data);
+		ssize_t result = fsReq->result;
+
+		uv_fs_req_cleanup(fsReq);
+
+		if (result < 0)
+		{
+			trace("opening %s for sending failed - %s\n", req->path.c_str(), uv_strerror(result));
+
+			req->stream->FinishSendFile(false);
+			return;
+		}
+
+		req->file = static_cast<uv_file>(result);
+		req->stream->ContinueSendFile();
+	});
+
+	if (result < 0)
+	{
+		trace("opening %s for sending failed - %s\n", req->path.c_str(), uv_strerror(result));
+
+		FinishSendFile(false);
+	}
+}
+
+void UvTcpServerStream::ContinueSendFile()
+{
+	// don't hog a thread pool worker for too long on large files
+	static const uint64_t MaxSendFileChunk = 4 * 1024 * 1024;
+
+	UvSendFileReq* req = m_sendFile.get();
+
+	if (!m_client.get() || m_closePending)
+	{
+		FinishSendFile(false);
+		return;
+	}
+
+	if (req->remaining == 0)
+	{
+		FinishSendFile(true);
+		return;
+	}
+
+	uv_os_fd_t socket;
+	uv_fileno(reinterpret_cast<uv_handle_t*>(m_client.get()), &socket);
+
+	int result = uv_fs_sendfile(m_loop->GetLoop(), &req->fsReq, socket, req->file, req->offset, std::min(req->remaining, MaxSendFileChunk), [] (uv_fs_t* fsReq)
+	{
+		UvSendFileReq* req = reinterpret_cast<UvSendFileReq*>(fsReq->data);
+		ssize_t result = fsReq->result;
+
+		uv_fs_req_cleanup(fsReq);
+
+		// the socket is non-blocking, so this means the send buffer is full
+		if (result == UV_EAGAIN)
+		{
+			req->stream->WaitForWritable();
+			return;
+		}
+
+		if (result <= 0)
+		{
+			trace("sending %s failed - %s\n", req->path.c_str(), (result == 0) ? "unexpected end of file" : uv_strerror(result));
+
+			req->stream->FinishSendFile(false);
+			return;
+		}
+
+		req->offset += result;
+		req->remaining -= result;
+
+		req->stream->m_lastActivityTime = uv_now(fsReq->loop);
+
+		req->stream->ContinueSendFile();
+	});
+
+	if (result < 0)
+	{
+		trace("sending %s failed - %s\n", req->path.c_str(), uv_strerror(result));
+
+		FinishSendFile(false);
+	}
+}
+
+void UvTcpServerStream::WaitForWritable()
+{
+#ifndef _WIN32
+	UvSendFileReq* req = m_sendFile.get();
+
+	// libuv won't watch a socket its stream already watches, but it will watch a duplicate of it
+	if (!req->writablePoll)
+	{
+		uv_os_fd_t socket;
+		uv_fileno(reinterpret_cast<uv_handle_t*>(m_client.get()), &socket);
+
+		req->pollSocket = dup(socket);
+
+		if (req->pollSocket < 0)
+		{
+			trace("watching %s for writability failed - %s\n", GetPeerAddress().ToString().c_str(), strerror(errno));
+
+			FinishSendFile(false);
+			return;
+		}
+
+		req->writablePoll = std::make_unique<uv_poll_t>();
+		uv_poll_init_socket(m_loop->GetLoop(), req->writablePoll.get(), req->pollSocket);
+
+		req->writablePoll->data = req;
+	}
+
+	uv_poll_start(req->writablePoll.get(), UV_WRITABLE, [] (uv_poll_t* poll, int status, int events)
+	{
+		UvSendFileReq* req = reinterpret_cast<UvSendFileReq*>(poll->data);
+
+		uv_poll_stop(poll);
+
+		// errors show up on the next send as well
+		req->stream->ContinueSendFile();
+	});
+#endif
+}
+
+void UvTcpServerStream::FinishSendFile(bool success)
+{
+	// keep a reference in scope, as the request holds the last one if we got closed
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	std::unique_ptr<UvSendFileReq> req = std::move(m_sendFile);
+
+	if (req->file >= 0)
+	{
+		uv_fs_t* closeReq = new uv_fs_t;
+
+		int result = uv_fs_close(m_loop->GetLoop(), closeReq, req->file, [] (uv_fs_t* closeReq)
+		{
+			uv_fs_req_cleanup(closeReq);
+			delete closeReq;
+		});
+
+		if (result < 0)
+		{
+			delete closeReq;
+		}
+	}
+
+#ifndef _WIN32
+	if (req->writablePoll)
+	{
+		// closing the handle stops watching the duplicate right away, so it can be closed along with it
+		UvClose(std::move(req->writablePoll));
+		close(req->pollSocket);
+	}
+#endif
+
+	// the socket is free again, so finish a close that happened during the send
+	if (m_closePending)
+	{
+		m_closePending = false;
+
+		CloseClient();
+	}
+
+	// let through whatever got written while sending
+	Uncork();
+
+	m_sendingFile = false;
+
+	if (req->callback)
+	{
+		req->callback(success);
+	}
+}
+
+void UvTcpServerStream::ScheduleCallback(const TScheduledCallback& callback)
+{
+	if (m_loop->IsInLoopThread())
+	{
+		callback();
+		return;
+	}
+
+	// keep the stream alive until the callback ran
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	m_loop->EnqueueCallback([selfRef, callback] ()
+	{
+		callback();
+	});
+}
+
+void UvTcpServerStream::SetReadTimeout(std::chrono::milliseconds timeout)
+{
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	if (!m_loop->IsInLoopThread())
+	{
+		m_loop->EnqueueCallback([=] ()
+		{
+			selfRef->SetReadTimeout(timeout);
+		});
+
+		return;
+	}
+
+	m_readTimeout = timeout;
+	m_lastReadTime = uv_now(m_loop->GetLoop());
+
+	UpdateTimeout();
+}
+
+void UvTcpServerStream::SetIdleTimeout(std::chrono::milliseconds timeout)
+{
+	m_idleTimeout = timeout;
+	m_lastActivityTime = uv_now(m_loop->GetLoop());
+
+	UpdateTimeout();
+}
+
+void UvTcpServerStream::CancelTimeouts()
+{
+	m_readTimeout = std::chrono::milliseconds(0);
+	m_idleTimeout = std::chrono::milliseconds(0);
+
+	m_timeoutTimer.Stop();
+}
+
+void UvTcpServerStream::UpdateTimeout()
+{
+	if (!m_client.get())
+	{
+		m_timeoutTimer.Stop();
+		return;
+	}
+
+	uint64_t now = uv_now(m_loop->GetLoop());
+	uint64_t deadline = UINT64_MAX;
+
+	const char* reason = nullptr;
+
+	if (m_readTimeout.count() > 0)
+	{
+		deadline = m_lastReadTime + m_readTimeout.count();
+		reason = "no data received";
+	}
+
+	if (m_idleTimeout.count() > 0 && (m_lastActivityTime + m_idleTimeout.count()) < deadline)
+	{
+		deadline = m_lastActivityTime + m_idleTimeout.count();
+		reason = "idle";
+	}
+
+	if (deadline == UINT64_MAX)
+	{
+		m_timeoutTimer.Stop();
+		return;
+	}
+
+	if (deadline <= now)
+	{
+		// keep a reference in scope, as closing may release the last one
+		fwRefContainer<UvTcpServerStream> selfRef = this;
+
+		trace("closing connection from %s - %s for too long\n", GetPeerAddress().ToString().c_str(), reason);
+
+		Close();
+		return;
+	}
+
+	// activity since the timer got started just moved the deadline, so check again once the new one passes
+	// the timer keeps us alive while armed, so it can't fire for (or be unlinked by) a stream destroyed elsewhere
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	m_loop->GetTimerWheel()->Start(&m_timeoutTimer, std::chrono::milliseconds(deadline - now), [selfRef] ()
+	{
+		selfRef->UpdateTimeout();
+	});
+}
+
+void UvTcpServerStream::Close()
+{
+	// keep a reference in scope
+	fwRefContainer<UvTcpServerStream> selfRef = this;
+
+	// closing touches the handle and the per-loop client set, so it has to happen on the loop thread
+	if (!m_loop->IsInLoopThread())
+	{
+		m_loop->EnqueueCallback([=] ()
+		{
+			selfRef->Close();
+		});
+
+		return;
+	}
+
+	// anything written before closing should still go out - unless it's queued behind a file send, which will be
+	// aborted, in which case the send completing will drop it
+	if (!m_sendFile.get())
+	{
+		FlushCorked();
+	}
+
+	CloseClient();
+
+	// give the read block back to the pool
+	m_readBlock = nullptr;
 
 	SetReadCallback(TReadCallback());
+	SetDrainCallback(TDrainCallback());
 
 	// get it locally as we may recurse
 	auto closeCallback = GetCloseCallback();
@@ -251,4 +1245,4 @@ void UvTcpServerStream::Close()
 
 	m_server->RemoveStream(this);
 }
-}
\ No newline at end of file
+}
@@ -0,0 +1,236 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <MultiplexTcpServer.h>
+
+using namespace net;
+
+static MultiplexPatternMatchResult MatchString(const MultiplexPatternTrie& trie, const std::string& data, size_t* tag)
+{
+	return trie.Match(reinterpret_cast<const uint8_t*>(data.data()), data.size(), tag);
+}
+
+TEST(MultiplexPatternTrie, LongerPatternAddedFirstWinsOverlap)
+{
+	MultiplexPatternTrie trie;
+	trie.AddPattern(MultiplexPattern::FromPrefix("GET /admin"), 0);
+	trie.AddPattern(MultiplexPattern::FromPrefix("GET "), 1);
+	trie.Compile();
+
+	size_t tag = -1;
+
+	EXPECT_EQ(MultiplexPatternMatchResult::Match, MatchString(trie, "GET /admin HTTP/1.1", &tag));
+	EXPECT_EQ(0, tag);
+
+	// diverging from the longer pattern past the shared prefix leaves only the shorter one
+	EXPECT_EQ(MultiplexPatternMatchResult::Match, MatchString(trie, "GET /index HTTP/1.1", &tag));
+	EXPECT_EQ(1, tag);
+}
+
+TEST(MultiplexPatternTrie, ShorterPatternAddedFirstShadowsOverlap)
+{
+	MultiplexPatternTrie trie;
+	trie.AddPattern(MultiplexPattern::FromPrefix("GET "), 0);
+	trie.AddPattern(MultiplexPattern::FromPrefix("GET /admin"), 1);
+	trie.Compile();
+
+	size_t tag = -1;
+
+	EXPECT_EQ(MultiplexPatternMatchResult::Match, MatchString(trie, "GET /admin HTTP/1.1", &tag));
+	EXPECT_EQ(0, tag);
+}
+
+TEST(MultiplexPatternTrie, PartialSniffsNeedMoreData)
+{
+	MultiplexPatternTrie trie;
+	trie.AddPattern(MultiplexPattern::FromPrefix("POST "), 0);
+
+	// a TLS handshake record, for any 3.x version, with its full record header
+	trie.AddPattern(MultiplexPattern::FromMaskedPrefix({ 0x16, 0x03 }, { 0xFF, 0xFC }, 5), 1);
+	trie.Compile();
+
+	size_t tag = -1;
+
+	EXPECT_EQ(MultiplexPatternMatchResult::InsufficientData, MatchString(trie, "", &tag));
+	EXPECT_EQ(MultiplexPatternMatchResult::InsufficientData, MatchString(trie, "PO", &tag));
+	EXPECT_EQ(MultiplexPatternMatchResult::NoMatch, MatchString(trie, "PUT ", &tag));
+
+	EXPECT_EQ(MultiplexPatternMatchResult::Match, MatchString(trie, "POST /", &tag));
+	EXPECT_EQ(0, tag);
+
+	// the prefix matches after two bytes, but the minimum length isn't there yet
+	EXPECT_EQ(MultiplexPatternMatchResult::InsufficientData, MatchString(trie, std::string("\x16\x03\x01", 3), &tag));
+
+	EXPECT_EQ(MultiplexPatternMatchResult::Match, MatchString(trie, std::string("\x16\x03\x01\x02\x00", 5), &tag));
+	EXPECT_EQ(1, tag);
+
+	// the mask only lets through versions 3.0 to 3.3
+	EXPECT_EQ(MultiplexPatternMatchResult::NoMatch, MatchString(trie, std::string("\x16\x04\x01\x02\x00", 5), &tag));
+}
+
+// a stream that gets fed data by the test
+class MultiplexTestStream : public TcpServerStream
+{
+public:
+	std::chrono::milliseconds readTimeout = std::chrono::milliseconds(0);
+
+	bool closed = false;
+
+	using TcpServerStream::Write;
+
+	virtual PeerAddress GetPeerAddress() override
+	{
+		return PeerAddress();
+	}
+
+	virtual int GetLoopIndex() override
+	{
+		return 0;
+	}
+
+	virtual void Write(const Slice& data) override
+	{
+
+	}
+
+	virtual void SetReadTimeout(std::chrono::milliseconds timeout) override
+	{
+		readTimeout = timeout;
+	}
+
+	virtual void Close() override
+	{
+		if (closed)
+		{
+			return;
+		}
+
+		closed = true;
+
+		fwRefContainer<MultiplexTestStream> thisRef = this;
+
+		if (GetCloseCallback())
+		{
+			GetCloseCallback()();
+		}
+
+		SetReadCallback(TReadCallback());
+		SetCloseCallback(TCloseCallback());
+	}
+
+	void Receive(const std::string& data)
+	{
+		fwRefContainer<MultiplexTestStream> thisRef = this;
+
+		GetReadCallback()(Slice::Borrow(data.data(), data.size()));
+	}
+};
+
+class MultiplexTestFactory : public TcpServerFactory
+{
+private:
+	class TestTcpServer : public TcpServer
+	{
+	public:
+		void Connect(fwRefContainer<TcpServerStream> stream)
+		{
+			GetConnectionCallback()(stream);
+		}
+	};
+
+public:
+	fwRefContainer<TestTcpServer> server;
+
+	virtual fwRefContainer<TcpServer> CreateServer(const PeerAddress& bindAddress) override
+	{
+		server = new TestTcpServer();
+		return server;
+	}
+
+	fwRefContainer<MultiplexTestStream> Connect()
+	{
+		fwRefContainer<MultiplexTestStream> stream = new MultiplexTestStream();
+		server->Connect(stream);
+
+		return stream;
+	}
+};
+
+TEST(MultiplexTcpServer, SniffsAcrossReads)
+{
+	fwRefContainer<MultiplexTestFactory> factory = new MultiplexTestFactory();
+	fwRefContainer<MultiplexTcpServer> multiplexServer = new MultiplexTcpServer(factory);
+
+	multiplexServer->SetSniffTimeout(std::chrono::milliseconds(500));
+	multiplexServer->Bind(PeerAddress());
+
+	fwRefContainer<TcpServer> httpServer = multiplexServer->CreateServer({ MultiplexPattern::FromPrefix("GET ") });
+	fwRefContainer<TcpServer> otherServer = multiplexServer->CreateServer({ MultiplexPattern::FromPrefix("GEX ") });
+
+	std::string received;
+	int otherConnections = 0;
+
+	httpServer->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		stream->SetReadCallback([&] (const Slice& data)
+		{
+			received.append(reinterpret_cast<const char*>(data.GetData()), data.GetLength());
+		});
+	});
+
+	otherServer->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		otherConnections++;
+	});
+
+	fwRefContainer<MultiplexTestStream> stream = factory->Connect();
+
+	// until the connection tells which server it's for, it's on the sniff timeout
+	EXPECT_EQ(std::chrono::milliseconds(500), stream->readTimeout);
+
+	stream->Receive("G");
+	stream->Receive("E");
+
+	EXPECT_TRUE(received.empty());
+	EXPECT_FALSE(stream->closed);
+
+	// the server gets everything from the start, and sets its own timeout
+	stream->Receive("T /");
+
+	EXPECT_EQ("GET /", received);
+	EXPECT_EQ(std::chrono::milliseconds(0), stream->readTimeout);
+
+	stream->Receive(" HTTP/1.1");
+
+	EXPECT_EQ("GET / HTTP/1.1", received);
+	EXPECT_EQ(0, otherConnections);
+
+	stream->Close();
+}
+
+TEST(MultiplexTcpServer, ClosesUnmatchedConnections)
+{
+	fwRefContainer<MultiplexTestFactory> factory = new MultiplexTestFactory();
+	fwRefContainer<MultiplexTcpServer> multiplexServer = new MultiplexTcpServer(factory);
+
+	multiplexServer->Bind(PeerAddress());
+	multiplexServer->CreateServer({ MultiplexPattern::FromPrefix("GET ") });
+
+	fwRefContainer<MultiplexTestStream> stream = factory->Connect();
+
+	// the default sniff timeout applies
+	EXPECT_GT(stream->readTimeout.count(), 0);
+
+	stream->Receive("GE");
+	EXPECT_FALSE(stream->closed);
+
+	stream->Receive("X");
+	EXPECT_TRUE(stream->closed);
+}
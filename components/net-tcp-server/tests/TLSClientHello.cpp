@@ -0,0 +1,91 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <TLSClientHello.h>
+
+using namespace net;
+
+// a TLS 1.2 client hello body with a session ID, two cipher suites and null compression, followed by the passed extensions
+static std::vector<uint8_t> MakeClientHello(const std::vector<uint8_t>& extensions)
+{
+	std::vector<uint8_t> hello = { 0x03, 0x03 };
+	hello.resize(hello.size() + 32, 0xAA);
+
+	hello.insert(hello.end(), { 4, 1, 2, 3, 4 });
+	hello.insert(hello.end(), { 0x00, 0x04, 0xC0, 0x2F, 0x00, 0x9C });
+	hello.insert(hello.end(), { 0x01, 0x00 });
+
+	if (!extensions.empty())
+	{
+		hello.push_back(static_cast<uint8_t>(extensions.size() >> 8));
+		hello.push_back(static_cast<uint8_t>(extensions.size()));
+
+		hello.insert(hello.end(), extensions.begin(), extensions.end());
+	}
+
+	return hello;
+}
+
+TEST(TLSClientHello, ReadsSessionTicketAmongOtherExtensions)
+{
+	std::vector<uint8_t> hello = MakeClientHello({
+		// renegotiation_info, empty
+		0xFF, 0x01, 0x00, 0x01, 0x00,
+		// session_ticket
+		0x00, 0x23, 0x00, 0x04, 't', 'i', 'c', 'k',
+		// supported_groups
+		0x00, 0x0A, 0x00, 0x04, 0x00, 0x02, 0x00, 0x17
+	});
+
+	std::vector<uint8_t> ticket;
+
+	ASSERT_TRUE(ReadClientHelloSessionTicket(hello.data(), hello.size(), &ticket));
+	EXPECT_EQ(std::vector<uint8_t>({ 't', 'i', 'c', 'k' }), ticket);
+}
+
+TEST(TLSClientHello, NoTicketLeavesItEmpty)
+{
+	std::vector<uint8_t> ticket = { 1, 2, 3 };
+
+	// a client asking for a ticket sends the extension, but without one
+	std::vector<uint8_t> hello = MakeClientHello({ 0x00, 0x23, 0x00, 0x00 });
+
+	ASSERT_TRUE(ReadClientHelloSessionTicket(hello.data(), hello.size(), &ticket));
+	EXPECT_TRUE(ticket.empty());
+
+	// and old clients don't send any extensions at all
+	hello = MakeClientHello({});
+
+	ASSERT_TRUE(ReadClientHelloSessionTicket(hello.data(), hello.size(), &ticket));
+	EXPECT_TRUE(ticket.empty());
+}
+
+TEST(TLSClientHello, RejectsMalformedMessages)
+{
+	std::vector<uint8_t> hello = MakeClientHello({ 0x00, 0x23, 0x00, 0x04, 't', 'i', 'c', 'k' });
+	std::vector<uint8_t> ticket;
+
+	// cut off anywhere, the lengths don't add up anymore
+	for (size_t length = 0; length < hello.size(); length++)
+	{
+		if (length == hello.size() - 10)
+		{
+			// right before the extensions is where a hello without any ends
+			continue;
+		}
+
+		EXPECT_FALSE(ReadClientHelloSessionTicket(hello.data(), length, &ticket)) << "length " << length;
+	}
+
+	// an extension claiming to be longer than what's left
+	hello = MakeClientHello({ 0x00, 0x23, 0x00, 0x08, 't', 'i', 'c', 'k' });
+
+	EXPECT_FALSE(ReadClientHelloSessionTicket(hello.data(), hello.size(), &ticket));
+}
@@ -0,0 +1,447 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <TLSServer.h>
+
+#include <botan/ecdsa.h>
+#include <botan/tls_client.h>
+#include <botan/x509self.h>
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+using namespace net;
+
+static Botan::TLS::Session MakeSession(const std::vector<uint8_t>& sessionId)
+{
+	return Botan::TLS::Session(sessionId, Botan::secure_vector<uint8_t>(48, 0x42), Botan::TLS::Protocol_Version::TLS_V12, 0xC02F, 0, Botan::TLS::SERVER,
+		0, std::vector<Botan::X509_Certificate>(), std::vector<uint8_t>(), Botan::TLS::Server_Information(), "", 0);
+}
+
+// a session encrypted the way the server encrypts its tickets
+static std::vector<uint8_t> MakeTicket(const Botan::SymmetricKey& key)
+{
+	Botan::AutoSeeded_RNG rng;
+
+	return MakeSession({ 1 }).encrypt(key, rng);
+}
+
+TEST(TLSTicketKeys, RotatedKeysStillDecryptTheirTickets)
+{
+	TLSTicketKeys keys(std::chrono::seconds(60));
+
+	auto start = std::chrono::steady_clock::now();
+
+	Botan::SymmetricKey firstKey = keys.GetEncryptionKey(start);
+	EXPECT_EQ(firstKey, keys.GetEncryptionKey(start + std::chrono::seconds(59)));
+
+	std::vector<uint8_t> firstTicket = MakeTicket(firstKey);
+
+	// once the key is a lifetime old, new tickets use another one
+	auto rotated = start + std::chrono::seconds(60);
+
+	Botan::SymmetricKey secondKey = keys.GetEncryptionKey(rotated);
+	EXPECT_NE(firstKey, secondKey);
+
+	// but tickets issued before still get decrypted
+	EXPECT_EQ(firstKey, keys.GetDecryptionKey(firstTicket, rotated));
+	EXPECT_EQ(secondKey, keys.GetDecryptionKey(MakeTicket(secondKey), rotated));
+
+	// until the key gets replaced again
+	auto rotatedAgain = rotated + std::chrono::seconds(60);
+
+	Botan::SymmetricKey thirdKey = keys.GetEncryptionKey(rotatedAgain);
+
+	EXPECT_EQ(thirdKey, keys.GetDecryptionKey(firstTicket, rotatedAgain));
+	EXPECT_EQ(secondKey, keys.GetDecryptionKey(MakeTicket(secondKey), rotatedAgain));
+}
+
+TEST(TLSTicketKeys, IdleKeysDontOutliveTheirTickets)
+{
+	TLSTicketKeys keys(std::chrono::seconds(60));
+
+	auto start = std::chrono::steady_clock::now();
+
+	Botan::SymmetricKey firstKey = keys.GetEncryptionKey(start);
+	std::vector<uint8_t> ticket = MakeTicket(firstKey);
+
+	// nothing asked for a key in two lifetimes, so the ticket expired before the key got replaced
+	EXPECT_NE(firstKey, keys.GetDecryptionKey(ticket, start + std::chrono::seconds(120)));
+}
+
+TEST(TLSSessionCache, DropsLeastRecentlyUsedSessions)
+{
+	TLSSessionCache cache(2, std::chrono::seconds(60 * 60));
+
+	cache.save(MakeSession({ 'a' }));
+	cache.save(MakeSession({ 'b' }));
+
+	Botan::TLS::Session session;
+
+	// looking a session up makes it the most recently used one
+	ASSERT_TRUE(cache.load_from_session_id({ 'a' }, session));
+	EXPECT_EQ(std::vector<uint8_t>({ 'a' }), session.session_id());
+
+	cache.save(MakeSession({ 'c' }));
+
+	EXPECT_EQ(2, cache.GetSessionCount());
+
+	EXPECT_FALSE(cache.load_from_session_id({ 'b' }, session));
+	EXPECT_TRUE(cache.load_from_session_id({ 'a' }, session));
+	EXPECT_TRUE(cache.load_from_session_id({ 'c' }, session));
+}
+
+TEST(TLSSessionCache, ForgetsExpiredSessions)
+{
+	TLSSessionCache cache(10, std::chrono::seconds(0));
+
+	cache.save(MakeSession({ 'a' }));
+	EXPECT_EQ(1, cache.GetSessionCount());
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	Botan::TLS::Session session;
+
+	EXPECT_FALSE(cache.load_from_session_id({ 'a' }, session));
+	EXPECT_EQ(0, cache.GetSessionCount());
+}
+
+TEST(TLSSessionCache, IgnoresSessionsWithoutID)
+{
+	TLSSessionCache cache(10, std::chrono::seconds(60 * 60));
+
+	// these got resumed from a ticket, which has all there is to know about them
+	cache.save(MakeSession({}));
+
+	EXPECT_EQ(0, cache.GetSessionCount());
+}
+
+// credentials for a self-signed certificate made up on the spot, noting which thread used the key
+class TestServerCredentials : public Botan::Credentials_Manager
+{
+private:
+	Botan::AutoSeeded_RNG m_rng;
+
+	std::unique_ptr<Botan::Private_Key> m_key;
+
+	std::vector<Botan::X509_Certificate> m_certificates;
+
+public:
+	std::thread::id keyThread;
+
+	TestServerCredentials()
+	{
+		m_key.reset(new Botan::ECDSA_PrivateKey(m_rng, Botan::EC_Group("secp256r1")));
+
+		m_certificates.push_back(Botan::X509::create_self_signed_cert(Botan::X509_Cert_Options("localhost"), *m_key, "SHA-256", m_rng));
+	}
+
+	virtual std::vector<Botan::X509_Certificate> cert_chain(const std::vector<std::string>& cert_key_types, const std::string& type, const std::string& context) override
+	{
+		if (std::find(cert_key_types.begin(), cert_key_types.end(), m_key->algo_name()) != cert_key_types.end())
+		{
+			return m_certificates;
+		}
+
+		return std::vector<Botan::X509_Certificate>();
+	}
+
+	virtual Botan::Private_Key* private_key_for(const Botan::X509_Certificate& cert, const std::string& type, const std::string& context) override
+	{
+		keyThread = std::this_thread::get_id();
+
+		return m_key.get();
+	}
+};
+
+// a client trusting any certificate
+class TestClientCredentials : public Botan::Credentials_Manager
+{
+public:
+	virtual void verify_certificate_chain(const std::string& type, const std::string& hostname, const std::vector<Botan::X509_Certificate>& cert_chain) override
+	{
+
+	}
+};
+
+// a stream carrying records between the TLS server and a client in the test - writes, and callbacks scheduled from other
+// threads, run on the thread creating the stream once it calls RunScheduled
+class TLSTestStream : public TcpServerStream
+{
+private:
+	std::thread::id m_owningThread = std::this_thread::get_id();
+
+	std::mutex m_scheduledMutex;
+
+	std::condition_variable m_scheduledCondition;
+
+	std::deque<TScheduledCallback> m_scheduled;
+
+public:
+	// gets the records the server wrote
+	std::function<void(const std::vector<uint8_t>&)> writeCallback;
+
+	bool closed = false;
+
+	using TcpServerStream::Write;
+
+	virtual PeerAddress GetPeerAddress() override
+	{
+		return PeerAddress();
+	}
+
+	virtual int GetLoopIndex() override
+	{
+		return 0;
+	}
+
+	virtual void Write(const Slice& data) override
+	{
+		// always queued, as the client can't take records while it's busy writing its own
+		fwRefContainer<TLSTestStream> thisRef = this;
+		std::vector<uint8_t> record(data.GetData(), data.GetData() + data.GetLength());
+
+		Queue([thisRef, record] ()
+		{
+			if (thisRef->writeCallback)
+			{
+				thisRef->writeCallback(record);
+			}
+		});
+	}
+
+	virtual void Close() override
+	{
+		fwRefContainer<TLSTestStream> thisRef = this;
+
+		ScheduleCallback([thisRef] ()
+		{
+			if (thisRef->closed)
+			{
+				return;
+			}
+
+			thisRef->closed = true;
+
+			if (thisRef->GetCloseCallback())
+			{
+				thisRef->GetCloseCallback()();
+			}
+		});
+	}
+
+	virtual void ScheduleCallback(const TScheduledCallback& callback) override
+	{
+		if (std::this_thread::get_id() == m_owningThread)
+		{
+			callback();
+			return;
+		}
+
+		Queue(callback);
+	}
+
+	// runs queued callbacks until the predicate holds, returning false if it didn't in time
+	template<typename TPredicate>
+	bool RunScheduled(const TPredicate& predicate, std::chrono::milliseconds timeout = std::chrono::seconds(10))
+	{
+		auto deadline = std::chrono::steady_clock::now() + timeout;
+
+		while (!predicate())
+		{
+			TScheduledCallback callback;
+
+			{
+				std::unique_lock<std::mutex> lock(m_scheduledMutex);
+
+				if (!m_scheduledCondition.wait_until(lock, deadline, [this] () { return !m_scheduled.empty(); }))
+				{
+					return false;
+				}
+
+				callback = std::move(m_scheduled.front());
+				m_scheduled.pop_front();
+			}
+
+			callback();
+		}
+
+		return true;
+	}
+
+	void Receive(const uint8_t* data, size_t length)
+	{
+		if (closed)
+		{
+			return;
+		}
+
+		fwRefContainer<TLSTestStream> thisRef = this;
+
+		GetReadCallback()(Slice::Borrow(data, length));
+	}
+
+private:
+	void Queue(const TScheduledCallback& callback)
+	{
+		std::unique_lock<std::mutex> lock(m_scheduledMutex);
+		m_scheduled.push_back(callback);
+
+		m_scheduledCondition.notify_all();
+	}
+};
+
+// a TLS server echoing what it reads, taking connections from test streams rather than a socket
+class TLSTestServer
+{
+private:
+	class TestTcpServer : public TcpServer
+	{
+	public:
+		void Connect(fwRefContainer<TcpServerStream> stream)
+		{
+			GetConnectionCallback()(stream);
+		}
+	};
+
+	fwRefContainer<TestTcpServer> m_tcpServer;
+
+	fwRefContainer<TLSServer> m_tlsServer;
+
+public:
+	std::shared_ptr<TestServerCredentials> credentials;
+
+	TLSTestServer(WorkerPool* cryptoPool)
+		: m_tcpServer(new TestTcpServer()), credentials(std::make_shared<TestServerCredentials>())
+	{
+		m_tlsServer = new TLSServer(m_tcpServer, credentials);
+		m_tlsServer->SetCryptoPool(cryptoPool);
+
+		m_tlsServer->SetConnectionCallback([] (fwRefContainer<TcpServerStream> stream)
+		{
+			TcpServerStream* streamPtr = stream.GetRef();
+
+			stream->SetReadCallback([streamPtr] (const Slice& data)
+			{
+				streamPtr->Write(data);
+			});
+		});
+	}
+
+	TLSServer* operator->()
+	{
+		return m_tlsServer.GetRef();
+	}
+
+	// connects a client with the passed session store, sends the message and returns what got echoed back
+	std::string Exchange(Botan::TLS::Session_Manager& sessions, const std::string& message)
+	{
+		fwRefContainer<TLSTestStream> stream = new TLSTestStream();
+		m_tcpServer->Connect(stream);
+
+		Botan::AutoSeeded_RNG rng;
+		Botan::TLS::Policy policy;
+		TestClientCredentials clientCredentials;
+
+		bool active = false;
+		std::string received;
+
+		Botan::TLS::Client client(
+			[stream] (const uint8_t buf[], size_t length)
+			{
+				stream->Receive(buf, length);
+			},
+			[&] (const uint8_t buf[], size_t length)
+			{
+				received.append(reinterpret_cast<const char*>(buf), length);
+			},
+			[] (Botan::TLS::Alert alert, const uint8_t[], size_t)
+			{
+
+			},
+			[&] (const Botan::TLS::Session& session)
+			{
+				active = true;
+				return true;
+			},
+			sessions, clientCredentials, policy, rng, Botan::TLS::Server_Information("localhost", 443));
+
+		stream->writeCallback = [&] (const std::vector<uint8_t>& record)
+		{
+			client.received_data(record.data(), record.size());
+		};
+
+		EXPECT_TRUE(stream->RunScheduled([&] () { return active; }));
+
+		client.send(message);
+
+		EXPECT_TRUE(stream->RunScheduled([&] () { return received.size() >= message.size(); }));
+
+		client.close();
+
+		EXPECT_TRUE(stream->RunScheduled([&] () { return stream->closed; }));
+
+		stream->writeCallback = {};
+
+		return received;
+	}
+};
+
+TEST(TLSServer, ResumesSessionsWithoutOffloading)
+{
+	TLSTestServer server(nullptr);
+
+	Botan::AutoSeeded_RNG rng;
+	Botan::TLS::Session_Manager_In_Memory clientSessions(rng);
+
+	EXPECT_EQ("hello", server.Exchange(clientSessions, "hello"));
+
+	EXPECT_EQ(1, server->GetFullHandshakeCount());
+	EXPECT_EQ(1, server->GetSessionCache()->GetSessionCount());
+
+	// without offloading, the key gets used on the stream's thread
+	EXPECT_EQ(std::this_thread::get_id(), server.credentials->keyThread);
+
+	EXPECT_EQ("again", server.Exchange(clientSessions, "again"));
+
+	EXPECT_EQ(1, server->GetFullHandshakeCount());
+	EXPECT_EQ(1, server->GetResumedHandshakeCount());
+}
+
+TEST(TLSServer, ResumesSessionsFromTicketsOffTheLoop)
+{
+	WorkerPool pool(2);
+	TLSTestServer server(&pool);
+
+	Botan::AutoSeeded_RNG rng;
+	Botan::TLS::Session_Manager_In_Memory clientSessions(rng);
+
+	EXPECT_EQ("hello", server.Exchange(clientSessions, "hello"));
+
+	EXPECT_EQ(1, server->GetFullHandshakeCount());
+
+	// the handshake ran on the crypto pool
+	EXPECT_NE(std::thread::id(), server.credentials->keyThread);
+	EXPECT_NE(std::this_thread::get_id(), server.credentials->keyThread);
+
+	// the server gave the client a ticket - and with the session gone from the cache, that's the only way to resume it
+	Botan::TLS::Session session;
+
+	ASSERT_TRUE(clientSessions.load_from_server_info(Botan::TLS::Server_Information("localhost", 443), session));
+	EXPECT_FALSE(session.session_ticket().empty());
+
+	server->GetSessionCache()->remove_entry(session.session_id());
+
+	EXPECT_EQ("again", server.Exchange(clientSessions, "again"));
+
+	EXPECT_EQ(1, server->GetFullHandshakeCount());
+	EXPECT_EQ(1, server->GetResumedHandshakeCount());
+}
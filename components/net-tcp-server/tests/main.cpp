@@ -0,0 +1,603 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include <gtest/gtest.h>
+
+#include <MultiplexTcpServer.h>
+#include <NetBufferPool.h>
+#include <TcpServerManager.h>
+#include <UvLoopHolder.h>
+#include <UvTcpServer.h>
+
+#include <future>
+#include <thread>
+
+using namespace net;
+
+static const int TestPort = 30159;
+
+static PeerAddress GetTestAddress(int port = TestPort)
+{
+	sockaddr_in addr;
+	uv_ip4_addr("127.0.0.1", port, &addr);
+
+	return PeerAddress(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+}
+
+// connects to the test port on a separate loop, reading until the server closes the connection - returns false if it
+// didn't in time. a read delay holds off reading after connecting (with a small receive buffer), to let the server run
+// into a full socket buffer.
+static bool ReadUntilClosed(std::chrono::milliseconds timeout, std::string* data = nullptr, std::chrono::milliseconds readDelay = std::chrono::milliseconds(0))
+{
+	struct ClientState
+	{
+		uv_tcp_t client;
+		uv_connect_t connect;
+		uv_timer_t timer;
+
+		std::string data;
+		bool closed;
+
+		std::chrono::milliseconds readDelay;
+	};
+
+	uv_loop_t loop;
+	uv_loop_init(&loop);
+
+	ClientState state;
+	state.closed = false;
+	state.readDelay = readDelay;
+
+	uv_tcp_init_ex(&loop, &state.client, AF_INET);
+	state.client.data = &state;
+
+	if (readDelay.count() > 0)
+	{
+		int receiveBufferSize = 64 * 1024;
+		uv_recv_buffer_size(reinterpret_cast<uv_handle_t*>(&state.client), &receiveBufferSize);
+	}
+
+	uv_timer_init(&loop, &state.timer);
+
+	// don't hang forever on a server that never closes
+	uv_timer_start(&state.timer, [] (uv_timer_t* timer)
+	{
+		uv_stop(timer->loop);
+	}, timeout.count(), 0);
+
+	PeerAddress address = GetTestAddress();
+
+	uv_tcp_connect(&state.connect, &state.client, address.GetSocketAddress(), [] (uv_connect_t* req, int status)
+	{
+		if (status < 0)
+		{
+			uv_stop(req->handle->loop);
+			return;
+		}
+
+		std::this_thread::sleep_for(reinterpret_cast<ClientState*>(req->handle->data)->readDelay);
+
+		uv_read_start(req->handle, [] (uv_handle_t*, size_t suggestedSize, uv_buf_t* buf)
+		{
+			*buf = uv_buf_init(new char[suggestedSize], suggestedSize);
+		}, [] (uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+		{
+			ClientState* state = reinterpret_cast<ClientState*>(stream->data);
+
+			if (nread > 0)
+			{
+				state->data.append(buf->base, nread);
+			}
+			else if (nread < 0)
+			{
+				state->closed = (nread == UV_EOF);
+				uv_stop(stream->loop);
+			}
+
+			delete[] buf->base;
+		});
+	});
+
+	uv_run(&loop, UV_RUN_DEFAULT);
+
+	uv_close(reinterpret_cast<uv_handle_t*>(&state.client), nullptr);
+	uv_close(reinterpret_cast<uv_handle_t*>(&state.timer), nullptr);
+	uv_run(&loop, UV_RUN_DEFAULT);
+
+	uv_loop_close(&loop);
+
+	if (data)
+	{
+		*data = std::move(state.data);
+	}
+
+	return state.closed;
+}
+
+struct EchoClientState
+{
+	uv_tcp_t client;
+	uv_connect_t connect;
+	uv_timer_t timer;
+
+	std::string message;
+	std::string echoed;
+
+	int rounds;
+	int completedRounds;
+
+	char readBuffer[65536];
+};
+
+static void SendEchoMessage(EchoClientState* state)
+{
+	uv_write_t* write = new uv_write_t;
+	uv_buf_t buffer = uv_buf_init(const_cast<char*>(state->message.data()), state->message.size());
+
+	uv_write(write, reinterpret_cast<uv_stream_t*>(&state->client), &buffer, 1, [] (uv_write_t* write, int status)
+	{
+		delete write;
+	});
+}
+
+// connects to the test port on a separate loop, and sends the message again each time it got echoed back in full -
+// returns the amount of messages that were
+static int RunEchoRounds(int rounds, const std::string& message, std::chrono::milliseconds timeout)
+{
+	uv_loop_t loop;
+	uv_loop_init(&loop);
+
+	std::unique_ptr<EchoClientState> state = std::make_unique<EchoClientState>();
+	state->message = message;
+	state->rounds = rounds;
+	state->completedRounds = 0;
+
+	uv_tcp_init(&loop, &state->client);
+	state->client.data = state.get();
+
+	uv_timer_init(&loop, &state->timer);
+
+	uv_timer_start(&state->timer, [] (uv_timer_t* timer)
+	{
+		uv_stop(timer->loop);
+	}, timeout.count(), 0);
+
+	PeerAddress address = GetTestAddress();
+
+	uv_tcp_connect(&state->connect, &state->client, address.GetSocketAddress(), [] (uv_connect_t* req, int status)
+	{
+		if (status < 0)
+		{
+			uv_stop(req->handle->loop);
+			return;
+		}
+
+		uv_read_start(req->handle, [] (uv_handle_t* handle, size_t suggestedSize, uv_buf_t* buf)
+		{
+			EchoClientState* state = reinterpret_cast<EchoClientState*>(handle->data);
+			*buf = uv_buf_init(state->readBuffer, sizeof(state->readBuffer));
+		}, [] (uv_stream_t* stream, ssize_t nread, const uv_buf_t* buf)
+		{
+			EchoClientState* state = reinterpret_cast<EchoClientState*>(stream->data);
+
+			if (nread < 0)
+			{
+				uv_stop(stream->loop);
+				return;
+			}
+
+			state->echoed.append(buf->base, nread);
+
+			if (state->echoed.size() < state->message.size())
+			{
+				return;
+			}
+
+			if (state->echoed != state->message)
+			{
+				uv_stop(stream->loop);
+				return;
+			}
+
+			state->echoed.clear();
+
+			if (++state->completedRounds == state->rounds)
+			{
+				uv_stop(stream->loop);
+				return;
+			}
+
+			SendEchoMessage(state);
+		});
+
+		SendEchoMessage(reinterpret_cast<EchoClientState*>(req->handle->data));
+	});
+
+	uv_run(&loop, UV_RUN_DEFAULT);
+
+	uv_close(reinterpret_cast<uv_handle_t*>(&state->client), nullptr);
+	uv_close(reinterpret_cast<uv_handle_t*>(&state->timer), nullptr);
+	uv_run(&loop, UV_RUN_DEFAULT);
+
+	uv_loop_close(&loop);
+
+	return state->completedRounds;
+}
+
+TEST(UvTcpServer, CloseAfterWriteSendsAllData)
+{
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	// large enough to still be queued in libuv when the stream gets closed
+	std::vector<uint8_t> response(8 * 1024 * 1024);
+
+	for (size_t i = 0; i < response.size(); i++)
+	{
+		response[i] = static_cast<uint8_t>(i * 7);
+	}
+
+	server->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		stream->Write(response);
+		stream->Close();
+	});
+
+	std::string received;
+	ASSERT_TRUE(ReadUntilClosed(std::chrono::seconds(10), &received));
+
+	ASSERT_EQ(response.size(), received.size());
+	EXPECT_EQ(0, memcmp(response.data(), received.data(), response.size()));
+}
+
+TEST(UvTcpServer, ReadTimeoutClosesStream)
+{
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	// the stream isn't referenced from here on, so only the server and its timeout keep it alive
+	server->SetConnectionCallback([] (fwRefContainer<TcpServerStream> stream)
+	{
+		stream->SetReadTimeout(std::chrono::milliseconds(300));
+	});
+
+	auto start = std::chrono::steady_clock::now();
+
+	ASSERT_TRUE(ReadUntilClosed(std::chrono::seconds(10)));
+
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+}
+
+TEST(UvTcpServer, DestroyingServerCancelsTimeouts)
+{
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	std::promise<void> connected;
+
+	server->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		stream->SetReadTimeout(std::chrono::seconds(60));
+
+		connected.set_value();
+	});
+
+	auto closed = std::async(std::launch::async, [] ()
+	{
+		return ReadUntilClosed(std::chrono::seconds(10));
+	});
+
+	connected.get_future().wait();
+
+	// this destroys the server from outside its loop, which has to stop the armed timer before the stream goes
+	server = nullptr;
+	manager = nullptr;
+
+	EXPECT_TRUE(closed.get());
+}
+
+TEST(MultiplexTcpServer, SniffTimeoutClosesSilentConnections)
+{
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<MultiplexTcpServer> multiplexServer = new MultiplexTcpServer(manager);
+
+	multiplexServer->SetSniffTimeout(std::chrono::milliseconds(300));
+	multiplexServer->Bind(GetTestAddress());
+
+	ASSERT_TRUE(multiplexServer->GetRootServer().GetRef());
+
+	multiplexServer->CreateServer({ MultiplexPattern::FromPrefix("GET ") });
+
+	// the client never sends anything, so it never gets matched
+	auto start = std::chrono::steady_clock::now();
+
+	ASSERT_TRUE(ReadUntilClosed(std::chrono::seconds(10)));
+
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+}
+
+TEST(UvTcpServer, ReleasingServersOnTheirLoopsDoesNotWaitOnOtherLoops)
+{
+	// both managers share the same two loops, and their servers listen on both
+	fwRefContainer<TcpServerManager> managers[2] = { new TcpServerManager(2), new TcpServerManager(2) };
+
+	ASSERT_TRUE(managers[0]->CreateServer(GetTestAddress()).GetRef());
+	ASSERT_TRUE(managers[1]->CreateServer(GetTestAddress(TestPort + 1)).GetRef());
+
+	// each loop drops the last reference to one manager (and so its server) at the same time - if tearing down the
+	// server waited on the other loop, they'd both wait forever
+	std::atomic<int> arrived(0);
+	std::promise<void> released[2];
+
+	for (int i = 0; i < 2; i++)
+	{
+		UvLoopHolder* loop = reinterpret_cast<UvLoopHolder*>(managers[0]->GetLoop(i)->data);
+
+		loop->EnqueueCallback([&, i] ()
+		{
+			arrived++;
+
+			while (arrived != 2)
+			{
+				std::this_thread::yield();
+			}
+
+			managers[i] = nullptr;
+
+			released[i].set_value();
+		});
+	}
+
+	for (auto& release : released)
+	{
+		ASSERT_EQ(std::future_status::ready, release.get_future().wait_for(std::chrono::seconds(5)));
+	}
+
+	// the listeners got closed once each loop got around to it
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager(2);
+
+	for (int i = 0; i < 2; i++)
+	{
+		reinterpret_cast<UvLoopHolder*>(manager->GetLoop(i)->data)->InvokeCallback([] () {});
+	}
+
+	EXPECT_FALSE(ReadUntilClosed(std::chrono::seconds(5)));
+}
+
+TEST(UvTcpServer, SendFileKeepsOrderWithWrites)
+{
+	std::string path = ::testing::TempDir() + "tcp_send_file.bin";
+
+	// far more than fits in the socket buffers, so the send has to wait for the socket to become writable
+	std::string contents(32 * 1024 * 1024, '\0');
+
+	for (size_t i = 0; i < contents.size(); i++)
+	{
+		contents[i] = static_cast<char>(i * 13);
+	}
+
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		ASSERT_TRUE(file);
+
+		fwrite(contents.data(), 1, contents.size(), file);
+		fclose(file);
+	}
+
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	std::atomic<bool> secondSendAccepted(true);
+	std::atomic<bool> sendSucceeded(false);
+
+	server->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		stream->Write(std::vector<uint8_t>{ 'h', 'e', 'a', 'd' });
+
+		bool sending = stream->SendFile(path, 16, contents.size() - 32, [&, stream] (bool success)
+		{
+			sendSucceeded = success;
+
+			stream->Close();
+		});
+
+		if (!sending)
+		{
+			stream->Close();
+			return;
+		}
+
+		// a second file can't be sent until the first completed, so the caller gets to write it itself
+		secondSendAccepted = stream->SendFile(path, 0, 16, [] (bool success) {});
+
+		stream->Write(std::vector<uint8_t>{ 't', 'a', 'i', 'l' });
+	});
+
+	std::string received;
+	ASSERT_TRUE(ReadUntilClosed(std::chrono::seconds(30), &received, std::chrono::milliseconds(200)));
+
+	EXPECT_TRUE(sendSucceeded);
+	EXPECT_FALSE(secondSendAccepted);
+
+	ASSERT_EQ(contents.size() - 32 + 8, received.size());
+	EXPECT_EQ("head", received.substr(0, 4));
+	EXPECT_TRUE(received.compare(4, contents.size() - 32, contents, 16, contents.size() - 32) == 0);
+	EXPECT_EQ("tail", received.substr(received.size() - 4));
+
+	remove(path.c_str());
+}
+
+TEST(UvTcpServer, SlowReaderStopsWritesAtHighWatermark)
+{
+	static const size_t LowWatermark = 256 * 1024;
+	static const size_t HighWatermark = 1024 * 1024;
+	static const size_t ChunkSize = 64 * 1024;
+	static const size_t TotalSize = 32 * 1024 * 1024;
+
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	// only touched from the loop thread until the connection closed
+	size_t written = 0;
+	size_t maxQueuedBytes = 0;
+	int drainCount = 0;
+
+	server->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		stream->SetWriteWatermarks(LowWatermark, HighWatermark);
+
+		// writes for as long as the stream is writable, as a well-behaved producer would
+		auto writeMore = [&, stream] ()
+		{
+			while (stream->IsWritable() && written < TotalSize)
+			{
+				std::vector<uint8_t> chunk(ChunkSize);
+
+				for (size_t i = 0; i < chunk.size(); i++)
+				{
+					chunk[i] = static_cast<uint8_t>((written + i) * 7);
+				}
+
+				stream->Write(std::move(chunk));
+				written += ChunkSize;
+
+				maxQueuedBytes = std::max(maxQueuedBytes, stream->GetQueuedBytes());
+			}
+
+			if (written == TotalSize)
+			{
+				stream->Close();
+			}
+		};
+
+		stream->SetDrainCallback([&, writeMore] ()
+		{
+			drainCount++;
+
+			// draining means the queue got down to the low watermark
+			EXPECT_LE(stream->GetQueuedBytes(), LowWatermark);
+
+			writeMore();
+		});
+
+		writeMore();
+	});
+
+	std::string received;
+	ASSERT_TRUE(ReadUntilClosed(std::chrono::seconds(30), &received, std::chrono::milliseconds(200)));
+
+	ASSERT_EQ(TotalSize, received.size());
+
+	for (size_t i = 0; i < received.size(); i += 4093)
+	{
+		ASSERT_EQ(static_cast<uint8_t>(i * 7), static_cast<uint8_t>(received[i]));
+	}
+
+	// the queue stops growing once past the high watermark - by at most the chunk that got it there
+	EXPECT_GE(maxQueuedBytes, HighWatermark);
+	EXPECT_LT(maxQueuedBytes, HighWatermark + ChunkSize);
+
+	EXPECT_GT(drainCount, 0);
+}
+
+TEST(UvTcpServer, EchoingDoesntAllocateAtSteadyState)
+{
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	UvTcpServer* uvServer = static_cast<UvTcpServer*>(server.GetRef());
+
+	std::atomic<uint64_t> reads(0);
+
+	// each read gets echoed as two writes of the read data, which the stream corks into a single one
+	server->SetConnectionCallback([&] (fwRefContainer<TcpServerStream> stream)
+	{
+		TcpServerStream* streamPtr = stream.GetRef();
+
+		stream->SetReadCallback([&reads, streamPtr] (const Slice& data)
+		{
+			size_t half = data.GetLength() / 2;
+
+			streamPtr->Write(data.SubSlice(0, half));
+			streamPtr->Write(data.SubSlice(half, data.GetLength() - half));
+
+			reads++;
+		});
+	});
+
+	std::string message(1000, 'x');
+
+	ASSERT_EQ(100, RunEchoRounds(100, message, std::chrono::seconds(10)));
+
+	// from here on, read blocks and write requests all get recycled
+	BufferPool* readPool = BufferPool::GetForSize(BufferPool::MaxPooledSize);
+
+	uint64_t blockAllocations = readPool->GetHeapAllocationCount();
+	uint64_t writeReqAllocations = uvServer->GetWriteReqAllocationCount();
+
+	ASSERT_EQ(1000, RunEchoRounds(1000, message, std::chrono::seconds(10)));
+
+	EXPECT_EQ(0, readPool->GetHeapAllocationCount() - blockAllocations);
+	EXPECT_EQ(0, uvServer->GetWriteReqAllocationCount() - writeReqAllocations);
+
+	// and every read got answered using a single write - the last one gets counted once the socket took it, which may be
+	// after the client already got the data
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+	while (uvServer->GetSubmittedWriteCount() < reads && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	EXPECT_EQ(reads.load(), uvServer->GetSubmittedWriteCount());
+}
+
+TEST(UvTcpServer, CorkedWritesGoOutTogether)
+{
+	fwRefContainer<TcpServerManager> manager = new TcpServerManager();
+	fwRefContainer<TcpServer> server = manager->CreateServer(GetTestAddress());
+
+	ASSERT_TRUE(server.GetRef());
+
+	UvTcpServer* uvServer = static_cast<UvTcpServer*>(server.GetRef());
+
+	server->SetConnectionCallback([] (fwRefContainer<TcpServerStream> stream)
+	{
+		std::string body = "body";
+
+		stream->Cork();
+
+		stream->Write(Slice::Borrow("head ", 5));
+		stream->Write({ Slice::Borrow(body.data(), body.size()), Slice(), Slice::Copy(" and", 4) });
+		stream->Write(std::vector<uint8_t>{ ' ', 't', 'a', 'i', 'l' });
+
+		// borrowed data has to be copied while corked, as it's only valid until the write call returns
+		body = "XXXX";
+
+		stream->Uncork();
+		stream->Close();
+	});
+
+	std::string received;
+	ASSERT_TRUE(ReadUntilClosed(std::chrono::seconds(10), &received));
+
+	EXPECT_EQ("head body and tail", received);
+	EXPECT_EQ(1, uvServer->GetSubmittedWriteCount());
+}
@@ -36,8 +36,13 @@ class NetPacketMetrics
 private:
 	uint32_t m_subSizes[NET_PACKET_SUB_MAX];
 
+	// the size of the message before and after compression - equal if it wasn't compressed
+	uint32_t m_uncompressedSize;
+	uint32_t m_compressedSize;
+
 public:
 	inline NetPacketMetrics()
+		: m_uncompressedSize(0), m_compressedSize(0)
 	{
 		memset(m_subSizes, 0, sizeof(m_subSizes));
 	}
@@ -61,6 +66,22 @@ public:
 	{
 		m_subSizes[index] += value;
 	}
+
+	inline uint32_t GetUncompressedSize() const
+	{
+		return m_uncompressedSize;
+	}
+
+	inline uint32_t GetCompressedSize() const
+	{
+		return m_compressedSize;
+	}
+
+	inline void SetCompressionSizes(uint32_t uncompressedSize, uint32_t compressedSize)
+	{
+		m_uncompressedSize = uncompressedSize;
+		m_compressedSize = compressedSize;
+	}
 };
 
 inline NetPacketMetrics operator+(const NetPacketMetrics& left, const NetPacketMetrics& right)
@@ -74,5 +95,7 @@ inline NetPacketMetrics operator+(const NetPacketMetrics& left, const NetPacketM
 		retval.SetElementSize(sub, left.GetElementSize(sub) + right.GetElementSize(sub));
 	}
 
+	retval.SetCompressionSizes(left.GetUncompressedSize() + right.GetUncompressedSize(), left.GetCompressedSize() + right.GetCompressedSize());
+
 	return retval;
 }
\ No newline at end of file
@@ -34,6 +34,9 @@ public:
 	bool Read(void* buffer, size_t length);
 	void Write(const void* buffer, size_t length);
 
+	// skips over the next bytes, returning a pointer to them - or null, if they don't fit
+	const char* ReadInPlace(size_t length);
+
 	template<typename T>
 	T Read()
 	{
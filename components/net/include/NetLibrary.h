@@ -10,11 +10,15 @@
 #include <bitset>
 #include <functional>
 #include <thread>
+#include <memory>
 #include <WS2tcpip.h>
 #include "HttpClient.h"
 #include "CrossLibraryInterfaces.h"
 
 #include "INetMetricSink.h"
+#include "RoutedPacketQueue.h"
+#include "NetSendScheduler.h"
+#include "ReliableCommandWindow.h"
 
 #include <concurrent_queue.h>
 
@@ -60,37 +64,61 @@ public:
 };
 
 #include "NetBuffer.h"
+#include "NetPacketCompressor.h"
 
 class NetLibrary;
 
 #define FRAGMENT_SIZE 1300
 
+// sequence bits marking a fragmented or compressed message
+#define SEQUENCE_FRAGMENTED 0x80000000
+#define SEQUENCE_COMPRESSED 0x40000000
+
 class NetChannel
 {
 private:
 	int m_fragmentSequence;
 	int m_fragmentLength;
-	char* m_fragmentBuffer;
+	std::vector<char> m_fragmentBuffer;
 	std::bitset<65536 / FRAGMENT_SIZE> m_fragmentValidSet;
 	int m_fragmentLastBit;
 
 	uint32_t m_inSequence;
 	uint32_t m_outSequence;
 
+	// per-channel, as channels may send from different threads
+	char m_sendBuffer[FRAGMENT_SIZE + 100];
+
 	NetAddress m_targetAddress;
 	NetLibrary* m_netLibrary;
 
+	// only set if the server agreed to compression
+	std::unique_ptr<NetPacketCompressor> m_compressor;
+
+	size_t m_lastPayloadSize;
+
 private:
-	void SendFragmented(NetBuffer& buffer);
+	void SendFragmented(const char* data, size_t length, uint32_t sequenceFlags);
+
+	bool ProcessPayload(const char* data, size_t length, bool compressed, NetBuffer** buffer);
 
 public:
 	NetChannel();
 
 	void Reset(NetAddress& target, NetLibrary* netLibrary);
 
-	void Send(NetBuffer& buffer);
+	void SetCompression(bool enabled);
+
+	// returns the size of the message as sent, after compression
+	size_t Send(NetBuffer& buffer);
 
 	bool Process(const char* message, size_t size, NetBuffer** buffer);
+
+	// the size of the last processed message as received, before decompression
+	inline size_t GetLastPayloadSize()
+	{
+		return m_lastPayloadSize;
+	}
 };
 
 #define MAX_RELIABLE_COMMANDS 64
@@ -119,6 +147,10 @@ public:
 		uint32_t id;
 		uint32_t type;
 		std::string command;
+
+		// the number of times this command got sent, and when it last was
+		uint32_t sendCount;
+		uint32_t lastSent;
 	};
 
 private:
@@ -148,7 +180,7 @@ private:
 
 	SOCKET m_socket6;
 
-	uint32_t m_lastSend;
+	NetSendScheduler m_sendScheduler;
 
 	uint32_t m_outSequence;
 
@@ -156,8 +188,6 @@ private:
 
 	uint32_t m_serverProtocol;
 
-	uint32_t m_lastReceivedReliableCommand;
-
 	uint32_t m_outReliableAcknowledged;
 
 	uint32_t m_outReliableSequence;
@@ -166,19 +196,23 @@ private:
 
 	uint32_t m_lastReceivedAt;
 
+	// whether the server agreed to compress NetChannel messages
+	bool m_compressionEnabled;
+
 	uint32_t m_lastFrameNumber;
 
 	std::string m_playerName;
 
 	fwRefContainer<INetMetricSink> m_metricSink;
 
-	HANDLE m_receiveEvent;
-
 private:
 	typedef std::function<void(const char* buf, size_t len)> ReliableHandlerType;
 
 	std::unordered_multimap<uint32_t, ReliableHandlerType> m_reliableHandlers;
 
+	// received commands, put back in order
+	ReliableCommandWindow m_inReliableCommands;
+
 private:
 	struct RoutingPacket
 	{
@@ -190,8 +224,7 @@ private:
 	};
 
 private:
-	std::mutex m_incomingPacketMutex;
-	std::queue<RoutingPacket> m_incomingPackets;
+	RoutedPacketQueue m_incomingPackets;
 	concurrency::concurrent_queue<RoutingPacket> m_outgoingPackets;
 
 private:
@@ -199,7 +232,8 @@ private:
 
 	void ProcessServerMessage(NetBuffer& msg);
 
-	void ProcessSend();
+	// flush sends right away, along with all unacknowledged reliable commands
+	void ProcessSend(bool flush = false);
 
 	void HandleReliableCommand(uint32_t msgType, const char* buf, size_t length);
 
@@ -245,7 +279,10 @@ public:
 
 	bool WaitForRoutedPacket(uint32_t timeout);
 
-	void EnqueueRoutedPacket(uint16_t netID, std::string packet);
+	void EnqueueRoutedPacket(uint16_t netID, const char* data, size_t length);
+
+	// passes up to maxCount routed packets to the callback, without copying them out first
+	size_t DequeueRoutedPackets(const std::function<void(uint16_t netID, const char* data, size_t length)>& callback, size_t maxCount = SIZE_MAX);
 
 	void SendOutOfBand(NetAddress& address, const char* format, ...);
 
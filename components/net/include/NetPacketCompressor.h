@@ -0,0 +1,68 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <vector>
+
+struct z_stream_s;
+
+// the compression name sent to the server in initConnect - changes whenever the dictionary does
+#define NETWORK_COMPRESSION_NAME "deflate-1"
+
+//
+// Compresses NetChannel messages as raw deflate, primed with a dictionary of common protocol data.
+//
+// Every message is compressed on its own, so a lost datagram doesn't affect any others. Small messages - usually just
+// routed game data - get the fastest compression level, larger ones (mostly reliable commands) a better one.
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	NetPacketCompressor
+{
+public:
+	// messages smaller than this are sent as-is
+	static const size_t MinCompressedSize = 128;
+
+	// messages up to this size get compressed for speed
+	static const size_t FastCompressionSize = 1024;
+
+	static const size_t MaxDecompressedSize = 65536;
+
+private:
+	z_stream_s* m_fastDeflateStream;
+
+	z_stream_s* m_deflateStream;
+
+	z_stream_s* m_inflateStream;
+
+	std::vector<char> m_compressBuffer;
+
+	std::vector<char> m_decompressBuffer;
+
+public:
+	NetPacketCompressor();
+
+	~NetPacketCompressor();
+
+	NetPacketCompressor(const NetPacketCompressor&) = delete;
+
+	NetPacketCompressor& operator=(const NetPacketCompressor&) = delete;
+
+	//
+	// Compresses a message, returning false if it's too small or didn't get any smaller - in which case it should be
+	// sent uncompressed. The compressed data stays valid until the next call.
+	//
+	bool Compress(const char* data, size_t length, const char** outData, size_t* outLength);
+
+	//
+	// Decompresses a received message. The data stays valid until the next call.
+	//
+	bool Decompress(const char* data, size_t length, const char** outData, size_t* outLength);
+};
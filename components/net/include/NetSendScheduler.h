@@ -0,0 +1,131 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+//
+// Decides when NetLibrary sends to the server, and which reliable commands go along.
+//
+// Routed packets are flushed as soon as they're queued, and an idle packet (carrying acknowledgements) is sent every
+// idle interval. Reliable commands are paced by the estimated delivery rate, and only retransmitted once the
+// retransmission timeout - derived from the measured round-trip time - has passed. Once a timeout expired, unacknowledged
+// commands get retransmitted every idle interval until an acknowledgement arrives - only if none does for the maximum
+// timeout, retransmissions back off.
+//
+// All times are in milliseconds, as returned by timeGetTime.
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	NetSendScheduler
+{
+public:
+	static const uint32_t DefaultIdleInterval = 1000 / 60;
+
+	static const uint32_t InitialRetransmitTimeout = 250;
+
+	static const uint32_t MinRetransmitTimeout = 40;
+
+	static const uint32_t MaxRetransmitTimeout = 3000;
+
+	// retransmissions wait for at most 2^this times the retransmission timeout
+	static const uint32_t MaxRetransmitBackoff = 2;
+
+	// in bytes per second
+	static const uint32_t InitialPacingRate = 64 * 1024;
+
+	static const uint32_t MinPacingRate = 16 * 1024;
+
+	// the number of delivery rate samples the bandwidth estimate is the maximum of
+	static const int DeliveryRateSampleCount = 8;
+
+private:
+	uint32_t m_idleInterval;
+
+	uint32_t m_lastSend;
+
+	// round-trip estimation (RFC 6298), zero until the first sample
+	uint32_t m_smoothedRtt;
+
+	uint32_t m_rttVariance;
+
+	uint32_t m_retransmitTimeout;
+
+	// pacing, as a token bucket of reliable bytes
+	int64_t m_pacingBudget;
+
+	uint32_t m_lastBudgetUpdate;
+
+	// delivery rate sampling
+	uint32_t m_deliveryRates[DeliveryRateSampleCount];
+
+	int m_deliveryRateIndex;
+
+	uint32_t m_deliverySampleStart;
+
+	uint32_t m_deliveredBytes;
+
+	// whether a command had to wait for the pacing budget during the current sample
+	bool m_pacingLimited;
+
+	// when a retransmission timeout last expired without acknowledgements arriving since, or 0
+	uint32_t m_recoveryStart;
+
+private:
+	void UpdateBudget(uint32_t now);
+
+	uint32_t GetBurstSize() const;
+
+public:
+	NetSendScheduler();
+
+	void Reset();
+
+	inline void SetIdleInterval(uint32_t interval)
+	{
+		m_idleInterval = interval;
+	}
+
+	//
+	// Returns whether a packet should be sent now - immediately if there's urgent (routed) data pending, or once the
+	// idle interval has passed.
+	//
+	bool ShouldSend(uint32_t now, bool hasUrgentData) const;
+
+	//
+	// Returns whether a reliable command should be included in the packet being built. sendCount is the number of times
+	// the command has been sent before, and lastSent when it was last sent. First sends are paced; forceSend ignores both
+	// the pacing budget and the retransmission timeout. A retransmission starts loss recovery, which lasts until the next
+	// call to OnReliableAcknowledged.
+	//
+	// As the server skips over commands missing before a newer one, callers send a command that's due along with all
+	// unacknowledged commands before it, whether those are due or not.
+	//
+	bool ShouldSendReliable(uint32_t now, uint32_t sendCount, uint32_t lastSent, size_t length, bool forceSend);
+
+	void OnPacketSent(uint32_t now);
+
+	//
+	// Called when the server acknowledges reliable commands, with the round-trip time of the newest one - or UINT32_MAX,
+	// if it's ambiguous as commands got retransmitted.
+	//
+	void OnReliableAcknowledged(uint32_t now, size_t length, uint32_t roundTripTime);
+
+	inline uint32_t GetRetransmitTimeout() const
+	{
+		return m_retransmitTimeout;
+	}
+
+	inline uint32_t GetSmoothedRoundTripTime() const
+	{
+		return m_smoothedRtt;
+	}
+
+	// in bytes per second
+	uint32_t GetPacingRate() const;
+};
@@ -0,0 +1,95 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <vector>
+
+//
+// Puts received reliable commands back in order.
+//
+// Commands are numbered from 1, and handled strictly in order, exactly once. A command arriving ahead of a missing one
+// is held - in a slot indexed by its id modulo the window size, which keeps its storage for later commands - until the
+// missing one gets retransmitted. Commands too far ahead to hold are dropped, and have to be retransmitted later.
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	ReliableCommandWindow
+{
+public:
+	// held commands that had to grow beyond this give their storage back once handled
+	static const size_t MaxRetainedCommandSize = 65536;
+
+private:
+	struct HeldCommand
+	{
+		// zero if the slot is unused
+		uint32_t id;
+		uint32_t type;
+		std::vector<char> command;
+	};
+
+private:
+	std::vector<HeldCommand> m_slots;
+
+	uint32_t m_lastId;
+
+private:
+	// returns false if the command is too far ahead to be held
+	bool Hold(uint32_t id, uint32_t type, const char* data, size_t length);
+
+	// takes the held command following the last handled one, if it's there
+	HeldCommand* TakeNext();
+
+	void ReleaseSlot(HeldCommand& slot);
+
+public:
+	explicit ReliableCommandWindow(size_t size);
+
+	void Reset();
+
+	//
+	// Processes a received command, calling the handler (with type, data and length) for it and any held commands it
+	// was the last missing one for. The data is only valid for the duration of the handler.
+	//
+	template<typename THandler>
+	void Process(uint32_t id, uint32_t type, const char* data, size_t length, const THandler& handler)
+	{
+		// check to prevent double execution
+		if (id <= m_lastId)
+		{
+			return;
+		}
+
+		if (id != (m_lastId + 1))
+		{
+			// an earlier command got lost - keep this one until that one gets retransmitted
+			Hold(id, type, data, length);
+			return;
+		}
+
+		m_lastId = id;
+
+		handler(type, data, length);
+
+		// handle any commands that were waiting for this one
+		while (HeldCommand* slot = TakeNext())
+		{
+			handler(slot->type, slot->command.data(), slot->command.size());
+
+			ReleaseSlot(*slot);
+		}
+	}
+
+	// the id of the last command handled, which acknowledges it and all before it
+	inline uint32_t GetLastId() const
+	{
+		return m_lastId;
+	}
+};
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+//
+// A single-producer, single-consumer ring of routed packets, handing packets from the network thread to the game
+// thread without taking a lock per packet.
+//
+// Each slot keeps its payload storage after being consumed, so once the slots have grown to the usual packet size,
+// queueing doesn't allocate. If the consumer falls behind by more than the capacity (say, while the game is loading),
+// packets go to a locked overflow list instead, which gets moved back into the ring as it drains - so no packet is
+// ever dropped.
+//
+class
+#ifdef COMPILING_NET
+	__declspec(dllexport)
+#endif
+	RoutedPacketQueue
+{
+public:
+	static const size_t Capacity = 1024;
+
+	// slots that had to grow beyond this give their storage back once consumed
+	static const size_t MaxRetainedPayloadSize = 16384;
+
+private:
+	struct Slot
+	{
+		uint16_t netID;
+
+		std::vector<char> payload;
+	};
+
+private:
+	std::vector<Slot> m_slots;
+
+	// written by the producer only
+	std::atomic<size_t> m_head;
+
+	// written by the consumer only
+	std::atomic<size_t> m_tail;
+
+	// set while the consumer waits for packets, so the producer only signals when needed
+	std::atomic<bool> m_consumerWaiting;
+
+	std::mutex m_waitMutex;
+
+	std::condition_variable m_waitCondition;
+
+	// packets that didn't fit in the ring, all newer than the ones in it - only touched with the mutex held
+	std::deque<Slot> m_overflow;
+
+	std::mutex m_overflowMutex;
+
+	// the size of the overflow list, for checking without taking the lock - only the producer makes it grow
+	std::atomic<size_t> m_overflowSize;
+
+	std::atomic<uint64_t> m_overflowedPackets;
+
+private:
+	bool TryPush(uint16_t netID, const char* data, size_t length);
+
+	void Signal();
+
+	void ReleaseSlot(Slot& slot);
+
+	template<typename TCallback>
+	size_t DequeueRing(const TCallback& callback, size_t maxCount)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		size_t head = m_head.load(std::memory_order_acquire);
+
+		size_t count = 0;
+
+		while (tail != head && count < maxCount)
+		{
+			Slot& slot = m_slots[tail % Capacity];
+
+			callback(slot.netID, slot.payload.data(), slot.payload.size());
+
+			ReleaseSlot(slot);
+
+			tail++;
+			count++;
+		}
+
+		m_tail.store(tail, std::memory_order_release);
+
+		return count;
+	}
+
+public:
+	RoutedPacketQueue();
+
+	//
+	// Queues a packet - only to be called from the producer.
+	//
+	void Enqueue(uint16_t netID, const char* data, size_t length);
+
+	//
+	// Copies the oldest packet into the buffer, which has to be able to hold any routed packet (64 KiB). Only to be
+	// called from the consumer.
+	//
+	bool Dequeue(char* buffer, size_t* length, uint16_t* netID);
+
+	//
+	// Passes up to maxCount queued packets to the callback in order, without copying them. Only to be called from the
+	// consumer - the data is only valid for the duration of the callback.
+	//
+	template<typename TCallback>
+	size_t DequeueBatch(const TCallback& callback, size_t maxCount = SIZE_MAX)
+	{
+		size_t count = DequeueRing(callback, maxCount);
+
+		if (count < maxCount && m_overflowSize.load(std::memory_order_acquire) != 0)
+		{
+			std::lock_guard<std::mutex> lock(m_overflowMutex);
+
+			// while packets are overflowing, the producer only adds to the ring with the lock held - so once the ring is
+			// empty, the overflow list holds the next packets
+			count += DequeueRing(callback, maxCount - count);
+
+			while (count < maxCount && !m_overflow.empty())
+			{
+				Slot& slot = m_overflow.front();
+
+				callback(slot.netID, slot.payload.data(), slot.payload.size());
+
+				m_overflow.pop_front();
+				count++;
+			}
+
+			m_overflowSize.store(m_overflow.size(), std::memory_order_release);
+		}
+
+		return count;
+	}
+
+	//
+	// Waits for a packet to be queued, for at most the timeout in milliseconds (UINT32_MAX waits indefinitely). Returns
+	// whether a packet is available.
+	//
+	bool Wait(uint32_t timeout);
+
+	inline bool IsEmpty() const
+	{
+		return (m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire) && m_overflowSize.load(std::memory_order_acquire) == 0);
+	}
+
+	// the number of packets that had to go through the overflow list, as the ring was full
+	inline uint64_t GetOverflowedPacketCount() const
+	{
+		return m_overflowedPackets.load(std::memory_order_relaxed);
+	}
+};
@@ -48,6 +48,24 @@ bool NetBuffer::Read(void* buffer, size_t length)
 	return true;
 }
 
+const char* NetBuffer::ReadInPlace(size_t length)
+{
+	if ((m_curOff + length) >= m_length)
+	{
+		m_end = true;
+
+		if ((m_curOff + length) > m_length)
+		{
+			return nullptr;
+		}
+	}
+
+	const char* data = &m_bytes[m_curOff];
+	m_curOff += length;
+
+	return data;
+}
+
 void NetBuffer::Write(const void* buffer, size_t length)
 {
 	if ((m_curOff + length) >= m_length)
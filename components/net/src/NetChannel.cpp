@@ -9,6 +9,7 @@
 #include "NetLibrary.h"
 
 NetChannel::NetChannel()
+	: m_lastPayloadSize(0)
 {
 	NetAddress dummyAddress;
 
@@ -17,7 +18,8 @@ NetChannel::NetChannel()
 
 void NetChannel::Reset(NetAddress& target, NetLibrary* netLibrary)
 {
-	m_fragmentBuffer = "";
+	// reused for every fragmented sequence
+	m_fragmentBuffer.resize(65536);
 	m_fragmentLength = 0;
 	m_fragmentSequence = -1;
 
@@ -28,40 +30,66 @@ void NetChannel::Reset(NetAddress& target, NetLibrary* netLibrary)
 	m_netLibrary = netLibrary;
 }
 
-void NetChannel::Send(NetBuffer& buffer)
+void NetChannel::SetCompression(bool enabled)
 {
-	if (buffer.GetCurLength() > FRAGMENT_SIZE)
+	if (!enabled)
 	{
-		return SendFragmented(buffer);
+		m_compressor.reset();
 	}
+	else if (!m_compressor)
+	{
+		m_compressor = std::make_unique<NetPacketCompressor>();
+	}
+}
+
+size_t NetChannel::Send(NetBuffer& buffer)
+{
+	const char* data = buffer.GetBuffer();
+	size_t length = buffer.GetCurLength();
 
-	static char msgBuffer[FRAGMENT_SIZE + 100];
-	*(uint32_t*)(msgBuffer) = m_outSequence;
-	memcpy(&msgBuffer[4], buffer.GetBuffer(), buffer.GetCurLength());
+	uint32_t sequenceFlags = 0;
 
-	m_netLibrary->SendData(m_targetAddress, msgBuffer, buffer.GetCurLength() + 4);
+	if (m_compressor && m_compressor->Compress(buffer.GetBuffer(), buffer.GetCurLength(), &data, &length))
+	{
+		sequenceFlags |= SEQUENCE_COMPRESSED;
+	}
+
+	if (length > FRAGMENT_SIZE)
+	{
+		SendFragmented(data, length, sequenceFlags);
+
+		return length;
+	}
+
+	char* msgBuffer = m_sendBuffer;
+	*(uint32_t*)(msgBuffer) = m_outSequence | sequenceFlags;
+	memcpy(&msgBuffer[4], data, length);
+
+	m_netLibrary->SendData(m_targetAddress, msgBuffer, length + 4);
 
 	m_outSequence++;
+
+	return length;
 }
 
-void NetChannel::SendFragmented(NetBuffer& buffer)
+void NetChannel::SendFragmented(const char* data, size_t length, uint32_t sequenceFlags)
 {
-	uint32_t outSequence = m_outSequence | 0x80000000;
-	uint32_t remaining = buffer.GetCurLength();
+	uint32_t outSequence = m_outSequence | SEQUENCE_FRAGMENTED | sequenceFlags;
+	uint32_t remaining = length;
 	uint16_t i = 0;
 
-	assert(buffer.GetCurLength() < 65536);
+	assert(length < 65536);
 
 	while (remaining >= 0)
 	{
 		uint16_t thisSize = min(remaining, FRAGMENT_SIZE);
 
 		// build this packet
-		static char msgBuffer[FRAGMENT_SIZE + 100];
+		char* msgBuffer = m_sendBuffer;
 		*(uint32_t*)(&msgBuffer[0]) = outSequence;
 		*(uint16_t*)(&msgBuffer[4]) = i;
 		*(uint16_t*)(&msgBuffer[6]) = thisSize;
-		memcpy(&msgBuffer[8], buffer.GetBuffer() + i, thisSize);
+		memcpy(&msgBuffer[8], data + i, thisSize);
 
 		m_netLibrary->SendData(m_targetAddress, msgBuffer, thisSize + 8);
 
@@ -83,7 +111,8 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 {
 	uint32_t sequence = *(uint32_t*)(message);
 
-	bool fragmented = ((sequence & 0x80000000) != 0);
+	bool fragmented = ((sequence & SEQUENCE_FRAGMENTED) != 0);
+	bool compressed = ((sequence & SEQUENCE_COMPRESSED) != 0);
 	uint16_t fragmentStart = 0;
 	uint16_t fragmentLength = 0;
 
@@ -92,8 +121,6 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 		fragmentStart = *(uint16_t*)(message + 4);
 		fragmentLength = *(uint16_t*)(message + 6);
 
-		sequence &= ~0x80000000;
-
 		message += 8;
 	}
 	else
@@ -101,6 +128,8 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 		message += 4;
 	}
 
+	sequence &= ~(SEQUENCE_FRAGMENTED | SEQUENCE_COMPRESSED);
+
 	if (sequence <= m_inSequence && m_inSequence != 0)
 	{
 		trace("out of order packet (%d, %d)\n", sequence, m_inSequence);
@@ -121,7 +150,6 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 		{
 			m_fragmentLength = 0;
 			m_fragmentSequence = sequence;
-			m_fragmentBuffer = new char[65536];
 			m_fragmentValidSet.reset();
 			m_fragmentLastBit = -1;
 		}
@@ -162,18 +190,39 @@ bool NetChannel::Process(const char* message, size_t size, NetBuffer** buffer)
 
 		m_inSequence = sequence;
 
-		*buffer = new NetBuffer(m_fragmentBuffer, m_fragmentLength);
-
+		size_t fragmentTotal = m_fragmentLength;
 		m_fragmentLength = 0;
 
-		return true;
+		return ProcessPayload(m_fragmentBuffer.data(), fragmentTotal, compressed, buffer);
 	}
 	else
 	{
-		*buffer = new NetBuffer(message, size - 4);
-
 		m_inSequence = sequence;
 
-		return true;
+		return ProcessPayload(message, size - 4, compressed, buffer);
 	}
+}
+
+bool NetChannel::ProcessPayload(const char* data, size_t length, bool compressed, NetBuffer** buffer)
+{
+	m_lastPayloadSize = length;
+
+	if (compressed)
+	{
+		if (!m_compressor)
+		{
+			trace("Received a compressed message, but compression wasn't negotiated.\n");
+
+			return false;
+		}
+
+		if (!m_compressor->Decompress(data, length, &data, &length))
+		{
+			return false;
+		}
+	}
+
+	*buffer = new NetBuffer(data, length);
+
+	return true;
 }
\ No newline at end of file
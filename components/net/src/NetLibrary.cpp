@@ -92,6 +92,7 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 
 	// metrics bits
 	NetPacketMetrics metrics;
+	metrics.SetCompressionSizes(msg.GetLength(), m_netChannel.GetLastPayloadSize());
 
 	// receive the message
 	uint32_t msgType;
@@ -100,10 +101,20 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 
 	if (curReliableAck != m_outReliableAcknowledged)
 	{
+		size_t acknowledgedBytes = 0;
+		uint32_t lastSent = 0;
+
+		// acknowledgements are cumulative, so any retransmitted command makes the round-trip time ambiguous
+		bool ambiguousRtt = false;
+
 		for (auto it = m_outReliableCommands.begin(); it != m_outReliableCommands.end();)
 		{
 			if (it->id <= curReliableAck)
 			{
+				acknowledgedBytes += it->command.size();
+				lastSent = it->lastSent;
+				ambiguousRtt |= (it->sendCount != 1);
+
 				it = m_outReliableCommands.erase(it);
 			}
 			else
@@ -112,6 +123,13 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 			}
 		}
 
+		if (acknowledgedBytes > 0)
+		{
+			uint32_t now = timeGetTime();
+
+			m_sendScheduler.OnReliableAcknowledged(now, acknowledgedBytes, (ambiguousRtt) ? UINT32_MAX : (now - lastSent));
+		}
+
 		m_outReliableAcknowledged = curReliableAck;
 	}
 
@@ -141,13 +159,14 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 
 			//trace("msgRoute from %d len %d\n", netID, rlength);
 
-			char routeBuffer[65536];
-			if (!msg.Read(routeBuffer, rlength))
+			const char* routeData = msg.ReadInPlace(rlength);
+
+			if (!routeData)
 			{
 				break;
 			}
 
-			EnqueueRoutedPacket(netID, std::string(routeBuffer, rlength));
+			EnqueueRoutedPacket(netID, routeData, rlength);
 
 			// add to metrics
 			metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, 2 + rlength);
@@ -191,33 +210,18 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 				metrics.AddElementSize(NET_PACKET_SUB_RELIABLES, 2);
 			}
 
-			// test for bad scenarios
-			if (id > (m_lastReceivedReliableCommand + 64))
-			{
-				return;
-			}
-
-			char* reliableBuf = new(std::nothrow) char[size];
+			// handlers get to see the command in the received packet itself
+			const char* reliableData = msg.ReadInPlace(size);
 
-			if (!reliableBuf)
-			{
-				return;
-			}
-
-			if (!msg.Read(reliableBuf, size))
+			if (!reliableData)
 			{
 				break;
 			}
 
-			// check to prevent double execution
-			if (id > m_lastReceivedReliableCommand)
+			m_inReliableCommands.Process(id, msgType, reliableData, size, [&] (uint32_t type, const char* data, size_t length)
 			{
-				HandleReliableCommand(msgType, reliableBuf, size);
-
-				m_lastReceivedReliableCommand = id;
-			}
-
-			delete[] reliableBuf;
+				HandleReliableCommand(type, data, length);
+			});
 
 			// add to metrics
 			metrics.AddElementSize(NET_PACKET_SUB_RELIABLES, 4 + size);
@@ -232,60 +236,22 @@ void NetLibrary::ProcessServerMessage(NetBuffer& msg)
 
 bool NetLibrary::WaitForRoutedPacket(uint32_t timeout)
 {
-	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		if (!m_incomingPackets.empty())
-		{
-			return true;
-		}
-	}
-
-	WaitForSingleObject(m_receiveEvent, timeout);
-
-	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		return (!m_incomingPackets.empty());
-	}
+	return m_incomingPackets.Wait(timeout);
 }
 
-void NetLibrary::EnqueueRoutedPacket(uint16_t netID, std::string packet)
+void NetLibrary::EnqueueRoutedPacket(uint16_t netID, const char* data, size_t length)
 {
-	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		RoutingPacket routePacket;
-		routePacket.netID = netID;
-		routePacket.payload = packet;
-
-		m_incomingPackets.push(routePacket);
-	}
-
-	SetEvent(m_receiveEvent);
+	m_incomingPackets.Enqueue(netID, data, length);
 }
 
 bool NetLibrary::DequeueRoutedPacket(char* buffer, size_t* length, uint16_t* netID)
 {
-	{
-		std::lock_guard<std::mutex> guard(m_incomingPacketMutex);
-
-		if (m_incomingPackets.empty())
-		{
-			return false;
-		}
-
-		auto packet = m_incomingPackets.front();
-		m_incomingPackets.pop();
-
-		memcpy(buffer, packet.payload.c_str(), packet.payload.size());
-		*netID = packet.netID;
-		*length = packet.payload.size();
-	}
-
-	ResetEvent(m_receiveEvent);
+	return m_incomingPackets.Dequeue(buffer, length, netID);
+}
 
-	return true;
+size_t NetLibrary::DequeueRoutedPackets(const std::function<void(uint16_t netID, const char* data, size_t length)>& callback, size_t maxCount)
+{
+	return m_incomingPackets.DequeueBatch(callback, maxCount);
 }
 
 void NetLibrary::RoutePacket(const char* buffer, size_t length, uint16_t netID)
@@ -318,13 +284,14 @@ void NetLibrary::ProcessOOB(NetAddress& from, char* oob, size_t length)
 			m_hostNetID = atoi(hostIDStr);
 			m_hostBase = atoi(hostBaseStr);
 
-			m_lastReceivedReliableCommand = 0;
+			m_inReliableCommands.Reset();
 
 			trace("connectOK, our id %d, host id %d\n", m_serverNetID, m_hostNetID);
 
 			OnConnectOKReceived(m_currentServer);
 
 			m_netChannel.Reset(m_currentServer, this);
+			m_netChannel.SetCompression(m_compressionEnabled);
 			m_connectionState = CS_CONNECTED;
 		}
 		else if (!_strnicmp(oob, "error", 5))
@@ -379,30 +346,12 @@ NetLibrary::RoutingPacket::RoutingPacket()
 	genTime = 0;
 }
 
-void NetLibrary::ProcessSend()
+void NetLibrary::ProcessSend(bool flush)
 {
-	// is it time to send a packet yet?
-	bool continueSend = false;
+	// is it time to send a packet yet? routed packets are latency-sensitive, so they get sent right away
+	uint32_t now = timeGetTime();
 
-/*	if (GameFlags::GetFlag(GameFlag::InstantSendPackets))
-	{
-		if (!m_outgoingPackets.empty())
-		{
-			continueSend = true;
-		}
-	}*/
-
-	if (!continueSend)
-	{
-		uint32_t diff = timeGetTime() - m_lastSend;
-
-		if (diff >= (1000 / 60))
-		{
-			continueSend = true;
-		}
-	}
-
-	if (!continueSend)
+	if (!flush && !m_sendScheduler.ShouldSend(now, !m_outgoingPackets.empty()))
 	{
 		return;
 	}
@@ -419,7 +368,7 @@ void NetLibrary::ProcessSend()
 	// build a nice packet
 	NetBuffer msg(24000);
 
-	msg.Write(m_lastReceivedReliableCommand);
+	msg.Write(m_inReliableCommands.GetLastId());
 
 	if (m_serverProtocol >= 2)
 	{
@@ -441,9 +390,32 @@ void NetLibrary::ProcessSend()
 		metrics.AddElementSize(NET_PACKET_SUB_ROUTED_MESSAGES, packet.payload.size() + 2 + 2 + 4);
 	}
 
-	// send pending reliable commands
-	for (auto& command : m_outReliableCommands)
+	// the server handles any reliable command newer than the last one it got, skipping the ones in between - so a command
+	// may only go out along with every unacknowledged command before it. find the newest command that's due: a new one
+	// the pacing allows, or one that wasn't acknowledged in time
+	auto sendEnd = m_outReliableCommands.begin();
+
+	for (auto it = m_outReliableCommands.begin(); it != m_outReliableCommands.end(); it++)
 	{
+		if (m_sendScheduler.ShouldSendReliable(now, it->sendCount, it->lastSent, it->command.size(), flush))
+		{
+			sendEnd = std::next(it);
+		}
+		else if (it->sendCount == 0)
+		{
+			// keep new commands in order
+			break;
+		}
+	}
+
+	// and send everything up to it
+	for (auto it = m_outReliableCommands.begin(); it != sendEnd; it++)
+	{
+		auto& command = *it;
+
+		command.sendCount++;
+		command.lastSent = now;
+
 		msg.Write(command.type);
 
 		if (command.command.size() > UINT16_MAX)
@@ -479,9 +451,11 @@ void NetLibrary::ProcessSend()
 
 	msg.Write(0xCA569E63); // msgEnd
 
-	m_netChannel.Send(msg);
+	size_t sentSize = m_netChannel.Send(msg);
+
+	metrics.SetCompressionSizes(msg.GetCurLength(), sentSize);
 
-	m_lastSend = timeGetTime();
+	m_sendScheduler.OnPacketSent(now);
 
 	if (m_metricSink.GetRef())
 	{
@@ -504,6 +478,8 @@ void NetLibrary::SendReliableCommand(const char* type, const char* buffer, size_
 	cmd.type = HashRageString(type);
 	cmd.id = m_outReliableSequence;
 	cmd.command = std::string(buffer, length);
+	cmd.sendCount = 0;
+	cmd.lastSent = 0;
 
 	m_outReliableCommands.push_back(cmd);
 }
@@ -630,10 +606,12 @@ void NetLibrary::ConnectToServer(const char* hostname, uint16_t port)
 
 	m_outReliableAcknowledged = 0;
 	m_outSequence = 0;
-	m_lastReceivedReliableCommand = 0;
+	m_inReliableCommands.Reset();
 	m_outReliableCommands.clear();
+	m_sendScheduler.Reset();
 
 	m_lastFrameNumber = 0;
+	m_compressionEnabled = false;
 
 	wchar_t wideHostname[256];
 	mbstowcs(wideHostname, hostname, _countof(wideHostname) - 1);
@@ -646,6 +624,7 @@ void NetLibrary::ConnectToServer(const char* hostname, uint16_t port)
 	postMap["method"] = "initConnect";
 	postMap["name"] = GetPlayerName();
 	postMap["protocol"] = va("%d", NETWORK_PROTOCOL);
+	postMap["compression"] = NETWORK_COMPRESSION_NAME;
 
 	TerminalClient* clientContainer = Instance<TerminalClient>::Get();
 	auto client = clientContainer->GetClient();
@@ -719,6 +698,9 @@ void NetLibrary::ConnectToServer(const char* hostname, uint16_t port)
 
 			m_serverProtocol = node["protocol"].as<uint32_t>();
 
+			// servers not knowing about compression won't reply with it
+			m_compressionEnabled = (node["compression"].IsDefined() && node["compression"].as<std::string>() == NETWORK_COMPRESSION_NAME);
+
 			m_connectionState = CS_INITRECEIVED;
 		}
 		catch (YAML::Exception&)
@@ -746,11 +728,9 @@ void NetLibrary::FinalizeDisconnect()
 	{
 		SendReliableCommand("msgIQuit", g_disconnectReason.c_str(), g_disconnectReason.length() + 1);
 
-		m_lastSend = 0;
-		ProcessSend();
+		ProcessSend(true);
 
-		m_lastSend = 0;
-		ProcessSend();
+		ProcessSend(true);
 
 		OnFinalizeDisconnect(m_currentServer);
 		//GameFlags::ResetFlags();
@@ -966,11 +946,11 @@ void NetLibrary::SendNetEvent(fwString eventName, fwString jsonString, int i)
 
 NetLibrary::NetLibrary()
 	: m_serverNetID(0), m_serverBase(0), m_hostBase(0), m_hostNetID(0), m_connectionState(CS_IDLE),
-	  m_tempGuid(0), m_lastConnect(0), m_lastSend(0), m_outSequence(0), m_lastReceivedReliableCommand(0), m_outReliableAcknowledged(0), m_outReliableSequence(0),
-	  m_lastReceivedAt(0)
+	  m_tempGuid(0), m_lastConnect(0), m_outSequence(0), m_outReliableAcknowledged(0), m_outReliableSequence(0),
+	  m_lastReceivedAt(0), m_compressionEnabled(false), m_inReliableCommands(MAX_RELIABLE_COMMANDS)
 
 {
-	m_receiveEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
 }
 
 __declspec(dllexport) fwEvent<NetLibrary*> NetLibrary::OnNetLibraryCreate;
@@ -0,0 +1,139 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetPacketCompressor.h"
+
+#include <zlib.h>
+
+// the preset dictionary both sides prime deflate with - deflate prefers matches at the end, so the most common data goes
+// last. changing this needs a new NETWORK_COMPRESSION_NAME, as the server has to use the exact same bytes.
+static const char g_compressionDictionary[] =
+	"msgResStartmsgResStopmsgIQuitmsgHeHostmsgIHostmsgServerEventmsgNetEvent"
+	"\x4a\xcd\xe4\xaf" // msgResStart
+	"\xd7\x55\xe8\x45" // msgResStop
+	"\xd1\xad\x2c\x52" // msgIQuit
+	"\x7b\xf8\xe9\x86" // msgHeHost
+	"\xde\x30\xea\xb3" // msgIHost
+	"\x18\x6e\x77\xfa" // msgServerEvent
+	"\x7a\xfd\x37\x73" // msgNetEvent
+	"\x3f\xfa\xff\x53" // msgFrame
+	"\x63\x9e\x56\xca" // msgEnd
+	"\x5b\x44\x38\xe9"; // msgRoute
+
+static void SetDictionary(z_stream* stream, bool deflating)
+{
+	const Bytef* dictionary = reinterpret_cast<const Bytef*>(g_compressionDictionary);
+	uInt dictionaryLength = sizeof(g_compressionDictionary) - 1;
+
+	if (deflating)
+	{
+		deflateSetDictionary(stream, dictionary, dictionaryLength);
+	}
+	else
+	{
+		inflateSetDictionary(stream, dictionary, dictionaryLength);
+	}
+}
+
+static z_stream* CreateDeflateStream(int level, int windowBits, int memLevel)
+{
+	z_stream* stream = new z_stream;
+	memset(stream, 0, sizeof(*stream));
+
+	// negative window bits make for raw deflate, without the zlib header and checksum
+	deflateInit2(stream, level, Z_DEFLATED, -windowBits, memLevel, Z_DEFAULT_STRATEGY);
+
+	return stream;
+}
+
+NetPacketCompressor::NetPacketCompressor()
+{
+	// resetting a stream clears its hash table - keep that small for small messages, as it'd take longer than compressing
+	m_fastDeflateStream = CreateDeflateStream(Z_BEST_SPEED, 11, 4);
+	m_deflateStream = CreateDeflateStream(Z_DEFAULT_COMPRESSION, 15, 8);
+
+	m_inflateStream = new z_stream;
+	memset(m_inflateStream, 0, sizeof(*m_inflateStream));
+
+	inflateInit2(m_inflateStream, -15);
+
+	m_decompressBuffer.resize(MaxDecompressedSize);
+}
+
+NetPacketCompressor::~NetPacketCompressor()
+{
+	deflateEnd(m_fastDeflateStream);
+	deflateEnd(m_deflateStream);
+	inflateEnd(m_inflateStream);
+
+	delete m_fastDeflateStream;
+	delete m_deflateStream;
+	delete m_inflateStream;
+}
+
+bool NetPacketCompressor::Compress(const char* data, size_t length, const char** outData, size_t* outLength)
+{
+	if (length < MinCompressedSize)
+	{
+		return false;
+	}
+
+	z_stream* stream = (length <= FastCompressionSize) ? m_fastDeflateStream : m_deflateStream;
+
+	deflateReset(stream);
+	SetDictionary(stream, true);
+
+	// anything that doesn't fit in the original size isn't worth sending compressed
+	if (m_compressBuffer.size() < length)
+	{
+		m_compressBuffer.resize(length);
+	}
+
+	stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream->avail_in = static_cast<uInt>(length);
+	stream->next_out = reinterpret_cast<Bytef*>(m_compressBuffer.data());
+	stream->avail_out = static_cast<uInt>(length - 1);
+
+	if (deflate(stream, Z_FINISH) != Z_STREAM_END)
+	{
+		return false;
+	}
+
+	*outData = m_compressBuffer.data();
+	*outLength = stream->total_out;
+
+	return true;
+}
+
+bool NetPacketCompressor::Decompress(const char* data, size_t length, const char** outData, size_t* outLength)
+{
+	z_stream* stream = m_inflateStream;
+
+	inflateReset(stream);
+
+	// raw inflate streams take the dictionary up front, as there's no header asking for it
+	SetDictionary(stream, false);
+
+	stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream->avail_in = static_cast<uInt>(length);
+	stream->next_out = reinterpret_cast<Bytef*>(m_decompressBuffer.data());
+	stream->avail_out = static_cast<uInt>(m_decompressBuffer.size());
+
+	int result = inflate(stream, Z_FINISH);
+
+	if (result != Z_STREAM_END)
+	{
+		trace("Failed to decompress a %d byte server message - zlib error %d.\n", static_cast<int>(length), result);
+		return false;
+	}
+
+	*outData = m_decompressBuffer.data();
+	*outLength = stream->total_out;
+
+	return true;
+}
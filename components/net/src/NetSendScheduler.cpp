@@ -0,0 +1,179 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "NetSendScheduler.h"
+
+// these get passed by reference to std::min/std::max
+const uint32_t NetSendScheduler::MinRetransmitTimeout;
+const uint32_t NetSendScheduler::MaxRetransmitTimeout;
+const uint32_t NetSendScheduler::MaxRetransmitBackoff;
+const uint32_t NetSendScheduler::MinPacingRate;
+
+NetSendScheduler::NetSendScheduler()
+	: m_idleInterval(DefaultIdleInterval)
+{
+	Reset();
+}
+
+void NetSendScheduler::Reset()
+{
+	m_lastSend = 0;
+
+	m_smoothedRtt = 0;
+	m_rttVariance = 0;
+	m_retransmitTimeout = InitialRetransmitTimeout;
+
+	memset(m_deliveryRates, 0, sizeof(m_deliveryRates));
+	m_deliveryRateIndex = 0;
+	m_deliverySampleStart = 0;
+	m_deliveredBytes = 0;
+	m_pacingLimited = false;
+
+	m_pacingBudget = GetBurstSize();
+	m_lastBudgetUpdate = 0;
+
+	m_recoveryStart = 0;
+}
+
+bool NetSendScheduler::ShouldSend(uint32_t now, bool hasUrgentData) const
+{
+	return (hasUrgentData || (now - m_lastSend) >= m_idleInterval);
+}
+
+bool NetSendScheduler::ShouldSendReliable(uint32_t now, uint32_t sendCount, uint32_t lastSent, size_t length, bool forceSend)
+{
+	UpdateBudget(now);
+
+	if (!forceSend)
+	{
+		if (sendCount > 0)
+		{
+			uint32_t timeout;
+
+			if (m_recoveryStart != 0 && (now - m_recoveryStart) < MaxRetransmitTimeout)
+			{
+				// once a timeout showed commands are getting lost, keep retransmitting until they're acknowledged
+				timeout = m_idleInterval;
+			}
+			else
+			{
+				// back off while retransmissions keep getting lost
+				timeout = std::min(m_retransmitTimeout << std::min(sendCount - 1, MaxRetransmitBackoff), MaxRetransmitTimeout);
+			}
+
+			if ((now - lastSent) < timeout)
+			{
+				return false;
+			}
+
+			if (m_recoveryStart == 0)
+			{
+				m_recoveryStart = now;
+			}
+		}
+		else if (m_pacingBudget <= 0)
+		{
+			m_pacingLimited = true;
+			return false;
+		}
+	}
+
+	// the budget may go negative, so commands larger than the burst size still get sent
+	m_pacingBudget -= static_cast<int64_t>(length);
+
+	return true;
+}
+
+void NetSendScheduler::OnPacketSent(uint32_t now)
+{
+	m_lastSend = now;
+}
+
+void NetSendScheduler::OnReliableAcknowledged(uint32_t now, size_t length, uint32_t roundTripTime)
+{
+	m_recoveryStart = 0;
+
+	if (roundTripTime != UINT32_MAX)
+	{
+		if (m_smoothedRtt == 0)
+		{
+			m_smoothedRtt = std::max(roundTripTime, 1u);
+			m_rttVariance = roundTripTime / 2;
+		}
+		else
+		{
+			uint32_t delta = (m_smoothedRtt > roundTripTime) ? (m_smoothedRtt - roundTripTime) : (roundTripTime - m_smoothedRtt);
+
+			m_rttVariance = ((m_rttVariance * 3) + delta) / 4;
+			m_smoothedRtt = std::max(((m_smoothedRtt * 7) + roundTripTime) / 8, 1u);
+		}
+
+		m_retransmitTimeout = std::min(std::max(m_smoothedRtt + (m_rttVariance * 4), MinRetransmitTimeout), MaxRetransmitTimeout);
+	}
+
+	// sample the delivery rate about once per round trip
+	if (m_deliverySampleStart == 0)
+	{
+		m_deliverySampleStart = now;
+	}
+
+	m_deliveredBytes += static_cast<uint32_t>(length);
+
+	uint32_t elapsed = now - m_deliverySampleStart;
+
+	if (elapsed >= std::max(m_smoothedRtt, 100u))
+	{
+		uint32_t rate = static_cast<uint32_t>((uint64_t(m_deliveredBytes) * 1000) / elapsed);
+
+		// while we're not sending as fast as we may, a lower rate says nothing about the available bandwidth
+		if (m_pacingLimited || rate > GetPacingRate() / 2)
+		{
+			m_deliveryRates[m_deliveryRateIndex] = rate;
+			m_deliveryRateIndex = (m_deliveryRateIndex + 1) % DeliveryRateSampleCount;
+		}
+
+		m_deliverySampleStart = now;
+		m_deliveredBytes = 0;
+		m_pacingLimited = false;
+	}
+}
+
+uint32_t NetSendScheduler::GetPacingRate() const
+{
+	uint32_t maxRate = 0;
+
+	for (uint32_t rate : m_deliveryRates)
+	{
+		maxRate = std::max(maxRate, rate);
+	}
+
+	if (maxRate == 0)
+	{
+		return InitialPacingRate;
+	}
+
+	// leave room for the rate to grow
+	return std::max(maxRate * 2, MinPacingRate);
+}
+
+uint32_t NetSendScheduler::GetBurstSize() const
+{
+	// 100 ms worth of data
+	return std::max(GetPacingRate() / 10, 4096u);
+}
+
+void NetSendScheduler::UpdateBudget(uint32_t now)
+{
+	if (m_lastBudgetUpdate != 0)
+	{
+		m_pacingBudget += (int64_t(GetPacingRate()) * (now - m_lastBudgetUpdate)) / 1000;
+		m_pacingBudget = std::min(m_pacingBudget, int64_t(GetBurstSize()));
+	}
+
+	m_lastBudgetUpdate = now;
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "ReliableCommandWindow.h"
+
+ReliableCommandWindow::ReliableCommandWindow(size_t size)
+	: m_slots(size), m_lastId(0)
+{
+	Reset();
+}
+
+void ReliableCommandWindow::Reset()
+{
+	m_lastId = 0;
+
+	for (auto& slot : m_slots)
+	{
+		slot.id = 0;
+		slot.type = 0;
+		slot.command.clear();
+	}
+}
+
+bool ReliableCommandWindow::Hold(uint32_t id, uint32_t type, const char* data, size_t length)
+{
+	// test for bad scenarios
+	if (id > (m_lastId + m_slots.size()))
+	{
+		return false;
+	}
+
+	HeldCommand& slot = m_slots[id % m_slots.size()];
+	slot.id = id;
+	slot.type = type;
+	slot.command.assign(data, data + length);
+
+	return true;
+}
+
+ReliableCommandWindow::HeldCommand* ReliableCommandWindow::TakeNext()
+{
+	HeldCommand& slot = m_slots[(m_lastId + 1) % m_slots.size()];
+
+	if (slot.id != (m_lastId + 1))
+	{
+		return nullptr;
+	}
+
+	slot.id = 0;
+	m_lastId++;
+
+	return &slot;
+}
+
+void ReliableCommandWindow::ReleaseSlot(HeldCommand& slot)
+{
+	// don't hold on to memory for the occasional large command
+	if (slot.command.capacity() > MaxRetainedCommandSize)
+	{
+		std::vector<char>().swap(slot.command);
+	}
+}
@@ -0,0 +1,135 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+#include "RoutedPacketQueue.h"
+
+RoutedPacketQueue::RoutedPacketQueue()
+	: m_slots(Capacity), m_head(0), m_tail(0), m_consumerWaiting(false), m_overflowSize(0), m_overflowedPackets(0)
+{
+
+}
+
+bool RoutedPacketQueue::TryPush(uint16_t netID, const char* data, size_t length)
+{
+	size_t head = m_head.load(std::memory_order_relaxed);
+
+	if ((head - m_tail.load(std::memory_order_acquire)) >= Capacity)
+	{
+		return false;
+	}
+
+	Slot& slot = m_slots[head % Capacity];
+	slot.netID = netID;
+	slot.payload.assign(data, data + length);
+
+	// sequentially consistent, so either we see the consumer waiting, or it sees this packet before waiting
+	m_head.store(head + 1, std::memory_order_seq_cst);
+
+	return true;
+}
+
+void RoutedPacketQueue::Enqueue(uint16_t netID, const char* data, size_t length)
+{
+	// only we make the overflow list grow, so if it's empty now, it stays that way
+	if (m_overflowSize.load(std::memory_order_relaxed) == 0 && TryPush(netID, data, length))
+	{
+		Signal();
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_overflowMutex);
+
+	// move as many overflowed packets back into the ring as fit - they're older than this one
+	while (!m_overflow.empty())
+	{
+		Slot& slot = m_overflow.front();
+
+		if (!TryPush(slot.netID, slot.payload.data(), slot.payload.size()))
+		{
+			break;
+		}
+
+		m_overflow.pop_front();
+	}
+
+	if (!m_overflow.empty() || !TryPush(netID, data, length))
+	{
+		m_overflow.emplace_back();
+
+		Slot& slot = m_overflow.back();
+		slot.netID = netID;
+		slot.payload.assign(data, data + length);
+
+		m_overflowedPackets.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	m_overflowSize.store(m_overflow.size(), std::memory_order_seq_cst);
+
+	Signal();
+}
+
+void RoutedPacketQueue::Signal()
+{
+	if (m_consumerWaiting.load(std::memory_order_seq_cst))
+	{
+		std::lock_guard<std::mutex> lock(m_waitMutex);
+		m_waitCondition.notify_one();
+	}
+}
+
+void RoutedPacketQueue::ReleaseSlot(Slot& slot)
+{
+	if (slot.payload.capacity() > MaxRetainedPayloadSize)
+	{
+		std::vector<char>().swap(slot.payload);
+	}
+}
+
+bool RoutedPacketQueue::Dequeue(char* buffer, size_t* length, uint16_t* netID)
+{
+	return (DequeueBatch([&] (uint16_t packetNetID, const char* data, size_t packetLength)
+	{
+		memcpy(buffer, data, packetLength);
+
+		*length = packetLength;
+		*netID = packetNetID;
+	}, 1) != 0);
+}
+
+bool RoutedPacketQueue::Wait(uint32_t timeout)
+{
+	if (!IsEmpty())
+	{
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(m_waitMutex);
+
+	m_consumerWaiting.store(true, std::memory_order_seq_cst);
+
+	auto hasPacket = [&] ()
+	{
+		return (m_head.load(std::memory_order_seq_cst) != m_tail.load(std::memory_order_relaxed) || m_overflowSize.load(std::memory_order_seq_cst) != 0);
+	};
+
+	bool result;
+
+	if (timeout == UINT32_MAX)
+	{
+		m_waitCondition.wait(lock, hasPacket);
+		result = true;
+	}
+	else
+	{
+		result = m_waitCondition.wait_for(lock, std::chrono::milliseconds(timeout), hasPacket);
+	}
+
+	m_consumerWaiting.store(false, std::memory_order_relaxed);
+
+	return result;
+}
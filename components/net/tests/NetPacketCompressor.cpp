@@ -0,0 +1,167 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+
+#include <NetPacketCompressor.h>
+
+// a message looking like a typical reliable command - repetitive text, with protocol hashes mixed in
+static std::vector<char> MakeMessage(size_t length)
+{
+	static const char text[] = "msgServerEvent\x18\x6e\x77\xfa playerSpawned {\"x\":123.5,\"y\":-52.25,\"z\":31.0} ";
+
+	std::vector<char> message(length);
+
+	for (size_t i = 0; i < length; i++)
+	{
+		message[i] = text[i % (sizeof(text) - 1)];
+	}
+
+	return message;
+}
+
+static std::vector<char> RoundTrip(NetPacketCompressor& sender, NetPacketCompressor& receiver, const std::vector<char>& message, bool* compressed)
+{
+	const char* data;
+	size_t length;
+
+	*compressed = sender.Compress(message.data(), message.size(), &data, &length);
+
+	if (!*compressed)
+	{
+		return message;
+	}
+
+	EXPECT_LT(length, message.size());
+
+	// the compressed data gets overwritten by the next call, as it would be when sending
+	std::vector<char> wire(data, data + length);
+
+	EXPECT_TRUE(receiver.Decompress(wire.data(), wire.size(), &data, &length));
+
+	return std::vector<char>(data, data + length);
+}
+
+TEST(NetPacketCompressor, RoundTripsMessagesOfAllSizes)
+{
+	NetPacketCompressor sender;
+	NetPacketCompressor receiver;
+
+	// both compression levels, and the largest message the receiver takes
+	for (size_t size : { NetPacketCompressor::MinCompressedSize, size_t(500), NetPacketCompressor::FastCompressionSize,
+						 NetPacketCompressor::FastCompressionSize + 1, size_t(20000), NetPacketCompressor::MaxDecompressedSize })
+	{
+		std::vector<char> message = MakeMessage(size);
+
+		bool compressed;
+		std::vector<char> received = RoundTrip(sender, receiver, message, &compressed);
+
+		EXPECT_TRUE(compressed) << size;
+		EXPECT_EQ(message, received) << size;
+	}
+}
+
+TEST(NetPacketCompressor, MessagesAreIndependent)
+{
+	NetPacketCompressor sender;
+	NetPacketCompressor receiver;
+
+	std::vector<std::vector<char>> wire;
+	std::vector<std::vector<char>> messages;
+
+	for (size_t i = 0; i < 4; i++)
+	{
+		messages.push_back(MakeMessage(300 + (i * 700)));
+
+		const char* data;
+		size_t length;
+
+		ASSERT_TRUE(sender.Compress(messages[i].data(), messages[i].size(), &data, &length));
+
+		wire.emplace_back(data, data + length);
+	}
+
+	// as datagrams can get lost or reordered, each one has to decompress on its own
+	for (size_t i : { 3, 1, 0 })
+	{
+		const char* data;
+		size_t length;
+
+		ASSERT_TRUE(receiver.Decompress(wire[i].data(), wire[i].size(), &data, &length));
+
+		EXPECT_EQ(messages[i], std::vector<char>(data, data + length));
+	}
+}
+
+TEST(NetPacketCompressor, SmallMessagesAreSentAsIs)
+{
+	NetPacketCompressor compressor;
+
+	std::vector<char> message = MakeMessage(NetPacketCompressor::MinCompressedSize - 1);
+
+	const char* data;
+	size_t length;
+
+	EXPECT_FALSE(compressor.Compress(message.data(), message.size(), &data, &length));
+}
+
+TEST(NetPacketCompressor, IncompressibleMessagesAreSentAsIs)
+{
+	NetPacketCompressor compressor;
+
+	std::mt19937 random(42);
+
+	for (size_t size : { size_t(200), size_t(1000), size_t(5000) })
+	{
+		std::vector<char> message(size);
+
+		for (auto& byte : message)
+		{
+			byte = static_cast<char>(random());
+		}
+
+		const char* data;
+		size_t length;
+
+		EXPECT_FALSE(compressor.Compress(message.data(), message.size(), &data, &length)) << size;
+	}
+
+	// and the compressor still works after giving up
+	std::vector<char> message = MakeMessage(1000);
+
+	const char* data;
+	size_t length;
+
+	EXPECT_TRUE(compressor.Compress(message.data(), message.size(), &data, &length));
+}
+
+TEST(NetPacketCompressor, RejectsCorruptData)
+{
+	NetPacketCompressor sender;
+	NetPacketCompressor receiver;
+
+	std::vector<char> message = MakeMessage(2000);
+
+	const char* data;
+	size_t length;
+
+	ASSERT_TRUE(sender.Compress(message.data(), message.size(), &data, &length));
+
+	// a truncated message doesn't complete the stream
+	EXPECT_FALSE(receiver.Decompress(data, length / 2, &data, &length));
+
+	// nor does one that decompresses to more than a message can hold
+	std::vector<char> large = MakeMessage(NetPacketCompressor::MaxDecompressedSize + 1);
+
+	ASSERT_TRUE(sender.Compress(large.data(), large.size(), &data, &length));
+
+	EXPECT_FALSE(receiver.Decompress(data, length, &data, &length));
+}
@@ -0,0 +1,311 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <random>
+
+#include <NetSendScheduler.h>
+
+//
+// Simulates a client sending reliable commands to a server over a lossy link, the way NetLibrary drives its scheduler:
+// a packet goes out for every game frame, carrying the commands up to the newest one the scheduler allows. Like the server,
+// the simulated one handles any command newer than the last one it got - skipping the ones in between - and acknowledges
+// the last command it handled with each of its own packets.
+//
+class ReliableLinkSimulation
+{
+public:
+	// when set, every unacknowledged command goes out with every packet - what NetLibrary did before scheduling
+	bool resendEveryPacket = false;
+
+	uint32_t oneWayDelay = 30;
+
+	double lossRate = 0.0;
+
+	uint32_t frameInterval = 7;
+
+	uint32_t serverInterval = 16;
+
+	uint32_t commandInterval = 50;
+
+	size_t commandSize = 200;
+
+	NetSendScheduler scheduler;
+
+	// statistics
+	size_t deliveredCommands = 0;
+
+	uint64_t totalLatency = 0;
+
+	uint32_t maxLatency = 0;
+
+	size_t sentCommandBytes = 0;
+
+	size_t skippedCommands = 0;
+
+private:
+	struct Command
+	{
+		uint32_t id;
+		uint32_t queuedAt;
+		uint32_t sendCount;
+		uint32_t lastSent;
+	};
+
+	struct InFlight
+	{
+		uint32_t arrival;
+		std::vector<Command> commands;
+		uint32_t ack;
+	};
+
+	std::mt19937 m_random{ 1234 };
+
+	std::deque<Command> m_outCommands;
+
+	std::deque<InFlight> m_toServer;
+
+	std::deque<InFlight> m_toClient;
+
+	uint32_t m_nextId = 1;
+
+	uint32_t m_serverReceived = 0;
+
+	uint32_t m_clientAcknowledged = 0;
+
+private:
+	bool IsLost()
+	{
+		return std::uniform_real_distribution<double>(0.0, 1.0)(m_random) < lossRate;
+	}
+
+	void ClientSend(uint32_t now)
+	{
+		InFlight packet;
+		packet.arrival = now + oneWayDelay;
+		packet.ack = 0;
+
+		// find the newest command that's due, as NetLibrary does
+		auto sendEnd = m_outCommands.begin();
+
+		for (auto it = m_outCommands.begin(); it != m_outCommands.end(); it++)
+		{
+			if (resendEveryPacket || scheduler.ShouldSendReliable(now, it->sendCount, it->lastSent, commandSize, false))
+			{
+				sendEnd = std::next(it);
+			}
+			else if (it->sendCount == 0)
+			{
+				break;
+			}
+		}
+
+		for (auto it = m_outCommands.begin(); it != sendEnd; it++)
+		{
+			auto& command = *it;
+
+			command.sendCount++;
+			command.lastSent = now;
+
+			sentCommandBytes += commandSize;
+
+			packet.commands.push_back(command);
+		}
+
+		scheduler.OnPacketSent(now);
+
+		if (!IsLost())
+		{
+			m_toServer.push_back(packet);
+		}
+	}
+
+	void ClientReceive(uint32_t now, uint32_t ack)
+	{
+		if (ack == m_clientAcknowledged)
+		{
+			return;
+		}
+
+		size_t acknowledgedBytes = 0;
+		uint32_t lastSent = 0;
+		bool ambiguousRtt = false;
+
+		while (!m_outCommands.empty() && m_outCommands.front().id <= ack)
+		{
+			acknowledgedBytes += commandSize;
+			lastSent = m_outCommands.front().lastSent;
+			ambiguousRtt |= (m_outCommands.front().sendCount != 1);
+
+			m_outCommands.pop_front();
+		}
+
+		if (acknowledgedBytes > 0)
+		{
+			scheduler.OnReliableAcknowledged(now, acknowledgedBytes, (ambiguousRtt) ? UINT32_MAX : (now - lastSent));
+		}
+
+		m_clientAcknowledged = ack;
+	}
+
+	void ServerReceive(uint32_t now, const std::vector<Command>& commands)
+	{
+		for (auto& command : commands)
+		{
+			if (command.id > m_serverReceived)
+			{
+				uint32_t latency = now - command.queuedAt;
+
+				deliveredCommands++;
+				totalLatency += latency;
+				maxLatency = std::max(maxLatency, latency);
+
+				// anything between the last command and this one never gets handled
+				skippedCommands += command.id - m_serverReceived - 1;
+
+				m_serverReceived = command.id;
+			}
+		}
+	}
+
+public:
+	void Run(uint32_t duration)
+	{
+		// start at a nonzero time, as the scheduler (like timeGetTime) doesn't expect time 0
+		const uint32_t start = 1000;
+
+		for (uint32_t now = start; now < start + duration; now++)
+		{
+			if ((now % commandInterval) == 0)
+			{
+				m_outCommands.push_back({ m_nextId++, now, 0, 0 });
+			}
+
+			while (!m_toServer.empty() && m_toServer.front().arrival <= now)
+			{
+				ServerReceive(now, m_toServer.front().commands);
+				m_toServer.pop_front();
+			}
+
+			while (!m_toClient.empty() && m_toClient.front().arrival <= now)
+			{
+				ClientReceive(now, m_toClient.front().ack);
+				m_toClient.pop_front();
+			}
+
+			if ((now % frameInterval) == 0)
+			{
+				ClientSend(now);
+			}
+
+			if ((now % serverInterval) == 0 && !IsLost())
+			{
+				m_toClient.push_back({ now + oneWayDelay, {}, m_serverReceived });
+			}
+		}
+	}
+
+	inline double GetMeanLatency() const
+	{
+		return (deliveredCommands) ? (double(totalLatency) / deliveredCommands) : 0.0;
+	}
+};
+
+TEST(NetSendScheduler, RetransmitTimeoutBacksOffAndCaps)
+{
+	// a command sent once waits one timeout, twice two, then four - and no longer
+	for (uint32_t sendCount = 1; sendCount <= 5; sendCount++)
+	{
+		NetSendScheduler scheduler;
+
+		uint32_t rto = scheduler.GetRetransmitTimeout();
+
+		EXPECT_EQ(static_cast<uint32_t>(NetSendScheduler::InitialRetransmitTimeout), rto);
+
+		uint32_t backoff = 1u << std::min(sendCount - 1, NetSendScheduler::MaxRetransmitBackoff);
+		uint32_t timeout = std::min(rto * backoff, NetSendScheduler::MaxRetransmitTimeout);
+
+		EXPECT_FALSE(scheduler.ShouldSendReliable(10000 + timeout - 1, sendCount, 10000, 100, false)) << sendCount;
+		EXPECT_TRUE(scheduler.ShouldSendReliable(10000 + timeout, sendCount, 10000, 100, false)) << sendCount;
+	}
+}
+
+TEST(NetSendScheduler, RetransmitsQuicklyAfterATimeout)
+{
+	NetSendScheduler scheduler;
+	scheduler.SetIdleInterval(16);
+
+	uint32_t rto = scheduler.GetRetransmitTimeout();
+
+	// the first retransmission waits for the timeout
+	EXPECT_FALSE(scheduler.ShouldSendReliable(10000 + rto - 1, 1, 10000, 100, false));
+	EXPECT_TRUE(scheduler.ShouldSendReliable(10000 + rto, 1, 10000, 100, false));
+
+	// after that, neither it nor other unacknowledged commands wait for a (backed off) timeout
+	EXPECT_FALSE(scheduler.ShouldSendReliable(10000 + rto + 15, 2, 10000 + rto, 100, false));
+	EXPECT_TRUE(scheduler.ShouldSendReliable(10000 + rto + 16, 2, 10000 + rto, 100, false));
+	EXPECT_TRUE(scheduler.ShouldSendReliable(10000 + rto + 16, 1, 10000 + rto, 100, false));
+
+	// until an acknowledgement shows commands are getting through again
+	scheduler.OnReliableAcknowledged(10000 + rto + 50, 100, UINT32_MAX);
+
+	EXPECT_FALSE(scheduler.ShouldSendReliable(10000 + rto + 100, 1, 10000 + rto + 16, 100, false));
+}
+
+TEST(NetSendScheduler, AmbiguousRoundTripsAreNotSampled)
+{
+	NetSendScheduler scheduler;
+
+	scheduler.OnReliableAcknowledged(1000, 100, 100);
+
+	EXPECT_EQ(100, scheduler.GetSmoothedRoundTripTime());
+
+	uint32_t rto = scheduler.GetRetransmitTimeout();
+
+	// Karn's rule - an acknowledgement covering a retransmitted command says nothing about the round-trip time
+	scheduler.OnReliableAcknowledged(2000, 100, UINT32_MAX);
+
+	EXPECT_EQ(100, scheduler.GetSmoothedRoundTripTime());
+	EXPECT_EQ(rto, scheduler.GetRetransmitTimeout());
+
+	scheduler.OnReliableAcknowledged(3000, 100, 20);
+
+	EXPECT_LT(scheduler.GetSmoothedRoundTripTime(), 100);
+}
+
+TEST(NetSendScheduler, SimulatedLossStaysCloseToResendingEveryPacket)
+{
+	for (double lossRate : { 0.0, 0.05, 0.2 })
+	{
+		ReliableLinkSimulation baseline;
+		baseline.resendEveryPacket = true;
+		baseline.lossRate = lossRate;
+		baseline.Run(60000);
+
+		ReliableLinkSimulation scheduled;
+		scheduled.lossRate = lossRate;
+		scheduled.Run(60000);
+
+		printf("%.0f%% loss: every packet %.1f ms mean, %u ms max, %zu bytes - scheduled %.1f ms mean, %u ms max, %zu bytes\n",
+			lossRate * 100.0, baseline.GetMeanLatency(), baseline.maxLatency, baseline.sentCommandBytes,
+			scheduled.GetMeanLatency(), scheduled.maxLatency, scheduled.sentCommandBytes);
+
+		EXPECT_EQ(0, baseline.skippedCommands);
+		EXPECT_EQ(0, scheduled.skippedCommands);
+
+		EXPECT_GT(scheduled.deliveredCommands, baseline.deliveredCommands * 0.99);
+		EXPECT_LT(scheduled.GetMeanLatency(), baseline.GetMeanLatency() * 1.5);
+		EXPECT_LT(scheduled.maxLatency, 400);
+
+		// while sending a fraction of the data
+		EXPECT_LT(scheduled.sentCommandBytes, baseline.sentCommandBytes / 2);
+	}
+}
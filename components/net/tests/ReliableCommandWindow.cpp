@@ -0,0 +1,168 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+#include <ReliableCommandWindow.h>
+
+// feeds commands to a window, recording what got handled
+class WindowRecorder
+{
+public:
+	ReliableCommandWindow window;
+
+	std::vector<uint32_t> handled;
+
+	WindowRecorder()
+		: window(8)
+	{
+
+	}
+
+	// commands carry their own id, so the handled order can be checked
+	void Receive(uint32_t id)
+	{
+		std::string data = std::to_string(id);
+
+		window.Process(id, id * 2, data.c_str(), data.size(), [&] (uint32_t type, const char* buffer, size_t length)
+		{
+			EXPECT_EQ(std::to_string(type / 2), std::string(buffer, length));
+
+			handled.push_back(type / 2);
+		});
+	}
+};
+
+TEST(ReliableCommandWindow, HandlesCommandsInOrder)
+{
+	WindowRecorder recorder;
+
+	for (uint32_t id : { 1, 2, 3 })
+	{
+		recorder.Receive(id);
+	}
+
+	EXPECT_EQ(std::vector<uint32_t>({ 1, 2, 3 }), recorder.handled);
+	EXPECT_EQ(3, recorder.window.GetLastId());
+}
+
+TEST(ReliableCommandWindow, HoldsCommandsAcrossAGap)
+{
+	WindowRecorder recorder;
+
+	for (uint32_t id : { 1, 3, 5, 4 })
+	{
+		recorder.Receive(id);
+	}
+
+	// nothing past the gap gets handled, or acknowledged
+	EXPECT_EQ(std::vector<uint32_t>({ 1 }), recorder.handled);
+	EXPECT_EQ(1, recorder.window.GetLastId());
+
+	recorder.Receive(2);
+
+	EXPECT_EQ(std::vector<uint32_t>({ 1, 2, 3, 4, 5 }), recorder.handled);
+	EXPECT_EQ(5, recorder.window.GetLastId());
+}
+
+TEST(ReliableCommandWindow, IgnoresDuplicates)
+{
+	WindowRecorder recorder;
+
+	for (uint32_t id : { 1, 1, 3, 3, 2, 2, 3 })
+	{
+		recorder.Receive(id);
+	}
+
+	EXPECT_EQ(std::vector<uint32_t>({ 1, 2, 3 }), recorder.handled);
+}
+
+TEST(ReliableCommandWindow, DropsCommandsPastTheWindow)
+{
+	WindowRecorder recorder;
+
+	// the window holds commands up to 8 past the last handled one
+	recorder.Receive(8);
+	recorder.Receive(9);
+
+	for (uint32_t id = 1; id <= 7; id++)
+	{
+		recorder.Receive(id);
+	}
+
+	// 8 was held, 9 has to be retransmitted
+	EXPECT_EQ(8, recorder.window.GetLastId());
+
+	recorder.Receive(9);
+
+	EXPECT_EQ(9, recorder.window.GetLastId());
+	EXPECT_EQ(9, recorder.handled.size());
+}
+
+TEST(ReliableCommandWindow, ResetForgetsHeldCommands)
+{
+	WindowRecorder recorder;
+
+	recorder.Receive(1);
+	recorder.Receive(3);
+
+	recorder.window.Reset();
+
+	EXPECT_EQ(0, recorder.window.GetLastId());
+
+	// a new connection numbers its commands from 1 again
+	recorder.Receive(1);
+	recorder.Receive(2);
+
+	EXPECT_EQ(std::vector<uint32_t>({ 1, 1, 2 }), recorder.handled);
+}
+
+TEST(ReliableCommandWindow, LossyReorderedStreamIsHandledOnceInOrder)
+{
+	WindowRecorder recorder;
+
+	std::mt19937 random(5678);
+
+	const uint32_t commandCount = 20000;
+
+	// every round, the sender sends the unacknowledged commands it may send in a shuffled order, 30% of which get lost
+	uint32_t acknowledged = 0;
+
+	while (acknowledged < commandCount)
+	{
+		std::vector<uint32_t> round;
+
+		for (uint32_t id = acknowledged + 1; id <= std::min(acknowledged + 12, commandCount); id++)
+		{
+			round.push_back(id);
+		}
+
+		std::shuffle(round.begin(), round.end(), random);
+
+		for (uint32_t id : round)
+		{
+			if (std::uniform_int_distribution<int>(0, 9)(random) >= 3)
+			{
+				recorder.Receive(id);
+			}
+		}
+
+		acknowledged = recorder.window.GetLastId();
+	}
+
+	ASSERT_EQ(commandCount, recorder.handled.size());
+
+	for (uint32_t i = 0; i < commandCount; i++)
+	{
+		ASSERT_EQ(i + 1, recorder.handled[i]);
+	}
+}
@@ -0,0 +1,187 @@
+/*
+ * This file is part of the CitizenFX project - http://citizen.re/
+ *
+ * See LICENSE and MENTIONS in the root of the source tree for information
+ * regarding licensing.
+ */
+
+#include "StdInc.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+#include <RoutedPacketQueue.h>
+
+static std::vector<char> MakePacket(size_t index)
+{
+	std::vector<char> packet(16 + (index % 64));
+
+	for (size_t i = 0; i < packet.size(); i++)
+	{
+		packet[i] = static_cast<char>(index + i);
+	}
+
+	return packet;
+}
+
+TEST(RoutedPacketQueue, EmptyQueueHasNothingToDequeue)
+{
+	RoutedPacketQueue queue;
+
+	std::vector<char> buffer(65536);
+	size_t length;
+	uint16_t netID;
+
+	EXPECT_TRUE(queue.IsEmpty());
+	EXPECT_FALSE(queue.Dequeue(buffer.data(), &length, &netID));
+	EXPECT_EQ(0, queue.DequeueBatch([] (uint16_t, const char*, size_t) {}));
+	EXPECT_FALSE(queue.Wait(0));
+
+	// draining the last packet leaves it empty again
+	queue.Enqueue(1, "abc", 3);
+	EXPECT_FALSE(queue.IsEmpty());
+	EXPECT_TRUE(queue.Wait(0));
+
+	ASSERT_TRUE(queue.Dequeue(buffer.data(), &length, &netID));
+	EXPECT_EQ(1, netID);
+	EXPECT_EQ(3, length);
+	EXPECT_EQ(0, memcmp(buffer.data(), "abc", 3));
+
+	EXPECT_TRUE(queue.IsEmpty());
+	EXPECT_FALSE(queue.Dequeue(buffer.data(), &length, &netID));
+}
+
+TEST(RoutedPacketQueue, FullQueueOverflowsWithoutDropping)
+{
+	RoutedPacketQueue queue;
+
+	// twice the capacity, as if the consumer had stalled
+	const size_t packetCount = RoutedPacketQueue::Capacity * 2;
+
+	for (size_t i = 0; i < packetCount; i++)
+	{
+		std::vector<char> packet = MakePacket(i);
+
+		queue.Enqueue(static_cast<uint16_t>(i), packet.data(), packet.size());
+	}
+
+	EXPECT_EQ(static_cast<uint64_t>(RoutedPacketQueue::Capacity), queue.GetOverflowedPacketCount());
+
+	// consuming some of the ring makes room for overflowed packets once more get queued
+	size_t index = 0;
+
+	auto checkPacket = [&] (uint16_t netID, const char* data, size_t length)
+	{
+		EXPECT_EQ(static_cast<uint16_t>(index), netID);
+		EXPECT_EQ(MakePacket(index), std::vector<char>(data, data + length));
+
+		index++;
+	};
+
+	EXPECT_EQ(10, queue.DequeueBatch(checkPacket, 10));
+
+	std::vector<char> packet = MakePacket(packetCount);
+	queue.Enqueue(static_cast<uint16_t>(packetCount), packet.data(), packet.size());
+
+	// the new packet still queues behind the overflowed ones
+	EXPECT_EQ(static_cast<uint64_t>(RoutedPacketQueue::Capacity + 1), queue.GetOverflowedPacketCount());
+
+	// everything comes out in order
+	EXPECT_EQ(packetCount + 1 - 10, queue.DequeueBatch(checkPacket));
+
+	EXPECT_EQ(packetCount + 1, index);
+	EXPECT_TRUE(queue.IsEmpty());
+
+	// and with the overflow gone, packets go straight to the ring again
+	queue.Enqueue(1, "x", 1);
+
+	EXPECT_EQ(static_cast<uint64_t>(RoutedPacketQueue::Capacity + 1), queue.GetOverflowedPacketCount());
+	EXPECT_FALSE(queue.IsEmpty());
+}
+
+TEST(RoutedPacketQueue, SlotsAreReusedAcrossWraparound)
+{
+	RoutedPacketQueue queue;
+
+	std::vector<char> buffer(65536);
+	size_t next = 0;
+
+	auto dequeueNext = [&] ()
+	{
+		size_t length;
+		uint16_t netID;
+
+		ASSERT_TRUE(queue.Dequeue(buffer.data(), &length, &netID));
+
+		EXPECT_EQ(static_cast<uint16_t>(next), netID);
+		EXPECT_EQ(MakePacket(next), std::vector<char>(buffer.data(), buffer.data() + length));
+
+		next++;
+	};
+
+	// keep a varying amount of packets queued, so head and tail wrap around the slots many times at different offsets
+	for (size_t i = 0; i < RoutedPacketQueue::Capacity * 5; i++)
+	{
+		std::vector<char> packet = MakePacket(i);
+
+		queue.Enqueue(static_cast<uint16_t>(i), packet.data(), packet.size());
+
+		if ((i % 7) != 0)
+		{
+			dequeueNext();
+		}
+
+		if ((i % 100) == 99)
+		{
+			while (!queue.IsEmpty())
+			{
+				dequeueNext();
+			}
+		}
+	}
+
+	EXPECT_EQ(0, queue.GetOverflowedPacketCount());
+}
+
+TEST(RoutedPacketQueue, ConsumerThreadReceivesAllPacketsInOrder)
+{
+	RoutedPacketQueue queue;
+
+	const size_t packetCount = 100000;
+
+	std::thread producer([&] ()
+	{
+		for (size_t i = 0; i < packetCount; i++)
+		{
+			std::vector<char> packet = MakePacket(i);
+
+			queue.Enqueue(static_cast<uint16_t>(i), packet.data(), packet.size());
+		}
+	});
+
+	size_t received = 0;
+	bool inOrder = true;
+
+	while (received < packetCount && queue.Wait(5000))
+	{
+		// take small batches, and stall now and then, so the producer keeps running into a full ring
+		queue.DequeueBatch([&] (uint16_t netID, const char* data, size_t length)
+		{
+			inOrder = inOrder && (netID == static_cast<uint16_t>(received)) && (MakePacket(received) == std::vector<char>(data, data + length));
+
+			received++;
+		}, 64);
+
+		if ((received % 8192) < 64)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	producer.join();
+
+	EXPECT_EQ(packetCount, received);
+	EXPECT_TRUE(inOrder);
+	EXPECT_GT(queue.GetOverflowedPacketCount(), 0);
+}
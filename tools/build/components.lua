@@ -254,6 +254,7 @@ local do_component = function(name, comp)
 
 	files {
 		relPath .. "/include/**.idl",
+		relPath .. "/include/**.netidl",
 	}
 
 	defines { "COMPILING_" .. name:upper():gsub('-', '_'), 'HAS_LOCAL_H' }
@@ -348,6 +349,29 @@ local do_component = function(name, comp)
 
 	links { "Shared", "CitiCore", "gmock_main", "gtest_main", name }
 
+	-- tests link whatever the component itself does
+	configuration {}
+	dofile(comp.absPath .. '/component.lua')
+
+	-- tests may use the component's dependencies directly
+	for dep, data in pairs(hasDeps) do
+		configuration {}
+
+		if not data.vendor or not data.vendor.dummy then
+			links { dep }
+		end
+
+		if data.vendor then
+			if data.vendor.include then
+				data.vendor.include()
+			end
+		else
+			includedirs { 'components/' .. dep .. '/include/' }
+		end
+	end
+
+	configuration {}
+
 	pchsource "client/common/StdInc.cpp"
 	pchheader "StdInc.h"
 end
@@ -35,6 +35,28 @@ function files(x)
 				break
 			end
 		end
+
+		for _, v in ipairs(x) do
+			if v:endswith('.netidl') then
+				filter 'files:**.netidl'
+
+				local prj_root = '%{prj.location}/../../'
+
+				if _OPTIONS['game'] == 'server' then
+					prj_root = prj_root .. '../'
+				end
+
+				buildcommands {
+					'python "' .. prj_root .. 'tools/idl/netmsg.py" -o "%{file and file.directory or ""}/%{file and file.basename or ""}.h" %{file and file.relpath or ""}'
+				}
+
+				buildoutputs { '%{file.directory}/%{file.basename}.h' }
+
+				filter {}
+
+				break
+			end
+		end
 	end
 
 end
\ No newline at end of file
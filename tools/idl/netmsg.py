@@ -0,0 +1,227 @@
+#!/usr/bin/env python
+# netmsg.py - Generate C++ message reader/writer structs from a network message IDL.
+#
+# The IDL declares messages as a list of typed fields:
+#
+#   message msgNetEvent
+#   {
+#       uint16 sourceNetId;
+#       string eventName;
+#       bytes data;
+#       bytes[16] guid;
+#   }
+#
+# Scalars are stored as-is, 'string' and 'bytes' with a uint16 length prefix, and 'bytes[N]' as N bytes. Readers parse a
+# received message in place - variable-size fields are slices pointing into the received buffer.
+
+import sys
+import os.path
+import re
+import argparse
+
+scalarTypes = {
+    'bool': ('bool', 1),
+    'int8': ('int8_t', 1),
+    'uint8': ('uint8_t', 1),
+    'int16': ('int16_t', 2),
+    'uint16': ('uint16_t', 2),
+    'int32': ('int32_t', 4),
+    'uint32': ('uint32_t', 4),
+    'int64': ('int64_t', 8),
+    'uint64': ('uint64_t', 8),
+    'float': ('float', 4),
+    'double': ('double', 8),
+}
+
+commentRe = re.compile(r'//[^\n]*|/\*.*?\*/', re.S)
+messageRe = re.compile(r'message\s+(\w+)\s*\{(.*?)\}', re.S)
+fieldRe = re.compile(r'^(\w+)(?:\[(\d+)\])?\s+(\w+)$')
+
+
+class Field(object):
+    def __init__(self, type, size, name):
+        self.type = type
+        self.size = size
+        self.name = name
+
+    def isScalar(self):
+        return self.type in scalarTypes
+
+    def isFixed(self):
+        return self.isScalar() or self.size is not None
+
+    def accessorName(self):
+        return self.name[0].upper() + self.name[1:]
+
+    def nativeType(self):
+        return scalarTypes[self.type][0] if self.isScalar() else 'Slice'
+
+
+def parseIdl(filename, text):
+    text = commentRe.sub('', text)
+
+    messages = []
+
+    for match in messageRe.finditer(text):
+        name, body = match.group(1), match.group(2)
+        fields = []
+
+        for decl in body.split(';'):
+            decl = ' '.join(decl.split())
+
+            if not decl:
+                continue
+
+            fieldMatch = fieldRe.match(decl)
+
+            if not fieldMatch:
+                raise Exception('%s: invalid field declaration `%s` in message %s' % (filename, decl, name))
+
+            type, size, fieldName = fieldMatch.group(1), fieldMatch.group(2), fieldMatch.group(3)
+
+            if type in scalarTypes and size is None:
+                fields.append(Field(type, None, fieldName))
+            elif type == 'bytes' and size is not None:
+                fields.append(Field(type, int(size), fieldName))
+            elif type in ('bytes', 'string') and size is None:
+                fields.append(Field(type, None, fieldName))
+            else:
+                raise Exception('%s: unknown type `%s` for field %s in message %s' % (filename, type, fieldName, name))
+
+        messages.append((name, fields))
+
+    return messages
+
+
+header = """/*
+ * DO NOT EDIT. THIS FILE IS GENERATED FROM %(filename)s using tools/idl/netmsg.py.
+ */
+
+#pragma once
+
+#include <NetBuffer.h>
+#include <NetMessageType.h>
+
+namespace net
+{
+namespace msg
+{
+"""
+
+footer = """}
+}
+"""
+
+
+def writeMessage(fd, name, fields):
+    fd.write('struct %s\n{\n' % name)
+    fd.write('\tstatic const uint32_t TypeHash = HashMessageName("%s");\n\n' % name)
+    fd.write('\tstatic constexpr MessageType GetType()\n\t{\n\t\treturn MessageType("%s");\n\t}\n\n' % name)
+
+    # reader
+    fd.write('\t// a received message - slices point into the buffer it was read from\n')
+    fd.write('\tclass Reader\n\t{\n\tprivate:\n')
+
+    for f in fields:
+        fd.write('\t\t%s m_%s;\n\n' % (f.nativeType(), f.name))
+
+    fd.write('\t\tbool m_valid;\n\n')
+    fd.write('\tpublic:\n')
+    fd.write('\t\tinline explicit Reader(const Buffer& buffer)\n\t\t{\n')
+    fd.write('\t\t\tm_valid = Parse(buffer.GetBuffer() + buffer.GetCurOffset(), buffer.GetRemainingBytes());\n\t\t}\n\n')
+
+    fd.write('\t\tinline bool Parse(const uint8_t* data, size_t length)\n\t\t{\n')
+    if fields:
+        fd.write('\t\t\tsize_t offset = 0;\n')
+
+    for f in fields:
+        fd.write('\n')
+
+        if f.isScalar():
+            fd.write('\t\t\tif ((length - offset) < sizeof(m_%s))\n\t\t\t{\n\t\t\t\treturn false;\n\t\t\t}\n\n' % f.name)
+            fd.write('\t\t\tmemcpy(&m_%s, data + offset, sizeof(m_%s));\n' % (f.name, f.name))
+            fd.write('\t\t\toffset += sizeof(m_%s);\n' % f.name)
+        elif f.isFixed():
+            fd.write('\t\t\tif ((length - offset) < %d)\n\t\t\t{\n\t\t\t\treturn false;\n\t\t\t}\n\n' % f.size)
+            fd.write('\t\t\tm_%s = Slice::Borrow(data + offset, %d);\n' % (f.name, f.size))
+            fd.write('\t\t\toffset += %d;\n' % f.size)
+        else:
+            fd.write('\t\t\tuint16_t %sLength;\n\n' % f.name)
+            fd.write('\t\t\tif ((length - offset) < sizeof(%sLength))\n\t\t\t{\n\t\t\t\treturn false;\n\t\t\t}\n\n' % f.name)
+            fd.write('\t\t\tmemcpy(&%sLength, data + offset, sizeof(%sLength));\n' % (f.name, f.name))
+            fd.write('\t\t\toffset += sizeof(%sLength);\n\n' % f.name)
+            fd.write('\t\t\tif ((length - offset) < %sLength)\n\t\t\t{\n\t\t\t\treturn false;\n\t\t\t}\n\n' % f.name)
+            fd.write('\t\t\tm_%s = Slice::Borrow(data + offset, %sLength);\n' % (f.name, f.name))
+            fd.write('\t\t\toffset += %sLength;\n' % f.name)
+
+    fd.write('\n\t\t\treturn true;\n\t\t}\n\n')
+    fd.write('\t\tinline bool IsValid() const\n\t\t{\n\t\t\treturn m_valid;\n\t\t}\n')
+
+    for f in fields:
+        if f.isScalar():
+            fd.write('\n\t\tinline %s Get%s() const\n\t\t{\n\t\t\treturn m_%s;\n\t\t}\n' % (f.nativeType(), f.accessorName(), f.name))
+        else:
+            fd.write('\n\t\tinline const Slice& Get%s() const\n\t\t{\n\t\t\treturn m_%s;\n\t\t}\n' % (f.accessorName(), f.name))
+
+    fd.write('\t};\n\n')
+
+    # writer
+    fd.write('\t// a message to send - slices are only read from while writing\n')
+    fd.write('\tstruct Writer\n\t{\n')
+
+    for f in fields:
+        fd.write('\t\t%s %s;\n\n' % (f.nativeType(), f.name))
+
+    fd.write('\t\tinline size_t GetSize() const\n\t\t{\n\t\t\treturn 0')
+
+    for f in fields:
+        if f.isScalar():
+            fd.write('\n\t\t\t\t+ sizeof(%s)' % f.name)
+        elif f.isFixed():
+            fd.write('\n\t\t\t\t+ %d' % f.size)
+        else:
+            fd.write('\n\t\t\t\t+ sizeof(uint16_t) + %s.GetLength()' % f.name)
+
+    fd.write(';\n\t\t}\n\n')
+
+    fd.write('\t\tinline void Write(Buffer& buffer) const\n\t\t{\n')
+
+    for f in fields:
+        if f.isScalar():
+            fd.write('\t\t\tbuffer.Write<%s>(%s);\n' % (f.nativeType(), f.name))
+        elif f.isFixed():
+            fd.write('\t\t\tassert(%s.GetLength() == %d);\n' % (f.name, f.size))
+            fd.write('\t\t\tbuffer.Write(%s.GetData(), %d);\n' % (f.name, f.size))
+        else:
+            fd.write('\t\t\tassert(%s.GetLength() <= UINT16_MAX);\n' % f.name)
+            fd.write('\t\t\tbuffer.Write<uint16_t>(static_cast<uint16_t>(%s.GetLength()));\n' % f.name)
+            fd.write('\t\t\tbuffer.Write(%s.GetData(), %s.GetLength());\n' % (f.name, f.name))
+
+    fd.write('\t\t}\n\t};\n};\n\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate C++ message structs from a network message IDL.')
+    parser.add_argument('-o', dest='outfile', default=None, help='Output file (default is stdout)')
+    parser.add_argument('filename')
+
+    options = parser.parse_args()
+
+    with open(options.filename, 'r') as f:
+        messages = parseIdl(options.filename, f.read())
+
+    fd = open(options.outfile, 'w') if options.outfile else sys.stdout
+
+    fd.write(header % { 'filename': os.path.basename(options.filename) })
+
+    for name, fields in messages:
+        writeMessage(fd, name, fields)
+
+    fd.write(footer)
+
+    if options.outfile:
+        fd.close()
+
+
+if __name__ == '__main__':
+    main()